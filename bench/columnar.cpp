@@ -0,0 +1,283 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "columnar.hpp"
+#include "crc32c.hpp"
+#include "xlog.hpp"
+
+/* bytes on the wire and encode CPU of journald records as one log command each against columnar batches, batched
+   as the remote sink batches them; batches are encoded from the entries the queue keeps, and from the records alone
+   as for spooled ones. the fixture is 'journalctl -o json' output, converted the way the journald source converts
+   entries; without one, entries modelled on a busy server's journal are generated.
+   usage: route8-log-bench-columnar [journalctl.json] */
+
+static constexpr size_t g_generated_entries{50000};
+static constexpr size_t g_maximum_write_size{64 * 1024};
+static constexpr size_t g_iterations{5};
+
+/* the object the queue serializes for an entry */
+static std::string serialize(const xlog::queue::log_entry_t& entry) {
+    nlohmann::json data = {
+        {"identifier", entry.identifier},
+        {"timestamp", entry.timestamp},
+        {"timestamp_unit", "ns"},
+        {"message", entry.message},
+    };
+
+    if (!entry.fields.is_null()) {
+        data["fields"] = entry.fields;
+    }
+
+    return data.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+}
+
+/* MESSAGE is the message and the other pairs are fields, as in the journald source; the '__' keys are journalctl's
+   own and aren't data of the entry */
+static bool load_fixture(const std::string& filename, std::vector<xlog::queue::log_entry_t>& entries) {
+    std::ifstream stream(filename);
+    std::string line{};
+
+    if (!stream.is_open()) {
+        std::cout << std::format("failed to open '{}'\n", filename);
+
+        return false;
+    }
+
+    while (std::getline(stream, line)) {
+        auto record = nlohmann::json::parse(line, nullptr, false);
+
+        if (record.is_discarded() || !record.is_object()) {
+            continue;
+        }
+
+        xlog::queue::log_entry_t entry{.identifier = "journal"};
+        auto fields = nlohmann::json::object();
+
+        for (auto&& [key, value] : record.items()) {
+            if (key == "MESSAGE" && value.is_string()) {
+                entry.message = value.get<std::string>();
+            } else if (key == "MESSAGE" && value.is_array()) {
+                // journalctl writes messages that aren't valid UTF-8 as arrays of bytes
+                for (auto&& byte : value) {
+                    entry.message.push_back(static_cast<char>(byte.get<int>()));
+                }
+            } else if (key == "__REALTIME_TIMESTAMP" && value.is_string()) {
+                entry.timestamp = std::stoll(value.get<std::string>()) * 1000;
+            } else if (key == "__MONOTONIC_TIMESTAMP" && value.is_string()) {
+                fields["monotonic_us"] = std::stoull(value.get<std::string>());
+            } else if (!key.starts_with("__")) {
+                fields[key] = value;
+            }
+        }
+
+        if (auto boot_id{fields.find("_BOOT_ID")}; boot_id != fields.end()) {
+            fields["boot_id"] = *boot_id;
+        }
+
+        if (auto priority{fields.find("PRIORITY")}; priority != fields.end() && priority->is_string()) {
+            if (auto level{xlog::severity::parse_level(priority->get_ref<const std::string&>())}) {
+                fields["severity"] = *level;
+            }
+        }
+
+        entry.fields = std::move(fields);
+        entries.push_back(std::move(entry));
+    }
+
+    return true;
+}
+
+static void generate_fixture(std::vector<xlog::queue::log_entry_t>& entries) {
+    struct unit_t {
+        const char* unit;
+        const char* identifier;
+        const char* executable;
+        uint32_t pid;
+        uint32_t uid;
+    };
+
+    static constexpr unit_t units[]{
+        {"nginx.service", "nginx", "/usr/sbin/nginx", 1204, 33},
+        {"postgresql@15-main.service", "postgres", "/usr/lib/postgresql/15/bin/postgres", 981, 112},
+        {"sshd.service", "sshd", "/usr/sbin/sshd", 744, 0},
+        {"cron.service", "CRON", "/usr/sbin/cron", 612, 0},
+        {"systemd-resolved.service", "systemd-resolved", "/lib/systemd/systemd-resolved", 402, 101},
+        {"docker.service", "dockerd", "/usr/bin/dockerd", 1350, 0},
+        {"containerd.service", "containerd", "/usr/bin/containerd", 1102, 0},
+        {"kubelet.service", "kubelet", "/usr/bin/kubelet", 1488, 0},
+        {"app-api.service", "app-api", "/opt/app/bin/api", 20417, 1001},
+        {"app-worker.service", "app-worker", "/opt/app/bin/worker", 20533, 1001},
+    };
+
+    static constexpr const char* messages[]{
+        "Accepted publickey for deploy from 10.0.{}.{} port {} ssh2: ED25519 SHA256:Xq3{}",
+        "GET /api/v1/items/{} HTTP/1.1 200 {} {}ms",
+        "checkpoint complete: wrote {} buffers ({}.{}%); 0 WAL file(s) added, 0 removed, {} recycled",
+        "(root) CMD (/usr/local/bin/rotate-metrics --since {}m --batch {})",
+        "Using degraded feature set UDP instead of UDP+EDNS0 for DNS server 10.0.{}.{}; retry {} in {}s",
+        "container {} health_status: healthy, exec_id {}{}{}",
+        "job {} finished in {} ms, {} rows, queue depth {}",
+    };
+
+    const std::string boot_id{"3f1c0a8e5d2b4c7fa9e6d1b0c8a7f2e4"};
+    const std::string machine_id{"9b2e7d4c1a0f4e3d8c6b5a4f3e2d1c0b"};
+    int64_t timestamp{1760861531000000000};
+    uint64_t monotonic{86400000000};
+    uint64_t state{88172645463325252};
+
+    for (size_t i{0}; i < g_generated_entries; i++) {
+        // xorshift, so the fixture is the same on every run
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+
+        const auto& unit{units[state % std::size(units)]};
+        auto priority{state % 100 < 3 ? 3 : state % 100 < 10 ? 4 : 6};
+        auto step{static_cast<int64_t>(state % 4000) * 1000};
+
+        timestamp += step;
+        monotonic += static_cast<uint64_t>(step / 1000);
+
+        xlog::queue::log_entry_t entry{.identifier = "journal", .timestamp = timestamp};
+        uint64_t a{(state >> 16) % 256}, b{(state >> 24) % 256}, c{(state >> 32) % 65536}, d{state % 100000};
+        entry.message = std::vformat(messages[(state >> 8) % std::size(messages)], std::make_format_args(a, b, c, d));
+
+        entry.fields = {
+            {"_HOSTNAME", "web-17.eu-west.example.net"},
+            {"_BOOT_ID", boot_id},
+            {"_MACHINE_ID", machine_id},
+            {"_TRANSPORT", unit.uid ? "stdout" : "syslog"},
+            {"_SYSTEMD_UNIT", unit.unit},
+            {"_SYSTEMD_SLICE", unit.uid == 1001 ? "app.slice" : "system.slice"},
+            {"_SYSTEMD_CGROUP", std::format("/system.slice/{}", unit.unit)},
+            {"_SYSTEMD_INVOCATION_ID", std::format("{:032x}", unit.pid * 2654435761ull)},
+            {"_PID", std::to_string(unit.pid)},
+            {"_UID", std::to_string(unit.uid)},
+            {"_GID", std::to_string(unit.uid)},
+            {"_COMM", unit.identifier},
+            {"_EXE", unit.executable},
+            {"_CMDLINE", std::format("{} --config /etc/{}.conf", unit.executable, unit.identifier)},
+            {"_CAP_EFFECTIVE", unit.uid ? "0" : "1ffffffffff"},
+            {"_SOURCE_REALTIME_TIMESTAMP", std::to_string(timestamp / 1000 - 37)},
+            {"SYSLOG_IDENTIFIER", unit.identifier},
+            {"SYSLOG_FACILITY", unit.uid ? "3" : "4"},
+            {"PRIORITY", std::to_string(priority)},
+            {"monotonic_us", monotonic},
+            {"boot_id", boot_id},
+            {"severity", priority},
+        };
+
+        entries.push_back(std::move(entry));
+    }
+}
+
+/* the '{"command":...,"crc32c":...,"data":' prefix, the data, '}' and the NUL terminator, as inet frames them */
+static size_t frame(std::string& output, std::string_view command, std::string_view data) {
+    output.clear();
+    output.append(R"({"command":")");
+    output.append(command);
+    output.append(R"(","crc32c":)");
+    output.append(std::to_string(crc32c::compute(data)));
+    output.append(R"(,"data":)");
+    output.append(data);
+    output.push_back('}');
+    output.push_back(0);
+
+    return output.length();
+}
+
+int main(int argc, char** argv) {
+    std::vector<xlog::queue::log_entry_t> entries{};
+
+    if (argc > 1) {
+        if (!load_fixture(argv[1], entries)) {
+            return 1;
+        }
+    } else {
+        generate_fixture(entries);
+    }
+
+    xlog::sinks::records_t records{};
+
+    for (auto&& entry : entries) {
+        records.push_back(serialize(entry));
+    }
+
+    // the same records without their entries, as loaded from a spool
+    xlog::sinks::records_t spooled{records};
+    records.entries = std::move(entries);
+
+    // batches cover about as many records as one write of log commands would, as in the remote sink
+    std::vector<std::pair<size_t, size_t>> batches{};
+
+    for (size_t i{0}; i < records.size();) {
+        auto first{i};
+        size_t plain_bytes{0};
+
+        while (i < records.size() && (i == first || plain_bytes + records[i].length() < g_maximum_write_size)) {
+            plain_bytes += records[i].length();
+            i++;
+        }
+
+        batches.emplace_back(first, i);
+    }
+
+    size_t plain_bytes{0};
+    size_t columnar_bytes{0};
+    std::chrono::nanoseconds plain_time{0};
+    std::chrono::nanoseconds columnar_time{0};
+    std::chrono::nanoseconds spooled_time{0};
+    std::string output{};
+    std::string batch{};
+
+    for (size_t iteration{0}; iteration < g_iterations; iteration++) {
+        plain_bytes = 0;
+        columnar_bytes = 0;
+
+        auto start{std::chrono::steady_clock::now()};
+
+        for (auto&& record : records) {
+            plain_bytes += frame(output, "log", record);
+        }
+
+        plain_time += std::chrono::steady_clock::now() - start;
+
+        for (auto [source, time] : {std::pair{&records, &columnar_time}, std::pair{&spooled, &spooled_time}}) {
+            columnar_bytes = 0;
+            start = std::chrono::steady_clock::now();
+
+            for (auto&& [first, last] : batches) {
+                if (!columnar::encode(*source, first, last, batch)) {
+                    std::cout << "a record couldn't be encoded\n";
+
+                    return 1;
+                }
+
+                columnar_bytes += frame(output, "log_batch", batch);
+            }
+
+            *time += std::chrono::steady_clock::now() - start;
+        }
+    }
+
+    auto per_record_us = [&records](std::chrono::nanoseconds time) {
+        return std::chrono::duration<double, std::micro>(time).count() / static_cast<double>(g_iterations * records.size());
+    };
+
+    std::cout << std::format("{} records in {} batches\n", records.size(), batches.size());
+    std::cout << std::format("log commands:     {:>12} bytes, {:>8.0f} bytes/record, {:>6.2f} us/record\n",
+        plain_bytes, static_cast<double>(plain_bytes) / static_cast<double>(records.size()), per_record_us(plain_time));
+    std::cout << std::format("columnar batches: {:>12} bytes, {:>8.0f} bytes/record, {:>6.2f} us/record ({:.1f}% of the bytes)\n",
+        columnar_bytes, static_cast<double>(columnar_bytes) / static_cast<double>(records.size()), per_record_us(columnar_time),
+        100.0 * static_cast<double>(columnar_bytes) / static_cast<double>(plain_bytes));
+    std::cout << std::format("  parsed back from spooled records: {:>6.2f} us/record\n", per_record_us(spooled_time));
+
+    return 0;
+}
@@ -0,0 +1,207 @@
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "config.hpp"
+#include "linesplitter.hpp"
+#include "metrics.hpp"
+#include "xlogfileuring.hpp"
+
+/* CPU time and syscalls per GiB read from many busy files, through io_uring and through plain preads, issued the
+   way the file source issues them on a wakeup: a fstat per file, then its new data. every round appends to all
+   files and reads them back; only the reads are measured. usage: route8-log-bench-file [files] [megabytes] */
+
+static constexpr size_t g_append_length{16 * 1024};
+static constexpr size_t g_read_chunk_size{64 * 1024};
+
+struct tailed_file {
+    int append_handle{-1};
+    int read_handle{-1};
+    uint64_t position{0};
+    uint64_t size{0};
+    linesplitter splitter{};
+};
+
+struct result_t {
+    uint64_t bytes{0};
+    uint64_t lines{0};
+    uint64_t fstats{0};
+    uint64_t preads{0};
+    uint64_t submits{0};
+    double cpu_seconds{0};
+};
+
+static double cpu_seconds() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) + static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/* the plain path of the file source: preads until one comes back short */
+static void read_available(tailed_file& file, result_t& result, std::vector<std::string>& lines) {
+    std::array<char, g_read_chunk_size> chunk{};
+
+    while (true) {
+        auto read_length{::pread(file.read_handle, chunk.data(), chunk.size(), static_cast<off_t>(file.position))};
+        result.preads++;
+
+        if (read_length <= 0) {
+            return;
+        }
+
+        file.splitter.feed(std::string_view(chunk.data(), static_cast<size_t>(read_length)), lines);
+        file.position += static_cast<uint64_t>(read_length);
+
+        if (static_cast<size_t>(read_length) < chunk.size()) {
+            return;
+        }
+    }
+}
+
+static bool run(bool use_uring, size_t file_count, size_t rounds, const std::string& content, result_t& result) {
+    std::vector<tailed_file> files(file_count);
+    std::vector<bool> queued(file_count);
+    std::vector<std::string> lines{};
+    auto& submits{metrics::counter("file.uring.submits")};
+
+    for (size_t i{0}; i < files.size(); i++) {
+        auto path{std::format("{}.log", i)};
+        files[i].append_handle = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        files[i].read_handle = ::open(path.c_str(), O_RDONLY);
+
+        if (files[i].append_handle == -1 || files[i].read_handle == -1) {
+            std::cout << std::format("failed to create '{}'\n", path);
+
+            return false;
+        }
+    }
+
+    auto submits_before{submits.load()};
+
+    for (size_t round{0}; round < rounds; round++) {
+        for (auto&& file : files) {
+            if (::write(file.append_handle, content.data(), content.size()) != static_cast<ssize_t>(content.size())) {
+                std::cout << "failed to append\n";
+
+                return false;
+            }
+        }
+
+        auto start{cpu_seconds()};
+
+        for (size_t i{0}; i < files.size(); i++) {
+            struct stat file_stat{};
+            fstat(files[i].read_handle, &file_stat);
+            result.fstats++;
+
+            files[i].size = static_cast<uint64_t>(file_stat.st_size);
+
+            // files past the ring's slots are read the plain way, as the file source does
+            queued[i] = use_uring && xlog::file::uring::queue_read(files[i].read_handle, files[i].position, files[i].size - files[i].position, i + 1);
+        }
+
+        for (size_t i{0}; i < files.size(); i++) {
+            auto& file{files[i]};
+
+            if (queued[i]) {
+                xlog::file::uring::complete(i + 1, [&file, &lines](std::string_view data) {
+                    file.splitter.feed(data, lines);
+                    file.position += data.size();
+                });
+
+                if (file.position < file.size) {
+                    read_available(file, result, lines);
+                }
+            } else {
+                read_available(file, result, lines);
+            }
+
+            result.lines += lines.size();
+            lines.clear();
+        }
+
+        result.cpu_seconds += cpu_seconds() - start;
+    }
+
+    result.submits = submits.load() - submits_before;
+
+    for (auto&& file : files) {
+        result.bytes += file.position;
+        ::close(file.append_handle);
+        ::close(file.read_handle);
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv) {
+    size_t file_count{argc > 1 ? std::stoull(argv[1]) : 200};
+    size_t megabytes{argc > 2 ? std::stoull(argv[2]) : 2048};
+    auto rounds{std::max<size_t>(megabytes * 1024 * 1024 / (file_count * g_append_length), 1)};
+
+    std::string content{};
+
+    for (size_t i{0}; content.size() + 128 < g_append_length; i++) {
+        content += std::format("2026-10-19T08:12:11.{:03}Z INFO request served method=GET path=/api/v1/items/{} status=200\n", i % 1000, i);
+    }
+
+    // file_io_uring is read from config.yml, so the files and a minimal config live in a scratch directory
+    auto directory{std::filesystem::temp_directory_path() / "route8-log-bench-file"};
+    std::filesystem::create_directories(directory);
+    std::filesystem::current_path(directory);
+
+    std::ofstream("config.yml") << "verbose: false\ndispatch_sleep_ms: 10\nmaximum_log_entries: 1000\nseconds_between_connects: 1\n"
+        "remote_address: 127.0.0.1\nremote_port: 1\nremote_certificate: ''\nidentity: ''\nidentity_password: ''\n"
+        "maximum_receive_size: 1\nfile_io_uring: true\n";
+
+    auto settings{config::initialize("config.yml")};
+
+    if (!settings) {
+        std::cout << "failed to load the scratch config\n";
+
+        return 1;
+    }
+
+    config::bind(settings.get());
+
+    std::cout << std::format("{} files, {} rounds of {} bytes each\n", file_count, rounds, content.size());
+
+    for (auto use_uring : {false, true}) {
+        if (use_uring && !xlog::file::uring::enabled()) {
+            std::cout << "io_uring: unavailable, not compiled in or refused by the kernel\n";
+            break;
+        }
+
+        result_t result{};
+
+        if (!run(use_uring, file_count, rounds, content, result)) {
+            return 1;
+        }
+
+        auto gib{static_cast<double>(result.bytes) / (1024.0 * 1024.0 * 1024.0)};
+        auto syscalls{result.fstats + result.preads + result.submits};
+
+        std::cout << std::format("{}: {:.2f} GiB, {} lines, {:.2f} CPU s/GiB, {:.0f} syscalls/GiB ({} fstat, {} pread, {} io_uring_enter)\n",
+            use_uring ? "io_uring" : "plain", gib, result.lines, result.cpu_seconds / gib, static_cast<double>(syscalls) / gib,
+            result.fstats, result.preads, result.submits);
+    }
+
+    config::bind(nullptr);
+    std::filesystem::current_path(std::filesystem::temp_directory_path());
+    std::filesystem::remove_all(directory);
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include <chrono>
+#include <cstddef>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "xlog.hpp"
+#include "xlogsource.hpp"
+
+/* lines/s of each parser type on batches the size the reactor hands over from a busy source;
+   usage: route8-log-bench-parser [lines] */
+
+static constexpr size_t g_batch_length{4096};
+
+struct parser_case {
+    xlog::parser::options options{};
+    std::function<std::string(size_t)> line{};
+};
+
+static std::vector<xlog::queue::log_entry_t> make_batch(const parser_case& test, size_t first) {
+    std::vector<xlog::queue::log_entry_t> batch(g_batch_length);
+
+    for (size_t i{0}; i < batch.size(); i++) {
+        batch[i].identifier = "bench";
+        batch[i].message = test.line(first + i);
+    }
+
+    return batch;
+}
+
+int main(int argc, char** argv) {
+    size_t lines{argc > 1 ? std::stoull(argv[1]) : 1000000};
+
+    std::vector<parser_case> cases{
+        {{"json", ""}, [](size_t i) {
+            return std::format(R"({{"level":"info","request_id":"{:016x}","method":"GET","path":"/api/v1/items/{}","status":200,"duration_ms":{}.{}}})", i * 2654435761, i % 1000, i % 250, i % 10);
+        }},
+        {{"logfmt", ""}, [](size_t i) {
+            return std::format(R"(level=info request_id={:016x} method=GET path=/api/v1/items/{} status=200 duration_ms={}.{} msg="request served")", i * 2654435761, i % 1000, i % 250, i % 10);
+        }},
+        {{"regex", R"(^(?<address>\S+) \S+ \S+ \[(?<time>[^\]]+)\] "(?<method>\S+) (?<path>\S+) [^"]*" (?<status>\d{3}) (?<bytes>\d+))"}, [](size_t i) {
+            return std::format(R"(10.0.{}.{} - - [19/Oct/2026:08:12:11 +0000] "GET /api/v1/items/{} HTTP/1.1" 200 {})", i % 256, i % 199, i % 1000, 512 + i % 4096);
+        }}
+    };
+
+    for (auto&& test : cases) {
+        auto stage{xlog::parser::create(test.options)};
+
+        if (!stage) {
+            std::cout << std::format("{}: failed to create the parser\n", test.options.type);
+
+            return 1;
+        }
+
+        std::chrono::nanoseconds elapsed{0};
+        size_t parsed{0};
+
+        // batches are built outside the timed section, so only the stage is measured
+        for (size_t done{0}; done < lines; done += g_batch_length) {
+            auto batch{make_batch(test, done)};
+            auto start{std::chrono::steady_clock::now()};
+
+            stage->process(batch);
+
+            elapsed += std::chrono::steady_clock::now() - start;
+
+            for (auto&& entry : batch) {
+                parsed += entry.fields.is_object() ? 1 : 0;
+            }
+        }
+
+        auto seconds{std::chrono::duration<double>(elapsed).count()};
+        auto total{(lines + g_batch_length - 1) / g_batch_length * g_batch_length};
+
+        std::cout << std::format("{:<7} {:>12.0f} lines/s  ({} of {} lines parsed in {:.3f}s)\n", test.options.type, total / seconds, parsed, total, seconds);
+    }
+
+    return 0;
+}
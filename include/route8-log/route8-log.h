@@ -0,0 +1,68 @@
+#ifndef __ROUTE8_LOG_H
+#define __ROUTE8_LOG_H
+
+/* runs the shipper inside the calling process; link route8-log-core.
+
+   a context owns the agent's state: its configuration, checkpoints, queue, sinks, sources and connection,
+   read from and kept in the paths it was opened with. the modules work on the open context, so one can be
+   open at a time; another can be opened once it's closed. signal handling is left to the application;
+   SIGHUP doesn't reload an embedded agent */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* also run the sources of log.yml, and reload config.yml and log.yml when they change on disk */
+#define R8_OPEN_SOURCES 1
+
+typedef struct r8_context r8_context;
+
+/* NULL paths keep the defaults the executable uses; relative paths resolve against the working directory */
+typedef struct r8_options {
+    /* config.yml */
+    const char* config_path;
+    /* log.yml, only read with R8_OPEN_SOURCES */
+    const char* log_path;
+    /* checkpoint.yml */
+    const char* checkpoint_path;
+    /* the directory of the spool.<sink>.jsonl files; the working directory */
+    const char* spool_directory;
+    /* debug.log */
+    const char* debug_path;
+    /* R8_OPEN_ flags */
+    int flags;
+} r8_options;
+
+typedef struct r8_entry {
+    const char* identifier;
+    size_t identifier_length;
+    /* nanoseconds since the Unix epoch; 0 stamps the entry on arrival */
+    int64_t timestamp;
+    const char* message;
+    size_t message_length;
+} r8_entry;
+
+/* NULL options open with the defaults. returns NULL when a context is open or the agent failed to start;
+   see the debug log. a failed start is undone, so r8_open can be called again, as after r8_close */
+r8_context* r8_open(const r8_options* options);
+
+/* serializes the entries straight from the caller's buffers, which can be reused once this returns;
+   0 on success, -1 on invalid arguments */
+int r8_log_batch(r8_context* context, const r8_entry* entries, size_t count);
+
+/* waits up to timeout_ms for everything logged so far to be written by every sink;
+   returns the records still pending, or -1 on invalid arguments */
+int64_t r8_flush(r8_context* context, int64_t timeout_ms);
+
+/* drains within shutdown_deadline_ms, spools the rest and frees the context;
+   returns the records lost, or -1 on invalid arguments */
+int64_t r8_close(r8_context* context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
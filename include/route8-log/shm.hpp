@@ -0,0 +1,222 @@
+#ifndef __ROUTE8_LOG_SHM_HPP
+#define __ROUTE8_LOG_SHM_HPP
+
+/* shared-memory log rings read by route8-log's 'shm' source; header-only, no dependencies.
+
+   an application opens one producer per process and channel, then calls write() from one thread:
+
+       xlog::shm::producer log{};
+       log.open("payments");
+       log.write("order 42 settled");
+
+   write() takes no locks and makes no system calls; it fails when the ring is full, and the
+   agent reports those records as overflows. rings are POSIX shared memory objects named
+   /route8-log.<channel>.<pid>, found by the agent without any registration */
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <string_view>
+
+namespace xlog {
+    namespace shm {
+        constexpr uint32_t ring_magic{0x52384c47};
+        constexpr uint32_t ring_version{1};
+        constexpr const char* name_prefix{"route8-log."};
+
+        constexpr uint32_t record_kind_entry{0};
+        /* fills the end of the data area when the next record doesn't fit before it */
+        constexpr uint32_t record_kind_padding{1};
+
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, "rings need lock-free 64-bit atomics");
+
+        /* positions only grow; the offset into the data area is position & (capacity - 1) */
+        struct ring_header {
+            std::atomic<uint32_t> magic;
+            uint32_t version;
+            uint64_t capacity;
+            int64_t pid;
+            /* set by a producer that closed cleanly, so the agent removes the ring once drained */
+            std::atomic<uint32_t> closed;
+            /* records write() refused because the ring was full */
+            std::atomic<uint64_t> overflows;
+            alignas(64) std::atomic<uint64_t> head;
+            alignas(64) std::atomic<uint64_t> tail;
+        };
+
+        /* the data area starts at this offset of the mapping */
+        constexpr size_t data_offset{(sizeof(ring_header) + 63) / 64 * 64};
+
+        /* every record starts 8-byte aligned with this header, followed by the message */
+        struct record_header {
+            uint32_t length;
+            uint32_t kind;
+            /* nanoseconds since the Unix epoch */
+            int64_t timestamp;
+        };
+
+        constexpr size_t record_size(size_t length) {
+            return (sizeof(xlog::shm::record_header) + length + 7) / 8 * 8;
+        }
+
+        inline std::string ring_name(std::string_view channel, int64_t pid) {
+            return "/" + std::string(xlog::shm::name_prefix) + std::string(channel) + "." + std::to_string(pid);
+        }
+
+    #ifndef _WIN32
+        /* single producer; not thread-safe, use one per writing thread and channel if needed */
+        class producer {
+        private:
+            std::string name{};
+            void* mapping{nullptr};
+            size_t mapping_size{0};
+            xlog::shm::ring_header* header{nullptr};
+            char* data{nullptr};
+            uint64_t capacity{0};
+
+            static int64_t now_ns() {
+                // system_clock goes through the vDSO, not a system call
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            }
+        public:
+            producer() = default;
+            producer(const producer&) = delete;
+            producer& operator=(const producer&) = delete;
+
+            ~producer() {
+                this->close();
+            }
+
+            /* capacity is rounded up to a power of two; messages longer than half of it are refused */
+            bool open(std::string_view channel, size_t capacity = 1024 * 1024) {
+                if (this->header || channel.empty() || channel.find('/') != std::string_view::npos) {
+                    return false;
+                }
+
+                uint64_t rounded{4096};
+
+                while (rounded < capacity) {
+                    rounded <<= 1;
+                }
+
+                this->name = xlog::shm::ring_name(channel, static_cast<int64_t>(::getpid()));
+                // a ring left by an earlier process with the same pid is stale
+                ::shm_unlink(this->name.c_str());
+
+                auto handle{::shm_open(this->name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600)};
+
+                if (handle == -1) {
+                    return false;
+                }
+
+                this->mapping_size = xlog::shm::data_offset + rounded;
+
+                if (::ftruncate(handle, static_cast<off_t>(this->mapping_size)) == -1) {
+                    ::close(handle);
+                    ::shm_unlink(this->name.c_str());
+
+                    return false;
+                }
+
+                this->mapping = ::mmap(nullptr, this->mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+                ::close(handle);
+
+                if (this->mapping == MAP_FAILED) {
+                    this->mapping = nullptr;
+                    ::shm_unlink(this->name.c_str());
+
+                    return false;
+                }
+
+                this->header = new (this->mapping) xlog::shm::ring_header{};
+                this->header->version = xlog::shm::ring_version;
+                this->header->capacity = rounded;
+                this->header->pid = static_cast<int64_t>(::getpid());
+                this->data = static_cast<char*>(this->mapping) + xlog::shm::data_offset;
+                this->capacity = rounded;
+
+                // the agent ignores the ring until the magic says the rest is written
+                this->header->magic.store(xlog::shm::ring_magic, std::memory_order_release);
+
+                return true;
+            }
+
+            /* false when the ring has no room; the record is then counted as an overflow */
+            bool write(std::string_view message) {
+                if (!this->header) {
+                    return false;
+                }
+
+                const auto size{xlog::shm::record_size(message.length())};
+
+                if (size > this->capacity / 2) {
+                    this->header->overflows.fetch_add(1, std::memory_order_relaxed);
+
+                    return false;
+                }
+
+                auto head{this->header->head.load(std::memory_order_relaxed)};
+                const auto tail{this->header->tail.load(std::memory_order_acquire)};
+                auto offset{head & (this->capacity - 1)};
+                const auto until_end{this->capacity - offset};
+                const auto needed{until_end < size ? size + until_end : size};
+
+                if (this->capacity - (head - tail) < needed) {
+                    this->header->overflows.fetch_add(1, std::memory_order_relaxed);
+
+                    return false;
+                }
+
+                if (until_end < size) {
+                    // offsets are 8-byte aligned, so the kind always fits before the end
+                    const xlog::shm::record_header padding{0, xlog::shm::record_kind_padding, 0};
+                    std::memcpy(this->data + offset, &padding, until_end < sizeof(padding) ? until_end : sizeof(padding));
+
+                    head += until_end;
+                    offset = 0;
+                }
+
+                const xlog::shm::record_header record{static_cast<uint32_t>(message.length()), xlog::shm::record_kind_entry, now_ns()};
+                std::memcpy(this->data + offset, &record, sizeof(record));
+                std::memcpy(this->data + offset + sizeof(record), message.data(), message.length());
+
+                this->header->head.store(head + size, std::memory_order_release);
+
+                return true;
+            }
+
+            /* an empty ring is removed right away, otherwise the agent removes it once drained */
+            void close() {
+                if (!this->header) {
+                    return;
+                }
+
+                this->header->closed.store(1, std::memory_order_release);
+
+                if (this->header->head.load(std::memory_order_acquire) == this->header->tail.load(std::memory_order_acquire)) {
+                    ::shm_unlink(this->name.c_str());
+                }
+
+                ::munmap(this->mapping, this->mapping_size);
+
+                this->mapping = nullptr;
+                this->header = nullptr;
+                this->data = nullptr;
+            }
+        };
+    #endif
+    }
+}
+
+#endif
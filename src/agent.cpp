@@ -0,0 +1,205 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <span>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include "agent.hpp"
+#include "debug.hpp"
+#include "config.hpp"
+#include "checkpoint.hpp"
+#include "crc32c.hpp"
+#include "lifecycle.hpp"
+#include "metrics.hpp"
+#include "reload.hpp"
+#include "xlog.hpp"
+#include "inet.hpp"
+
+namespace agent {
+    /* set from a successful start() to stop(), while the modules work on that instance's state */
+    static std::atomic<bool> g_running{false};
+
+    instance::instance(agent::options options)
+        : options(std::move(options)) {
+    }
+
+    instance::~instance() {
+        if (this->running) {
+            this->stop();
+        }
+    }
+
+    /* drops the state of every module, in the reverse order of bring_up(); the threads are joined already */
+    void instance::release() {
+        this->entries.reset();
+        this->reactor.reset();
+        this->queue.reset();
+        this->sinks.reset();
+        this->remote.reset();
+        this->checkpoints.reset();
+        this->configuration.reset();
+    }
+
+    /* undoes what a start() that failed partway brought up, so it can be tried again; steps that
+       never ran have nothing to undo. what the sinks held is spooled for the next start */
+    void instance::rollback() {
+        this->reload = std::jthread{};
+        this->metrics = std::jthread{};
+        xlog::reactor::stop();
+        xlog::clear();
+        checkpoint::stop();
+        xlog::queue::drain(std::chrono::milliseconds(0));
+
+        size_t held{0};
+        xlog::sinks::persist(held);
+        xlog::sinks::stop();
+        inet::bind(nullptr);
+        config::bind(nullptr);
+        debug::close();
+
+        this->release();
+    }
+
+    int instance::bring_up() {
+        const auto& paths{this->options.paths};
+
+        if (!debug::initialize(paths.debug.string())) {
+            std::cerr << "failed to initialize the debug module; aborting!";
+
+            return -1;
+        }
+
+        debug::print("app", "############## STARTED ##############");
+        debug::print("app", "checksumming with {} CRC32C", crc32c::implementation());
+
+        if (this->options.handle_signals && !lifecycle::prepare()) {
+            return -9;
+        }
+
+        this->configuration = config::initialize(paths.config.string());
+
+        if (!this->configuration) {
+            return -2;
+        }
+
+        config::bind(this->configuration.get());
+        this->checkpoints = checkpoint::initialize(paths.checkpoint.string());
+
+        if (!this->checkpoints || !checkpoint::start(*this->checkpoints)) {
+            return -3;
+        }
+
+        // the remote sink sends through the connection from the moment it starts
+        this->remote = inet::create();
+        inet::bind(this->remote.get());
+        this->sinks = xlog::sinks::create(paths.spool.string());
+
+        if (!xlog::sinks::start(*this->sinks)) {
+            return -10;
+        }
+
+        this->queue = xlog::queue::start();
+        this->reactor = xlog::reactor::start();
+
+        if (!this->reactor) {
+            return -5;
+        }
+
+        if (this->options.load_sources) {
+            this->entries = xlog::initialize(paths.log.string());
+
+            if (!this->entries) {
+                return -6;
+            }
+        }
+
+        this->metrics = metrics::start();
+
+        if (this->options.load_sources) {
+            this->reload = reload::start(this->options.handle_signals);
+        }
+
+        this->connection = std::jthread([](std::stop_token stop_token) {
+            if (!inet::connect(stop_token)) {
+                lifecycle::request();
+            }
+        });
+
+        return 0;
+    }
+
+    int instance::start() {
+        if (this->running || agent::g_running.exchange(true)) {
+            return -11;
+        }
+
+        auto result{this->bring_up()};
+
+        if (result != 0) {
+            debug::print("app", "failed to start, error: {}", result);
+            this->rollback();
+            agent::g_running = false;
+
+            return result;
+        }
+
+        this->running = true;
+
+        return 0;
+    }
+
+    void instance::publish(std::span<const xlog::queue::log_view_t> entries) {
+        xlog::queue::publish(entries);
+    }
+
+    size_t instance::flush(std::chrono::milliseconds deadline) {
+        const auto until{std::chrono::steady_clock::now() + deadline};
+
+        // the queue is published every dispatch_sleep_ms, then the sinks take over
+        while (xlog::queue::size() > 0 && std::chrono::steady_clock::now() < until) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        return xlog::queue::size() + xlog::sinks::drain(until);
+    }
+
+    size_t instance::stop() {
+        if (!this->running) {
+            return 0;
+        }
+
+        debug::print("app", "shutting down");
+
+        // no new sources, then every source queues what it buffered and checkpoints
+        this->reload = std::jthread{};
+        xlog::reactor::stop();
+        xlog::clear();
+        checkpoint::stop();
+
+        auto pending{xlog::queue::drain(std::chrono::milliseconds(config::current()->shutdown_deadline_ms))};
+
+        this->connection = std::jthread{};
+
+        // the remote sink keeps delivering until the connection stops, so what's lost is counted only after
+        size_t held{0};
+        auto spooled{xlog::sinks::persist(held)};
+        auto lost{held > spooled ? held - spooled : 0};
+
+        this->metrics = std::jthread{};
+        metrics::dump();
+        debug::print("app", "shutdown summary: {} records pending at the deadline, {} spooled, {} lost, {} dropped at the queue limit and {} at the sink limits since start",
+            pending, spooled, lost, xlog::queue::dropped(), xlog::sinks::dropped());
+
+        xlog::sinks::stop();
+        inet::bind(nullptr);
+        config::bind(nullptr);
+        debug::close();
+
+        this->release();
+        this->running = false;
+        agent::g_running = false;
+
+        return lost;
+    }
+}
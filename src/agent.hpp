@@ -0,0 +1,83 @@
+#ifndef __AGENT_HPP
+#define __AGENT_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <thread>
+#include "checkpoint.hpp"
+#include "config.hpp"
+#include "inet.hpp"
+#include "xlog.hpp"
+
+/* the whole shipper: brings the modules up and down in order, for the executable and for
+   applications embedding it through the C API */
+namespace agent {
+    /* relative paths resolve against the working directory */
+    struct paths {
+        std::filesystem::path config{"config.yml"};
+        std::filesystem::path log{"log.yml"};
+        std::filesystem::path checkpoint{"checkpoint.yml"};
+        /* the sinks spool into spool.<sink>.jsonl here */
+        std::filesystem::path spool{"."};
+        std::filesystem::path debug{"debug.log"};
+    };
+
+    struct options {
+        /* take over SIGTERM, SIGINT and SIGHUP; only the executable should */
+        bool handle_signals{true};
+        /* run the sources of the log file and reload both files when they change */
+        bool load_sources{true};
+        agent::paths paths{};
+    };
+
+    /* owns the state of every module it starts: the configuration, the checkpoints, the queue, the sinks,
+       the reactor with its sources, the connection and their threads. the modules work on the state of the
+       running instance, so one runs at a time; an instance can be started again once stopped, or after a
+       failed start. the debug stream and the metrics counters stay process-wide */
+    class instance {
+    private:
+        agent::options options{};
+        bool running{false};
+
+        std::shared_ptr<config::state_t> configuration{};
+        std::shared_ptr<checkpoint::state_t> checkpoints{};
+        std::shared_ptr<inet::state_t> remote{};
+        std::shared_ptr<xlog::sinks::state_t> sinks{};
+        std::shared_ptr<xlog::queue::state_t> queue{};
+        std::shared_ptr<xlog::reactor::state_t> reactor{};
+        std::shared_ptr<xlog::state_t> entries{};
+        std::jthread metrics{};
+        std::jthread reload{};
+        std::jthread connection{};
+
+        int bring_up();
+        void rollback();
+        void release();
+
+    public:
+        explicit instance(agent::options options);
+        instance(const instance&) = delete;
+        instance& operator=(const instance&) = delete;
+
+        /* stops it when it still runs */
+        ~instance();
+
+        /* returns 0, or the process exit code of the step that failed; -11 while another instance runs */
+        int start();
+
+        /* serializes borrowed entries into one batch for the sinks, after what the sources queued */
+        void publish(std::span<const xlog::queue::log_view_t> entries);
+
+        /* waits until what was logged so far reached the sinks or until the deadline passes;
+           returns the records still pending */
+        size_t flush(std::chrono::milliseconds deadline);
+
+        /* drains within shutdown_deadline_ms and spools the rest; returns the records lost */
+        size_t stop();
+    };
+}
+
+#endif
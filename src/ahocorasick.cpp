@@ -0,0 +1,93 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <queue>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+#include "ahocorasick.hpp"
+
+/* state 0 is the root; a zero transition from any other state means "none" until build() fills it in */
+ahocorasick::ahocorasick() {
+    this->transitions.emplace_back();
+    this->transitions.back().fill(0);
+    this->outputs.emplace_back();
+}
+
+size_t ahocorasick::add(std::string_view pattern) {
+    if (this->built) {
+        throw std::logic_error("ahocorasick: add() after build()");
+    }
+
+    uint32_t state{0};
+
+    for (auto c : pattern) {
+        auto& next{this->transitions[state][static_cast<uint8_t>(c)]};
+
+        if (!next) {
+            next = static_cast<uint32_t>(this->transitions.size());
+            this->transitions.emplace_back();
+            this->transitions.back().fill(0);
+            this->outputs.emplace_back();
+        }
+
+        state = this->transitions[state][static_cast<uint8_t>(c)];
+    }
+
+    this->outputs[state].push_back(this->pattern_count);
+
+    return this->pattern_count++;
+}
+
+/* turns the trie into a full DFA: missing transitions follow failure links, outputs are merged along them */
+void ahocorasick::build() {
+    this->failures.assign(this->transitions.size(), 0);
+
+    std::queue<uint32_t> pending{};
+
+    for (auto next : this->transitions[0]) {
+        if (next) {
+            pending.push(next);
+        }
+    }
+
+    while (!pending.empty()) {
+        auto state{pending.front()};
+        pending.pop();
+
+        const auto& inherited{this->outputs[this->failures[state]]};
+        this->outputs[state].insert(this->outputs[state].end(), inherited.begin(), inherited.end());
+
+        for (size_t c{0}; c < 256; c++) {
+            auto& next{this->transitions[state][c]};
+            auto fallback{this->transitions[this->failures[state]][c]};
+
+            if (next) {
+                this->failures[next] = fallback;
+                pending.push(next);
+            } else {
+                next = fallback;
+            }
+        }
+    }
+
+    this->built = true;
+}
+
+void ahocorasick::search(std::string_view text, std::vector<bool>& matched) const {
+    matched.assign(this->pattern_count, false);
+
+    uint32_t state{0};
+
+    for (auto c : text) {
+        state = this->transitions[state][static_cast<uint8_t>(c)];
+
+        for (auto identifier : this->outputs[state]) {
+            matched[identifier] = true;
+        }
+    }
+}
+
+size_t ahocorasick::size() const {
+    return this->pattern_count;
+}
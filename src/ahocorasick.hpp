@@ -0,0 +1,31 @@
+#ifndef __AHOCORASICK_HPP
+#define __AHOCORASICK_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/* multi-pattern substring matcher; every added pattern is found in a single pass over the text */
+class ahocorasick {
+private:
+    std::vector<std::array<uint32_t, 256>> transitions{};
+    std::vector<uint32_t> failures{};
+    std::vector<std::vector<size_t>> outputs{};
+    size_t pattern_count{0};
+    bool built{false};
+public:
+    ahocorasick();
+
+    /* returns the pattern's identifier; patterns can't be added after build() */
+    size_t add(std::string_view pattern);
+    void build();
+
+    /* sets matched[identifier] for every pattern found in text; matched is resized to size() */
+    void search(std::string_view text, std::vector<bool>& matched) const;
+
+    size_t size() const;
+};
+
+#endif
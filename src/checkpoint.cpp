@@ -0,0 +1,262 @@
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <ios>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include "yaml-cpp/yaml.h"
+#include "checkpoint.hpp"
+#include "crc32c.hpp"
+#include "debug.hpp"
+#include "metrics.hpp"
+
+namespace checkpoint {
+    static constexpr std::chrono::seconds g_flush_interval{1};
+
+    struct state_t {
+        std::string filename{};
+        /* stores only touch the map under lock; the file is written from thread, or by flush() */
+        std::mutex lock{};
+        std::unordered_map<std::string, YAML::Node> entries{};
+        bool dirty{false};
+        /* held while writing the file, so the thread and flush() don't interleave */
+        std::mutex write_lock{};
+        std::jthread thread{};
+    };
+
+    static checkpoint::state_t* g_state{nullptr};
+
+    static std::atomic<uint64_t>& g_mismatches{metrics::counter("checkpoint.crc_mismatches")};
+
+    /* the file ends with this comment and the CRC32C of everything before it, as 8 hex digits */
+    static constexpr std::string_view g_trailer{"# crc32c "};
+
+    /* false when the trailer is missing or doesn't match, as in a truncated file */
+    static bool verify(std::string& content) {
+        auto start{content.rfind(checkpoint::g_trailer)};
+
+        if (start == std::string::npos || (start != 0 && content[start - 1] != '\n')) {
+            return false;
+        }
+
+        uint32_t expected{0};
+        auto digits{std::string_view(content).substr(start + checkpoint::g_trailer.length(), 8)};
+        auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.length(), expected, 16);
+
+        if (ec != std::errc{} || end != digits.data() + 8) {
+            return false;
+        }
+
+        content.resize(start);
+
+        return crc32c::compute(content) == expected;
+    }
+
+    static bool write_state(checkpoint::state_t& state) {
+        const std::lock_guard<std::mutex> _write_lock(state.write_lock);
+        YAML::Emitter emitter{};
+
+        {
+            const std::lock_guard<std::mutex> _lock(state.lock);
+
+            if (!state.dirty) {
+                return true;
+            }
+
+            emitter << YAML::BeginMap;
+
+            for (auto&& [key, value] : state.entries) {
+                emitter << YAML::Key << key << YAML::Value << value;
+            }
+
+            emitter << YAML::EndMap;
+            state.dirty = false;
+        }
+
+        const std::string temporary_filename{state.filename + ".tmp"};
+        std::string content(emitter.c_str(), emitter.size());
+        content.push_back('\n');
+        content.append(std::format("{}{:08x}\n", checkpoint::g_trailer, crc32c::compute(content)));
+
+        // a failed write leaves the state dirty, so the next pass tries again
+        auto failed = [&state]() {
+            const std::lock_guard<std::mutex> _lock(state.lock);
+            state.dirty = true;
+
+            return false;
+        };
+
+        {
+            // flawfinder: ignore
+            std::ofstream stream(temporary_filename, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+
+            if (!stream.is_open()) {
+                debug::print("checkpoint", "failed to open '{}' for writing", temporary_filename);
+
+                return failed();
+            }
+
+            stream.write(content.data(), static_cast<std::streamsize>(content.length()));
+
+            if (!stream.flush()) {
+                debug::print("checkpoint", "failed to write '{}'", temporary_filename);
+
+                return failed();
+            }
+        }
+
+        std::error_code ec{};
+        std::filesystem::rename(temporary_filename, state.filename, ec);
+
+        if (ec) {
+            debug::print("checkpoint", "failed to replace '{}', error: {}", state.filename, ec.message());
+
+            return failed();
+        }
+
+        return true;
+    }
+
+    static void worker(std::stop_token stop_token, checkpoint::state_t& state) {
+        std::mutex wait_lock{};
+        std::condition_variable_any wait_condition{};
+        std::unique_lock<std::mutex> _lock(wait_lock);
+
+        while (!stop_token.stop_requested()) {
+            wait_condition.wait_for(_lock, stop_token, checkpoint::g_flush_interval, []() { return false; });
+            checkpoint::write_state(state);
+        }
+    }
+
+    std::shared_ptr<checkpoint::state_t> initialize(std::string filename) {
+        auto result{std::make_shared<checkpoint::state_t>()};
+        result->filename = std::move(filename);
+
+        if (!std::filesystem::exists(result->filename)) {
+            return result;
+        }
+
+        std::ifstream stream(result->filename, std::ios_base::in | std::ios_base::binary);
+        std::string content{std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>()};
+
+        if (!checkpoint::verify(content)) {
+            debug::print("checkpoint", "checkpoint file '{}' fails its checksum; starting without checkpoints", result->filename);
+            checkpoint::g_mismatches++;
+
+            return result;
+        }
+
+        YAML::Node state{};
+
+        try {
+            state = YAML::Load(content);
+        } catch (const std::exception& e) {
+            debug::print("checkpoint", "failed to load checkpoint file '{}', error: {}", result->filename, e.what());
+
+            return nullptr;
+        }
+
+        if (!state.IsMap()) {
+            debug::print("checkpoint", "checkpoint file '{}' isn't a map; starting without checkpoints", result->filename);
+
+            return result;
+        }
+
+        for (auto&& entry : state) {
+            result->entries.emplace(entry.first.as<std::string>(), entry.second);
+        }
+
+        debug::print("checkpoint", "loaded {} checkpoint(s)", result->entries.size());
+
+        return result;
+    }
+
+    bool start(checkpoint::state_t& state) {
+        if (checkpoint::g_state) {
+            debug::print("checkpoint", "already running");
+
+            return false;
+        }
+
+        checkpoint::g_state = &state;
+        state.thread = std::jthread(checkpoint::worker, std::ref(state));
+
+        return true;
+    }
+
+    void stop() {
+        if (!checkpoint::g_state) {
+            return;
+        }
+
+        auto& state{*checkpoint::g_state};
+
+        if (state.thread.joinable()) {
+            state.thread.request_stop();
+            state.thread.join();
+        }
+
+        checkpoint::write_state(state);
+        checkpoint::g_state = nullptr;
+    }
+
+    YAML::Node load(const std::string& key) {
+        if (!checkpoint::g_state) {
+            return YAML::Node{};
+        }
+
+        const std::lock_guard<std::mutex> _lock(checkpoint::g_state->lock);
+        auto found{checkpoint::g_state->entries.find(key)};
+
+        if (found == checkpoint::g_state->entries.end()) {
+            return YAML::Node{};
+        }
+
+        return YAML::Clone(found->second);
+    }
+
+    void store(const std::string& key, const YAML::Node& value) {
+        if (!checkpoint::g_state) {
+            return;
+        }
+
+        auto state{YAML::Clone(value)};
+        const std::lock_guard<std::mutex> _lock(checkpoint::g_state->lock);
+
+        // assigning to a YAML::Node writes through to the node it refers to, so the old one is replaced instead
+        checkpoint::g_state->entries.erase(key);
+        checkpoint::g_state->entries.emplace(key, std::move(state));
+        checkpoint::g_state->dirty = true;
+    }
+
+    void erase(const std::string& key) {
+        if (!checkpoint::g_state) {
+            return;
+        }
+
+        const std::lock_guard<std::mutex> _lock(checkpoint::g_state->lock);
+
+        if (checkpoint::g_state->entries.erase(key) > 0) {
+            checkpoint::g_state->dirty = true;
+        }
+    }
+
+    bool flush() {
+        return !checkpoint::g_state || checkpoint::write_state(*checkpoint::g_state);
+    }
+}
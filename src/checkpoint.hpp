@@ -0,0 +1,30 @@
+#ifndef __CHECKPOINT_HPP
+#define __CHECKPOINT_HPP
+
+#include <memory>
+#include <string>
+#include "yaml-cpp/yaml.h"
+
+/* persisted source positions, kept in a file (checkpoint.yml by default) so that a restart resumes where the last run stopped */
+namespace checkpoint {
+    /* the file and the positions of one agent::instance, which owns them */
+    struct state_t;
+
+    /* loads filename when it exists; nullptr when it exists but can't be parsed */
+    std::shared_ptr<checkpoint::state_t> initialize(std::string filename);
+
+    /* makes the functions below work on state, and a thread writes its file once per second when
+       anything changed; stop() writes the rest. without a started state they do nothing */
+    bool start(checkpoint::state_t& state);
+    void stop();
+
+    /* a null node (IsMap() and friends are false) when nothing was stored under the key */
+    YAML::Node load(const std::string& key);
+
+    /* only update the state in memory, so sources can call them on every batch */
+    void store(const std::string& key, const YAML::Node& value);
+    void erase(const std::string& key);
+    bool flush();
+}
+
+#endif
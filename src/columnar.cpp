@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "columnar.hpp"
+
+namespace columnar {
+    /* one value per record; nullptr where the record doesn't have one */
+    template <typename value_t>
+    using column_t = std::vector<const value_t*>;
+
+    template <typename integer_t>
+    static void append_integer(std::string& output, integer_t value) {
+        char digits[24]{};
+        auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+        output.append(digits, end);
+    }
+
+    static const std::string* text(const std::string* value) {
+        return value;
+    }
+
+    /* nullptr for values that aren't strings, which can't go into a dictionary */
+    static const std::string* text(const nlohmann::json* value) {
+        return value->is_string() ? &value->get_ref<const std::string&>() : nullptr;
+    }
+
+    static void append_value(std::string& output, const std::string& value) {
+        xlog::queue::append_json_string(output, value);
+    }
+
+    static void append_value(std::string& output, const nlohmann::json& value) {
+        if (value.is_string()) {
+            xlog::queue::append_json_string(output, value.get_ref<const std::string&>());
+        } else if (value.is_number_unsigned()) {
+            columnar::append_integer(output, value.get<uint64_t>());
+        } else if (value.is_number_integer()) {
+            columnar::append_integer(output, value.get<int64_t>());
+        } else {
+            output.append(value.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace));
+        }
+    }
+
+    /* written straight into the batch; building it as a json object and dumping that cost more than the
+       encoding saved on the wire */
+    template <typename value_t>
+    static void append_column(std::string& output, const columnar::column_t<value_t>& column) {
+        std::unordered_map<std::string_view, int64_t> indices{};
+        std::vector<const std::string*> dictionary{};
+        std::vector<int64_t> codes(column.size(), -1);
+        size_t present{0};
+        /* only strings go into a dictionary, and only while values repeat enough */
+        bool encodable{true};
+
+        indices.reserve(column.size());
+
+        for (size_t i{0}; i < column.size(); i++) {
+            if (!column[i]) {
+                continue;
+            }
+
+            present++;
+
+            auto text{columnar::text(column[i])};
+
+            if (!text) {
+                encodable = false;
+                break;
+            }
+
+            auto [found, inserted]{indices.try_emplace(*text, static_cast<int64_t>(dictionary.size()))};
+
+            if (inserted) {
+                dictionary.push_back(text);
+            }
+
+            codes[i] = found->second;
+
+            // past this the column can't be dictionary-encoded anymore, so the rest needn't be hashed
+            if (dictionary.size() * 2 > column.size()) {
+                encodable = false;
+                break;
+            }
+        }
+
+        // a dictionary only pays off once values repeat
+        if (encodable && present > 0 && dictionary.size() * 2 <= present) {
+            output.append(R"({"dictionary":[)");
+
+            for (size_t i{0}; i < dictionary.size(); i++) {
+                if (i) {
+                    output.push_back(',');
+                }
+
+                xlog::queue::append_json_string(output, *dictionary[i]);
+            }
+
+            output.append(R"(],"values":[)");
+
+            for (size_t i{0}; i < codes.size(); i++) {
+                if (i) {
+                    output.push_back(',');
+                }
+
+                columnar::append_integer(output, codes[i]);
+            }
+        } else {
+            output.append(R"({"values":[)");
+
+            for (size_t i{0}; i < column.size(); i++) {
+                if (i) {
+                    output.push_back(',');
+                }
+
+                if (column[i]) {
+                    columnar::append_value(output, *column[i]);
+                } else {
+                    output.append("null");
+                }
+            }
+        }
+
+        output.append("]}");
+    }
+
+    static void encode_entries(std::span<const xlog::queue::log_entry_t> entries, std::string& output) {
+        const auto count{entries.size()};
+        columnar::column_t<std::string> identifiers(count, nullptr);
+        columnar::column_t<std::string> messages(count, nullptr);
+        std::unordered_map<std::string_view, columnar::column_t<nlohmann::json>> fields{};
+        /* the key and column of each field position in the previous entry; entries of one source mostly carry
+           the same keys, so the column is usually found without hashing the key */
+        std::vector<std::pair<std::string_view, columnar::column_t<nlohmann::json>*>> previous{};
+
+        for (size_t i = 0; i < count; i++) {
+            const auto& entry{entries[i]};
+
+            identifiers[i] = &entry.identifier;
+            messages[i] = &entry.message;
+
+            if (!entry.fields.is_object()) {
+                continue;
+            }
+
+            size_t position{0};
+
+            for (auto it{entry.fields.begin()}; it != entry.fields.end(); ++it, position++) {
+                const std::string_view key{it.key()};
+
+                if (position == previous.size()) {
+                    previous.emplace_back();
+                }
+
+                if (previous[position].first != key) {
+                    auto& column{fields[key]};
+
+                    if (column.empty()) {
+                        column.resize(count, nullptr);
+                    }
+
+                    previous[position] = {key, &column};
+                }
+
+                (*previous[position].second)[i] = &it.value();
+            }
+        }
+
+        output.clear();
+        output.append(R"({"count":)");
+        columnar::append_integer(output, count);
+        output.append(R"(,"timestamp_unit":"ns","timestamp":{"base":)");
+        columnar::append_integer(output, count ? entries.front().timestamp : 0);
+        output.append(R"(,"deltas":[)");
+
+        for (size_t i = 0; i < count; i++) {
+            if (i) {
+                output.push_back(',');
+            }
+
+            columnar::append_integer(output, entries[i].timestamp - (i ? entries[i - 1].timestamp : entries[i].timestamp));
+        }
+
+        output.append(R"(]},"identifier":)");
+        columnar::append_column(output, identifiers);
+        output.append(R"(,"message":)");
+        columnar::append_column(output, messages);
+
+        if (!fields.empty()) {
+            // sorted so a batch's layout doesn't depend on hashing
+            std::vector<std::string_view> keys{};
+            keys.reserve(fields.size());
+
+            for (auto&& [key, column] : fields) {
+                keys.push_back(key);
+            }
+
+            std::sort(keys.begin(), keys.end());
+            output.append(R"(,"fields":{)");
+
+            for (size_t i{0}; i < keys.size(); i++) {
+                if (i) {
+                    output.push_back(',');
+                }
+
+                xlog::queue::append_json_string(output, keys[i]);
+                output.push_back(':');
+                columnar::append_column(output, fields[keys[i]]);
+            }
+
+            output.push_back('}');
+        }
+
+        output.push_back('}');
+    }
+
+    bool encode(const xlog::sinks::records_t& records, size_t first, size_t last, std::string& output) {
+        if (records.entries.size() == records.size()) {
+            columnar::encode_entries(std::span(records.entries).subspan(first, last - first), output);
+
+            return true;
+        }
+
+        // spooled records and those of the C API were never entries here, so they're parsed back
+        std::vector<xlog::queue::log_entry_t> entries{};
+        entries.reserve(last - first);
+
+        for (auto i{first}; i < last; i++) {
+            auto record = nlohmann::json::parse(records[i], nullptr, false);
+
+            if (record.is_discarded() || !record.is_object() || !record.contains("timestamp") || !record["timestamp"].is_number_integer()
+                || record.value("timestamp_unit", "") != "ns" || !record.value("identifier", nlohmann::json{}).is_string()
+                || !record.value("message", nlohmann::json{}).is_string()) {
+                return false;
+            }
+
+            xlog::queue::log_entry_t entry{
+                .identifier = record["identifier"].get<std::string>(),
+                .timestamp = record["timestamp"].get<int64_t>(),
+                .message = record["message"].get<std::string>(),
+            };
+
+            if (auto it{record.find("fields")}; it != record.end()) {
+                entry.fields = std::move(*it);
+            }
+
+            entries.push_back(std::move(entry));
+        }
+
+        columnar::encode_entries(entries, output);
+
+        return true;
+    }
+}
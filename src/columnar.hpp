@@ -0,0 +1,28 @@
+#ifndef __COLUMNAR_HPP
+#define __COLUMNAR_HPP
+
+#include <cstddef>
+#include <string>
+#include "xlog.hpp"
+
+/* the columnar batch encoding a collector can accept instead of one log command per record.
+   the records of a batch become one object of columns, each holding a value per record:
+
+       {"count":3,"timestamp_unit":"ns",
+        "timestamp":{"base":1700000000000000000,"deltas":[0,1500,20]},
+        "identifier":{"dictionary":["journal"],"values":[0,0,0]},
+        "message":{"values":["a","b","c"]},
+        "fields":{"_HOSTNAME":{"dictionary":["web-1"],"values":[0,0,-1]},
+                  "_PID":{"values":["811","811",null]}}}
+
+   deltas are to the previous record's timestamp. a column whose values are strings repeating
+   within the batch is dictionary-encoded, -1 marking records without the value; any other
+   column lists the values, null marking records without one. records with empty fields come
+   back without fields */
+namespace columnar {
+    /* encodes records [first, last) from the entries they were serialized from, or parses them back when those
+       weren't kept; false when one of them isn't a record the queue serialized */
+    bool encode(const xlog::sinks::records_t& records, size_t first, size_t last, std::string& output);
+}
+
+#endif
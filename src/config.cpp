@@ -1,21 +1,20 @@
+#include <atomic>
 #include <exception>
+#include <memory>
+#include <string>
+#include <utility>
 #include "yaml-cpp/yaml.h"
 #include "config.hpp"
 #include "debug.hpp"
 
 namespace config {
-    static const char* g_filename{"config.yml"};
-
-    bool        field_verbose{};
-    int64_t     field_dispatch_sleep_ms{};
-    size_t      field_maximum_log_entries{};
-    int64_t     field_seconds_between_connects{};
-    std::string field_remote_address{};
-    uint16_t    field_remote_port{};
-    std::string field_remote_certificate{};
-    std::string field_identity{};
-    std::string field_identity_password{};
-    size_t      field_maximum_receive_size{};
+    struct state_t {
+        std::string filename{};
+        std::atomic<std::shared_ptr<const config::snapshot_t>> current{};
+    };
+
+    static config::state_t* g_state{nullptr};
+    static const std::shared_ptr<const config::snapshot_t> g_defaults{std::make_shared<const config::snapshot_t>()};
 
     template<typename T>
     static bool load_config_key(YAML::Node& config, const char* key_name, T& value) {
@@ -40,15 +39,13 @@ namespace config {
         return false;
     }
 
-    bool initialize() {
-        debug::print("config", "initializing");
-
+    static bool load(const std::string& filename, config::snapshot_t& result) {
         YAML::Node config{};
 
         try {
-            config = YAML::LoadFile(g_filename);
+            config = YAML::LoadFile(filename);
         } catch (const std::exception& e) {
-            debug::print("config", "failed to load config file '{}', error: {}", g_filename, e.what());
+            debug::print("config", "failed to load config file '{}', error: {}", filename, e.what());
             return false;
         }
 
@@ -59,19 +56,128 @@ namespace config {
             } \
         }
 
-        LOAD_CONFIG_KEY_VALUE("verbose", config::field_verbose);
-        LOAD_CONFIG_KEY_VALUE("dispatch_sleep_ms", config::field_dispatch_sleep_ms);
-        LOAD_CONFIG_KEY_VALUE("maximum_log_entries", config::field_maximum_log_entries);
-        LOAD_CONFIG_KEY_VALUE("seconds_between_connects", config::field_seconds_between_connects);
-        LOAD_CONFIG_KEY_VALUE("remote_address", config::field_remote_address);
-        LOAD_CONFIG_KEY_VALUE("remote_port", config::field_remote_port);
-        LOAD_CONFIG_KEY_VALUE("remote_certificate", config::field_remote_certificate);
-        LOAD_CONFIG_KEY_VALUE("identity", config::field_identity);
-        LOAD_CONFIG_KEY_VALUE("identity_password", config::field_identity_password);
-        LOAD_CONFIG_KEY_VALUE("maximum_receive_size", config::field_maximum_receive_size);
+        #define LOAD_OPTIONAL_CONFIG_KEY_VALUE(KEY_NAME, VARIABLE) { \
+            if (config[KEY_NAME] && !load_config_key(config, KEY_NAME, VARIABLE)) { \
+                debug::print("config", "failed to load key '{}'", KEY_NAME); \
+                return false; \
+            } \
+        }
+
+        LOAD_CONFIG_KEY_VALUE("verbose", result.verbose);
+        LOAD_CONFIG_KEY_VALUE("dispatch_sleep_ms", result.dispatch_sleep_ms);
+        LOAD_CONFIG_KEY_VALUE("maximum_log_entries", result.maximum_log_entries);
+        LOAD_OPTIONAL_CONFIG_KEY_VALUE("priority_severity", result.priority_severity);
+        LOAD_CONFIG_KEY_VALUE("seconds_between_connects", result.seconds_between_connects);
+        LOAD_CONFIG_KEY_VALUE("remote_address", result.remote_address);
+        LOAD_CONFIG_KEY_VALUE("remote_port", result.remote_port);
+        LOAD_CONFIG_KEY_VALUE("remote_certificate", result.remote_certificate);
+        LOAD_CONFIG_KEY_VALUE("identity", result.identity);
+        LOAD_CONFIG_KEY_VALUE("identity_password", result.identity_password);
+        LOAD_CONFIG_KEY_VALUE("maximum_receive_size", result.maximum_receive_size);
+        LOAD_OPTIONAL_CONFIG_KEY_VALUE("columnar_batches", result.columnar_batches);
+        LOAD_OPTIONAL_CONFIG_KEY_VALUE("heartbeat_interval_ms", result.heartbeat_interval_ms);
+        LOAD_OPTIONAL_CONFIG_KEY_VALUE("heartbeat_missed", result.heartbeat_missed);
+        LOAD_OPTIONAL_CONFIG_KEY_VALUE("tcp_keepalive_s", result.tcp_keepalive_s);
+        LOAD_OPTIONAL_CONFIG_KEY_VALUE("kernel_tls", result.kernel_tls);
+        LOAD_OPTIONAL_CONFIG_KEY_VALUE("dns_cache_ttl_s", result.dns_cache_ttl_s);
+        LOAD_OPTIONAL_CONFIG_KEY_VALUE("connect_attempt_delay_ms", result.connect_attempt_delay_ms);
+        LOAD_OPTIONAL_CONFIG_KEY_VALUE("reactor_threads", result.reactor_threads);
+        LOAD_OPTIONAL_CONFIG_KEY_VALUE("reactor_pin_threads", result.reactor_pin_threads);
+        LOAD_OPTIONAL_CONFIG_KEY_VALUE("file_io_uring", result.file_io_uring);
+        LOAD_OPTIONAL_CONFIG_KEY_VALUE("metrics_interval_s", result.metrics_interval_s);
+        LOAD_OPTIONAL_CONFIG_KEY_VALUE("shutdown_deadline_ms", result.shutdown_deadline_ms);
+        LOAD_OPTIONAL_CONFIG_KEY_VALUE("archive_directory", result.archive_directory);
+        LOAD_OPTIONAL_CONFIG_KEY_VALUE("archive_maximum_bytes", result.archive_maximum_bytes);
+        LOAD_OPTIONAL_CONFIG_KEY_VALUE("archive_maximum_age_s", result.archive_maximum_age_s);
+        LOAD_OPTIONAL_CONFIG_KEY_VALUE("archive_compress", result.archive_compress);
+        LOAD_OPTIONAL_CONFIG_KEY_VALUE("archive_keep", result.archive_keep);
 
+        #undef LOAD_OPTIONAL_CONFIG_KEY_VALUE
         #undef LOAD_CONFIG_KEY_VALUE
 
         return true;
     }
+
+    std::shared_ptr<const config::snapshot_t> current() {
+        return config::g_state ? config::g_state->current.load() : config::g_defaults;
+    }
+
+    std::shared_ptr<config::state_t> initialize(std::string filename) {
+        debug::print("config", "initializing from '{}'", filename);
+
+        auto snapshot{std::make_shared<config::snapshot_t>()};
+
+        if (!config::load(filename, *snapshot)) {
+            return nullptr;
+        }
+
+        auto state{std::make_shared<config::state_t>()};
+        state->filename = std::move(filename);
+        state->current.store(std::move(snapshot));
+
+        return state;
+    }
+
+    void bind(config::state_t* state) {
+        config::g_state = state;
+    }
+
+    bool reload(bool& connection_changed) {
+        auto running{config::current()};
+        auto snapshot{std::make_shared<config::snapshot_t>()};
+
+        connection_changed = false;
+
+        if (!config::g_state || !config::load(config::g_state->filename, *snapshot)) {
+            debug::print("config", "keeping the running configuration");
+
+            return false;
+        }
+
+        if (snapshot->reactor_threads != running->reactor_threads
+            || snapshot->reactor_pin_threads != running->reactor_pin_threads
+            || snapshot->file_io_uring != running->file_io_uring) {
+            debug::print("config", "reactor_threads, reactor_pin_threads and file_io_uring take effect after a restart");
+
+            snapshot->reactor_threads = running->reactor_threads;
+            snapshot->reactor_pin_threads = running->reactor_pin_threads;
+            snapshot->file_io_uring = running->file_io_uring;
+        }
+
+        if (snapshot->archive_directory != running->archive_directory
+            || snapshot->archive_maximum_bytes != running->archive_maximum_bytes
+            || snapshot->archive_maximum_age_s != running->archive_maximum_age_s
+            || snapshot->archive_compress != running->archive_compress
+            || snapshot->archive_keep != running->archive_keep) {
+            debug::print("config", "the archive_ settings take effect after a restart");
+
+            snapshot->archive_directory = running->archive_directory;
+            snapshot->archive_maximum_bytes = running->archive_maximum_bytes;
+            snapshot->archive_maximum_age_s = running->archive_maximum_age_s;
+            snapshot->archive_compress = running->archive_compress;
+            snapshot->archive_keep = running->archive_keep;
+        }
+
+        connection_changed = snapshot->remote_address != running->remote_address
+            || snapshot->remote_port != running->remote_port
+            || snapshot->remote_certificate != running->remote_certificate
+            || snapshot->identity != running->identity
+            || snapshot->identity_password != running->identity_password
+            || snapshot->columnar_batches != running->columnar_batches
+            || snapshot->heartbeat_interval_ms != running->heartbeat_interval_ms
+            || snapshot->heartbeat_missed != running->heartbeat_missed
+            || snapshot->tcp_keepalive_s != running->tcp_keepalive_s
+            || snapshot->kernel_tls != running->kernel_tls;
+
+        config::g_state->current.store(std::move(snapshot));
+        debug::print("config", "reloaded");
+
+        return true;
+    }
+
+    const std::string& filename() {
+        static const std::string none{};
+
+        return config::g_state ? config::g_state->filename : none;
+    }
 }
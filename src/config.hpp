@@ -3,21 +3,75 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <string>
 
 namespace config {
-    extern bool        field_verbose;
-    extern int64_t     field_dispatch_sleep_ms;
-    extern size_t      field_maximum_log_entries;
-    extern int64_t     field_seconds_between_connects;
-    extern std::string field_remote_address;
-    extern uint16_t    field_remote_port;
-    extern std::string field_remote_certificate;
-    extern std::string field_identity;
-    extern std::string field_identity_password;
-    extern size_t      field_maximum_receive_size;
-
-    bool initialize();
+    /* one consistent set of values from config.yml; a reload publishes a new snapshot
+       while readers keep the one they hold */
+    struct snapshot_t {
+        bool        verbose{};
+        int64_t     dispatch_sleep_ms{};
+        /* entries with a 'severity' field at or above this syslog level (0 emergency .. 7 debug, so numerically
+           at or below it) skip dispatch_sleep_ms and go ahead of every sink's backlog; -1 disables */
+        int64_t     priority_severity{3};
+        size_t      maximum_log_entries{};
+        int64_t     seconds_between_connects{};
+        std::string remote_address{};
+        uint16_t    remote_port{};
+        std::string remote_certificate{};
+        std::string identity{};
+        std::string identity_password{};
+        size_t      maximum_receive_size{};
+        /* offer columnar batches at authentication; records go as log commands unless the collector accepts */
+        bool        columnar_batches{true};
+        /* ping the collector this often once it accepts heartbeats at authentication; 0 disables */
+        int64_t     heartbeat_interval_ms{2000};
+        /* the connection is dropped after this many intervals without a frame from the collector */
+        int64_t     heartbeat_missed{3};
+        /* TCP keepalive probes after this long idle, and unacknowledged data fails the connection about
+           as fast; 0 keeps the system defaults */
+        int64_t     tcp_keepalive_s{15};
+        /* hand TLS encryption to the kernel's tls module after the handshake; user space when it's unavailable */
+        bool        kernel_tls{false};
+        /* resolved collector addresses are reused this long; 0 resolves on every connect */
+        int64_t     dns_cache_ttl_s{60};
+        /* the next resolved address is tried this long after the previous one when neither answered yet */
+        int64_t     connect_attempt_delay_ms{250};
+        /* read once at startup; changing them needs a restart */
+        size_t      reactor_threads{0};
+        bool        reactor_pin_threads{false};
+        /* experimental: halves the read syscalls of busy file sources, but didn't save CPU in bench/file */
+        bool        file_io_uring{false};
+        int64_t     metrics_interval_s{60};
+        /* time the queue gets to drain on shutdown before the rest is spooled */
+        int64_t     shutdown_deadline_ms{5000};
+        /* local archive sink of everything shipped; disabled while empty. read once at startup */
+        std::string archive_directory{};
+        /* a file is rotated once this much log data went into it, or once it's this old */
+        uint64_t    archive_maximum_bytes{64 * 1024 * 1024};
+        int64_t     archive_maximum_age_s{3600};
+        bool        archive_compress{false};
+        /* rotated files kept; 0 keeps all */
+        size_t      archive_keep{0};
+    };
+
+    /* the file and the snapshot of one agent::instance, which owns them */
+    struct state_t;
+
+    /* nullptr when the file can't be loaded */
+    std::shared_ptr<config::state_t> initialize(std::string filename);
+
+    /* makes the functions below work on state; the instance binds its own while it runs */
+    void bind(config::state_t* state);
+
+    /* the defaults when no state is bound */
+    std::shared_ptr<const config::snapshot_t> current();
+
+    /* keeps the running snapshot when the file is invalid; sets connection_changed when
+       the remote, the credentials, the offered encodings or the connection settings differ */
+    bool reload(bool& connection_changed);
+    const std::string& filename();
 }
 
 #endif
@@ -0,0 +1,179 @@
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#include <nmmintrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#include <cpuid.h>
+#include <nmmintrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__aarch64__)
+#include <arm_acle.h>
+#ifdef __linux__
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include "crc32c.hpp"
+
+namespace crc32c {
+    /* the reflected Castagnoli polynomial */
+    static constexpr uint32_t g_polynomial{0x82f63b78};
+
+    using tables_t = std::array<std::array<uint32_t, 256>, 8>;
+
+    /* tables[k][b] is the CRC of byte b followed by k zero bytes */
+    static constexpr tables_t make_tables() {
+        tables_t tables{};
+
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc{i};
+
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (g_polynomial & (0u - (crc & 1)));
+            }
+
+            tables[0][i] = crc;
+        }
+
+        for (size_t k = 1; k < tables.size(); k++) {
+            for (uint32_t i = 0; i < 256; i++) {
+                tables[k][i] = (tables[k - 1][i] >> 8) ^ tables[0][tables[k - 1][i] & 0xff];
+            }
+        }
+
+        return tables;
+    }
+
+    static constexpr tables_t g_tables{crc32c::make_tables()};
+
+    static uint32_t load_le32(const uint8_t* data) {
+        return static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8 | static_cast<uint32_t>(data[2]) << 16 | static_cast<uint32_t>(data[3]) << 24;
+    }
+
+    /* state is the running, not yet inverted CRC */
+    static uint32_t update_portable(uint32_t state, const uint8_t* data, size_t length) {
+        const auto& t{crc32c::g_tables};
+
+        while (length >= 8) {
+            auto low{crc32c::load_le32(data) ^ state};
+            auto high{crc32c::load_le32(data + 4)};
+
+            state = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^ t[5][(low >> 16) & 0xff] ^ t[4][low >> 24]
+                ^ t[3][high & 0xff] ^ t[2][(high >> 8) & 0xff] ^ t[1][(high >> 16) & 0xff] ^ t[0][high >> 24];
+
+            data += 8;
+            length -= 8;
+        }
+
+        while (length--) {
+            state = t[0][(state ^ *data++) & 0xff] ^ (state >> 8);
+        }
+
+        return state;
+    }
+
+#if (defined(_MSC_VER) && defined(_M_X64)) || ((defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__))
+    #define CRC32C_HARDWARE "sse4.2"
+
+    #ifndef _MSC_VER
+    __attribute__((target("sse4.2")))
+    #endif
+    static uint32_t update_hardware(uint32_t state, const uint8_t* data, size_t length) {
+        uint64_t wide{state};
+
+        while (length >= 8) {
+            uint64_t word{};
+            std::memcpy(&word, data, sizeof(word));
+            wide = _mm_crc32_u64(wide, word);
+            data += 8;
+            length -= 8;
+        }
+
+        state = static_cast<uint32_t>(wide);
+
+        while (length--) {
+            state = _mm_crc32_u8(state, *data++);
+        }
+
+        return state;
+    }
+
+    static bool hardware_support() {
+    #ifdef _MSC_VER
+        int registers[4]{};
+        __cpuid(registers, 1);
+
+        return (registers[2] & (1 << 20)) != 0;
+    #else
+        unsigned int eax{0}, ebx{0}, ecx{0}, edx{0};
+
+        return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0;
+    #endif
+    }
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__aarch64__)
+    #define CRC32C_HARDWARE "armv8"
+
+    __attribute__((target("+crc")))
+    static uint32_t update_hardware(uint32_t state, const uint8_t* data, size_t length) {
+        while (length >= 8) {
+            uint64_t word{};
+            std::memcpy(&word, data, sizeof(word));
+            state = __crc32cd(state, word);
+            data += 8;
+            length -= 8;
+        }
+
+        while (length--) {
+            state = __crc32cb(state, *data++);
+        }
+
+        return state;
+    }
+
+    static bool hardware_support() {
+    #ifdef __linux__
+        return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+    #else
+        // every 64-bit Apple CPU has the CRC instructions
+        return true;
+    #endif
+    }
+#endif
+
+    using update_t = uint32_t(*)(uint32_t, const uint8_t*, size_t);
+
+    /* picked once; the CPU doesn't change under the process */
+    static update_t select() {
+    #ifdef CRC32C_HARDWARE
+        if (crc32c::hardware_support()) {
+            return crc32c::update_hardware;
+        }
+    #endif
+
+        return crc32c::update_portable;
+    }
+
+    static const update_t g_update{crc32c::select()};
+
+    uint32_t compute(const void* data, size_t length, uint32_t crc) {
+        return ~crc32c::g_update(~crc, static_cast<const uint8_t*>(data), length);
+    }
+
+    uint32_t compute(std::string_view data, uint32_t crc) {
+        return crc32c::compute(data.data(), data.length(), crc);
+    }
+
+    const char* implementation() {
+    #ifdef CRC32C_HARDWARE
+        if (crc32c::g_update == crc32c::update_hardware) {
+            return CRC32C_HARDWARE;
+        }
+    #endif
+
+        return "slicing-by-8";
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef __CRC32C_HPP
+#define __CRC32C_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/* CRC32C (Castagnoli) with the SSE4.2 or ARMv8 CRC instructions when the CPU has them,
+   slicing-by-8 tables otherwise */
+namespace crc32c {
+    /* pass a previous result as crc to continue it over more data */
+    uint32_t compute(const void* data, size_t length, uint32_t crc = 0);
+    uint32_t compute(std::string_view data, uint32_t crc = 0);
+
+    /* "sse4.2", "armv8" or "slicing-by-8" */
+    const char* implementation();
+}
+
+#endif
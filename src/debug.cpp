@@ -8,18 +8,23 @@
 #include <iostream>
 #include <fstream>
 #include <mutex>
+#include <string>
 
 #include "debug.hpp"
 
 namespace debug {
-    static const char* g_stream_filename{"debug.log"};
-
     std::mutex g_stream_lock{};
     std::ofstream g_stream{};
 
-    bool initialize() {
+    bool initialize(const std::string& filename) {
+        const std::lock_guard<std::mutex> _lock(debug::g_stream_lock);
+
+        if (debug::g_stream.is_open()) {
+            debug::g_stream.close();
+        }
+
         // flawfinder: ignore
-        debug::g_stream.open(debug::g_stream_filename, std::ios_base::app);
+        debug::g_stream.open(filename, std::ios_base::app);
 
         if (!debug::g_stream.is_open()) {
             return false;
@@ -27,4 +32,12 @@ namespace debug {
 
         return true;
     }
+
+    void close() {
+        const std::lock_guard<std::mutex> _lock(debug::g_stream_lock);
+
+        if (debug::g_stream.is_open()) {
+            debug::g_stream.close();
+        }
+    }
 }
@@ -8,6 +8,7 @@
 #include <fstream>
 #include <mutex>
 #include <sstream>
+#include <string>
 #include <string_view>
 
 namespace debug {
@@ -49,7 +50,10 @@ namespace debug {
         }
     }
 
-    bool initialize();
+    /* the stream is process-wide since every module prints to it; an agent opens it at its debug path
+       when it starts and closes it when it stops */
+    bool initialize(const std::string& filename);
+    void close();
 }
 
 #endif
@@ -1,7 +1,3 @@
-#ifdef _WIN32
-#define _SILENCE_ALL_CXX17_DEPRECATION_WARNINGS
-#endif
-
 #include <array>
 #include <cerrno>
 #include <chrono>
@@ -11,56 +7,23 @@
 #include <stdexcept>
 #include <thread>
 #include <format>
-#include <locale>
-#include <codecvt>
 #include "config.hpp"
 #include "debug.hpp"
 #include "filenotify.hpp"
 
 #ifdef _WIN32
-bool filenotify::wait() {
-    while (true){
-        constexpr DWORD buffer_length{4096};
-        BYTE buffer[buffer_length]{};
-        DWORD bytes_returned{0};
-
-        std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
-        std::wstring wide_filename{converter.from_bytes(this->filename)};
-
-        auto read_result{ReadDirectoryChangesW(
-            this->handle,
-            &buffer,
-            sizeof(buffer),
-            TRUE,
-            FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE,
-            &bytes_returned,
-            NULL,
-            NULL)
-        };
-
-        if (!read_result) {
-            debug::print("filenotify", "failed to read directory changes, error: 0x{:08X}", GetLastError());
-            return false;
-        }
-
-        FILE_NOTIFY_INFORMATION* fni{reinterpret_cast<FILE_NOTIFY_INFORMATION*>(buffer)};
-
-        do {
-            std::wstring affected_filename(fni->FileName, fni->FileNameLength / sizeof(WCHAR));
-
-            if (wide_filename == affected_filename) {
-                if (fni->Action == FILE_ACTION_MODIFIED) {
-                    return true;
-                }
-            }
-
-            if (fni->NextEntryOffset == 0) {
-                break;
-            }
+filenotify_handle_t filenotify::native_handle() const {
+    return this->handle;
+}
 
-            fni = reinterpret_cast<FILE_NOTIFY_INFORMATION*>(reinterpret_cast<BYTE*>(fni) + fni->NextEntryOffset);
-        } while (true);
+filenotify_event filenotify::consume() {
+    // change notifications don't carry the file name; any change in the folder counts
+    if (!FindNextChangeNotification(this->handle)) {
+        debug::print("filenotify", "failed to re-arm directory change notification, error: 0x{:08X}", GetLastError());
+        return filenotify_event::none;
     }
+
+    return filenotify_event::modified;
 }
 
 filenotify::filenotify(const std::string filepath) {
@@ -71,14 +34,10 @@ filenotify::filenotify(const std::string filepath) {
 
     debug::print("filenotify", "setting watch in folder '{}' for file '{}'", directory, this->filename);
 
-    this->handle = CreateFileA(
+    this->handle = FindFirstChangeNotificationA(
         directory.c_str(),
-        FILE_LIST_DIRECTORY,
-        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
-        NULL,
-        OPEN_EXISTING,
-        FILE_FLAG_BACKUP_SEMANTICS,
-        NULL
+        FALSE,
+        FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE
     );
 
     if (this->handle == filenotify_handle_nullptr) {
@@ -88,7 +47,7 @@ filenotify::filenotify(const std::string filepath) {
 
 filenotify::~filenotify() {
     if (this->handle != filenotify_handle_nullptr) {
-        CloseHandle(this->handle);
+        FindCloseChangeNotification(this->handle);
     }
 }
 
@@ -96,26 +55,40 @@ filenotify::~filenotify() {
 #include <unistd.h>
 #include <sys/inotify.h>
 
-bool filenotify::wait() {
+filenotify_handle_t filenotify::native_handle() const {
+    return this->handle;
+}
+
+filenotify_event filenotify::consume() {
+    filenotify_event result{filenotify_event::none};
+
     while (true) {
-        char buffer[4096]{};
+        alignas(inotify_event) char buffer[4096]{};
         auto read_length{::read(this->handle, buffer, sizeof(buffer))};
 
-        if (read_length == -1 && errno != EAGAIN) {
-            debug::print("filenotify", "failed to read from handle, error: {}", std::strerror(errno));
-            return false;
+        if (read_length == -1) {
+            if (errno != EAGAIN) {
+                debug::print("filenotify", "failed to read from handle, error: {}", std::strerror(errno));
+            }
+
+            return result;
         }
 
         if (!read_length) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
-            continue;
+            return result;
         }
 
-        for (char* ptr{buffer}; ptr < buffer + read_length; ptr += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(buffer)->len) {
+        for (char* ptr{buffer}; ptr < buffer + read_length; ptr += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(ptr)->len) {
             const inotify_event* event{reinterpret_cast<inotify_event*>(ptr)};
 
-            if (this->filename == event->name) {
-                return true;
+            if (!event->len || this->filename != event->name) {
+                continue;
+            }
+
+            if (event->mask & (IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)) {
+                result = filenotify_event::replaced;
+            } else if (result == filenotify_event::none) {
+                result = filenotify_event::modified;
             }
         }
     }
@@ -129,13 +102,13 @@ filenotify::filenotify(const std::string filepath) {
 
     debug::print("filenotify", "setting watch in folder '{}' for file '{}'", directory, this->filename);
 
-    this->handle = inotify_init1(IN_NONBLOCK);
+    this->handle = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
 
     if (this->handle == filenotify_handle_nullptr) {
         throw std::runtime_error("failed to create a handle");
     }
 
-    this->file_handle = inotify_add_watch(this->handle, directory.c_str(), IN_CLOSE_WRITE | IN_MODIFY);
+    this->file_handle = inotify_add_watch(this->handle, directory.c_str(), IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM);
 
     if (this->file_handle == filenotify_handle_nullptr) {
         ::close(this->handle);
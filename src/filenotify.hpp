@@ -16,6 +16,13 @@ using filenotify_handle_t = int;
 constexpr filenotify_handle_t filenotify_handle_nullptr{-1};
 #endif
 
+enum class filenotify_event {
+    none,
+    modified,
+    /* the file was created, moved or removed; the path may now refer to a different file */
+    replaced,
+};
+
 class filenotify {
 private:
     std::string filename{};
@@ -28,7 +35,12 @@ private:
 public:
     filenotify(const std::string filepath);
     ~filenotify();
-    bool wait();
+
+    /* waitable handle that becomes ready when the watched directory changes */
+    filenotify_handle_t native_handle() const;
+
+    /* non-blocking; drains pending notifications and reports the strongest one concerning the file */
+    filenotify_event consume();
 };
 
 #endif
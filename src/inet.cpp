@@ -5,224 +5,1101 @@
 #include <boost/asio/ssl.hpp>
 #include <boost/asio/write.hpp>
 #include <boost/system/detail/error_code.hpp>
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#ifdef __linux__
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <exception>
 #include <filesystem>
 #include <functional>
+#include <future>
+#include <memory>
 #include <mutex>
-#include <optional>
+#include <stdexcept>
+#include <stop_token>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
+#include "columnar.hpp"
+#include "crc32c.hpp"
 #include "debug.hpp"
 #include "config.hpp"
+#include "metrics.hpp"
+#include "xlog.hpp"
 #include "nlohmann/detail/input/json_sax.hpp"
 #include "nlohmann/json.hpp"
 #include "nlohmann/json_fwd.hpp"
 
 namespace inet {
-    static std::optional<std::reference_wrapper<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>>> g_ssl_stream = std::nullopt;
+    using ssl_stream_t = boost::asio::ssl::stream<boost::asio::ip::tcp::socket>;
 
-    static bool g_connected{false};
-    std::mutex  g_connection_fault_mutex{};
-    static std::condition_variable g_connection_fault{};
+    class session;
 
-    static bool send(std::string& data) {
-        if (!inet::g_connected || !inet::g_ssl_stream.has_value()) {
-            return false;
-        }
+    /* a write is sent as soon as it reaches this size, so one TLS record doesn't grow unbounded */
+    static constexpr size_t g_maximum_write_size{64 * 1024};
+
+    /* a collector that doesn't accept the connection, finish the TLS handshake or answer the auth
+       command by then is given up on */
+    static constexpr std::chrono::seconds g_handshake_timeout{10};
 
-        auto& ssl_stream{inet::g_ssl_stream.value().get()};
+    static std::atomic<uint64_t>& g_heartbeat_sent{metrics::counter("inet.heartbeat.sent")};
+    static std::atomic<uint64_t>& g_heartbeat_timeouts{metrics::counter("inet.heartbeat.timeouts")};
+    /* gauges rather than counters: the smoothed round trip of the pongs, and the longest one */
+    static std::atomic<uint64_t>& g_rtt_us{metrics::counter("inet.heartbeat.rtt_us")};
+    static std::atomic<uint64_t>& g_rtt_max_us{metrics::counter("inet.heartbeat.rtt_max_us")};
 
-        std::vector<char> buffer(data.begin(), data.end());
-        buffer.push_back(0);
+    /* writes grow with the round trip, so a long link carries more records per write and per
+       columnar batch: 64 KiB up to 10 ms, 16 times that from 160 ms */
+    static size_t write_size() {
+        auto rtt_ms{inet::g_rtt_us.load() / 1000};
+
+        return inet::g_maximum_write_size * std::clamp<uint64_t>(rtt_ms / 10, 1, 16);
+    }
+
+    /* starts a frame of command; the collector checks data against the CRC32C before it */
+    static void append_prefix(std::string& frames, std::string_view command, std::string_view data) {
+        frames.append(R"({"command":")");
+        frames.append(command);
+        frames.append(R"(","crc32c":)");
+        frames.append(std::to_string(crc32c::compute(data)));
+        frames.append(R"(,"data":)");
+    }
+
+    /* the kernel probes an idle connection after idle_s and fails one with unacknowledged data about as
+       fast, instead of after its defaults of two hours and fifteen minutes */
+    static void set_keepalive(boost::asio::ip::tcp::socket& socket, int64_t idle_s) {
+        if (idle_s <= 0) {
+            return;
+        }
 
         boost::system::error_code ec;
-        boost::asio::write(ssl_stream, boost::asio::buffer(buffer), ec);
+        socket.set_option(boost::asio::socket_base::keep_alive(true), ec);
 
         if (ec) {
-            debug::print("inet", "failed to send due to {}", ec.message());
-            return false;
+            debug::print("inet", "failed to enable keepalive, error: {}", ec.message());
+
+            return;
         }
 
-        return true;
+    #ifdef __linux__
+        int idle{static_cast<int>(idle_s)};
+        int interval{std::max(1, idle / 3)};
+        int count{3};
+        unsigned int user_timeout{static_cast<unsigned int>(idle + interval * count) * 1000};
+        auto handle{socket.native_handle()};
+
+        if (setsockopt(handle, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle)) != 0
+            || setsockopt(handle, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval)) != 0
+            || setsockopt(handle, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count)) != 0
+            || setsockopt(handle, IPPROTO_TCP, TCP_USER_TIMEOUT, &user_timeout, sizeof(user_timeout)) != 0) {
+            debug::print("inet", "failed to tune keepalive, error: {}", std::strerror(errno));
+        }
+    #endif
     }
 
-    static bool receive(std::string& data) {
-        if (!inet::g_connected || !inet::g_ssl_stream.has_value()) {
-            return false;
+    using io_handler_t = std::function<void(const boost::system::error_code&, size_t)>;
+
+    /* the TLS connection a session reads from and writes to; one read and one write may be outstanding */
+    class transport {
+    public:
+        virtual ~transport() = default;
+
+        virtual void async_write(std::string_view frames, inet::io_handler_t handler) = 0;
+        virtual void async_read_some(boost::asio::mutable_buffer buffer, inet::io_handler_t handler) = 0;
+        virtual boost::asio::ip::tcp::socket& socket() = 0;
+
+        /* where the records are encrypted, for the log */
+        virtual std::string mode() const = 0;
+    };
+
+    /* asio's TLS stream; OpenSSL only sees memory buffers, so records are always encrypted in user space */
+    class user_tls : public inet::transport {
+    private:
+        inet::ssl_stream_t& stream;
+    public:
+        user_tls(inet::ssl_stream_t& stream) : stream(stream) {}
+
+        void async_write(std::string_view frames, inet::io_handler_t handler) override {
+            boost::asio::async_write(this->stream, boost::asio::buffer(frames.data(), frames.length()), std::move(handler));
+        }
+
+        void async_read_some(boost::asio::mutable_buffer buffer, inet::io_handler_t handler) override {
+            this->stream.async_read_some(buffer, std::move(handler));
         }
 
-        auto& ssl_stream{inet::g_ssl_stream.value().get()};
-        std::string result_buffer{};
+        boost::asio::ip::tcp::socket& socket() override {
+            return this->stream.next_layer();
+        }
+
+        std::string mode() const override {
+            return "user space";
+        }
+    };
+
+    /* gauges: 1 while the current connection's records are encrypted, or decrypted, by the kernel */
+    static std::atomic<uint64_t>& g_kernel_send{metrics::counter("inet.tls.kernel_send")};
+    static std::atomic<uint64_t>& g_kernel_receive{metrics::counter("inet.tls.kernel_receive")};
+
+#ifdef SSL_OP_ENABLE_KTLS
+    /* OpenSSL on the socket itself with SSL_OP_ENABLE_KTLS, so it can hand the record layer to the kernel's
+       tls module after the handshake. once the kernel encrypts, frames go out as plain socket writes; without
+       the module, or with an OpenSSL built without kTLS, the same connection keeps encrypting in user space */
+    class kernel_tls : public inet::transport {
+    private:
+        boost::asio::ip::tcp::socket& stream_socket;
+        SSL* ssl{nullptr};
+        bool kernel_send{false};
+        bool kernel_receive{false};
+        size_t read_length{0};
+        size_t write_length{0};
+
+        /* reruns operation whenever OpenSSL waits for the socket; ends with eof on close_notify */
+        void drive(std::function<int()> operation, std::function<void(const boost::system::error_code&)> done) {
+            ERR_clear_error();
+
+            auto result{operation()};
+
+            if (result > 0) {
+                done({});
+
+                return;
+            }
+
+            auto error{SSL_get_error(this->ssl, result)};
+
+            if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) {
+                auto wait{error == SSL_ERROR_WANT_READ ? boost::asio::socket_base::wait_read : boost::asio::socket_base::wait_write};
+
+                this->stream_socket.async_wait(wait, [this, operation, done](const boost::system::error_code& ec) {
+                    if (ec) {
+                        done(ec);
+
+                        return;
+                    }
+
+                    this->drive(operation, done);
+                });
+
+                return;
+            }
 
-        while (true) {
+            if (error == SSL_ERROR_ZERO_RETURN) {
+                done(boost::asio::error::eof);
+            } else if (auto code{ERR_get_error()}) {
+                done(boost::system::error_code(static_cast<int>(code), boost::asio::error::get_ssl_category()));
+            } else {
+                done(boost::system::error_code(errno ? errno : ECONNRESET, boost::system::system_category()));
+            }
+        }
+    public:
+        kernel_tls(boost::asio::ip::tcp::socket& stream_socket, SSL_CTX* context) : stream_socket(stream_socket) {
+            this->ssl = SSL_new(context);
+
+            if (!this->ssl) {
+                throw std::runtime_error("failed to create the TLS session");
+            }
+
+            SSL_set_options(this->ssl, SSL_OP_ENABLE_KTLS);
+        }
+
+        ~kernel_tls() override {
+            SSL_free(this->ssl);
+        }
+
+        /* expects the socket connected */
+        void async_handshake(std::function<void(const boost::system::error_code&)> done) {
             boost::system::error_code ec;
-            boost::asio::streambuf streambuf;
-            boost::asio::read(ssl_stream, streambuf, ec);
+            this->stream_socket.non_blocking(true, ec);
 
-            if (ec && ec != boost::asio::error::eof && ec != boost::asio::ssl::error::stream_truncated) {
-                debug::print("inet", "failed to receive due to {}", ec.message());
-                inet::g_connection_fault.notify_all();
+            if (ec || SSL_set_fd(this->ssl, static_cast<int>(this->stream_socket.native_handle())) != 1) {
+                done(ec ? ec : boost::asio::error::bad_descriptor);
 
-                return false;
+                return;
             }
 
-            std::string buffer(boost::asio::buffer_cast<const char*>(streambuf.data()), streambuf.size());
-            auto eof{buffer.find("\0")};
+            this->drive([this]() { return SSL_connect(this->ssl); }, [this, done](const boost::system::error_code& ec) {
+                if (!ec) {
+                    this->kernel_send = BIO_get_ktls_send(SSL_get_wbio(this->ssl)) > 0;
+                    this->kernel_receive = BIO_get_ktls_recv(SSL_get_rbio(this->ssl)) > 0;
+                }
 
-            if (eof == std::string::npos) {
-                if (result_buffer.length() + buffer.length() >= config::field_maximum_receive_size) {
-                    debug::print("inet", "received passed the receive limit");
+                done(ec);
+            });
+        }
+
+        void async_write(std::string_view frames, inet::io_handler_t handler) override {
+            if (this->kernel_send) {
+                boost::asio::async_write(this->stream_socket, boost::asio::buffer(frames.data(), frames.length()), std::move(handler));
+
+                return;
+            }
+
+            // without partial writes enabled, SSL_write succeeds only once all of frames went out
+            this->drive([this, frames]() {
+                return SSL_write_ex(this->ssl, frames.data(), frames.length(), &this->write_length);
+            }, [this, handler](const boost::system::error_code& ec) {
+                handler(ec, ec ? 0 : this->write_length);
+            });
+        }
+
+        void async_read_some(boost::asio::mutable_buffer buffer, inet::io_handler_t handler) override {
+            this->drive([this, buffer]() {
+                return SSL_read_ex(this->ssl, buffer.data(), buffer.size(), &this->read_length);
+            }, [this, handler](const boost::system::error_code& ec) {
+                handler(ec, ec ? 0 : this->read_length);
+            });
+        }
 
-                    return false;
+        boost::asio::ip::tcp::socket& socket() override {
+            return this->stream_socket;
+        }
+
+        std::string mode() const override {
+            if (this->kernel_send) {
+                return this->kernel_receive ? "kernel" : "kernel for sending, user space for receiving";
+            }
+
+            return "user space; kTLS is unavailable, the tls module may not be loaded";
+        }
+
+        bool sends_in_kernel() const {
+            return this->kernel_send;
+        }
+
+        bool receives_in_kernel() const {
+            return this->kernel_receive;
+        }
+    };
+#endif
+
+    /* a connected and handshaken collector connection; the transport refers to the stream */
+    struct connection_t {
+        std::unique_ptr<inet::ssl_stream_t> stream{};
+        std::unique_ptr<inet::transport> transport{};
+        boost::asio::ip::tcp::endpoint endpoint{};
+    };
+
+    /* one endpoint's connect and handshake within a race */
+    struct attempt_t {
+        boost::asio::ip::tcp::endpoint endpoint{};
+        std::unique_ptr<inet::ssl_stream_t> stream{};
+    #ifdef SSL_OP_ENABLE_KTLS
+        std::unique_ptr<inet::kernel_tls> kernel{};
+    #endif
+        bool finished{false};
+    };
+
+    static std::atomic<uint64_t>& g_connect_attempts{metrics::counter("inet.connect.attempts")};
+    /* gauge: how long the last successful race took */
+    static std::atomic<uint64_t>& g_connect_ms{metrics::counter("inet.connect.last_ms")};
+
+    /* alternates address families, starting with the one the resolver put first, as RFC 8305 orders them */
+    static std::vector<boost::asio::ip::tcp::endpoint> interleave(const std::vector<boost::asio::ip::tcp::endpoint>& endpoints) {
+        std::vector<boost::asio::ip::tcp::endpoint> first{};
+        std::vector<boost::asio::ip::tcp::endpoint> second{};
+
+        for (auto&& endpoint : endpoints) {
+            (endpoint.address().is_v6() == endpoints.front().address().is_v6() ? first : second).push_back(endpoint);
+        }
+
+        std::vector<boost::asio::ip::tcp::endpoint> result{};
+
+        for (size_t i = 0; i < std::max(first.size(), second.size()); i++) {
+            if (i < first.size()) {
+                result.push_back(first[i]);
+            }
+
+            if (i < second.size()) {
+                result.push_back(second[i]);
+            }
+        }
+
+        return result;
+    }
+
+    /* Happy Eyeballs: starts an attempt every connect_attempt_delay_ms, or as soon as the previous one fails,
+       and keeps the first to complete its TLS handshake, through the kernel when kernel_tls is set. empty
+       when all fail, after g_handshake_timeout or once stop is requested */
+    static inet::connection_t race(boost::asio::io_context& io_context, boost::asio::ssl::context& context,
+        const std::vector<boost::asio::ip::tcp::endpoint>& endpoints, std::stop_token stop_token) {
+        const auto settings{config::current()};
+        const auto started{std::chrono::steady_clock::now()};
+        boost::asio::steady_timer deadline(io_context, inet::g_handshake_timeout);
+        boost::asio::steady_timer stagger(io_context);
+        std::vector<std::unique_ptr<inet::attempt_t>> attempts{};
+        inet::attempt_t* winner{nullptr};
+        size_t failed{0};
+        bool timed_out{false};
+
+    #ifndef SSL_OP_ENABLE_KTLS
+        if (settings->kernel_tls) {
+            debug::print("inet", "kernel_tls is set, but OpenSSL before 3.0 can't offload to the kernel; encrypting in user space");
+        }
+    #endif
+
+        for (auto&& endpoint : inet::interleave(endpoints)) {
+            attempts.push_back(std::make_unique<inet::attempt_t>(inet::attempt_t{.endpoint = endpoint}));
+        }
+
+        auto abort = [&attempts, &deadline, &stagger]() {
+            for (auto&& attempt : attempts) {
+                if (attempt->stream) {
+                    boost::system::error_code ec;
+                    attempt->stream->lowest_layer().close(ec);
                 }
+            }
+
+            deadline.cancel();
+            stagger.cancel();
+        };
+
+        std::function<void()> start_next{};
+
+        auto finish = [&](inet::attempt_t* attempt, const boost::system::error_code& ec) {
+            if (attempt->finished || winner) {
+                return;
+            }
+
+            attempt->finished = true;
+
+            if (!ec) {
+                winner = attempt;
+
+                // the losers are closed; their handlers still run and find the race decided
+                for (auto&& other : attempts) {
+                    if (other.get() != attempt && other->stream) {
+                        boost::system::error_code close_ec;
+                        other->stream->lowest_layer().close(close_ec);
+                    }
+                }
+
+                deadline.cancel();
+                stagger.cancel();
 
-                result_buffer += buffer;
+                return;
+            }
+
+            if (!stop_token.stop_requested() && !timed_out) {
+                debug::print("inet", "failed to connect to {}:{} due to {}", attempt->endpoint.address().to_string(), attempt->endpoint.port(), ec.message());
+            }
+
+            if (++failed == attempts.size()) {
+                deadline.cancel();
+                stagger.cancel();
             } else {
-                if (result_buffer.length() + eof >= config::field_maximum_receive_size) {
-                    debug::print("inet", "received passed the receive limit");
+                start_next();
+            }
+        };
+
+        start_next = [&]() {
+            auto next{std::find_if(attempts.begin(), attempts.end(), [](const std::unique_ptr<inet::attempt_t>& attempt) { return !attempt->stream; })};
+
+            if (winner || timed_out || next == attempts.end()) {
+                return;
+            }
 
-                    return false;
+            auto attempt{next->get()};
+            attempt->stream = std::make_unique<inet::ssl_stream_t>(io_context, context);
+
+        #ifdef SSL_OP_ENABLE_KTLS
+            if (settings->kernel_tls) {
+                attempt->kernel = std::make_unique<inet::kernel_tls>(attempt->stream->next_layer(), context.native_handle());
+            }
+        #endif
+
+            inet::g_connect_attempts++;
+
+            attempt->stream->lowest_layer().async_connect(attempt->endpoint, [attempt, &finish](const boost::system::error_code& ec) {
+                if (ec) {
+                    finish(attempt, ec);
+
+                    return;
                 }
 
-                result_buffer += std::string(buffer.begin(), buffer.begin() + (eof - 1));
-                break;
+            #ifdef SSL_OP_ENABLE_KTLS
+                if (attempt->kernel) {
+                    attempt->kernel->async_handshake([attempt, &finish](const boost::system::error_code& ec) { finish(attempt, ec); });
+
+                    return;
+                }
+            #endif
+
+                attempt->stream->async_handshake(boost::asio::ssl::stream_base::client, [attempt, &finish](const boost::system::error_code& ec) { finish(attempt, ec); });
+            });
+
+            stagger.expires_after(std::chrono::milliseconds(settings->connect_attempt_delay_ms));
+            stagger.async_wait([&start_next](const boost::system::error_code& ec) {
+                if (!ec) {
+                    start_next();
+                }
+            });
+        };
+
+        deadline.async_wait([&timed_out, &abort](const boost::system::error_code& ec) {
+            if (!ec) {
+                timed_out = true;
+                abort();
             }
+        });
+
+        if (!attempts.empty()) {
+            start_next();
         }
 
-        data = result_buffer;
+        {
+            std::stop_callback on_stop(stop_token, [&io_context, &abort]() { boost::asio::post(io_context, abort); });
 
-        return true;
+            io_context.restart();
+            io_context.run();
+        }
+
+        // an abort posted while run() returned
+        io_context.restart();
+        io_context.poll();
+
+        if (timed_out && !winner) {
+            debug::print("inet", "no TLS session within {} seconds", inet::g_handshake_timeout.count());
+        }
+
+        if (!winner || stop_token.stop_requested()) {
+            return {};
+        }
+
+        inet::g_connect_ms = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count());
+        inet::connection_t result{.stream = std::move(winner->stream), .endpoint = winner->endpoint};
+
+    #ifdef SSL_OP_ENABLE_KTLS
+        inet::g_kernel_send = winner->kernel && winner->kernel->sends_in_kernel() ? 1 : 0;
+        inet::g_kernel_receive = winner->kernel && winner->kernel->receives_in_kernel() ? 1 : 0;
+
+        if (winner->kernel) {
+            result.transport = std::move(winner->kernel);
+
+            return result;
+        }
+    #endif
+
+        result.transport = std::make_unique<inet::user_tls>(*result.stream);
+
+        return result;
     }
 
-    bool send_log(std::string log_identifier, int64_t log_timestamp, std::string log_data) {
-        if (!inet::g_connected || !inet::g_ssl_stream.has_value()) {
-            return false;
+    /* remote_address resolved, reused for dns_cache_ttl_s; only used on the connection thread */
+    struct resolved_t {
+        std::string host{};
+        uint16_t port{0};
+        std::vector<boost::asio::ip::tcp::endpoint> endpoints{};
+        std::chrono::steady_clock::time_point at{};
+    };
+
+    struct state_t {
+        /* the session whose stream every write goes to; set from start to teardown, connected once authenticated */
+        std::mutex session_lock{};
+        inet::session* session{nullptr};
+        std::atomic<bool> connected{false};
+        /* the collector accepted columnar batches at authentication */
+        std::atomic<bool> columnar{false};
+        std::mutex fault_lock{};
+        std::condition_variable_any fault{};
+        inet::resolved_t resolved{};
+    };
+
+    /* bound before the sinks start and until they stopped, so their threads never see it change */
+    static inet::state_t* g_state{nullptr};
+
+    static std::atomic<uint64_t>& g_dns_lookups{metrics::counter("inet.dns.lookups")};
+    static std::atomic<uint64_t>& g_dns_cache_hits{metrics::counter("inet.dns.cache_hits")};
+    static std::atomic<uint64_t>& g_dns_stale{metrics::counter("inet.dns.stale")};
+
+    /* the cached endpoints while they're younger than dns_cache_ttl_s, otherwise a fresh lookup; a failed
+       lookup falls back to the stale ones. cached tells whether no lookup was made */
+    static std::vector<boost::asio::ip::tcp::endpoint> resolve(boost::asio::io_context& io_context, bool& cached) {
+        const auto settings{config::current()};
+        const auto now{std::chrono::steady_clock::now()};
+        auto& entry{inet::g_state->resolved};
+        bool same{entry.host == settings->remote_address && entry.port == settings->remote_port && !entry.endpoints.empty()};
+
+        cached = same && now - entry.at < std::chrono::seconds(settings->dns_cache_ttl_s);
+
+        if (cached) {
+            inet::g_dns_cache_hits++;
+
+            return entry.endpoints;
         }
 
-        nlohmann::json data_json = {
-            {"command", "log"},
-            {"data", {
-                {"identifier", log_identifier},
-                {"timestamp", log_timestamp},
-                {"message", log_data},
-            }},
-        };
+        inet::g_dns_lookups++;
 
-        auto data_json_str{data_json.dump()};
+        try {
+            boost::asio::ip::tcp::resolver resolver(io_context);
+            std::vector<boost::asio::ip::tcp::endpoint> endpoints{};
 
-        if (!inet::send(data_json_str)) {
-            debug::print("inet", "failed to send log");
-            inet::g_connection_fault.notify_all();
+            for (auto&& result : resolver.resolve(settings->remote_address, std::to_string(settings->remote_port))) {
+                endpoints.push_back(result.endpoint());
+            }
 
-            return false;
+            entry = inet::resolved_t{
+                .host = settings->remote_address,
+                .port = settings->remote_port,
+                .endpoints = std::move(endpoints),
+                .at = now,
+            };
+
+            return entry.endpoints;
+        } catch (const std::exception& e) {
+            if (!same) {
+                throw;
+            }
+
+            debug::print("inet", "failed to resolve '{}' due to {}; using the addresses resolved before", settings->remote_address, e.what());
+            inet::g_dns_stale++;
+            cached = true;
+
+            return entry.endpoints;
         }
+    }
 
-        return true;
+    /* the next lookup goes to the resolver */
+    static void forget_resolved() {
+        inet::g_state->resolved.endpoints.clear();
     }
 
-    static bool client_authenticate() {
-        nlohmann::json authenticate_json = {
-            {"command", "auth"},
-            {"identity", config::field_identity},
-            {"data", {
-                {"password", config::field_identity_password},
-            }},
-        };
+    /* a write waiting for its turn on the stream; done is null for the session's own frames */
+    struct outgoing_t {
+        std::string_view frames{};
+        std::promise<bool>* done{nullptr};
+        bool ping{false};
+    };
 
-        std::string authenticate_json_str{authenticate_json.dump()};
+    /* one authenticated connection; every operation on the stream runs on the connection thread,
+       so log writes of the sinks, pings and reads never overlap */
+    class session {
+    private:
+        boost::asio::io_context& io_context;
+        inet::transport& transport;
+        boost::asio::steady_timer timer;
+        std::shared_ptr<const config::snapshot_t> settings{};
+        std::deque<inet::outgoing_t> outbox{};
+        bool writing{false};
+        bool closed{false};
+        bool established{false};
+        bool heartbeat{false};
+        std::string inbox{};
+        std::array<char, 16 * 1024> buffer{};
+        std::string auth_frame{};
+        std::string ping_frame{};
+        bool ping_queued{false};
+        uint64_t sequence{0};
+        std::chrono::steady_clock::time_point ping_sent{};
+        std::chrono::steady_clock::time_point last_received{};
 
-        if (!inet::send(authenticate_json_str)) {
-            debug::print("inet", "failed to authenticate");
+        void complete(const inet::outgoing_t& item, bool written) {
+            if (item.done) {
+                item.done->set_value(written);
+            } else if (item.ping) {
+                this->ping_queued = false;
+                this->ping_sent = std::chrono::steady_clock::now();
+            }
+        }
 
-            return false;
+        void pump() {
+            if (this->writing || this->closed || this->outbox.empty()) {
+                return;
+            }
+
+            this->writing = true;
+
+            this->transport.async_write(this->outbox.front().frames, [this](const boost::system::error_code& ec, size_t) {
+                auto item{this->outbox.front()};
+
+                this->writing = false;
+                this->outbox.pop_front();
+
+                if (ec) {
+                    if (!this->closed) {
+                        debug::print("inet", "failed to send due to {}", ec.message());
+                    }
+
+                    this->complete(item, false);
+                    this->close();
+
+                    return;
+                }
+
+                this->complete(item, true);
+                this->pump();
+            });
+        }
+
+        void read() {
+            this->transport.async_read_some(boost::asio::buffer(this->buffer), [this](const boost::system::error_code& ec, size_t length) {
+                if (ec) {
+                    if (!this->closed && ec != boost::asio::error::eof && ec != boost::asio::ssl::error::stream_truncated) {
+                        debug::print("inet", "failed to receive due to {}", ec.message());
+                    }
+
+                    this->close();
+
+                    return;
+                }
+
+                this->inbox.append(this->buffer.data(), length);
+
+                // frames are NUL-terminated, and one read may end in the middle of one
+                size_t start{0};
+
+                for (auto end{this->inbox.find('\0')}; end != std::string::npos; end = this->inbox.find('\0', start)) {
+                    this->receive(std::string_view(this->inbox).substr(start, end - start));
+                    start = end + 1;
+
+                    if (this->closed) {
+                        return;
+                    }
+                }
+
+                this->inbox.erase(0, start);
+
+                if (this->inbox.length() >= this->settings->maximum_receive_size) {
+                    debug::print("inet", "received passed the receive limit");
+                    this->close();
+
+                    return;
+                }
+
+                this->read();
+            });
         }
 
-        std::string server_result_str{};
+        void receive(std::string_view frame) {
+            this->last_received = std::chrono::steady_clock::now();
+
+            auto message = nlohmann::json::parse(frame, nullptr, false);
+
+            if (!this->established) {
+                this->authenticate(message);
+
+                return;
+            }
+
+            if (message.is_object() && message.contains("pong") && message["pong"].is_number_unsigned()
+                && message["pong"].get<uint64_t>() == this->sequence && !this->ping_queued) {
+                auto sample{static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(this->last_received - this->ping_sent).count())};
+                auto smoothed{inet::g_rtt_us.load()};
+
+                // as TCP smooths its own round trip, RFC 6298
+                inet::g_rtt_us = smoothed ? (smoothed * 7 + sample) / 8 : sample;
+
+                if (sample > inet::g_rtt_max_us.load()) {
+                    inet::g_rtt_max_us = sample;
+                }
+            }
+        }
+
+        void authenticate(const nlohmann::json& message) {
+            try {
+                if (message.is_object() && message.contains("auth") && message["auth"] == "authenticated") {
+                    inet::g_state->columnar = this->settings->columnar_batches && message.value("encoding", "json") == "columnar";
+                    this->heartbeat = this->settings->heartbeat_interval_ms > 0 && message.value("heartbeat", false);
+                    this->established = true;
+                    inet::g_rtt_us = 0;
+                    inet::g_state->connected = true;
+
+                    debug::print("inet", "authenticated; shipping {}, {}", inet::g_state->columnar ? "columnar batches" : "log commands",
+                        this->heartbeat ? "with heartbeats" : "without heartbeats");
+
+                    if (this->heartbeat) {
+                        this->schedule(std::chrono::milliseconds(this->settings->heartbeat_interval_ms));
+                    } else {
+                        this->timer.cancel();
+                    }
+
+                    return;
+                }
+            } catch (const std::exception& e) {
+                debug::print("inet", "failed to authenticate due to exception: {}", e.what());
+            }
 
-        if (!inet::receive(server_result_str)) {
             debug::print("inet", "failed to authenticate");
+            this->close();
+        }
 
-            return false;
+        void schedule(std::chrono::steady_clock::duration after) {
+            this->timer.expires_after(after);
+            this->timer.async_wait([this](const boost::system::error_code& ec) {
+                if (!ec && !this->closed) {
+                    this->tick();
+                }
+            });
         }
 
-        try {
-            auto server_result{nlohmann::json::parse(server_result_str)};
+        void tick() {
+            if (!this->established) {
+                debug::print("inet", "no answer to authentication within {} seconds", inet::g_handshake_timeout.count());
+                this->close();
 
-            if (server_result.contains("auth") && server_result["auth"] == "authenticated") {
-                return true;
+                return;
             }
-        } catch (const std::exception& e) {
-            debug::print("inet", "failed to authenticate due to exception: {}", e.what());
+
+            if (!this->heartbeat) {
+                return;
+            }
+
+            const auto interval{std::chrono::milliseconds(this->settings->heartbeat_interval_ms)};
+            const auto silence{std::chrono::steady_clock::now() - this->last_received};
+
+            if (silence >= interval * std::max<int64_t>(this->settings->heartbeat_missed, 1)) {
+                debug::print("inet", "nothing from the collector for {} ms; dropping the connection",
+                    std::chrono::duration_cast<std::chrono::milliseconds>(silence).count());
+                inet::g_heartbeat_timeouts++;
+                this->close();
+
+                return;
+            }
+
+            // a ping still waiting behind stuck writes isn't doubled; the silence catches those
+            if (!this->ping_queued) {
+                auto data{R"({"sequence":)" + std::to_string(++this->sequence) + "}"};
+
+                this->ping_frame.clear();
+                inet::append_prefix(this->ping_frame, "ping", data);
+                this->ping_frame.append(data);
+                this->ping_frame.push_back('}');
+                this->ping_frame.push_back(0);
+                this->ping_queued = true;
+                inet::g_heartbeat_sent++;
+
+                this->enqueue({.frames = this->ping_frame, .ping = true});
+            }
+
+            this->schedule(interval);
+        }
+    public:
+        session(boost::asio::io_context& io_context, inet::transport& transport)
+            : io_context(io_context), transport(transport), timer(io_context), settings(config::current()) {}
+
+        boost::asio::io_context& context() {
+            return this->io_context;
+        }
+
+        /* on the connection thread; writes after close fail at once */
+        void enqueue(const inet::outgoing_t& item) {
+            if (this->closed) {
+                this->complete(item, false);
+
+                return;
+            }
+
+            this->outbox.push_back(item);
+            this->pump();
+        }
+
+        /* on the connection thread; fails every write but the one in flight, which its handler fails */
+        void close() {
+            if (this->closed) {
+                return;
+            }
+
+            this->closed = true;
+            inet::g_state->connected = false;
+
+            for (auto i{this->writing ? size_t{1} : size_t{0}}; i < this->outbox.size(); i++) {
+                this->complete(this->outbox[i], false);
+            }
+
+            this->outbox.resize(this->writing ? 1 : 0);
+            this->timer.cancel();
+
+            boost::system::error_code ec;
+            this->transport.socket().close(ec);
         }
 
-        return false;
+        /* authenticates and serves the connection until it fails, stop is requested or reconnect() is called;
+           true when it got as far as authenticating */
+        bool run(std::stop_token stop_token) {
+            inet::set_keepalive(this->transport.socket(), this->settings->tcp_keepalive_s);
+
+            nlohmann::json authenticate_json = {
+                {"command", "auth"},
+                {"identity", this->settings->identity},
+                {"data", {
+                    {"password", this->settings->identity_password},
+                }},
+            };
+
+            // the collector picks one of the encodings offered and accepts heartbeats or not;
+            // one that doesn't answer keeps log commands and is only watched by TCP keepalive
+            if (this->settings->columnar_batches) {
+                authenticate_json["data"]["encodings"] = {"json", "columnar"};
+            }
+
+            if (this->settings->heartbeat_interval_ms > 0) {
+                authenticate_json["data"]["heartbeat_ms"] = this->settings->heartbeat_interval_ms;
+            }
+
+            inet::g_state->columnar = false;
+            this->auth_frame = authenticate_json.dump();
+            this->auth_frame.push_back(0);
+            this->last_received = std::chrono::steady_clock::now();
+
+            {
+                const std::lock_guard<std::mutex> _lock(inet::g_state->session_lock);
+                inet::g_state->session = this;
+            }
+
+            {
+                std::stop_callback on_stop(stop_token, [this]() {
+                    boost::asio::post(this->io_context, [this]() { this->close(); });
+                });
+
+                this->enqueue({.frames = this->auth_frame});
+                this->read();
+                this->schedule(inet::g_handshake_timeout);
+
+                this->io_context.restart();
+                this->io_context.run();
+            }
+
+            {
+                const std::lock_guard<std::mutex> _lock(inet::g_state->session_lock);
+                inet::g_state->session = nullptr;
+            }
+
+            // writes posted while run() returned fail now, before the session goes away
+            this->close();
+            this->io_context.restart();
+            this->io_context.run();
+
+            return this->established;
+        }
+    };
+
+    /* closes the current session from any thread */
+    static void fault() {
+        const std::lock_guard<std::mutex> _lock(inet::g_state->session_lock);
+
+        if (inet::g_state->session) {
+            auto session{inet::g_state->session};
+            boost::asio::post(session->context(), [session]() { session->close(); });
+        }
     }
 
-    static void client_procedure() {
-        if (!inet::client_authenticate()) {
-            return;
+    /* writes already framed, NUL-terminated commands through the connection thread; false once the session closed */
+    static bool write(const std::string& frames) {
+        std::promise<bool> done{};
+        auto written{done.get_future()};
+
+        {
+            const std::lock_guard<std::mutex> _lock(inet::g_state->session_lock);
+
+            if (!inet::g_state->session || !inet::g_state->connected) {
+                return false;
+            }
+
+            auto session{inet::g_state->session};
+            boost::asio::post(session->context(), [session, &frames, &done]() {
+                session->enqueue({.frames = frames, .done = &done});
+            });
+        }
+
+        return written.get();
+    }
+
+    /* what the records would take as log commands, against what they took as columnar batches */
+    static std::atomic<uint64_t>& g_plain_bytes{metrics::counter("inet.columnar.plain_bytes")};
+    static std::atomic<uint64_t>& g_encoded_bytes{metrics::counter("inet.columnar.encoded_bytes")};
+
+    /* sends records [first, last) as log commands, coalesced into writes of up to write_size() */
+    static size_t send_commands(const xlog::sinks::records_t& records, size_t first, size_t last) {
+        const auto maximum_write_size{inet::write_size()};
+        std::string frames{};
+        size_t sent{0};
+        auto i{first};
+
+        while (i < last) {
+            size_t framed{0};
+            frames.clear();
+
+            // records are already serialized, so framing is just concatenation
+            while (i < last && (framed == 0 || frames.length() + records[i].length() < maximum_write_size)) {
+                inet::append_prefix(frames, "log", records[i]);
+                frames.append(records[i]);
+                frames.push_back('}');
+                frames.push_back(0);
+                framed++;
+                i++;
+            }
+
+            if (!inet::write(frames)) {
+                debug::print("inet", "failed to send log");
+
+                break;
+            }
+
+            sent += framed;
+        }
+
+        return sent;
+    }
+
+    /* sends one encoded columnar batch as a log_batch command */
+    static bool send_batch(const std::string& batch, size_t plain_bytes) {
+        std::string frame{};
+        frame.reserve(batch.length() + 64);
+        inet::append_prefix(frame, "log_batch", batch);
+        frame.append(batch);
+        frame.push_back('}');
+        frame.push_back(0);
+
+        if (!inet::write(frame)) {
+            debug::print("inet", "failed to send log batch");
+
+            return false;
         }
 
-        debug::print("inet", "authenticated");
+        inet::g_plain_bytes += plain_bytes;
+        inet::g_encoded_bytes += frame.length();
 
-        std::unique_lock connection_fault_lock(inet::g_connection_fault_mutex);
-        inet::g_connection_fault.wait(connection_fault_lock);
+        return true;
     }
 
-    bool connect() {
-        while (true) {
+    size_t send_logs(const xlog::sinks::records_t& records, size_t offset) {
+        static constexpr size_t command_overhead{std::string_view(R"({"command":"log","crc32c":4294967295,"data":})").length() + 1};
+
+        if (!inet::g_state || !inet::g_state->connected) {
+            return 0;
+        }
+
+        if (!inet::g_state->columnar) {
+            return inet::send_commands(records, offset, records.size());
+        }
+
+        const auto maximum_write_size{inet::write_size()};
+        std::string batch{};
+        size_t sent{0};
+        auto i{offset};
+
+        // batches cover about as many records as one write of log commands would
+        while (i < records.size()) {
+            auto first{i};
+            size_t plain_bytes{0};
+
+            while (i < records.size() && (i == first || plain_bytes + records[i].length() < maximum_write_size)) {
+                plain_bytes += records[i].length() + command_overhead;
+                i++;
+            }
+
+            if (columnar::encode(records, first, i, batch)) {
+                if (!inet::send_batch(batch, plain_bytes)) {
+                    break;
+                }
+
+                sent += i - first;
+                continue;
+            }
+
+            // records the encoder can't take still go out, one command each
+            auto commands{inet::send_commands(records, first, i)};
+            sent += commands;
+
+            if (commands < i - first) {
+                break;
+            }
+        }
+
+        return sent;
+    }
+
+    std::shared_ptr<inet::state_t> create() {
+        return std::make_shared<inet::state_t>();
+    }
+
+    void bind(inet::state_t* state) {
+        inet::g_state = state;
+    }
+
+    void reconnect() {
+        if (inet::g_state && inet::g_state->connected) {
+            debug::print("inet", "reconnecting with the new settings");
+            inet::fault();
+        }
+    }
+
+    bool connect(std::stop_token stop_token) {
+        while (!stop_token.stop_requested()) {
             boost::asio::io_context io_context;
+            bool retry_now{false};
+            const auto settings{config::current()};
 
-            if (!std::filesystem::exists(config::field_remote_certificate)) {
-                debug::print("inet", "missing PEM '{}'", config::field_remote_certificate);
+            if (!std::filesystem::exists(settings->remote_certificate)) {
+                debug::print("inet", "missing PEM '{}'", settings->remote_certificate);
 
                 return false;
             }
 
             try {
-                debug::print("inet", "connecting to '{}:{}' with PEM '{}'", config::field_remote_address, config::field_remote_port, config::field_remote_certificate);
+                debug::print("inet", "connecting to '{}:{}' with PEM '{}'", settings->remote_address, settings->remote_port, settings->remote_certificate);
 
-                boost::asio::ip::tcp::resolver resolver(io_context);
-                auto endpoints{resolver.resolve(config::field_remote_address, std::to_string(config::field_remote_port))};
+                bool cached{false};
+                auto endpoints{inet::resolve(io_context, cached)};
 
-                for (auto endpoint : endpoints) {
-                    auto remote_address{endpoint.endpoint().address().to_string()};
-                    auto remote_port{endpoint.endpoint().port()};
+                boost::asio::ssl::context ctx(boost::asio::ssl::context::sslv23);
+                ctx.set_default_verify_paths();
 
-                    boost::asio::ssl::context ctx(boost::asio::ssl::context::sslv23);
-                    boost::asio::ssl::stream<boost::asio::ip::tcp::socket> ssl_stream(io_context, ctx);
+                auto connection{inet::race(io_context, ctx, endpoints, stop_token)};
 
-                    ctx.set_default_verify_paths();
-
-                    try {
-                        ssl_stream.lowest_layer().connect(endpoint);
-                        ssl_stream.handshake(boost::asio::ssl::stream_base::client);
-                    } catch (const std::exception& e) {
-                        debug::print("inet", "failed to connect to {}:{}", remote_address, remote_port);
-                        continue;
+                if (!connection.transport) {
+                    // the collector may have moved; addresses from the cache are looked up again right away
+                    if (cached && !stop_token.stop_requested()) {
+                        debug::print("inet", "no cached address of '{}' answered; resolving it again", settings->remote_address);
+                        inet::forget_resolved();
+                        retry_now = true;
                     }
+                } else {
+                    debug::print("inet", "connected to {}:{} in {} ms, TLS records encrypted in {}", connection.endpoint.address().to_string(),
+                        connection.endpoint.port(), inet::g_connect_ms.load(), connection.transport->mode());
 
-                    debug::print("inet", "connected to {}:{}", remote_address, remote_port);
+                    auto started{std::chrono::steady_clock::now()};
+                    auto established{inet::session(io_context, *connection.transport).run(stop_token)};
 
-                    inet::g_ssl_stream = ssl_stream;
-                    inet::g_connected = true;
-                    inet::client_procedure();
-                    inet::g_connected = false;
-                    inet::g_ssl_stream = std::nullopt;
                     debug::print("inet", "stream closed");
 
-                    break;
+                    // a connection that was up for a while is retried at once, so a dead one costs seconds
+                    // rather than a full wait; one that drops right after connecting waits as usual
+                    retry_now = established && std::chrono::steady_clock::now() - started >= std::chrono::seconds(settings->seconds_between_connects);
                 }
             } catch (const std::exception& e) {
                 debug::print("inet", "exception occured: {}; trying again after 10 seconds", e.what());
-                inet::g_connected = false;
+                inet::g_state->connected = false;
+            }
+
+            if (stop_token.stop_requested()) {
+                break;
             }
 
-            debug::print("inet", "waiting {} seconds till next attempt", config::field_seconds_between_connects);
-            std::this_thread::sleep_for(std::chrono::seconds(config::field_seconds_between_connects));
+            if (retry_now) {
+                continue;
+            }
+
+            debug::print("inet", "waiting {} seconds till next attempt", settings->seconds_between_connects);
+
+            std::unique_lock wait_lock(inet::g_state->fault_lock);
+            inet::g_state->fault.wait_for(wait_lock, stop_token, std::chrono::seconds(settings->seconds_between_connects), []() { return false; });
         }
+
+        return true;
     }
 }
\ No newline at end of file
@@ -1,11 +1,30 @@
 #ifndef __INET_HPP
 #define __INET_HPP
 
+#include <cstddef>
+#include <memory>
+#include <stop_token>
 #include <string>
+#include "xlog.hpp"
 
 namespace inet {
-    bool send_log(std::string log_identifier, int64_t log_timestamp, std::string log_data);
-    bool connect();
+    /* the connection of one agent::instance, which owns it */
+    struct state_t;
+    std::shared_ptr<inet::state_t> create();
+
+    /* makes the functions below work on state, or on none with nullptr; the instance binds its own
+       before the sinks start and releases it once they stopped */
+    void bind(inet::state_t* state);
+
+    /* sends records from offset on as log commands, coalescing them into few writes;
+       returns how many were sent */
+    size_t send_logs(const xlog::sinks::records_t& records, size_t offset);
+
+    /* keeps a connection up until stop is requested; false when it can't even try */
+    bool connect(std::stop_token stop_token);
+
+    /* drops the current connection so the next attempt picks up changed settings */
+    void reconnect();
 }
 
 #endif
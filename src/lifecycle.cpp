@@ -0,0 +1,81 @@
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include "debug.hpp"
+#include "lifecycle.hpp"
+
+namespace lifecycle {
+    static std::mutex g_lock{};
+    static std::condition_variable g_requested_condition{};
+    static bool g_requested{false};
+
+    void request() {
+        {
+            const std::lock_guard<std::mutex> _lock(lifecycle::g_lock);
+            lifecycle::g_requested = true;
+        }
+
+        lifecycle::g_requested_condition.notify_all();
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> _lock(lifecycle::g_lock);
+        lifecycle::g_requested_condition.wait(_lock, []() { return lifecycle::g_requested; });
+    }
+
+#ifdef _WIN32
+    /* runs on a thread of its own, so it can take locks */
+    static BOOL WINAPI console_handler(DWORD control_type) {
+        debug::print("lifecycle", "received console event {}", control_type);
+        lifecycle::request();
+
+        return TRUE;
+    }
+
+    bool prepare() {
+        if (!SetConsoleCtrlHandler(lifecycle::console_handler, TRUE)) {
+            debug::print("lifecycle", "failed to set console handler, error: 0x{:08X}", GetLastError());
+
+            return false;
+        }
+
+        return true;
+    }
+#else
+    static sigset_t g_signals{};
+
+    bool prepare() {
+        sigemptyset(&lifecycle::g_signals);
+        sigaddset(&lifecycle::g_signals, SIGTERM);
+        sigaddset(&lifecycle::g_signals, SIGINT);
+
+        // threads inherit the mask, so the signals stay pending until sigwait() picks them up
+        auto result{pthread_sigmask(SIG_BLOCK, &lifecycle::g_signals, nullptr)};
+
+        if (result != 0) {
+            debug::print("lifecycle", "failed to block termination signals, error: {}", std::strerror(result));
+
+            return false;
+        }
+
+        std::thread([]() {
+            int signal_number{0};
+
+            if (sigwait(&lifecycle::g_signals, &signal_number) == 0) {
+                debug::print("lifecycle", "received signal {}", signal_number);
+                lifecycle::request();
+            }
+        }).detach();
+
+        return true;
+    }
+#endif
+}
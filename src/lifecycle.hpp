@@ -0,0 +1,16 @@
+#ifndef __LIFECYCLE_HPP
+#define __LIFECYCLE_HPP
+
+/* termination requests: SIGTERM and SIGINT, or console close events on Windows */
+namespace lifecycle {
+    /* blocks the termination signals so only wait() receives them; call before any thread starts */
+    bool prepare();
+
+    /* returns once termination was requested */
+    void wait();
+
+    /* requests termination from inside the process */
+    void request();
+}
+
+#endif
@@ -0,0 +1,43 @@
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "linesplitter.hpp"
+
+linesplitter::linesplitter(size_t maximum_line_length) : maximum_line_length(maximum_line_length) {}
+
+void linesplitter::feed(std::string_view data, std::vector<std::string>& lines) {
+    while (!data.empty()) {
+        auto newline{static_cast<const char*>(std::memchr(data.data(), '\n', data.size()))};
+        auto length{newline ? static_cast<size_t>(newline - data.data()) : data.size()};
+
+        for (auto chr : data.substr(0, length)) {
+            if (!chr) { continue; }
+            if (chr == '\r') { continue; }
+
+            this->partial.push_back(chr);
+        }
+
+        if (newline || this->partial.length() >= this->maximum_line_length) {
+            lines.push_back(std::move(this->partial));
+            this->partial.clear();
+        }
+
+        data.remove_prefix(newline ? length + 1 : length);
+    }
+}
+
+bool linesplitter::flush(std::string& line) {
+    if (this->partial.empty()) {
+        return false;
+    }
+
+    line = std::move(this->partial);
+    this->partial.clear();
+
+    return true;
+}
+
+size_t linesplitter::pending() const {
+    return this->partial.length();
+}
@@ -0,0 +1,26 @@
+#ifndef __LINESPLITTER_HPP
+#define __LINESPLITTER_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* splits a byte stream into lines; NUL and CR bytes are dropped and an unterminated
+   tail is kept until the rest of the line arrives */
+class linesplitter {
+private:
+    std::string partial{};
+    size_t maximum_line_length{};
+public:
+    linesplitter(size_t maximum_line_length = 1024 * 1024);
+
+    void feed(std::string_view data, std::vector<std::string>& lines);
+
+    /* hands out the unterminated tail, if any */
+    bool flush(std::string& line);
+
+    size_t pending() const;
+};
+
+#endif
@@ -1,35 +1,15 @@
-#include <chrono>
-#include <iostream>
-#include <thread>
-#include "debug.hpp"
-#include "config.hpp"
-#include "xlog.hpp"
-#include "inet.hpp"
+#include "agent.hpp"
+#include "lifecycle.hpp"
 
 int main() {
-    if (!debug::initialize()) {
-        std::cerr << "failed to initialize the debug module; aborting!";
+    agent::instance instance{agent::options{}};
+    auto result{instance.start()};
 
-        return -1;
+    if (result != 0) {
+        return result;
     }
 
-    debug::print("app", "############## STARTED ##############");
+    lifecycle::wait();
 
-    if (!config::initialize()) {
-        return -2;
-    }
-
-    if (!xlog::queue::start()) {
-        return -3;
-    }
-
-    if (!xlog::initialize()) {
-        return -4;
-    }
-
-    inet::connect();
-
-    // for (;;) {std::this_thread::sleep_for(std::chrono::seconds(10));}
-
-    // return 0;
+    return instance.stop() ? 1 : 0;
 }
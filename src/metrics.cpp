@@ -0,0 +1,74 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include "config.hpp"
+#include "debug.hpp"
+#include "metrics.hpp"
+
+namespace metrics {
+    struct registry {
+        std::mutex lock{};
+        /* ordered so that the dump groups related counters together */
+        std::map<std::string, std::unique_ptr<std::atomic<uint64_t>>> counters{};
+    };
+
+    /* constructed on first use, so counters can be registered from static initializers of other files */
+    static metrics::registry& get_registry() {
+        static metrics::registry instance{};
+
+        return instance;
+    }
+
+    std::atomic<uint64_t>& counter(const std::string& name) {
+        auto& registry{metrics::get_registry()};
+        const std::lock_guard<std::mutex> _lock(registry.lock);
+
+        auto& entry{registry.counters[name]};
+
+        if (!entry) {
+            entry = std::make_unique<std::atomic<uint64_t>>(0);
+        }
+
+        return *entry;
+    }
+
+    void dump() {
+        auto& registry{metrics::get_registry()};
+        const std::lock_guard<std::mutex> _lock(registry.lock);
+
+        for (auto&& [name, value] : registry.counters) {
+            debug::print("metrics", "{}: {}", name, value->load());
+        }
+    }
+
+    static void worker(std::stop_token stop_token) {
+        std::mutex wait_lock{};
+        std::condition_variable_any wait_condition{};
+        std::unique_lock<std::mutex> _lock(wait_lock);
+
+        while (!stop_token.stop_requested()) {
+            wait_condition.wait_for(_lock, stop_token, std::chrono::seconds(config::current()->metrics_interval_s), []() { return false; });
+
+            if (!stop_token.stop_requested()) {
+                metrics::dump();
+            }
+        }
+    }
+
+    std::jthread start() {
+        if (config::current()->metrics_interval_s <= 0) {
+            debug::print("metrics", "periodic dump disabled");
+
+            return std::jthread{};
+        }
+
+        return std::jthread(metrics::worker);
+    }
+}
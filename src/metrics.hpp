@@ -0,0 +1,20 @@
+#ifndef __METRICS_HPP
+#define __METRICS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+/* named process-wide counters, written to the debug output every metrics_interval_s */
+namespace metrics {
+    /* the thread writing them, which the agent::instance owns; not joinable when metrics_interval_s is 0 */
+    std::jthread start();
+
+    /* registers the counter on first use; the reference stays valid for the lifetime of the process */
+    std::atomic<uint64_t>& counter(const std::string& name);
+
+    void dump();
+}
+
+#endif
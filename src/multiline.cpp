@@ -0,0 +1,69 @@
+#include <chrono>
+#include <regex>
+#include <string>
+#include <vector>
+#include "multiline.hpp"
+
+multiline::multiline(const multiline_options& options) : options(options) {
+    this->match_starts = !options.start_pattern.empty();
+
+    const auto& pattern{this->match_starts ? options.start_pattern : options.continuation_pattern};
+    this->pattern = std::regex(pattern, std::regex::ECMAScript | std::regex::optimize);
+}
+
+void multiline::finish(std::vector<std::string>& events) {
+    if (!this->event_lines) {
+        return;
+    }
+
+    events.push_back(std::move(this->event));
+    this->event.clear();
+    this->event_lines = 0;
+}
+
+void multiline::feed(std::vector<std::string>& lines, std::vector<std::string>& events) {
+    for (auto&& line : lines) {
+        bool matched{std::regex_search(line, this->pattern)};
+        bool starts_event{this->match_starts ? matched : !matched};
+
+        if (starts_event
+            || this->event_lines >= this->options.maximum_lines
+            || this->event.length() + line.length() + 1 > this->options.maximum_bytes) {
+            this->finish(events);
+        }
+
+        if (!this->event_lines) {
+            this->event = std::move(line);
+        } else {
+            this->event.push_back('\n');
+            this->event += line;
+        }
+
+        this->event_lines++;
+        this->event_updated = std::chrono::steady_clock::now();
+    }
+
+    lines.clear();
+}
+
+bool multiline::flush(std::vector<std::string>& events, bool force) {
+    if (!this->event_lines) {
+        return false;
+    }
+
+    if (!force && std::chrono::steady_clock::now() - this->event_updated < std::chrono::milliseconds(this->options.flush_timeout_ms)) {
+        return false;
+    }
+
+    this->finish(events);
+
+    return true;
+}
+
+bool multiline::pending() const {
+    return this->event_lines > 0;
+}
+
+int64_t multiline::flush_timeout_ms() const {
+    return this->options.flush_timeout_ms;
+}
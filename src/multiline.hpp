@@ -0,0 +1,47 @@
+#ifndef __MULTILINE_HPP
+#define __MULTILINE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <regex>
+#include <string>
+#include <vector>
+
+struct multiline_options {
+    /* a line matching start begins a new event; otherwise it's appended to the current one */
+    std::string start_pattern{};
+    /* a line matching continuation is appended to the current event; otherwise it begins a new one */
+    std::string continuation_pattern{};
+    size_t maximum_lines{500};
+    size_t maximum_bytes{64 * 1024};
+    int64_t flush_timeout_ms{1000};
+};
+
+/* merges related lines (stack traces, continuation lines) into single events joined by '\n' */
+class multiline {
+private:
+    multiline_options options{};
+    std::regex pattern{};
+    bool match_starts{true};
+
+    std::string event{};
+    size_t event_lines{0};
+    std::chrono::steady_clock::time_point event_updated{};
+
+    void finish(std::vector<std::string>& events);
+public:
+    /* throws std::regex_error on an invalid pattern */
+    multiline(const multiline_options& options);
+
+    /* consumes lines and appends every completed event */
+    void feed(std::vector<std::string>& lines, std::vector<std::string>& events);
+
+    /* hands out the open event once no line was added for flush_timeout_ms, or right away when forced */
+    bool flush(std::vector<std::string>& events, bool force = false);
+
+    bool pending() const;
+    int64_t flush_timeout_ms() const;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include <cstddef>
+#include <regex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "namedregex.hpp"
+
+namedregex::namedregex(const std::string& pattern) {
+    std::string translated{};
+    translated.reserve(pattern.length());
+
+    size_t group{0};
+    bool in_class{false};
+
+    for (size_t i{0}; i < pattern.length(); i++) {
+        char c{pattern[i]};
+
+        if (c == '\\') {
+            translated.push_back(c);
+
+            if (i + 1 < pattern.length()) {
+                translated.push_back(pattern[++i]);
+            }
+
+            continue;
+        }
+
+        if (in_class) {
+            in_class = c != ']';
+            translated.push_back(c);
+            continue;
+        }
+
+        /* unlike POSIX, ECMAScript ends a class at a leading ']': '[]' matches nothing and '[^]' anything */
+        if (c == '[') {
+            in_class = true;
+            translated.push_back(c);
+            continue;
+        }
+
+        if (c != '(') {
+            translated.push_back(c);
+            continue;
+        }
+
+        if (i + 1 >= pattern.length() || pattern[i + 1] != '?') {
+            group++;
+            translated.push_back(c);
+            continue;
+        }
+
+        size_t name_start{std::string::npos};
+
+        if (pattern.compare(i, 4, "(?P<") == 0) {
+            name_start = i + 4;
+        } else if (pattern.compare(i, 3, "(?<") == 0 && i + 3 < pattern.length() && pattern[i + 3] != '=' && pattern[i + 3] != '!') {
+            name_start = i + 3;
+        }
+
+        /* (?: (?= (?! and lookbehinds don't capture */
+        if (name_start == std::string::npos) {
+            translated.push_back(c);
+            continue;
+        }
+
+        auto name_end{pattern.find('>', name_start)};
+
+        if (name_end == std::string::npos || name_end == name_start) {
+            throw std::regex_error(std::regex_constants::error_paren);
+        }
+
+        this->names.emplace_back(++group, pattern.substr(name_start, name_end - name_start));
+        translated.push_back('(');
+        i = name_end;
+    }
+
+    this->pattern = std::regex(translated, std::regex::ECMAScript | std::regex::optimize);
+}
+
+bool namedregex::match(const std::string& text, nlohmann::json& fields) const {
+    std::smatch match{};
+
+    if (!std::regex_search(text, match, this->pattern)) {
+        return false;
+    }
+
+    fields = nlohmann::json::object();
+
+    for (auto&& [index, name] : this->names) {
+        if (index < match.size() && match[index].matched) {
+            fields[name] = match[index].str();
+        }
+    }
+
+    return true;
+}
+
+const std::vector<std::pair<size_t, std::string>>& namedregex::groups() const {
+    return this->names;
+}
@@ -0,0 +1,27 @@
+#ifndef __NAMEDREGEX_HPP
+#define __NAMEDREGEX_HPP
+
+#include <cstddef>
+#include <regex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "nlohmann/json.hpp"
+
+/* std::regex with named groups; '(?<name>...)' and '(?P<name>...)' are rewritten
+   into plain groups since ECMAScript in libstdc++/MSVC has no named captures */
+class namedregex {
+private:
+    std::regex pattern{};
+    std::vector<std::pair<size_t, std::string>> names{};
+public:
+    /* throws std::regex_error on an invalid pattern */
+    namedregex(const std::string& pattern);
+
+    /* fills fields with the named groups that took part in the match */
+    bool match(const std::string& text, nlohmann::json& fields) const;
+
+    const std::vector<std::pair<size_t, std::string>>& groups() const;
+};
+
+#endif
@@ -0,0 +1,23 @@
+#include <chrono>
+#include <cstdint>
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#include "realtime.hpp"
+
+namespace realtime {
+    int64_t coarse_ns() {
+    #ifdef CLOCK_REALTIME_COARSE
+        timespec now{};
+
+        if (clock_gettime(CLOCK_REALTIME_COARSE, &now) == 0) {
+            return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+        }
+    #endif
+
+        // system_clock is the Unix epoch on every supported platform since C++20
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef __REALTIME_HPP
+#define __REALTIME_HPP
+
+#include <cstdint>
+
+/* wall-clock time as entry timestamps carry it: nanoseconds since the Unix epoch */
+namespace realtime {
+    /* the clock's last tick rather than a precise reading; a few milliseconds behind at most,
+       cheap enough to take once per batch */
+    int64_t coarse_ns();
+}
+
+#endif
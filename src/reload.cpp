@@ -0,0 +1,94 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <system_error>
+#include <thread>
+#include "config.hpp"
+#include "debug.hpp"
+#include "inet.hpp"
+#include "reload.hpp"
+#include "xlog.hpp"
+
+namespace reload {
+    /* files are checked by modification time; a watch per file would miss editors that replace the file */
+    static constexpr std::chrono::seconds g_check_interval{1};
+
+    /* process-wide, as the signal is */
+    static volatile std::sig_atomic_t g_requested{0};
+
+    static void signal_handler(int) {
+        reload::g_requested = 1;
+    }
+
+    static std::optional<std::filesystem::file_time_type> modified(const std::string& filename) {
+        std::error_code error{};
+        auto time{std::filesystem::last_write_time(filename, error)};
+
+        if (error) {
+            return std::nullopt;
+        }
+
+        return time;
+    }
+
+    static void worker(std::stop_token stop_token) {
+        std::mutex wait_lock{};
+        std::condition_variable_any wait_condition{};
+        std::unique_lock<std::mutex> _lock(wait_lock);
+
+        auto config_modified{reload::modified(config::filename())};
+        auto log_modified{reload::modified(xlog::filename())};
+
+        while (!stop_token.stop_requested()) {
+            wait_condition.wait_for(_lock, stop_token, reload::g_check_interval, []() { return false; });
+
+            if (stop_token.stop_requested()) {
+                break;
+            }
+
+            bool forced{reload::g_requested != 0};
+            reload::g_requested = 0;
+
+            auto config_now{reload::modified(config::filename())};
+            auto log_now{reload::modified(xlog::filename())};
+
+            // a file that's missing mid-save is picked up once it's back
+            if (forced || (config_now && config_now != config_modified)) {
+                debug::print("reload", "reloading '{}'", config::filename());
+
+                bool connection_changed{false};
+
+                if (config::reload(connection_changed) && connection_changed) {
+                    inet::reconnect();
+                }
+
+                config_modified = config_now;
+            }
+
+            if (forced || (log_now && log_now != log_modified)) {
+                debug::print("reload", "reloading '{}'", xlog::filename());
+                xlog::reload();
+                log_modified = log_now;
+            }
+        }
+    }
+
+    std::jthread start(bool handle_sighup) {
+    #ifndef _WIN32
+        if (handle_sighup) {
+            std::signal(SIGHUP, reload::signal_handler);
+        }
+    #else
+        (void)(handle_sighup);
+        (void)(reload::signal_handler);
+    #endif
+
+        return std::jthread(reload::worker);
+    }
+}
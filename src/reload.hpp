@@ -0,0 +1,13 @@
+#ifndef __RELOAD_HPP
+#define __RELOAD_HPP
+
+#include <thread>
+
+/* re-reads the configuration and log.yml of the running agent when they change on disk or on SIGHUP */
+namespace reload {
+    /* the thread checking the files, which the agent::instance owns; destroying it stops the checks.
+       SIGHUP is only taken over with handle_sighup; an application embedding the agent keeps its own handler */
+    std::jthread start(bool handle_sighup);
+}
+
+#endif
@@ -0,0 +1,106 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "route8-log/route8-log.h"
+#include "agent.hpp"
+#include "realtime.hpp"
+#include "xlog.hpp"
+
+struct r8_context {
+    agent::instance instance;
+    std::mutex lock{};
+    /* views handed to the queue, reused across batches */
+    std::vector<xlog::queue::log_view_t> views{};
+
+    explicit r8_context(agent::options options)
+        : instance(std::move(options)) {
+    }
+};
+
+extern "C" {
+    r8_context* r8_open(const r8_options* options) {
+        agent::options settings{
+            .handle_signals = false,
+            .load_sources = options && (options->flags & R8_OPEN_SOURCES) != 0,
+        };
+
+        if (options) {
+            auto& paths{settings.paths};
+
+            paths.config = options->config_path ? options->config_path : paths.config;
+            paths.log = options->log_path ? options->log_path : paths.log;
+            paths.checkpoint = options->checkpoint_path ? options->checkpoint_path : paths.checkpoint;
+            paths.spool = options->spool_directory ? options->spool_directory : paths.spool;
+            paths.debug = options->debug_path ? options->debug_path : paths.debug;
+        }
+
+        auto context{new (std::nothrow) r8_context(std::move(settings))};
+
+        if (!context) {
+            return nullptr;
+        }
+
+        // a failed start is rolled back, so a later r8_open can try again
+        if (context->instance.start() != 0) {
+            delete context;
+
+            return nullptr;
+        }
+
+        return context;
+    }
+
+    int r8_log_batch(r8_context* context, const r8_entry* entries, size_t count) {
+        if (!context || (!entries && count)) {
+            return -1;
+        }
+
+        const std::lock_guard<std::mutex> _lock(context->lock);
+        const auto now{realtime::coarse_ns()};
+
+        context->views.clear();
+        context->views.reserve(count);
+
+        for (size_t i = 0; i < count; i++) {
+            const auto& entry{entries[i]};
+
+            if ((!entry.identifier && entry.identifier_length) || (!entry.message && entry.message_length)) {
+                return -1;
+            }
+
+            context->views.push_back(xlog::queue::log_view_t{
+                .identifier = std::string_view(entry.identifier ? entry.identifier : "", entry.identifier_length),
+                .timestamp = entry.timestamp ? entry.timestamp : now,
+                .message = std::string_view(entry.message ? entry.message : "", entry.message_length),
+            });
+        }
+
+        context->instance.publish(context->views);
+
+        return 0;
+    }
+
+    int64_t r8_flush(r8_context* context, int64_t timeout_ms) {
+        if (!context || timeout_ms < 0) {
+            return -1;
+        }
+
+        return static_cast<int64_t>(context->instance.flush(std::chrono::milliseconds(timeout_ms)));
+    }
+
+    int64_t r8_close(r8_context* context) {
+        if (!context) {
+            return -1;
+        }
+
+        auto lost{context->instance.stop()};
+        delete context;
+
+        return static_cast<int64_t>(lost);
+    }
+}
@@ -0,0 +1,246 @@
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "timeformat.hpp"
+
+/* days since 1970-01-01 of a proleptic Gregorian date */
+static int64_t days_from_civil(int64_t year, unsigned month, unsigned day) {
+    year -= month <= 2;
+
+    const int64_t era{(year >= 0 ? year : year - 399) / 400};
+    const auto year_of_era{static_cast<unsigned>(year - era * 400)};
+    const unsigned day_of_year{(153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1};
+    const unsigned day_of_era{year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year};
+
+    return era * 146097 + static_cast<int64_t>(day_of_era) - 719468;
+}
+
+static bool read_number(std::string_view text, size_t& position, size_t minimum_digits, size_t maximum_digits, int64_t& result) {
+    size_t digits{0};
+    result = 0;
+
+    while (position < text.length() && digits < maximum_digits && text[position] >= '0' && text[position] <= '9') {
+        result = result * 10 + (text[position] - '0');
+        position++;
+        digits++;
+    }
+
+    return digits >= minimum_digits;
+}
+
+static bool read_month_name(std::string_view text, size_t& position, int64_t& result) {
+    static constexpr const char* names[]{"jan", "feb", "mar", "apr", "may", "jun", "jul", "aug", "sep", "oct", "nov", "dec"};
+
+    if (position + 3 > text.length()) {
+        return false;
+    }
+
+    for (int64_t i = 0; i < 12; i++) {
+        bool matched{true};
+
+        for (size_t j = 0; j < 3; j++) {
+            if ((text[position + j] | 0x20) != names[i][j]) {
+                matched = false;
+                break;
+            }
+        }
+
+        if (matched) {
+            result = i + 1;
+            position += 3;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Z, +hh, +hhmm or +hh:mm; result is the offset east of UTC in seconds */
+static bool read_zone(std::string_view text, size_t& position, int64_t& result) {
+    if (position >= text.length()) {
+        return false;
+    }
+
+    if (text[position] == 'Z' || text[position] == 'z') {
+        position++;
+        result = 0;
+
+        return true;
+    }
+
+    if (text[position] != '+' && text[position] != '-') {
+        return false;
+    }
+
+    const int64_t sign{text[position] == '-' ? -1 : 1};
+    int64_t hours{0};
+    int64_t minutes{0};
+    position++;
+
+    if (!read_number(text, position, 2, 2, hours)) {
+        return false;
+    }
+
+    if (position < text.length() && text[position] == ':') {
+        position++;
+    }
+
+    if (position < text.length() && text[position] >= '0' && text[position] <= '9') {
+        if (!read_number(text, position, 2, 2, minutes)) {
+            return false;
+        }
+    }
+
+    result = sign * (hours * 3600 + minutes * 60);
+
+    return true;
+}
+
+timeformat::timeformat(const std::string& format) {
+    for (size_t i = 0; i < format.length(); i++) {
+        if (format[i] != '%') {
+            if (this->tokens.empty() || this->tokens.back().specifier != 0) {
+                this->tokens.push_back(timeformat::token{});
+            }
+
+            this->tokens.back().literal.push_back(format[i]);
+            continue;
+        }
+
+        if (++i >= format.length()) {
+            throw std::invalid_argument("format ends in a lone '%'");
+        }
+
+        switch (format[i]) {
+            case '%':
+                if (this->tokens.empty() || this->tokens.back().specifier != 0) {
+                    this->tokens.push_back(timeformat::token{});
+                }
+
+                this->tokens.back().literal.push_back('%');
+                break;
+            case 'T':
+                this->tokens.push_back(timeformat::token{.specifier = 'H'});
+                this->tokens.push_back(timeformat::token{.literal = ":"});
+                this->tokens.push_back(timeformat::token{.specifier = 'M'});
+                this->tokens.push_back(timeformat::token{.literal = ":"});
+                this->tokens.push_back(timeformat::token{.specifier = 'S'});
+                break;
+            case 'h':
+                this->tokens.push_back(timeformat::token{.specifier = 'b'});
+                break;
+            case 'Y':
+                this->has_year = true;
+                [[fallthrough]];
+            case 'm':
+            case 'd':
+            case 'e':
+            case 'H':
+            case 'M':
+            case 'S':
+            case 'f':
+            case 'b':
+            case 'z':
+            case 's':
+                this->tokens.push_back(timeformat::token{.specifier = format[i]});
+                break;
+            default:
+                throw std::invalid_argument(std::string("unsupported specifier '%") + format[i] + "'");
+        }
+    }
+}
+
+bool timeformat::parse(std::string_view text, int fallback_year, int64_t& timestamp, size_t& consumed) const {
+    int64_t year{fallback_year};
+    int64_t month{1};
+    int64_t day{1};
+    int64_t hour{0};
+    int64_t minute{0};
+    int64_t second{0};
+    int64_t nanosecond{0};
+    int64_t zone_offset{0};
+    int64_t epoch_seconds{0};
+    bool epoch_given{false};
+    size_t position{0};
+
+    for (const auto& token : this->tokens) {
+        if (token.specifier == 0) {
+            for (auto c : token.literal) {
+                if (c == ' ') {
+                    if (position >= text.length() || text[position] != ' ') {
+                        return false;
+                    }
+
+                    while (position < text.length() && text[position] == ' ') {
+                        position++;
+                    }
+                } else if (position >= text.length() || text[position++] != c) {
+                    return false;
+                }
+            }
+
+            continue;
+        }
+
+        bool read{false};
+
+        switch (token.specifier) {
+            case 'Y': read = read_number(text, position, 4, 4, year); break;
+            case 'm': read = read_number(text, position, 1, 2, month); break;
+            case 'e':
+                if (position < text.length() && text[position] == ' ') {
+                    position++;
+                }
+                [[fallthrough]];
+            case 'd': read = read_number(text, position, 1, 2, day); break;
+            case 'H': read = read_number(text, position, 1, 2, hour); break;
+            case 'M': read = read_number(text, position, 1, 2, minute); break;
+            case 'S': read = read_number(text, position, 1, 2, second); break;
+            case 'b': read = read_month_name(text, position, month); break;
+            case 'z': read = read_zone(text, position, zone_offset); break;
+            case 's': read = read_number(text, position, 1, 12, epoch_seconds); epoch_given = true; break;
+            case 'f': {
+                auto start{position};
+                read = read_number(text, position, 1, 9, nanosecond);
+
+                for (auto digits{position - start}; digits < 9; digits++) {
+                    nanosecond *= 10;
+                }
+
+                // precision beyond nanoseconds is dropped
+                while (position < text.length() && text[position] >= '0' && text[position] <= '9') {
+                    position++;
+                }
+
+                break;
+            }
+        }
+
+        if (!read) {
+            return false;
+        }
+    }
+
+    if (epoch_given) {
+        timestamp = epoch_seconds * 1000000000 + nanosecond;
+    } else {
+        if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+            return false;
+        }
+
+        auto days{days_from_civil(year, static_cast<unsigned>(month), static_cast<unsigned>(day))};
+        auto seconds{days * 86400 + hour * 3600 + minute * 60 + second - zone_offset};
+        timestamp = seconds * 1000000000 + nanosecond;
+    }
+
+    consumed = position;
+
+    return true;
+}
+
+bool timeformat::year_given() const {
+    return this->has_year;
+}
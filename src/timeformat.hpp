@@ -0,0 +1,33 @@
+#ifndef __TIMEFORMAT_HPP
+#define __TIMEFORMAT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* a strptime-like timestamp reader compiled once and matched without allocating or touching the locale;
+   supports %Y %m %d %e %H %M %S %T %f %b %h %z %s and %%, a space matches one or more spaces and
+   anything else must match literally. times without %z are read as UTC */
+class timeformat {
+private:
+    struct token {
+        char specifier{};
+        std::string literal{};
+    };
+
+    std::vector<token> tokens{};
+    bool has_year{false};
+public:
+    /* throws std::invalid_argument on an unknown specifier */
+    timeformat(const std::string& format);
+
+    /* reads a timestamp from the start of text into nanoseconds since the Unix epoch;
+       fallback_year stands in when the format has no %Y */
+    bool parse(std::string_view text, int fallback_year, int64_t& timestamp, size_t& consumed) const;
+
+    bool year_given() const;
+};
+
+#endif
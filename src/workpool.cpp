@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <thread>
+#include <vector>
+#include "workpool.hpp"
+
+namespace workpool {
+    static constexpr size_t g_maximum_threads{8};
+
+    /* one run() call; its tasks are claimed by index, by the caller and whichever threads pick it up */
+    struct job_t {
+        std::span<const std::function<void()>> tasks{};
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> finished{0};
+        std::mutex lock{};
+        std::condition_variable done{};
+        std::exception_ptr error{};
+
+        void work() {
+            for (auto index{this->next++}; index < this->tasks.size(); index = this->next++) {
+                try {
+                    this->tasks[index]();
+                } catch (...) {
+                    const std::lock_guard<std::mutex> _lock(this->lock);
+
+                    if (!this->error) {
+                        this->error = std::current_exception();
+                    }
+                }
+
+                if (++this->finished == this->tasks.size()) {
+                    const std::lock_guard<std::mutex> _lock(this->lock);
+                    this->done.notify_all();
+                }
+            }
+        }
+    };
+
+    static std::mutex g_lock{};
+    static std::condition_variable_any g_wake{};
+    static std::deque<std::shared_ptr<workpool::job_t>> g_jobs{};
+    /* declared last, so the threads are joined before what they wait on is destroyed */
+    static std::vector<std::jthread> g_threads{};
+    static std::once_flag g_started{};
+
+    static void worker(std::stop_token stop_token) {
+        while (true) {
+            std::shared_ptr<workpool::job_t> job{};
+
+            {
+                std::unique_lock<std::mutex> lock(workpool::g_lock);
+
+                if (!workpool::g_wake.wait(lock, stop_token, []() { return !workpool::g_jobs.empty(); })) {
+                    return;
+                }
+
+                job = workpool::g_jobs.front();
+
+                // the job stays listed while it has unclaimed tasks, so idle threads keep joining in;
+                // the shared_ptr keeps it alive for a thread still notifying after run() returned
+                if (job->next >= job->tasks.size()) {
+                    workpool::g_jobs.pop_front();
+                    continue;
+                }
+            }
+
+            job->work();
+        }
+    }
+
+    static void start() {
+        // the calling thread works as well
+        auto count{std::clamp<size_t>(std::thread::hardware_concurrency(), 2, workpool::g_maximum_threads + 1) - 1};
+
+        for (size_t i{0}; i < count; i++) {
+            workpool::g_threads.emplace_back(workpool::worker);
+        }
+    }
+
+    void run(std::span<const std::function<void()>> tasks) {
+        if (tasks.empty()) {
+            return;
+        }
+
+        auto job{std::make_shared<workpool::job_t>()};
+        job->tasks = tasks;
+
+        if (tasks.size() > 1) {
+            std::call_once(workpool::g_started, workpool::start);
+
+            {
+                const std::lock_guard<std::mutex> _lock(workpool::g_lock);
+                workpool::g_jobs.push_back(job);
+            }
+
+            workpool::g_wake.notify_all();
+        }
+
+        job->work();
+
+        {
+            std::unique_lock<std::mutex> lock(job->lock);
+            job->done.wait(lock, [&job]() { return job->finished == job->tasks.size(); });
+        }
+
+        // threads that never got to the job don't have to find it drained
+        if (tasks.size() > 1) {
+            const std::lock_guard<std::mutex> _lock(workpool::g_lock);
+            std::erase(workpool::g_jobs, job);
+        }
+
+        if (job->error) {
+            std::rethrow_exception(job->error);
+        }
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef __WORKPOOL_HPP
+#define __WORKPOOL_HPP
+
+#include <functional>
+#include <span>
+
+/* a fixed set of threads, sized to the cores and started on first use, that CPU-bound work like backfill
+   chunks is spread over instead of starting a thread per piece */
+namespace workpool {
+    /* runs every task, on the pool and on the calling thread, and returns once all finished;
+       rethrows the first exception a task threw */
+    void run(std::span<const std::function<void()>> tasks);
+}
+
+#endif
@@ -1,32 +1,404 @@
 #ifndef __LOG_HPP
 #define __LOG_HPP
 
+#include <chrono>
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
-#include <tuple>
+#include <string_view>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "multiline.hpp"
+
+namespace YAML {
+    class Node;
+}
 
 namespace xlog {
-    bool initialize();
+    class source;
+    class stage;
+
+    using stages_t = std::vector<std::unique_ptr<xlog::stage>>;
+
+    /* builds a fresh set of stages for every source a log entry starts */
+    using stage_factory_t = std::function<xlog::stages_t()>;
+
+    /* what a log.yml entry hands to the sources it starts */
+    struct pipeline_t {
+        xlog::stage_factory_t stages{};
+        /* sources of one entry share a group, so a reload can stop them together */
+        uint64_t group{0};
+    };
+
+    /* the file and the running entries of one agent::instance, which owns them */
+    struct state_t;
+
+    /* runs the entries of filename and makes the functions below work on them; nullptr when any entry fails */
+    std::shared_ptr<xlog::state_t> initialize(std::string filename);
+
+    /* applies the difference between the file and the running entries; unchanged entries keep running */
+    bool reload();
+    const std::string& filename();
+
+    /* forgets the running entries once the reactor stopped their sources, so initialize() can run again */
+    void clear();
 
     namespace queue {
-        using log_entry_t = std::tuple<std::string, int64_t, std::string>;
+        struct log_entry_t {
+            std::string identifier{};
+            /* nanoseconds since the Unix epoch */
+            int64_t timestamp{0};
+            std::string message{};
+            /* structured fields extracted at the edge; null when the entry wasn't parsed */
+            nlohmann::json fields{};
+        };
+
+        /* an entry borrowed from its caller for the duration of one publish() */
+        struct log_view_t {
+            std::string_view identifier{};
+            /* nanoseconds since the Unix epoch */
+            int64_t timestamp{0};
+            std::string_view message{};
+        };
+
+        /* the lanes and the dispatcher of one agent::instance, which owns them */
+        struct state_t;
 
-        bool start();
+        /* starts the dispatcher and makes the functions below work on its lanes until drain() */
+        std::shared_ptr<xlog::queue::state_t> start();
         void insert(const log_entry_t& data);
+        void insert(std::vector<log_entry_t>& entries);
+        size_t size();
+
+        /* serializes borrowed entries straight from the caller's buffers into one batch for the sinks,
+           bypassing the queue; entries inserted before are published first */
+        void publish(std::span<const log_view_t> entries);
+
+        /* the record for an entry, the JSON object of a log command's data */
+        std::string serialize(const log_entry_t& entry);
+
+        /* appends text as a JSON string; invalid UTF-8 becomes U+FFFD, as nlohmann's replace handler does */
+        void append_json_string(std::string& output, std::string_view text);
+
+        /* stops the dispatcher, hands what's left to the sinks and waits for them until the deadline passes;
+           returns the records the sinks still hold. nothing can be queued after */
+        size_t drain(std::chrono::milliseconds deadline);
+
+        /* entries evicted at maximum_log_entries since start */
+        uint64_t dropped();
+    }
+
+    namespace sinks {
+        /* entries serialized once by the queue; every record is the JSON object of a log command's data */
+        struct records_t : std::vector<std::string> {
+            /* the entries the records were serialized from, kept while columnar_batches is on so the columnar
+               encoder builds its columns without parsing the records back; empty for spooled records and
+               those of the C API */
+            std::vector<xlog::queue::log_entry_t> entries{};
+        };
+
+        /* the sinks of one agent::instance, which owns them; they spool into spool.<sink>.jsonl in spool_directory */
+        struct state_t;
+        std::shared_ptr<xlog::sinks::state_t> create(std::string spool_directory);
+
+        /* the remote collector, plus the local archive when archive_directory is set; the functions below
+           work on state until stop(), also when a sink failed to start */
+        bool start(xlog::sinks::state_t& state);
+
+        /* hands one batch to every sink without copying it; a sink past maximum_log_entries
+           drops its oldest batch, independently of the others. urgent batches go ahead of every
+           ordinary one not yet being written; ingested is when the batch's oldest entry was queued */
+        void publish(const std::shared_ptr<const xlog::sinks::records_t>& records, bool urgent, std::chrono::steady_clock::time_point ingested);
+
+        /* waits until every sink caught up or until passes; returns the records still pending */
+        size_t drain(std::chrono::steady_clock::time_point until);
+
+        /* records the most backed-up sink still holds */
+        size_t backlog();
+
+        /* stops the sinks and spools what each still holds for its next start(); held is set to what they
+           held once stopped, and the spooled count is returned */
+        size_t persist(size_t& held);
+
+        /* drops the sinks persist() stopped, so a state can be started again */
+        void stop();
+
+        /* records sinks evicted at their backlog limit since start */
+        uint64_t dropped();
+    }
+
+    namespace reactor {
+        /* the threads and the sources of one agent::instance, which owns them */
+        struct state_t;
+
+        /* attach() and detach() work on the threads until stop(); nullptr when they can't be started */
+        std::shared_ptr<xlog::reactor::state_t> start();
+        bool attach(std::unique_ptr<xlog::source> source, const xlog::pipeline_t& pipeline = {});
+
+        /* returns once every source of the group was drained, checkpointed and destroyed on its reactor thread,
+           so a source replacing one of them resumes from its checkpoint */
+        void detach(uint64_t group);
+
+        /* drains and checkpoints every source, then joins the threads */
+        void stop();
+    }
+
+    namespace parser {
+        struct options {
+            /* json, logfmt or regex */
+            std::string type{};
+            /* named-capture regex for the regex parser */
+            std::string pattern{};
+        };
+
+        /* nullptr on an unknown type or an invalid pattern */
+        std::unique_ptr<xlog::stage> create(const options& options);
+    }
+
+    namespace filter {
+        struct rule {
+            /* a substring unless regex is set */
+            std::string pattern{};
+            bool regex{false};
+        };
+
+        struct options {
+            /* when non-empty, an entry must match one of these to be kept */
+            std::vector<xlog::filter::rule> include{};
+            /* an entry matching any of these is dropped */
+            std::vector<xlog::filter::rule> exclude{};
+        };
+
+        /* counters are registered as filter.<identifier>.<include|exclude>.<pattern>; nullptr on an invalid rule */
+        std::unique_ptr<xlog::stage> create(const std::string& identifier, const options& options);
+    }
+
+    namespace dedup {
+        struct options {
+            /* repeats of a line within this long of its first occurrence are collapsed */
+            int64_t window_ms{1000};
+            /* distinct lines tracked at once; the least recently seen is evicted beyond this */
+            size_t maximum_entries{4096};
+            /* digit runs don't make lines distinct */
+            bool ignore_numbers{false};
+            /* matches of these regexes don't make lines distinct */
+            std::vector<std::string> ignore{};
+        };
+
+        /* nullptr on an invalid pattern */
+        std::unique_ptr<xlog::stage> create(const options& options);
+    }
+
+    namespace timestamp {
+        struct options {
+            /* timeformat specification read from the start of the text, e.g. '%Y-%m-%dT%H:%M:%S.%f%z' */
+            std::string format{};
+            /* parsed field to read the time from instead of the message */
+            std::string field{};
+        };
+
+        /* counters are registered as timestamp.<identifier>.unparsed; nullptr on an invalid format */
+        std::unique_ptr<xlog::stage> create(const std::string& identifier, const options& options);
+    }
+
+    namespace severity {
+        enum class match { prefix, literal, regex };
+
+        struct rule {
+            std::string pattern{};
+            xlog::severity::match kind{xlog::severity::match::literal};
+            /* syslog numbering, 0 (emergency) to 7 (debug) */
+            int level{0};
+        };
+
+        struct options {
+            /* parsed field holding a level name or number, e.g. 'level'; read before the rules */
+            std::string field{};
+            /* the first matching rule sets the level */
+            std::vector<xlog::severity::rule> rules{};
+            /* without a matching rule, a level word near the start of the message sets it, as in '[ERROR]' */
+            bool keywords{true};
+        };
+
+        /* sets the 'severity' field of entries their source didn't classify; counters are registered as
+           severity.<identifier>.unclassified. nullptr on an invalid rule */
+        std::unique_ptr<xlog::stage> create(const std::string& identifier, const options& options);
+
+        /* a digit 0 to 7, or a level name like 'error' or 'WARN' */
+        std::optional<int> parse_level(std::string_view text);
+
+        /* true when the fields carry a severity at or above threshold, i.e. a number at or below it;
+           a negative threshold disables the fast path */
+        bool urgent(const nlohmann::json& fields, int64_t threshold);
+    }
+
+    namespace aggregate {
+        enum class kind { counter, gauge, histogram };
+
+        struct metric {
+            std::string name{};
+            xlog::aggregate::kind type{xlog::aggregate::kind::counter};
+            /* named-capture regex the message must match; without one, every entry is considered */
+            std::string pattern{};
+            /* captured or parsed fields a series is kept per combination of, e.g. 'status' and 'path' */
+            std::vector<std::string> labels{};
+            /* captured or parsed number observed by gauges and histograms; counters sum it instead of counting entries */
+            std::string value{};
+        };
+
+        struct options {
+            /* aggregates are shipped and reset this often */
+            int64_t interval_ms{60000};
+            std::vector<xlog::aggregate::metric> metrics{};
+            /* entries that counted toward a metric aren't shipped themselves */
+            bool drop{false};
+            /* label combinations per metric and interval; further ones are folded into one '__other__' series */
+            size_t maximum_series{1000};
+        };
+
+        /* ships one entry per series and interval; counters are registered as aggregate.<identifier>.<records|dropped|overflow>.
+           nullptr on an invalid metric or pattern */
+        std::unique_ptr<xlog::stage> create(const std::string& identifier, const options& options);
     }
 
     namespace journald {
-        bool start(std::string identifier);
+        bool start(std::string identifier, const xlog::pipeline_t& pipeline);
         bool platform_support();
     }
 
     namespace winevent {
-        bool start(std::string identifier, std::string source_name);
+        bool start(std::string identifier, std::string source_name, const xlog::pipeline_t& pipeline);
         bool platform_support();
     }
 
     namespace file {
-        bool start(std::string identifier, std::string source_filename);
+        struct options {
+            /* ship what the file already holds instead of starting at its end */
+            bool start_at_beginning{false};
+            /* read the existing content through a memory map in parallel chunks; implies start_at_beginning */
+            bool backfill{false};
+            /* backfill throughput limit in MiB/s; 0 is unlimited */
+            size_t backfill_rate_mb{0};
+            /* merges continuation lines into one entry before they're queued */
+            std::optional<multiline_options> multiline{};
+        };
+
+        bool start(std::string identifier, std::string source_filename, const options& options, const xlog::pipeline_t& pipeline);
+
+        /* where a file or glob source of identifier stopped in path; only while the file there is still the one it
+           read (inode 0 where there are none) and hasn't shrunk below that. overrides start_at, so an entry resumes
+           across restarts and reloads */
+        std::optional<uint64_t> resume_position(const std::string& identifier, const std::string& path, uint64_t inode, uint64_t size);
+        /* the same check against a {inode, position} node, as glob sources keep one per file under a single key */
+        std::optional<uint64_t> resume_position(const YAML::Node& state, const std::string& path, uint64_t inode, uint64_t size);
+        YAML::Node position_state(uint64_t inode, uint64_t position);
+        void store_position(const std::string& identifier, const std::string& path, uint64_t inode, uint64_t position);
+    }
+
+    namespace glob {
+        struct options {
+            xlog::file::options file{};
+            /* descriptors kept open at once; the least recently written file is closed beyond this */
+            size_t maximum_open_files{256};
+            /* files without writes for this long have their descriptor closed until written again */
+            int64_t idle_timeout_s{300};
+        };
+
+        /* tails every file matching the pattern, including ones created later, from one watch set */
+        bool start(std::string identifier, std::string pattern, const options& options, const xlog::pipeline_t& pipeline);
+        bool platform_support();
+
+        /* true when the path holds glob wildcards */
+        bool is_pattern(const std::string& path);
+    }
+
+    namespace syslog {
+        struct options {
+            /* listeners; an empty one isn't opened, at least one is required */
+            std::string unix_path{};
+            std::string udp{};
+            std::string tcp{};
+            /* TCP peers served at once; further ones are refused until one disconnects */
+            size_t maximum_connections{256};
+            /* longer datagrams are truncated and longer stream frames split */
+            size_t maximum_message_size{16 * 1024};
+        };
+
+        /* RFC 3164 and RFC 5424 headers are parsed into fields; all listeners of an entry share one poll handle */
+        bool start(std::string identifier, const options& options, const xlog::pipeline_t& pipeline);
+        bool platform_support();
+
+        /* splits a frame into facility, severity and header fields and its message; an RFC 5424 time replaces
+           timestamp. a frame without a valid <PRI> is kept whole as the message */
+        void parse(std::string_view frame, nlohmann::json& fields, std::string& message, int64_t& timestamp);
+    }
+
+    namespace kmsg {
+        struct options {
+            /* without a checkpoint from this boot, ship the records already in the ring */
+            bool start_at_beginning{true};
+        };
+
+        /* reads /dev/kmsg; the last shipped sequence number is checkpointed per boot */
+        bool start(std::string identifier, const options& options, const xlog::pipeline_t& pipeline);
+        bool platform_support();
+
+        /* one record as read from /dev/kmsg; the views point into the text it was parsed from */
+        struct record {
+            int priority{0};
+            uint64_t sequence{0};
+            uint64_t monotonic_us{0};
+            char flag{'-'};
+            std::string_view message{};
+            /* ' KEY=value' continuation lines */
+            std::string_view dictionary{};
+        };
+
+        /* 'priority,sequence,microseconds,flag[,...];message\n[ KEY=value\n]...' */
+        bool parse_record(std::string_view text, record& result);
+    }
+
+    namespace shm {
+        struct options {
+            /* rings named /route8-log.<channel>.<pid> are read */
+            std::string channel{};
+            /* producers don't signal new records, so rings are checked this often */
+            int64_t poll_interval_ms{10};
+            /* rings owned by one of these users, or by one of these groups, are read; with both empty only rings of
+               the agent's own user are. group-writable rings need their group listed, world-writable ones are never read */
+            std::vector<uint32_t> allowed_uids{};
+            std::vector<uint32_t> allowed_gids{};
+        };
+
+        /* drains the shared-memory rings producers open with include/route8-log/shm.hpp */
+        bool start(std::string identifier, const options& options, const xlog::pipeline_t& pipeline);
+        bool platform_support();
+    }
+
+    namespace stream {
+        struct options {
+            /* writers served at once on a socket; further ones are refused until one disconnects */
+            size_t maximum_connections{256};
+            /* longer lines are split */
+            size_t maximum_line_length{64 * 1024};
+            /* stop reading while the pipeline is backed up, so writers block instead of entries being dropped */
+            bool backpressure{true};
+        };
+
+        /* a listening unix stream socket, one line splitter per connected writer */
+        bool start_unix_stream(std::string identifier, std::string path, const options& options, const xlog::pipeline_t& pipeline);
+        /* a named pipe, created when missing; writers share it, so keep lines under PIPE_BUF to avoid interleaving */
+        bool start_fifo(std::string identifier, std::string path, const options& options, const xlog::pipeline_t& pipeline);
+        bool platform_support();
+    }
+
+    namespace archive {
+        /* archives are decompressed in order of attachment, at most concurrency of them at once */
+        bool start(std::string identifier, const std::vector<std::string>& source_filenames, size_t concurrency, const xlog::pipeline_t& pipeline);
+        bool platform_support();
     }
 }
 
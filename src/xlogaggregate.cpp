@@ -0,0 +1,423 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <map>
+#include <memory>
+#include <optional>
+#include <regex>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "debug.hpp"
+#include "metrics.hpp"
+#include "namedregex.hpp"
+#include "xlog.hpp"
+#include "xlogsource.hpp"
+
+namespace xlog {
+    namespace aggregate {
+        using aggregate_clock = std::chrono::steady_clock;
+
+        /* histograms are DDSketch-style: bucket i holds values in (gamma^(i-1), gamma^i], so any quantile
+           is within this relative error and sketches of the same metric merge by adding bucket counts */
+        static constexpr double g_accuracy{0.01};
+        static const double g_gamma{(1 + g_accuracy) / (1 - g_accuracy)};
+        static const double g_log_gamma{std::log(g_gamma)};
+        /* values at or below this, negative ones included, are counted in the zero bucket */
+        static constexpr double g_minimum_value{1e-9};
+
+        static constexpr double g_quantiles[]{0.5, 0.9, 0.99};
+
+        static const char* kind_name(xlog::aggregate::kind kind) {
+            switch (kind) {
+                case xlog::aggregate::kind::counter: return "counter";
+                case xlog::aggregate::kind::gauge: return "gauge";
+                case xlog::aggregate::kind::histogram: return "histogram";
+            }
+
+            return "counter";
+        }
+
+        static std::optional<double> to_number(const nlohmann::json& value) {
+            if (value.is_number()) {
+                return value.get<double>();
+            }
+
+            if (!value.is_string()) {
+                return std::nullopt;
+            }
+
+            const auto& text{value.get_ref<const std::string&>()};
+            double result{0};
+            auto [end, error]{std::from_chars(text.data(), text.data() + text.length(), result)};
+
+            if (error != std::errc{} || end != text.data() + text.length() || !std::isfinite(result)) {
+                return std::nullopt;
+            }
+
+            return result;
+        }
+
+        /* one label combination of a metric within the current interval */
+        struct series {
+            nlohmann::json labels{};
+            uint64_t count{0};
+            double sum{0};
+            double minimum{0};
+            double maximum{0};
+            double last{0};
+            uint64_t zero_count{0};
+            std::map<int32_t, uint64_t> buckets{};
+
+            void add(double value) {
+                if (!this->count) {
+                    this->minimum = value;
+                    this->maximum = value;
+                } else {
+                    this->minimum = std::min(this->minimum, value);
+                    this->maximum = std::max(this->maximum, value);
+                }
+
+                this->count++;
+                this->sum += value;
+                this->last = value;
+            }
+
+            void record(double value) {
+                if (value <= xlog::aggregate::g_minimum_value) {
+                    this->zero_count++;
+                    return;
+                }
+
+                this->buckets[static_cast<int32_t>(std::ceil(std::log(value) / xlog::aggregate::g_log_gamma))]++;
+            }
+
+            /* the bucket midpoint, clamped to the values actually seen */
+            double quantile(double q) const {
+                auto rank{static_cast<uint64_t>(q * static_cast<double>(this->count - 1))};
+                auto seen{this->zero_count};
+                double estimate{0};
+
+                if (seen <= rank) {
+                    for (auto&& [index, bucket_count] : this->buckets) {
+                        seen += bucket_count;
+
+                        if (seen > rank) {
+                            estimate = 2 * std::pow(xlog::aggregate::g_gamma, index) / (xlog::aggregate::g_gamma + 1);
+                            break;
+                        }
+                    }
+                }
+
+                return std::clamp(estimate, this->minimum, this->maximum);
+            }
+        };
+
+        struct compiled_metric {
+            xlog::aggregate::metric options{};
+            /* index into the stage's patterns, shared by metrics with the same pattern; -1 without one */
+            int64_t pattern{-1};
+            std::unordered_map<std::string, xlog::aggregate::series> series{};
+        };
+
+        /* entries are matched against every metric; each metric keeps one series per label combination
+           and all of them are shipped as one record each when the interval ends, then reset */
+        class aggregate_stage : public xlog::stage {
+        private:
+            std::string identifier{};
+            xlog::aggregate::options options{};
+            std::vector<namedregex> patterns{};
+            std::vector<xlog::aggregate::compiled_metric> metrics{};
+
+            aggregate_clock::time_point next_flush{};
+            int64_t interval_start{0};
+
+            /* per entry: the captures of each pattern, matched on first use */
+            std::vector<std::optional<nlohmann::json>> captures{};
+            std::vector<bool> matched{};
+            std::string key{};
+
+            std::atomic<uint64_t>* records{nullptr};
+            std::atomic<uint64_t>* dropped{nullptr};
+            std::atomic<uint64_t>* overflow{nullptr};
+
+            static int64_t wall_clock() {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            }
+
+            /* captures win over fields the entry was parsed into */
+            static const nlohmann::json* find(const nlohmann::json* captured, const nlohmann::json& fields, const std::string& name) {
+                if (captured) {
+                    auto value{captured->find(name)};
+
+                    if (value != captured->end()) {
+                        return &*value;
+                    }
+                }
+
+                if (fields.is_object()) {
+                    auto value{fields.find(name)};
+
+                    if (value != fields.end() && !value->is_null()) {
+                        return &*value;
+                    }
+                }
+
+                return nullptr;
+            }
+
+            /* returns true when the entry counted toward the metric */
+            bool observe(xlog::aggregate::compiled_metric& metric, const xlog::queue::log_entry_t& entry) {
+                const nlohmann::json* captured{nullptr};
+
+                if (metric.pattern >= 0) {
+                    auto& capture{this->captures[metric.pattern]};
+
+                    if (!this->matched[metric.pattern]) {
+                        nlohmann::json fields{};
+
+                        if (this->patterns[metric.pattern].match(entry.message, fields)) {
+                            capture = std::move(fields);
+                        }
+
+                        this->matched[metric.pattern] = true;
+                    }
+
+                    if (!capture) {
+                        return false;
+                    }
+
+                    captured = &*capture;
+                }
+
+                double value{1};
+
+                if (!metric.options.value.empty()) {
+                    auto field{aggregate_stage::find(captured, entry.fields, metric.options.value)};
+                    auto number{field ? xlog::aggregate::to_number(*field) : std::nullopt};
+
+                    if (!number) {
+                        return false;
+                    }
+
+                    value = *number;
+                }
+
+                this->key.clear();
+                auto labels = nlohmann::json::object();
+
+                for (auto&& name : metric.options.labels) {
+                    auto field{aggregate_stage::find(captured, entry.fields, name)};
+
+                    if (!field) {
+                        return false;
+                    }
+
+                    auto text{field->is_string() ? field->get<std::string>() : field->dump()};
+                    this->key.append(text).push_back('\x1f');
+                    labels[name] = std::move(text);
+                }
+
+                auto found{metric.series.find(this->key)};
+
+                if (found == metric.series.end()) {
+                    // past the limit, new combinations share one series so memory stays bounded
+                    if (metric.series.size() >= this->options.maximum_series) {
+                        (*this->overflow)++;
+                        this->key.assign("\x1e");
+
+                        for (auto&& name : metric.options.labels) {
+                            labels[name] = "__other__";
+                        }
+                    }
+
+                    found = metric.series.try_emplace(this->key).first;
+
+                    if (!found->second.count) {
+                        found->second.labels = std::move(labels);
+                    }
+                }
+
+                found->second.add(value);
+
+                if (metric.options.type == xlog::aggregate::kind::histogram) {
+                    found->second.record(value);
+                }
+
+                return true;
+            }
+
+            bool observe(const xlog::queue::log_entry_t& entry) {
+                std::fill(this->matched.begin(), this->matched.end(), false);
+                std::fill(this->captures.begin(), this->captures.end(), std::nullopt);
+
+                bool counted{false};
+
+                for (auto&& metric : this->metrics) {
+                    counted = this->observe(metric, entry) || counted;
+                }
+
+                return counted;
+            }
+
+            void flush(std::vector<xlog::queue::log_entry_t>& batch) {
+                auto now{aggregate_stage::wall_clock()};
+
+                for (auto&& metric : this->metrics) {
+                    for (auto&& [key, series] : metric.series) {
+                        auto fields = nlohmann::json::object();
+                        fields["metric"] = metric.options.name;
+                        fields["type"] = xlog::aggregate::kind_name(metric.options.type);
+                        fields["labels"] = std::move(series.labels);
+                        fields["start"] = this->interval_start;
+                        fields["end"] = now;
+
+                        switch (metric.options.type) {
+                            case xlog::aggregate::kind::counter: {
+                                fields["value"] = metric.options.value.empty() ? nlohmann::json(series.count) : nlohmann::json(series.sum);
+                                break;
+                            }
+                            case xlog::aggregate::kind::gauge: {
+                                fields["value"] = series.last;
+                                fields["min"] = series.minimum;
+                                fields["max"] = series.maximum;
+                                break;
+                            }
+                            case xlog::aggregate::kind::histogram: {
+                                fields["count"] = series.count;
+                                fields["sum"] = series.sum;
+                                fields["min"] = series.minimum;
+                                fields["max"] = series.maximum;
+
+                                for (auto q : xlog::aggregate::g_quantiles) {
+                                    fields[std::format("p{}", static_cast<int>(q * 100))] = series.quantile(q);
+                                }
+
+                                auto buckets = nlohmann::json::array();
+
+                                for (auto&& [index, count] : series.buckets) {
+                                    buckets.push_back(nlohmann::json::array({index, count}));
+                                }
+
+                                fields["sketch"] = {
+                                    {"accuracy", xlog::aggregate::g_accuracy},
+                                    {"zero_count", series.zero_count},
+                                    {"buckets", std::move(buckets)},
+                                };
+                                break;
+                            }
+                        }
+
+                        batch.push_back(xlog::queue::log_entry_t{
+                            .identifier = this->identifier,
+                            .timestamp = now,
+                            .message = metric.options.name,
+                            .fields = std::move(fields),
+                        });
+
+                        (*this->records)++;
+                    }
+
+                    metric.series.clear();
+                }
+
+                this->interval_start = now;
+                this->next_flush = aggregate_clock::now() + std::chrono::milliseconds(this->options.interval_ms);
+            }
+        public:
+            /* throws std::regex_error on an invalid pattern */
+            aggregate_stage(const std::string& identifier, const xlog::aggregate::options& options)
+                : identifier(identifier), options(options) {
+                std::vector<std::string> sources{};
+
+                for (auto&& metric : options.metrics) {
+                    xlog::aggregate::compiled_metric compiled{.options = metric};
+
+                    if (!metric.pattern.empty()) {
+                        auto found{std::find(sources.begin(), sources.end(), metric.pattern)};
+                        compiled.pattern = found - sources.begin();
+
+                        if (found == sources.end()) {
+                            this->patterns.emplace_back(metric.pattern);
+                            sources.push_back(metric.pattern);
+                        }
+                    }
+
+                    this->metrics.push_back(std::move(compiled));
+                }
+
+                this->captures.resize(this->patterns.size());
+                this->matched.resize(this->patterns.size());
+
+                this->interval_start = aggregate_stage::wall_clock();
+                this->next_flush = aggregate_clock::now() + std::chrono::milliseconds(options.interval_ms);
+
+                this->records = &metrics::counter(std::format("aggregate.{}.records", identifier));
+                this->dropped = &metrics::counter(std::format("aggregate.{}.dropped", identifier));
+                this->overflow = &metrics::counter(std::format("aggregate.{}.overflow", identifier));
+            }
+
+            void process(std::vector<xlog::queue::log_entry_t>& batch) override {
+                if (this->options.drop) {
+                    auto kept{std::remove_if(batch.begin(), batch.end(), [this](const xlog::queue::log_entry_t& entry) -> bool {
+                        return this->observe(entry);
+                    })};
+
+                    (*this->dropped) += static_cast<uint64_t>(batch.end() - kept);
+                    batch.erase(kept, batch.end());
+                } else {
+                    for (auto&& entry : batch) {
+                        this->observe(entry);
+                    }
+                }
+
+                if (aggregate_clock::now() >= this->next_flush) {
+                    this->flush(batch);
+                }
+            }
+
+            /* the partial interval is shipped rather than lost */
+            void drain(std::vector<xlog::queue::log_entry_t>& batch) override {
+                this->flush(batch);
+            }
+
+            /* due at the end of the interval even when the source is quiet */
+            int64_t poll_interval_ms() const override {
+                auto remaining{std::chrono::ceil<std::chrono::milliseconds>(this->next_flush - aggregate_clock::now()).count()};
+
+                return std::max<int64_t>(remaining, 0);
+            }
+        };
+
+        std::unique_ptr<xlog::stage> create(const std::string& identifier, const xlog::aggregate::options& options) {
+            if (options.interval_ms <= 0 || !options.maximum_series || options.metrics.empty()) {
+                debug::print("aggregate", "'{}' needs at least one metric and a positive interval_ms and max_series", identifier);
+
+                return nullptr;
+            }
+
+            for (auto&& metric : options.metrics) {
+                if (metric.name.empty() || (metric.type != xlog::aggregate::kind::counter && metric.value.empty())) {
+                    debug::print("aggregate", "metrics of '{}' need a name, and gauges and histograms a value", identifier);
+
+                    return nullptr;
+                }
+            }
+
+            try {
+                return std::make_unique<xlog::aggregate::aggregate_stage>(identifier, options);
+            } catch (const std::regex_error& e) {
+                debug::print("aggregate", "invalid pattern for '{}', error: {}", identifier, e.what());
+            }
+
+            return nullptr;
+        }
+    }
+}
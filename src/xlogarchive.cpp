@@ -0,0 +1,760 @@
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#ifdef ROUTE8_LOG_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef ROUTE8_LOG_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <algorithm>
+#include <charconv>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <format>
+#include <fstream>
+#include <ios>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+#include "yaml-cpp/yaml.h"
+#include "checkpoint.hpp"
+#include "config.hpp"
+#include "crc32c.hpp"
+#include "debug.hpp"
+#include "linesplitter.hpp"
+#include "metrics.hpp"
+#include "realtime.hpp"
+#include "xlog.hpp"
+#include "xlogsource.hpp"
+
+namespace xlog {
+    namespace archive {
+        static constexpr size_t g_input_buffer_size{64 * 1024};
+        static constexpr size_t g_output_buffer_size{256 * 1024};
+
+        /* decompressed bytes handled per reactor tick, so one archive can't hold a thread */
+        static constexpr size_t g_tick_output_bytes{4 * 1024 * 1024};
+        static constexpr int64_t g_tick_ms{10};
+        static constexpr int64_t g_wait_ms{100};
+
+        /* spacing of resumable positions in the decompressed stream */
+        static constexpr uint64_t g_access_point_spacing{8 * 1024 * 1024};
+        static constexpr std::chrono::seconds g_checkpoint_interval{1};
+
+        /* the archive sink's sidecar: the CRC32C of the uncompressed content, as 8 hex digits */
+        static std::optional<uint32_t> read_checksum(const std::string& source_filename) {
+            std::ifstream sidecar(source_filename + ".crc32c", std::ios_base::in | std::ios_base::binary);
+            std::string digits{};
+
+            if (!sidecar.is_open() || !std::getline(sidecar, digits)) {
+                return std::nullopt;
+            }
+
+            uint32_t checksum{0};
+            auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.length(), checksum, 16);
+
+            if (ec != std::errc{} || end != digits.data() + digits.length()) {
+                return std::nullopt;
+            }
+
+            return checksum;
+        }
+
+        enum class decode_result {
+            data,
+            end,
+            error,
+        };
+
+        /* a position in the archive that decoding can restart from */
+        struct access_point {
+            uint64_t input_offset{0};
+            uint64_t output_offset{0};
+            int bits{0};
+            std::vector<char> window{};
+        };
+
+        class decoder {
+        protected:
+            std::deque<xlog::archive::access_point> points{};
+
+            void add_point(xlog::archive::access_point point) {
+                this->points.push_back(std::move(point));
+
+                while (this->points.size() > 2) {
+                    this->points.pop_front();
+                }
+            }
+        public:
+            virtual ~decoder() = default;
+
+            /* starts at the access point, or at the beginning of the archive when there is none */
+            virtual bool open(std::ifstream& input, const xlog::archive::access_point* point) = 0;
+            virtual decode_result decode(std::ifstream& input, std::vector<char>& output, size_t& produced) = 0;
+
+            /* newest access point whose output offset doesn't exceed limit */
+            const xlog::archive::access_point* find_point(uint64_t limit) const {
+                for (auto point{this->points.rbegin()}; point != this->points.rend(); point++) {
+                    if (point->output_offset <= limit) {
+                        return &*point;
+                    }
+                }
+
+                return nullptr;
+            }
+        };
+
+    #ifdef ROUTE8_LOG_HAVE_ZLIB
+        /* resumable gzip decoding; access points are taken at deflate block boundaries like zlib's zran example */
+        class gzip_decoder : public decoder {
+        private:
+            static constexpr size_t g_window_size{32768};
+
+            z_stream stream{};
+            bool initialized{false};
+            bool raw{false};
+            size_t pending_trailer{0};
+            std::vector<unsigned char> input_buffer = std::vector<unsigned char>(g_input_buffer_size);
+            uint64_t input_base{0};
+            uint64_t output_offset{0};
+            uint64_t next_point{0};
+            std::vector<char> window = std::vector<char>(g_window_size);
+            size_t window_position{0};
+            size_t window_fill{0};
+
+            void remember_output(const char* data, size_t length) {
+                if (length >= g_window_size) {
+                    std::memcpy(this->window.data(), data + length - g_window_size, g_window_size);
+                    this->window_position = 0;
+                    this->window_fill = g_window_size;
+
+                    return;
+                }
+
+                while (length) {
+                    auto part{std::min(length, g_window_size - this->window_position)};
+                    std::memcpy(this->window.data() + this->window_position, data, part);
+
+                    this->window_position = (this->window_position + part) % g_window_size;
+                    this->window_fill = std::min(this->window_fill + part, g_window_size);
+                    data += part;
+                    length -= part;
+                }
+            }
+
+            std::vector<char> linear_window() const {
+                std::vector<char> result{};
+                result.reserve(this->window_fill);
+
+                if (this->window_fill == g_window_size) {
+                    result.insert(result.end(), this->window.begin() + static_cast<std::ptrdiff_t>(this->window_position), this->window.end());
+                }
+
+                result.insert(result.end(), this->window.begin(), this->window.begin() + static_cast<std::ptrdiff_t>(this->window_position));
+
+                return result;
+            }
+
+            uint64_t input_offset() const {
+                return this->input_base + static_cast<uint64_t>(this->stream.next_in - this->input_buffer.data());
+            }
+
+            bool refill(std::ifstream& input) {
+                this->input_base += static_cast<uint64_t>(this->stream.next_in - this->input_buffer.data());
+
+                input.read(reinterpret_cast<char*>(this->input_buffer.data()), static_cast<std::streamsize>(this->input_buffer.size()));
+
+                this->stream.next_in = this->input_buffer.data();
+                this->stream.avail_in = static_cast<uInt>(input.gcount());
+
+                return this->stream.avail_in > 0;
+            }
+
+            bool reset(int window_bits) {
+                if (this->initialized) {
+                    inflateEnd(&this->stream);
+                    this->initialized = false;
+                }
+
+                auto next_in{this->stream.next_in};
+                auto avail_in{this->stream.avail_in};
+
+                this->stream = z_stream{};
+                this->stream.next_in = next_in;
+                this->stream.avail_in = avail_in;
+
+                if (inflateInit2(&this->stream, window_bits) != Z_OK) {
+                    debug::print("archive", "failed to initialize inflate");
+
+                    return false;
+                }
+
+                this->initialized = true;
+                this->raw = window_bits < 0;
+
+                return true;
+            }
+        public:
+            ~gzip_decoder() override {
+                if (this->initialized) {
+                    inflateEnd(&this->stream);
+                }
+            }
+
+            bool open(std::ifstream& input, const xlog::archive::access_point* point) override {
+                this->stream.next_in = this->input_buffer.data();
+                this->stream.avail_in = 0;
+
+                if (!point) {
+                    // 32 selects automatic gzip/zlib header detection
+                    return this->reset(15 + 32);
+                }
+
+                this->input_base = point->input_offset - (point->bits ? 1 : 0);
+                input.seekg(static_cast<std::streamoff>(this->input_base));
+
+                if (!input || !this->reset(-15)) {
+                    return false;
+                }
+
+                if (point->bits) {
+                    auto byte{input.get()};
+
+                    if (byte == std::char_traits<char>::eof()) {
+                        return false;
+                    }
+
+                    this->input_base++;
+                    inflatePrime(&this->stream, point->bits, byte >> (8 - point->bits));
+                }
+
+                inflateSetDictionary(&this->stream, reinterpret_cast<const Bytef*>(point->window.data()), static_cast<uInt>(point->window.size()));
+
+                this->remember_output(point->window.data(), point->window.size());
+                this->output_offset = point->output_offset;
+                this->next_point = point->output_offset + g_access_point_spacing;
+                this->add_point(*point);
+
+                return true;
+            }
+
+            decode_result decode(std::ifstream& input, std::vector<char>& output, size_t& produced) override {
+                produced = 0;
+
+                while (true) {
+                    if (!this->stream.avail_in && !this->refill(input)) {
+                        if (this->pending_trailer || this->raw) {
+                            debug::print("archive", "archive ended in the middle of a stream");
+
+                            return decode_result::error;
+                        }
+
+                        return decode_result::end;
+                    }
+
+                    if (this->pending_trailer) {
+                        auto skip{std::min<size_t>(this->pending_trailer, this->stream.avail_in)};
+
+                        this->stream.next_in += skip;
+                        this->stream.avail_in -= static_cast<uInt>(skip);
+                        this->pending_trailer -= skip;
+
+                        if (!this->pending_trailer && !this->reset(15 + 32)) {
+                            return decode_result::error;
+                        }
+
+                        continue;
+                    }
+
+                    this->stream.next_out = reinterpret_cast<Bytef*>(output.data());
+                    this->stream.avail_out = static_cast<uInt>(output.size());
+
+                    auto result{inflate(&this->stream, Z_BLOCK)};
+                    produced = output.size() - this->stream.avail_out;
+
+                    this->remember_output(output.data(), produced);
+                    this->output_offset += produced;
+
+                    if (result == Z_STREAM_END) {
+                        if (this->raw) {
+                            // a resumed member has no header state; the gzip trailer is skipped by hand
+                            this->pending_trailer = 8;
+                        } else if (inflateReset(&this->stream) != Z_OK) {
+                            return decode_result::error;
+                        }
+                    } else if (result != Z_OK && result != Z_BUF_ERROR) {
+                        debug::print("archive", "failed to inflate, error: {}", this->stream.msg ? this->stream.msg : "unknown");
+
+                        return decode_result::error;
+                    }
+
+                    bool block_boundary{(this->stream.data_type & 128) && !(this->stream.data_type & 64)};
+
+                    if (result == Z_OK && block_boundary && this->output_offset >= this->next_point) {
+                        this->add_point(xlog::archive::access_point{
+                            .input_offset = this->input_offset(),
+                            .output_offset = this->output_offset,
+                            .bits = this->stream.data_type & 7,
+                            .window = this->linear_window(),
+                        });
+
+                        this->next_point = this->output_offset + g_access_point_spacing;
+                    }
+
+                    if (produced) {
+                        return decode_result::data;
+                    }
+                }
+            }
+        };
+    #endif
+
+    #ifdef ROUTE8_LOG_HAVE_ZSTD
+        /* zstd decoding; access points are taken at frame boundaries where no window is needed */
+        class zstd_decoder : public decoder {
+        private:
+            ZSTD_DStream* stream{nullptr};
+            std::vector<char> input_buffer = std::vector<char>(g_input_buffer_size);
+            ZSTD_inBuffer input_view{};
+            uint64_t input_base{0};
+            uint64_t output_offset{0};
+            uint64_t next_point{0};
+            bool frame_open{false};
+        public:
+            ~zstd_decoder() override {
+                if (this->stream) {
+                    ZSTD_freeDStream(this->stream);
+                }
+            }
+
+            bool open(std::ifstream& input, const xlog::archive::access_point* point) override {
+                this->stream = ZSTD_createDStream();
+
+                if (!this->stream || ZSTD_isError(ZSTD_initDStream(this->stream))) {
+                    debug::print("archive", "failed to initialize zstd decompression");
+
+                    return false;
+                }
+
+                this->input_view = ZSTD_inBuffer{this->input_buffer.data(), 0, 0};
+
+                if (point) {
+                    this->input_base = point->input_offset;
+                    this->output_offset = point->output_offset;
+                    this->next_point = point->output_offset + g_access_point_spacing;
+                    this->add_point(*point);
+
+                    input.seekg(static_cast<std::streamoff>(this->input_base));
+                }
+
+                return static_cast<bool>(input);
+            }
+
+            decode_result decode(std::ifstream& input, std::vector<char>& output, size_t& produced) override {
+                produced = 0;
+
+                while (true) {
+                    if (this->input_view.pos == this->input_view.size) {
+                        this->input_base += this->input_view.size;
+
+                        input.read(this->input_buffer.data(), static_cast<std::streamsize>(this->input_buffer.size()));
+                        this->input_view = ZSTD_inBuffer{this->input_buffer.data(), static_cast<size_t>(input.gcount()), 0};
+
+                        if (!this->input_view.size) {
+                            if (this->frame_open) {
+                                debug::print("archive", "archive ended in the middle of a frame");
+
+                                return decode_result::error;
+                            }
+
+                            return decode_result::end;
+                        }
+                    }
+
+                    ZSTD_outBuffer output_view{output.data(), output.size(), 0};
+                    auto result{ZSTD_decompressStream(this->stream, &output_view, &this->input_view)};
+
+                    if (ZSTD_isError(result)) {
+                        debug::print("archive", "failed to decompress, error: {}", ZSTD_getErrorName(result));
+
+                        return decode_result::error;
+                    }
+
+                    produced = output_view.pos;
+                    this->output_offset += produced;
+                    this->frame_open = result != 0;
+
+                    if (!this->frame_open && this->output_offset >= this->next_point) {
+                        this->add_point(xlog::archive::access_point{
+                            .input_offset = this->input_base + this->input_view.pos,
+                            .output_offset = this->output_offset,
+                            .bits = 0,
+                            .window = {},
+                        });
+
+                        this->next_point = this->output_offset + g_access_point_spacing;
+                    }
+
+                    if (produced) {
+                        return decode_result::data;
+                    }
+                }
+            }
+        };
+    #endif
+
+        static std::unique_ptr<xlog::archive::decoder> make_decoder(std::ifstream& input) {
+            std::array<unsigned char, 4> magic{};
+
+            input.read(reinterpret_cast<char*>(magic.data()), magic.size());
+            input.clear();
+            input.seekg(0);
+
+        #ifdef ROUTE8_LOG_HAVE_ZLIB
+            if (magic[0] == 0x1f && magic[1] == 0x8b) {
+                return std::make_unique<xlog::archive::gzip_decoder>();
+            }
+        #endif
+
+        #ifdef ROUTE8_LOG_HAVE_ZSTD
+            if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+                return std::make_unique<xlog::archive::zstd_decoder>();
+            }
+        #endif
+
+            return nullptr;
+        }
+
+        class archive_source : public xlog::source {
+        private:
+            std::string identifier{};
+            std::string source_filename{};
+            std::shared_ptr<std::atomic<size_t>> active{};
+            size_t concurrency{1};
+            bool holding_slot{false};
+
+            std::string checkpoint_key{};
+            uint64_t archive_size{0};
+            std::ifstream input{};
+            std::unique_ptr<xlog::archive::decoder> decoder{};
+            std::vector<char> output = std::vector<char>(g_output_buffer_size);
+            linesplitter splitter{};
+            std::vector<std::string> lines{};
+
+            uint64_t output_offset{0};
+            /* decompressed offset right after the last line handed out */
+            uint64_t shipped{0};
+            /* decompressed bytes already shipped by a previous run */
+            uint64_t skip_until{0};
+            uint64_t checkpointed{0};
+            std::chrono::steady_clock::time_point last_checkpoint{};
+            bool finished{false};
+
+            /* verified on completion when the archive has a sidecar and is read from its start */
+            std::optional<uint32_t> expected_checksum{};
+            uint32_t checksum{0};
+            std::atomic<uint64_t>* mismatches{nullptr};
+
+            bool acquire_slot() {
+                if (this->holding_slot) {
+                    return true;
+                }
+
+                auto current{this->active->load()};
+
+                while (current < this->concurrency) {
+                    if (this->active->compare_exchange_weak(current, current + 1)) {
+                        this->holding_slot = true;
+
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            void release_slot() {
+                if (this->holding_slot) {
+                    this->active->fetch_sub(1);
+                    this->holding_slot = false;
+                }
+            }
+
+            void consume(std::string_view data) {
+                if (this->expected_checksum) {
+                    this->checksum = crc32c::compute(data, this->checksum);
+                }
+
+                auto data_offset{this->output_offset};
+                this->output_offset += data.size();
+
+                if (this->output_offset <= this->skip_until) {
+                    return;
+                }
+
+                if (data_offset < this->skip_until) {
+                    data.remove_prefix(static_cast<size_t>(this->skip_until - data_offset));
+                    data_offset = this->skip_until;
+                }
+
+                auto last_newline{data.rfind('\n')};
+
+                if (last_newline != std::string_view::npos) {
+                    this->shipped = data_offset + last_newline + 1;
+                }
+
+                this->splitter.feed(data, this->lines);
+            }
+
+            void finish(bool complete) {
+                std::string line{};
+
+                if (complete && this->splitter.flush(line)) {
+                    this->lines.push_back(std::move(line));
+                    this->shipped = this->output_offset;
+                }
+
+                this->finished = true;
+                this->release_slot();
+
+                if (complete && this->expected_checksum && this->checksum != *this->expected_checksum) {
+                    debug::print("archive", "'{}' fails its checksum; its content changed after it was archived", this->source_filename);
+                    (*this->mismatches)++;
+                }
+
+                YAML::Node state{};
+                state["size"] = this->archive_size;
+                state["done"] = true;
+                checkpoint::store(this->checkpoint_key, state);
+
+                debug::print("archive", "finished '{}' after {} bytes", this->source_filename, this->output_offset);
+            }
+        public:
+            archive_source(std::string identifier, std::string source_filename, std::shared_ptr<std::atomic<size_t>> active, size_t concurrency)
+                : identifier(std::move(identifier)), source_filename(std::move(source_filename)), active(std::move(active)), concurrency(std::max<size_t>(concurrency, 1)) {
+                this->mismatches = &metrics::counter(std::format("archive.{}.crc_mismatches", this->identifier));
+            }
+
+            ~archive_source() override {
+                this->release_slot();
+            }
+
+            std::string name() const override {
+                return "archive:" + this->source_filename;
+            }
+
+            bool open() override {
+                this->input.open(this->source_filename, std::ios_base::in | std::ios_base::binary);
+
+                if (!this->input.is_open()) {
+                    debug::print("archive", "failed to open archive '{}'", this->source_filename);
+
+                    return false;
+                }
+
+            #ifdef _WIN32
+                this->checkpoint_key = "archive:" + this->source_filename;
+            #else
+                struct stat file_stat{};
+
+                if (stat(this->source_filename.c_str(), &file_stat) == -1) {
+                    debug::print("archive", "failed to stat archive '{}', error: {}", this->source_filename, std::strerror(errno));
+
+                    return false;
+                }
+
+                // keyed by inode so the checkpoint follows the archive through further rotations
+                this->checkpoint_key = "archive:" + std::to_string(file_stat.st_dev) + ":" + std::to_string(file_stat.st_ino);
+            #endif
+
+                this->input.seekg(0, std::ios_base::end);
+                this->archive_size = static_cast<uint64_t>(std::max<std::streamoff>(this->input.tellg(), 0));
+                this->input.seekg(0);
+
+                this->decoder = xlog::archive::make_decoder(this->input);
+
+                if (!this->decoder) {
+                    debug::print("archive", "'{}' isn't a supported archive", this->source_filename);
+
+                    return false;
+                }
+
+                auto state{checkpoint::load(this->checkpoint_key)};
+                std::optional<xlog::archive::access_point> point{};
+
+                try {
+                    if (state.IsMap() && state["size"].as<uint64_t>() == this->archive_size) {
+                        if (state["done"] && state["done"].as<bool>()) {
+                            debug::print("archive", "'{}' was already shipped", this->source_filename);
+                            this->finished = true;
+
+                            return true;
+                        }
+
+                        this->skip_until = state["shipped"].as<uint64_t>();
+
+                        if (state["point"]) {
+                            auto window{state["point"]["window"].as<YAML::Binary>()};
+
+                            point = xlog::archive::access_point{
+                                .input_offset = state["point"]["input"].as<uint64_t>(),
+                                .output_offset = state["point"]["output"].as<uint64_t>(),
+                                .bits = state["point"]["bits"].as<int>(),
+                                .window = std::vector<char>(window.data(), window.data() + window.size()),
+                            };
+                        }
+                    }
+                } catch (const std::exception& e) {
+                    debug::print("archive", "ignoring unreadable checkpoint of '{}', error: {}", this->source_filename, e.what());
+                    this->skip_until = 0;
+                    point.reset();
+                }
+
+                if (!this->decoder->open(this->input, point ? &*point : nullptr)) {
+                    debug::print("archive", "failed to start decoding '{}'", this->source_filename);
+
+                    return false;
+                }
+
+                if (point) {
+                    this->output_offset = point->output_offset;
+                } else {
+                    // a resumed read doesn't see the content before its access point
+                    this->expected_checksum = xlog::archive::read_checksum(this->source_filename);
+                }
+
+                this->shipped = this->skip_until;
+                this->checkpointed = this->shipped;
+
+                if (this->skip_until) {
+                    debug::print("archive", "resuming '{}' at decompressed offset {}", this->source_filename, this->skip_until);
+                }
+
+                return true;
+            }
+
+            xlog::source_handle_t poll_handle() const override {
+                return xlog::source_handle_nullptr;
+            }
+
+            int64_t poll_interval_ms() const override {
+                return this->holding_slot ? g_tick_ms : g_wait_ms;
+            }
+
+            bool read_batch(std::vector<xlog::queue::log_entry_t>& batch) override {
+                if (this->finished) {
+                    return false;
+                }
+
+                if (!this->acquire_slot()) {
+                    return true;
+                }
+
+                // leave room in the queue for live sources instead of evicting them
+                if (xlog::queue::size() >= config::current()->maximum_log_entries / 2) {
+                    return true;
+                }
+
+                size_t handled{0};
+
+                while (handled < g_tick_output_bytes) {
+                    size_t produced{0};
+                    auto result{this->decoder->decode(this->input, this->output, produced)};
+
+                    if (result == xlog::archive::decode_result::error) {
+                        debug::print("archive", "stopping on corrupt archive '{}' at decompressed offset {}", this->source_filename, this->output_offset);
+                        this->finish(false);
+                        break;
+                    }
+
+                    if (result == xlog::archive::decode_result::end) {
+                        this->finish(true);
+                        break;
+                    }
+
+                    this->consume(std::string_view(this->output.data(), produced));
+                    handled += produced;
+                }
+
+                const bool verbose{config::current()->verbose};
+                const auto timestamp{realtime::coarse_ns()};
+
+                for (auto&& line : this->lines) {
+                    if (verbose) {
+                        debug::print("archive", "detected line from '{}': '{}'", this->source_filename, line);
+                    }
+
+                    batch.push_back(xlog::queue::log_entry_t{.identifier = this->identifier, .timestamp = timestamp, .message = std::move(line)});
+                }
+
+                this->lines.clear();
+
+                return true;
+            }
+
+            void checkpoint() override {
+                if (this->finished || this->shipped == this->checkpointed) {
+                    return;
+                }
+
+                auto now{std::chrono::steady_clock::now()};
+
+                if (now - this->last_checkpoint < g_checkpoint_interval) {
+                    return;
+                }
+
+                auto point{this->decoder->find_point(this->shipped)};
+
+                YAML::Node state{};
+                state["size"] = this->archive_size;
+                state["shipped"] = this->shipped;
+
+                if (point) {
+                    state["point"]["input"] = point->input_offset;
+                    state["point"]["output"] = point->output_offset;
+                    state["point"]["bits"] = point->bits;
+                    state["point"]["window"] = YAML::Binary(reinterpret_cast<const unsigned char*>(point->window.data()), point->window.size());
+                }
+
+                checkpoint::store(this->checkpoint_key, state);
+                this->checkpointed = this->shipped;
+                this->last_checkpoint = now;
+            }
+        };
+
+        bool start(std::string identifier, const std::vector<std::string>& source_filenames, size_t concurrency, const xlog::pipeline_t& pipeline) {
+            auto active{std::make_shared<std::atomic<size_t>>(0)};
+
+            for (auto&& source_filename : source_filenames) {
+                if (!xlog::reactor::attach(std::make_unique<xlog::archive::archive_source>(identifier, source_filename, active, concurrency), pipeline)) {
+                    return false;
+                }
+
+                debug::print("archive", "started on archive '{}'", source_filename);
+            }
+
+            return true;
+        }
+
+        bool platform_support() {
+        #if defined(ROUTE8_LOG_HAVE_ZLIB) || defined(ROUTE8_LOG_HAVE_ZSTD)
+            return true;
+        #else
+            return false;
+        #endif
+        }
+    }
+}
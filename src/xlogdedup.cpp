@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "debug.hpp"
+#include "xlog.hpp"
+#include "xlogsource.hpp"
+
+namespace xlog {
+    namespace dedup {
+        using dedup_clock = std::chrono::steady_clock;
+
+        /* a line seen within the current window; only its hash is used as key, the message is
+           kept for the summary entry. window is the slot's place in the expiry order */
+        struct slot {
+            uint64_t hash{0};
+            dedup_clock::time_point expires{};
+            std::list<uint64_t>::iterator window{};
+            xlog::queue::log_entry_t first{};
+            int64_t first_repeat{0};
+            int64_t last_repeat{0};
+            uint64_t repeat_count{0};
+        };
+
+        /* the first occurrence of a line is shipped right away; later ones within the window are
+           counted and shipped as a single entry with repeat_count, first_seen and last_seen once the
+           window closes or the line is evicted */
+        class dedup_stage : public xlog::stage {
+        private:
+            xlog::dedup::options options{};
+            std::vector<std::regex> ignore{};
+
+            /* most recently seen first */
+            std::list<xlog::dedup::slot> slots{};
+            std::unordered_map<uint64_t, std::list<xlog::dedup::slot>::iterator> lookup{};
+            /* the hashes of the slots in the order their windows close, which is the order they opened in as windows
+               have a fixed length; an evicted slot takes its entry along, so there are never more than max_entries */
+            std::list<uint64_t> windows{};
+            size_t pending_summaries{0};
+
+            std::string normalized{};
+
+            uint64_t hash(const xlog::queue::log_entry_t& entry) {
+                std::string_view text{entry.message};
+
+                if (this->options.ignore_numbers || !this->ignore.empty()) {
+                    this->normalized.clear();
+
+                    for (size_t i{0}; i < entry.message.length(); i++) {
+                        bool digit{std::isdigit(static_cast<unsigned char>(entry.message[i])) != 0};
+
+                        if (!this->options.ignore_numbers || !digit) {
+                            this->normalized.push_back(entry.message[i]);
+                        } else if (i == 0 || !std::isdigit(static_cast<unsigned char>(entry.message[i - 1]))) {
+                            this->normalized.push_back('#');
+                        }
+                    }
+
+                    for (auto&& pattern : this->ignore) {
+                        this->normalized = std::regex_replace(this->normalized, pattern, "*");
+                    }
+
+                    text = this->normalized;
+                }
+
+                /* the identifier takes part so sources sharing a stage set never collapse into each other */
+                return std::hash<std::string_view>{}(text) ^ (std::hash<std::string>{}(entry.identifier) * 0x9E3779B97F4A7C15ull);
+            }
+
+            void summarize(xlog::dedup::slot& slot, std::vector<xlog::queue::log_entry_t>& summaries) {
+                if (!slot.repeat_count) {
+                    return;
+                }
+
+                auto entry{std::move(slot.first)};
+                entry.timestamp = slot.last_repeat;
+
+                if (!entry.fields.is_object()) {
+                    entry.fields = nlohmann::json::object();
+                }
+
+                entry.fields["repeat_count"] = slot.repeat_count;
+                entry.fields["first_seen"] = slot.first_repeat;
+                entry.fields["last_seen"] = slot.last_repeat;
+
+                summaries.push_back(std::move(entry));
+                slot.repeat_count = 0;
+                this->pending_summaries--;
+            }
+
+            void erase(std::list<xlog::dedup::slot>::iterator slot, std::vector<xlog::queue::log_entry_t>& summaries) {
+                this->summarize(*slot, summaries);
+                this->lookup.erase(slot->hash);
+                this->windows.erase(slot->window);
+                this->slots.erase(slot);
+            }
+
+            /* returns true when the entry is a repeat and has been absorbed */
+            bool absorb(const xlog::queue::log_entry_t& entry, dedup_clock::time_point now, std::vector<xlog::queue::log_entry_t>& summaries) {
+                auto hash{this->hash(entry)};
+                auto found{this->lookup.find(hash)};
+
+                if (found != this->lookup.end()) {
+                    auto& slot{*found->second};
+
+                    if (!slot.repeat_count) {
+                        slot.first_repeat = entry.timestamp;
+                        this->pending_summaries++;
+                    }
+
+                    slot.repeat_count++;
+                    slot.last_repeat = entry.timestamp;
+                    this->slots.splice(this->slots.begin(), this->slots, found->second);
+
+                    return true;
+                }
+
+                if (this->slots.size() >= this->options.maximum_entries) {
+                    this->erase(std::prev(this->slots.end()), summaries);
+                }
+
+                this->windows.push_back(hash);
+                this->slots.push_front(xlog::dedup::slot{
+                    .hash = hash,
+                    .expires = now + std::chrono::milliseconds(this->options.window_ms),
+                    .window = std::prev(this->windows.end()),
+                    .first = entry,
+                });
+                this->lookup.emplace(hash, this->slots.begin());
+
+                return false;
+            }
+
+            void expire(dedup_clock::time_point now, std::vector<xlog::queue::log_entry_t>& summaries) {
+                while (!this->windows.empty()) {
+                    auto slot{this->lookup.find(this->windows.front())->second};
+
+                    if (slot->expires > now) {
+                        return;
+                    }
+
+                    this->erase(slot, summaries);
+                }
+            }
+        public:
+            /* throws std::regex_error on an invalid pattern */
+            dedup_stage(const xlog::dedup::options& options) : options(options) {
+                for (auto&& pattern : options.ignore) {
+                    this->ignore.emplace_back(pattern, std::regex::ECMAScript | std::regex::optimize);
+                }
+            }
+
+            void process(std::vector<xlog::queue::log_entry_t>& batch) override {
+                auto now{dedup_clock::now()};
+                std::vector<xlog::queue::log_entry_t> summaries{};
+
+                this->expire(now, summaries);
+
+                auto kept{std::remove_if(batch.begin(), batch.end(), [&](const xlog::queue::log_entry_t& entry) -> bool {
+                    return this->absorb(entry, now, summaries);
+                })};
+
+                batch.erase(kept, batch.end());
+
+                for (auto&& entry : summaries) {
+                    batch.push_back(std::move(entry));
+                }
+            }
+
+            /* repeats still counting in open windows are shipped rather than lost */
+            void drain(std::vector<xlog::queue::log_entry_t>& batch) override {
+                // least recently seen first, roughly the order their windows would have closed in
+                for (auto slot{this->slots.rbegin()}; slot != this->slots.rend(); slot++) {
+                    this->summarize(*slot, batch);
+                }
+
+                this->slots.clear();
+                this->lookup.clear();
+                this->windows.clear();
+            }
+
+            /* summaries are shipped at most one window late when the source goes quiet */
+            int64_t poll_interval_ms() const override {
+                return this->pending_summaries ? this->options.window_ms : -1;
+            }
+        };
+
+        std::unique_ptr<xlog::stage> create(const xlog::dedup::options& options) {
+            if (options.window_ms <= 0 || !options.maximum_entries) {
+                debug::print("dedup", "window_ms and max_entries must be positive");
+
+                return nullptr;
+            }
+
+            try {
+                return std::make_unique<xlog::dedup::dedup_stage>(options);
+            } catch (const std::regex_error& e) {
+                debug::print("dedup", "invalid ignore pattern, error: {}", e.what());
+            }
+
+            return nullptr;
+        }
+    }
+}
@@ -1,107 +1,620 @@
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
 #include <exception>
 #include <fstream>
-#include <future>
+#include <functional>
 #include <ios>
 #include <iosfwd>
 #include <iostream>
-#include <sstream>
+#include <memory>
+#include <optional>
+#include <regex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
+#include "checkpoint.hpp"
 #include "debug.hpp"
 #include "config.hpp"
 #include "filenotify.hpp"
+#include "linesplitter.hpp"
+#include "multiline.hpp"
+#include "realtime.hpp"
+#include "workpool.hpp"
 #include "xlog.hpp"
+#include "xlogfileuring.hpp"
+#include "xlogsource.hpp"
 
 namespace xlog {
     namespace file {
-        static std::vector<std::future<void>> g_worker_list{};
+        static constexpr size_t g_read_chunk_size{64 * 1024};
+
+        static constexpr size_t g_backfill_chunk_size{1024 * 1024};
+        static constexpr int64_t g_backfill_tick_ms{10};
+        /* chunks split at once per tick */
+        static constexpr size_t g_backfill_parallelism{8};
 
-        static void worker(std::string identifier, std::string source_filename) {
-            auto get_source_file_size = [source_filename]() -> std::streampos {
-                std::ifstream stream(source_filename, std::ios_base::in | std::ios_base::ate);
-                return stream.tellg();
-            };
+        static std::string checkpoint_key(const std::string& identifier, const std::string& path) {
+            return "file:" + identifier + ":" + path;
+        }
+
+        std::optional<uint64_t> resume_position(const YAML::Node& state, const std::string& path, uint64_t inode, uint64_t size) {
+            if (!state.IsMap()) {
+                return std::nullopt;
+            }
 
             try {
-                std::streampos position{get_source_file_size()};
+                auto position{state["position"].as<uint64_t>()};
 
-                filenotify filenotify(source_filename);
+                if (state["inode"].as<uint64_t>() != inode || position > size) {
+                    debug::print("file", "'{}' was replaced or truncated since its checkpoint, not resuming it", path);
 
-                while (true) {
-                    if (!filenotify.wait()) {
-                        break;
-                    }
+                    return std::nullopt;
+                }
+
+                return position;
+            } catch (const std::exception& e) {
+                debug::print("file", "ignoring unreadable checkpoint of '{}', error: {}", path, e.what());
+            }
+
+            return std::nullopt;
+        }
+
+        std::optional<uint64_t> resume_position(const std::string& identifier, const std::string& path, uint64_t inode, uint64_t size) {
+            return xlog::file::resume_position(checkpoint::load(xlog::file::checkpoint_key(identifier, path)), path, inode, size);
+        }
+
+        YAML::Node position_state(uint64_t inode, uint64_t position) {
+            YAML::Node state{};
+            state["inode"] = inode;
+            state["position"] = position;
+
+            return state;
+        }
+
+        void store_position(const std::string& identifier, const std::string& path, uint64_t inode, uint64_t position) {
+            checkpoint::store(xlog::file::checkpoint_key(identifier, path), xlog::file::position_state(inode, position));
+        }
+
+        class file_source : public xlog::source {
+        private:
+            std::string identifier{};
+            std::string source_filename{};
+            xlog::file::options options{};
+            uint64_t position{0};
+            bool initial_read{false};
+            std::optional<filenotify> notify{};
+            filenotify_event pending_event{filenotify_event::none};
+            linesplitter splitter{};
+            std::vector<std::string> lines{};
+            std::optional<multiline> aggregator{};
+            std::vector<std::string> events{};
+            std::optional<uint64_t> checkpointed{};
+
+        #ifndef _WIN32
+            int file_handle{-1};
+            ino_t file_inode{0};
+            uint64_t file_size{0};
+            bool read_queued{false};
+
+            struct {
+                const char* mapping{nullptr};
+                size_t mapped_length{0};
+                size_t length{0};
+                size_t offset{0};
+                double budget{0};
+                std::chrono::steady_clock::time_point last_tick{};
+                /* the strongest event seen while backfilling; live lines are read once the backfill is done */
+                filenotify_event held{filenotify_event::none};
+            } backfill{};
+
+            uint64_t token() const {
+                return reinterpret_cast<uint64_t>(this);
+            }
+
+            void close_file() {
+                if (this->read_queued) {
+                    xlog::file::uring::release(this->token());
+                    this->read_queued = false;
+                }
+
+                if (this->file_handle != -1) {
+                    ::close(this->file_handle);
+                    this->file_handle = -1;
+                }
+            }
 
-                    std::streampos new_position_check{get_source_file_size()};
+            /* opens the file behind the path; a missing file isn't an error, it's picked up once created */
+            bool open_file(bool seek_end) {
+                this->file_handle = ::open(this->source_filename.c_str(), O_RDONLY | O_CLOEXEC);
 
-                    if (new_position_check < position) {
-                        position = new_position_check;
+                if (this->file_handle == -1) {
+                    if (errno != ENOENT) {
+                        debug::print("file", "failed to open file '{}' for reading, error: {}", this->source_filename, std::strerror(errno));
+
+                        return false;
                     }
 
-                    std::ifstream file_stream(source_filename, std::ios_base::in);
+                    return true;
+                }
 
-                    if (file_stream.is_open()) {
-                        if (!file_stream.seekg(position)) {
-                            file_stream.clear();
-                            file_stream.seekg(0);
+                struct stat file_stat{};
 
-                            debug::print("file", "failed to seek to previus position, setting to 0");
-                        }
+                if (fstat(this->file_handle, &file_stat) == -1) {
+                    debug::print("file", "failed to stat file '{}', error: {}", this->source_filename, std::strerror(errno));
+                    this->close_file();
 
-                        int chr{0};
-                        std::string blob{};
+                    return false;
+                }
+
+                this->file_inode = file_stat.st_ino;
+                this->file_size = static_cast<uint64_t>(file_stat.st_size);
+                this->position = seek_end ? this->file_size : 0;
 
-                        while (true) {
-                            chr = file_stream.get();
+                return true;
+            }
 
-                            if (file_stream.fail() || file_stream.eof()) {
-                                break;
-                            }
+            void read_available() {
+                std::array<char, g_read_chunk_size> chunk{};
 
-                            if (!chr) { continue; }
-                            if (chr == '\r') { continue; }
+                while (this->file_handle != -1) {
+                    auto read_length{::pread(this->file_handle, chunk.data(), chunk.size(), static_cast<off_t>(this->position))};
 
-                            blob.push_back(static_cast<char>(chr));
+                    if (read_length == -1) {
+                        if (errno == EINTR) {
+                            continue;
                         }
 
-                        file_stream.clear();
-                        position = file_stream.tellg();
+                        debug::print("file", "failed to read file '{}', error: {}", this->source_filename, std::strerror(errno));
 
-                        if (!blob.empty()) {
-                            if (!blob.ends_with('\n')) {
-                                blob.push_back('\n');
-                            }
+                        return;
+                    }
 
-                            std::string line{};
-                            std::stringstream blob_stream(blob);
+                    this->splitter.feed(std::string_view(chunk.data(), static_cast<size_t>(read_length)), this->lines);
+                    this->position += static_cast<uint64_t>(read_length);
 
-                            while (std::getline(blob_stream, line)) {
-                                if (config::field_verbose) {
-                                    debug::print("file", "detected line from '{}': '{}'", source_filename, line);
-                                }
+                    if (static_cast<size_t>(read_length) < chunk.size()) {
+                        return;
+                    }
+                }
+            }
 
-                                auto timestamp{static_cast<int64_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count())};
-                                xlog::queue::insert(std::make_tuple(identifier, timestamp, line));
-                            }
+            /* follows rotation and truncation; leaves file_size current */
+            bool sync_file(filenotify_event event) {
+                if (event == filenotify_event::replaced || this->file_handle == -1) {
+                    struct stat path_stat{};
+
+                    if (stat(this->source_filename.c_str(), &path_stat) == 0 && (this->file_handle == -1 || path_stat.st_ino != this->file_inode)) {
+                        // whatever reached the old file before the rotation is still shipped
+                        this->read_available();
+                        this->close_file();
+
+                        if (!this->open_file(false)) {
+                            return false;
                         }
 
-                    } else {
-                        debug::print("file", "failed to open file '{}' for reading", source_filename);
-                        return;
+                        debug::print("file", "file '{}' was replaced, reading the new file from the start", this->source_filename);
                     }
                 }
-            } catch (const std::exception& e) {
-                debug::print("file", "error occured while working on file '{}'; error: {}; stopping worker", source_filename, e.what());
+
+                if (this->file_handle == -1) {
+                    return true;
+                }
+
+                struct stat file_stat{};
+
+                if (fstat(this->file_handle, &file_stat) == -1) {
+                    debug::print("file", "failed to stat file '{}', error: {}", this->source_filename, std::strerror(errno));
+
+                    return false;
+                }
+
+                this->file_size = static_cast<uint64_t>(file_stat.st_size);
+
+                if (this->file_size < this->position) {
+                    this->position = this->file_size;
+                }
+
+                return true;
             }
 
-            (void)(identifier);
-        }
+            /* maps the existing content up to its last newline; live tailing continues from there */
+            void start_backfill() {
+                if (this->file_handle == -1 || !this->file_size) {
+                    return;
+                }
+
+                auto mapping{mmap(nullptr, this->file_size, PROT_READ, MAP_PRIVATE, this->file_handle, 0)};
+
+                if (mapping == MAP_FAILED) {
+                    debug::print("file", "failed to map file '{}' for backfill, reading it in order instead, error: {}", this->source_filename, std::strerror(errno));
+                    this->initial_read = true;
+
+                    return;
+                }
+
+                madvise(mapping, this->file_size, MADV_SEQUENTIAL);
+
+                auto data{static_cast<const char*>(mapping)};
+                auto last_newline{static_cast<const char*>(memrchr(data, '\n', this->file_size))};
+
+                if (!last_newline) {
+                    munmap(mapping, this->file_size);
+                    this->initial_read = true;
+
+                    return;
+                }
+
+                // the unterminated tail belongs to the live path
+                this->backfill.mapping = data;
+                this->backfill.mapped_length = this->file_size;
+                this->backfill.length = static_cast<size_t>(last_newline - data) + 1;
+                this->backfill.offset = 0;
+                this->backfill.last_tick = std::chrono::steady_clock::now();
+                this->position = this->backfill.length;
+
+                debug::print("file", "backfilling {} bytes of '{}'", this->backfill.length, this->source_filename);
+            }
+
+            void stop_backfill() {
+                if (this->backfill.mapping) {
+                    munmap(const_cast<char*>(this->backfill.mapping), this->backfill.mapped_length);
+                    this->backfill.mapping = nullptr;
+                }
+            }
+
+            void read_backfill(std::vector<xlog::queue::log_entry_t>& batch) {
+                // leave room in the queue for live lines instead of evicting them
+                if (xlog::queue::size() >= config::current()->maximum_log_entries / 2) {
+                    return;
+                }
+
+                struct stat file_stat{};
+
+                // a truncated file would fault on the mapped pages past its new end
+                if (fstat(this->file_handle, &file_stat) == -1 || static_cast<size_t>(file_stat.st_size) < this->backfill.length) {
+                    debug::print("file", "file '{}' shrank during backfill, stopping it at offset {}", this->source_filename, this->backfill.offset);
+                    this->stop_backfill();
+
+                    return;
+                }
+
+                size_t parallelism{std::clamp<size_t>(std::thread::hardware_concurrency(), 1, g_backfill_parallelism)};
+                size_t allowed{parallelism * g_backfill_chunk_size};
+                auto now{std::chrono::steady_clock::now()};
+
+                if (this->options.backfill_rate_mb) {
+                    double rate{static_cast<double>(this->options.backfill_rate_mb) * 1024 * 1024};
+                    double elapsed{std::chrono::duration<double>(now - this->backfill.last_tick).count()};
+
+                    this->backfill.budget = std::min(this->backfill.budget + rate * elapsed, rate);
+                    allowed = std::min(allowed, static_cast<size_t>(this->backfill.budget));
+                }
+
+                this->backfill.last_tick = now;
+
+                std::vector<std::string_view> chunks{};
+                size_t consumed{0};
+
+                while (chunks.size() < parallelism && consumed < allowed && this->backfill.offset < this->backfill.length) {
+                    auto begin{this->backfill.mapping + this->backfill.offset};
+                    auto remaining{this->backfill.length - this->backfill.offset};
+                    auto length{std::min(remaining, g_backfill_chunk_size)};
+                    auto newline{static_cast<const char*>(std::memchr(begin + length - 1, '\n', remaining - length + 1))};
+
+                    length = static_cast<size_t>(newline - begin) + 1;
+
+                    chunks.emplace_back(begin, length);
+                    this->backfill.offset += length;
+                    consumed += length;
+                }
+
+                if (this->options.backfill_rate_mb) {
+                    this->backfill.budget -= static_cast<double>(consumed);
+                }
+
+                // the chunks are newline-aligned, so each splits on its own; the worker pool keeps the threads across ticks
+                std::vector<std::vector<std::string>> split(chunks.size());
+                std::vector<std::function<void()>> tasks{};
+
+                for (size_t i{0}; i < chunks.size(); i++) {
+                    tasks.emplace_back([&chunks, &split, i]() {
+                        linesplitter splitter{};
+                        splitter.feed(chunks[i], split[i]);
+                    });
+                }
+
+                workpool::run(tasks);
+
+                for (auto&& lines : split) {
+                    this->lines.insert(this->lines.end(), std::make_move_iterator(lines.begin()), std::make_move_iterator(lines.end()));
+                }
+
+                this->emit(batch);
+
+                if (this->backfill.offset >= this->backfill.length) {
+                    debug::print("file", "backfill of '{}' done, tailing from offset {}", this->source_filename, this->backfill.length);
+                    this->stop_backfill();
+                }
+            }
+        #else
+            void read_available() {
+                std::ifstream size_stream(this->source_filename, std::ios_base::in | std::ios_base::ate);
+                auto file_size{static_cast<uint64_t>(std::max<std::streamoff>(size_stream.tellg(), 0))};
+
+                if (file_size < this->position) {
+                    this->position = file_size;
+                }
+
+                std::ifstream file_stream(this->source_filename, std::ios_base::in | std::ios_base::binary);
+
+                if (!file_stream.is_open()) {
+                    debug::print("file", "failed to open file '{}' for reading", this->source_filename);
+
+                    return;
+                }
+
+                if (!file_stream.seekg(static_cast<std::streamoff>(this->position))) {
+                    file_stream.clear();
+                    file_stream.seekg(0);
+                    this->position = 0;
+
+                    debug::print("file", "failed to seek to previus position, setting to 0");
+                }
+
+                std::array<char, g_read_chunk_size> chunk{};
+
+                while (file_stream.read(chunk.data(), chunk.size()) || file_stream.gcount()) {
+                    this->splitter.feed(std::string_view(chunk.data(), static_cast<size_t>(file_stream.gcount())), this->lines);
+                    this->position += static_cast<uint64_t>(file_stream.gcount());
+                }
+            }
+        #endif
+
+            void emit(std::vector<xlog::queue::log_entry_t>& batch, bool force = false) {
+                if (this->aggregator) {
+                    this->aggregator->feed(this->lines, this->events);
+                    this->aggregator->flush(this->events, force);
+                    this->lines.swap(this->events);
+                }
+
+                const bool verbose{config::current()->verbose};
+                const auto timestamp{realtime::coarse_ns()};
+
+                for (auto&& line : this->lines) {
+                    if (verbose) {
+                        debug::print("file", "detected line from '{}': '{}'", this->source_filename, line);
+                    }
+
+                    batch.push_back(xlog::queue::log_entry_t{.identifier = this->identifier, .timestamp = timestamp, .message = std::move(line)});
+                }
+
+                this->lines.clear();
+            }
+        public:
+            file_source(std::string identifier, std::string source_filename, const xlog::file::options& options)
+                : identifier(std::move(identifier)), source_filename(std::move(source_filename)), options(options) {}
+
+        #ifndef _WIN32
+            ~file_source() override {
+                this->stop_backfill();
+                this->close_file();
+            }
+        #endif
+
+            std::string name() const override {
+                return "file:" + this->source_filename;
+            }
+
+            bool open() override {
+                if (this->options.multiline) {
+                    try {
+                        this->aggregator.emplace(*this->options.multiline);
+                    } catch (const std::regex_error& e) {
+                        debug::print("file", "invalid multiline pattern for '{}'; error: {}", this->source_filename, e.what());
+
+                        return false;
+                    }
+                }
+
+                try {
+                    this->notify.emplace(this->source_filename);
+                } catch (const std::exception& e) {
+                    debug::print("file", "failed to watch file '{}'; error: {}", this->source_filename, e.what());
+
+                    return false;
+                }
+
+            #ifdef _WIN32
+                if (this->options.backfill) {
+                    debug::print("file", "backfill isn't supported on this platform, reading '{}' in order instead", this->source_filename);
+                }
+
+                std::ifstream stream(this->source_filename, std::ios_base::in | std::ios_base::ate);
+                auto file_size{static_cast<uint64_t>(std::max<std::streamoff>(stream.tellg(), 0))};
+
+                if (auto resumed{xlog::file::resume_position(this->identifier, this->source_filename, 0, file_size)}) {
+                    debug::print("file", "resuming '{}' at offset {}", this->source_filename, *resumed);
+                    this->position = *resumed;
+                    this->initial_read = true;
+                } else if (this->options.start_at_beginning) {
+                    this->initial_read = true;
+                } else {
+                    this->position = file_size;
+                }
+
+                return true;
+            #else
+                if (!this->open_file(!this->options.start_at_beginning)) {
+                    return false;
+                }
+
+                auto resumed{this->file_handle != -1
+                    ? xlog::file::resume_position(this->identifier, this->source_filename, static_cast<uint64_t>(this->file_inode), this->file_size)
+                    : std::nullopt};
+
+                if (resumed) {
+                    debug::print("file", "resuming '{}' at offset {}", this->source_filename, *resumed);
+                    this->position = *resumed;
+                    this->initial_read = true;
+                } else if (this->options.backfill) {
+                    this->start_backfill();
+                } else if (this->options.start_at_beginning) {
+                    this->initial_read = true;
+                }
+
+                return true;
+            #endif
+            }
+
+            xlog::source_handle_t poll_handle() const override {
+                return this->notify->native_handle();
+            }
+
+            int64_t poll_interval_ms() const override {
+            #ifndef _WIN32
+                if (this->backfill.mapping) {
+                    return g_backfill_tick_ms;
+                }
+            #endif
+
+                if (this->initial_read) {
+                    return 0;
+                }
+
+                return this->aggregator && this->aggregator->pending() ? this->aggregator->flush_timeout_ms() : -1;
+            }
+
+            void prepare() override {
+                this->pending_event = this->notify->consume();
+
+            #ifndef _WIN32
+                if (this->pending_event == filenotify_event::none || !xlog::file::uring::enabled() || this->backfill.mapping) {
+                    return;
+                }
+
+                if (!this->sync_file(this->pending_event)) {
+                    return;
+                }
+
+                if (this->file_handle != -1 && this->file_size > this->position) {
+                    this->read_queued = xlog::file::uring::queue_read(this->file_handle, this->position, this->file_size - this->position, this->token());
+                }
+            #endif
+            }
+
+            bool read_batch(std::vector<xlog::queue::log_entry_t>& batch) override {
+                auto event{std::exchange(this->pending_event, filenotify_event::none)};
+
+            #ifndef _WIN32
+                if (this->backfill.mapping) {
+                    // live lines wait for the backfill, so they don't land in the middle of its multiline events
+                    this->backfill.held = std::max(this->backfill.held, event);
+                    this->read_backfill(batch);
+
+                    if (this->backfill.mapping) {
+                        return true;
+                    }
+
+                    if (!this->sync_file(std::exchange(this->backfill.held, filenotify_event::none))) {
+                        return false;
+                    }
+
+                    this->read_available();
+                    this->emit(batch);
+
+                    return true;
+                }
+            #endif
+
+                if (event == filenotify_event::none && !std::exchange(this->initial_read, false)) {
+                    // interval wakeups flush multiline events that timed out
+                    this->emit(batch);
+
+                    return true;
+                }
+
+            #ifdef _WIN32
+                this->read_available();
+            #else
+                if (this->read_queued) {
+                    this->read_queued = false;
+
+                    xlog::file::uring::complete(this->token(), [this](std::string_view data) {
+                        this->splitter.feed(data, this->lines);
+                        this->position += data.size();
+                    });
+
+                    if (this->position < this->file_size) {
+                        this->read_available();
+                    }
+                } else {
+                    if (!xlog::file::uring::enabled() && !this->sync_file(event)) {
+                        return false;
+                    }
+
+                    this->read_available();
+                }
+            #endif
+
+                this->emit(batch);
+
+                return true;
+            }
+
+            /* position counts what was read, so a crash can skip a partial last line or an open multiline
+               event; a stop or detach drains them first */
+            void checkpoint() override {
+            #ifdef _WIN32
+                uint64_t inode{0};
+            #else
+                // lines before the end of the backfill may not have been read yet
+                if (this->file_handle == -1 || this->backfill.mapping) {
+                    return;
+                }
+
+                auto inode{static_cast<uint64_t>(this->file_inode)};
+            #endif
+
+                if (this->checkpointed == this->position) {
+                    return;
+                }
+
+                xlog::file::store_position(this->identifier, this->source_filename, inode, this->position);
+                this->checkpointed = this->position;
+            }
+
+            /* the unterminated last line and an open multiline event would be lost otherwise */
+            void drain(std::vector<xlog::queue::log_entry_t>& batch) override {
+                std::string tail{};
+
+                if (this->splitter.flush(tail)) {
+                    this->lines.push_back(std::move(tail));
+                }
+
+                this->emit(batch, true);
+            }
+        };
+
+        bool start(std::string identifier, std::string source_filename, const xlog::file::options& options, const xlog::pipeline_t& pipeline) {
+            if (!xlog::reactor::attach(std::make_unique<xlog::file::file_source>(identifier, source_filename, options), pipeline)) {
+                return false;
+            }
 
-        bool start(std::string identifier, std::string source_filename) {
-            xlog::file::g_worker_list.push_back(std::async(xlog::file::worker, identifier, source_filename));
             debug::print("file", "started on file '{}'", source_filename);
 
-            return false;
+            return true;
         }
     }
 }
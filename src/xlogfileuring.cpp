@@ -0,0 +1,225 @@
+#ifdef ROUTE8_LOG_HAVE_IO_URING
+#include <liburing.h>
+#include <sys/uio.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include "config.hpp"
+#include "debug.hpp"
+#include "metrics.hpp"
+#include "xlogfileuring.hpp"
+
+namespace xlog {
+    namespace file {
+        namespace uring {
+        #ifdef ROUTE8_LOG_HAVE_IO_URING
+            static constexpr unsigned g_slot_count{64};
+            static constexpr size_t g_slot_size{64 * 1024};
+
+            /* slot owned by a read whose caller went away; freed once its completion is reaped */
+            static constexpr uint64_t g_orphan_token{std::numeric_limits<uint64_t>::max()};
+
+            /* io_uring_enter calls, each covering every read queued on the thread at the time */
+            static std::atomic<uint64_t>& g_submits{metrics::counter("file.uring.submits")};
+
+            class ring_state {
+            public:
+                io_uring ring{};
+                bool initialized{false};
+                bool usable{false};
+                std::unique_ptr<char[]> buffers{};
+                std::array<uint64_t, g_slot_count> slot_token{};
+                std::array<int, g_slot_count> slot_result{};
+                std::array<bool, g_slot_count> slot_done{};
+                unsigned queued{0};
+
+                ~ring_state() {
+                    if (this->usable) {
+                        io_uring_queue_exit(&this->ring);
+                    }
+                }
+
+                bool initialize() {
+                    if (this->initialized) {
+                        return this->usable;
+                    }
+
+                    this->initialized = true;
+
+                    auto result{io_uring_queue_init(g_slot_count, &this->ring, 0)};
+
+                    if (result < 0) {
+                        debug::print("file-uring", "io_uring is unavailable, falling back to plain reads, error: {}", std::strerror(-result));
+
+                        return false;
+                    }
+
+                    this->buffers = std::make_unique<char[]>(g_slot_count * g_slot_size);
+
+                    std::array<iovec, g_slot_count> iovecs{};
+
+                    for (unsigned slot{0}; slot < g_slot_count; slot++) {
+                        iovecs[slot].iov_base = this->buffers.get() + slot * g_slot_size;
+                        iovecs[slot].iov_len = g_slot_size;
+                    }
+
+                    result = io_uring_register_buffers(&this->ring, iovecs.data(), g_slot_count);
+
+                    if (result < 0) {
+                        debug::print("file-uring", "failed to register buffers, falling back to plain reads, error: {}", std::strerror(-result));
+                        io_uring_queue_exit(&this->ring);
+
+                        return false;
+                    }
+
+                    debug::print("file-uring", "reading files through io_uring, which is experimental");
+                    this->usable = true;
+
+                    return true;
+                }
+
+                void reap() {
+                    io_uring_cqe* cqe{nullptr};
+
+                    while (io_uring_peek_cqe(&this->ring, &cqe) == 0) {
+                        auto slot{io_uring_cqe_get_data64(cqe)};
+
+                        if (slot < g_slot_count) {
+                            if (this->slot_token[slot] == g_orphan_token) {
+                                this->slot_token[slot] = 0;
+                            } else {
+                                this->slot_result[slot] = cqe->res;
+                                this->slot_done[slot] = true;
+                            }
+                        }
+
+                        io_uring_cqe_seen(&this->ring, cqe);
+                    }
+                }
+
+                bool find_slot(uint64_t token, unsigned& slot) const {
+                    auto found{std::find(this->slot_token.begin(), this->slot_token.end(), token)};
+
+                    if (found == this->slot_token.end()) {
+                        return false;
+                    }
+
+                    slot = static_cast<unsigned>(found - this->slot_token.begin());
+
+                    return true;
+                }
+            };
+
+            static thread_local ring_state g_ring{};
+        #endif
+
+            bool enabled() {
+            #ifdef ROUTE8_LOG_HAVE_IO_URING
+                return config::current()->file_io_uring && xlog::file::uring::g_ring.initialize();
+            #else
+                return false;
+            #endif
+            }
+
+            bool queue_read(int file_handle, uint64_t offset, size_t length, uint64_t token) {
+            #ifdef ROUTE8_LOG_HAVE_IO_URING
+                auto& state{xlog::file::uring::g_ring};
+                unsigned slot{0};
+
+                if (!state.usable || !length || !state.find_slot(0, slot)) {
+                    return false;
+                }
+
+                auto sqe{io_uring_get_sqe(&state.ring)};
+
+                if (!sqe) {
+                    return false;
+                }
+
+                auto read_length{static_cast<unsigned>(std::min(length, g_slot_size))};
+                io_uring_prep_read_fixed(sqe, file_handle, state.buffers.get() + slot * g_slot_size, read_length, offset, static_cast<int>(slot));
+                io_uring_sqe_set_data64(sqe, slot);
+
+                state.slot_token[slot] = token;
+                state.slot_done[slot] = false;
+                state.queued++;
+
+                return true;
+            #else
+                (void)(file_handle);
+                (void)(offset);
+                (void)(length);
+                (void)(token);
+
+                return false;
+            #endif
+            }
+
+            bool complete(uint64_t token, const std::function<void(std::string_view)>& consumer) {
+            #ifdef ROUTE8_LOG_HAVE_IO_URING
+                auto& state{xlog::file::uring::g_ring};
+                unsigned slot{0};
+
+                if (!state.usable || !state.find_slot(token, slot)) {
+                    return false;
+                }
+
+                while (!state.slot_done[slot]) {
+                    // one io_uring_enter covers every read queued on this thread
+                    auto result{io_uring_submit_and_wait(&state.ring, std::max(state.queued, 1u))};
+                    xlog::file::uring::g_submits++;
+
+                    if (result < 0 && result != -EINTR) {
+                        debug::print("file-uring", "failed to submit reads, error: {}", std::strerror(-result));
+                        state.slot_token[slot] = g_orphan_token;
+
+                        return false;
+                    }
+
+                    state.queued = 0;
+                    state.reap();
+                }
+
+                state.slot_token[slot] = 0;
+
+                if (state.slot_result[slot] < 0) {
+                    debug::print("file-uring", "read failed, error: {}", std::strerror(-state.slot_result[slot]));
+
+                    return false;
+                }
+
+                consumer(std::string_view(state.buffers.get() + slot * g_slot_size, static_cast<size_t>(state.slot_result[slot])));
+
+                return true;
+            #else
+                (void)(token);
+                (void)(consumer);
+
+                return false;
+            #endif
+            }
+
+            void release(uint64_t token) {
+            #ifdef ROUTE8_LOG_HAVE_IO_URING
+                auto& state{xlog::file::uring::g_ring};
+                unsigned slot{0};
+
+                if (state.usable && state.find_slot(token, slot)) {
+                    state.slot_token[slot] = state.slot_done[slot] ? 0 : g_orphan_token;
+                }
+            #else
+                (void)(token);
+            #endif
+            }
+        }
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef __XLOGFILEURING_HPP
+#define __XLOGFILEURING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+/* io_uring read path for file sources; every reactor thread owns one ring with a pool of
+   registered buffers, reads queued during prepare() are submitted together on the first complete() */
+namespace xlog {
+    namespace file {
+        namespace uring {
+            /* false when disabled in the config, not compiled in or refused by the kernel */
+            bool enabled();
+
+            /* token identifies the caller and must not be 0 */
+            bool queue_read(int file_handle, uint64_t offset, size_t length, uint64_t token);
+
+            /* submits all queued reads of this thread, waits for them and hands the caller's data to consumer */
+            bool complete(uint64_t token, const std::function<void(std::string_view)>& consumer);
+
+            /* drops a queued read that won't be completed */
+            void release(uint64_t token);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <format>
+#include <memory>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ahocorasick.hpp"
+#include "debug.hpp"
+#include "metrics.hpp"
+#include "xlog.hpp"
+#include "xlogsource.hpp"
+
+namespace xlog {
+    namespace filter {
+        /* prefilter literals shorter than this reject too little to be worth it */
+        static constexpr size_t g_minimum_prefilter_length{3};
+
+        /* the longest run of plain characters every match of the pattern must contain; empty when none
+           can be proven (alternation, unusual syntax, or no literal long enough), and the regex then runs
+           without a prefilter */
+        static std::string required_literal(const std::string& pattern) {
+            if (pattern.find('|') != std::string::npos) {
+                return {};
+            }
+
+            std::string best{};
+            std::string run{};
+            int depth{0};
+            bool in_class{false};
+
+            auto end_run = [&]() {
+                if (run.length() > best.length()) {
+                    best = run;
+                }
+
+                run.clear();
+            };
+
+            for (size_t i{0}; i < pattern.length(); i++) {
+                char c{pattern[i]};
+                std::optional<char> literal{};
+
+                if (in_class) {
+                    if (c == '\\') {
+                        i++;
+                    } else if (c == ']') {
+                        in_class = false;
+                    }
+
+                    continue;
+                }
+
+                if (c == '\\') {
+                    if (i + 1 >= pattern.length()) {
+                        break;
+                    }
+
+                    char escaped{pattern[++i]};
+
+                    /* \d, \w, \b and friends are classes or assertions; escaped punctuation is literal */
+                    if (!std::isalnum(static_cast<unsigned char>(escaped))) {
+                        literal = escaped;
+                    } else {
+                        /* the operands of \xHH, \uHHHH, \cX and of back references aren't text of their own */
+                        size_t operand{escaped == 'x' ? 2u : escaped == 'u' ? 4u : escaped == 'c' ? 1u : 0u};
+
+                        if (i + operand >= pattern.length()) {
+                            return {};
+                        }
+
+                        i += operand;
+
+                        while (std::isdigit(static_cast<unsigned char>(escaped)) && i + 1 < pattern.length()
+                            && std::isdigit(static_cast<unsigned char>(pattern[i + 1]))) {
+                            i++;
+                        }
+                    }
+                } else if (c == '{') {
+                    /* a {m,n} quantifier; its character was already left out of the run */
+                    auto close{pattern.find('}', i)};
+
+                    if (close == std::string::npos) {
+                        return {};
+                    }
+
+                    i = close;
+                } else if (c == '[') {
+                    in_class = true;
+                } else if (c == '(') {
+                    depth++;
+                } else if (c == ')') {
+                    depth--;
+                } else if (std::string_view{".^$*+?{}"}.find(c) == std::string_view::npos) {
+                    literal = c;
+                }
+
+                if (!literal || depth) {
+                    end_run();
+                    continue;
+                }
+
+                /* a quantifier after the character makes it optional or repeated */
+                char next{i + 1 < pattern.length() ? pattern[i + 1] : '\0'};
+
+                if (next == '?' || next == '*' || next == '{') {
+                    end_run();
+                    continue;
+                }
+
+                run.push_back(*literal);
+
+                if (next == '+') {
+                    end_run();
+                }
+            }
+
+            end_run();
+
+            return best.length() >= xlog::filter::g_minimum_prefilter_length ? best : std::string{};
+        }
+
+        struct compiled_rule {
+            /* automaton identifier of the literal, or of the regex's prefilter */
+            std::optional<size_t> literal{};
+            std::optional<std::regex> regex{};
+            std::atomic<uint64_t>* hits{nullptr};
+        };
+
+        /* all literals and regex prefilters of a source share one automaton, so each line is scanned once */
+        class filter_stage : public xlog::stage {
+        private:
+            ahocorasick automaton{};
+            std::vector<xlog::filter::compiled_rule> include{};
+            std::vector<xlog::filter::compiled_rule> exclude{};
+            std::atomic<uint64_t>* not_included{nullptr};
+            std::vector<bool> matched{};
+
+            xlog::filter::compiled_rule compile(const std::string& identifier, const char* kind, const xlog::filter::rule& rule) {
+                xlog::filter::compiled_rule result{};
+
+                if (rule.regex) {
+                    result.regex.emplace(rule.pattern, std::regex::ECMAScript | std::regex::optimize);
+
+                    auto prefilter{xlog::filter::required_literal(rule.pattern)};
+
+                    if (!prefilter.empty()) {
+                        result.literal = this->automaton.add(prefilter);
+                    }
+                } else {
+                    result.literal = this->automaton.add(rule.pattern);
+                }
+
+                result.hits = &metrics::counter(std::format("filter.{}.{}.{}", identifier, kind, rule.pattern));
+
+                return result;
+            }
+
+            bool matches(const xlog::filter::compiled_rule& rule, const std::string& message) const {
+                if (rule.literal && !this->matched[*rule.literal]) {
+                    return false;
+                }
+
+                return !rule.regex || std::regex_search(message, *rule.regex);
+            }
+
+            /* the first matching rule is credited with the hit */
+            const xlog::filter::compiled_rule* find(const std::vector<xlog::filter::compiled_rule>& rules, const std::string& message) const {
+                for (auto&& rule : rules) {
+                    if (this->matches(rule, message)) {
+                        return &rule;
+                    }
+                }
+
+                return nullptr;
+            }
+        public:
+            /* throws std::regex_error on an invalid pattern */
+            filter_stage(const std::string& identifier, const xlog::filter::options& options) {
+                for (auto&& rule : options.include) {
+                    this->include.push_back(this->compile(identifier, "include", rule));
+                }
+
+                for (auto&& rule : options.exclude) {
+                    this->exclude.push_back(this->compile(identifier, "exclude", rule));
+                }
+
+                this->automaton.build();
+                this->not_included = &metrics::counter(std::format("filter.{}.not_included", identifier));
+            }
+
+            void process(std::vector<xlog::queue::log_entry_t>& batch) override {
+                auto kept{std::remove_if(batch.begin(), batch.end(), [this](const xlog::queue::log_entry_t& entry) -> bool {
+                    this->automaton.search(entry.message, this->matched);
+
+                    if (!this->include.empty()) {
+                        auto rule{this->find(this->include, entry.message)};
+
+                        if (!rule) {
+                            (*this->not_included)++;
+
+                            return true;
+                        }
+
+                        (*rule->hits)++;
+                    }
+
+                    auto rule{this->find(this->exclude, entry.message)};
+
+                    if (rule) {
+                        (*rule->hits)++;
+
+                        return true;
+                    }
+
+                    return false;
+                })};
+
+                batch.erase(kept, batch.end());
+            }
+        };
+
+        std::unique_ptr<xlog::stage> create(const std::string& identifier, const xlog::filter::options& options) {
+            for (auto&& rules : {&options.include, &options.exclude}) {
+                for (auto&& rule : *rules) {
+                    if (rule.pattern.empty()) {
+                        debug::print("filter", "empty pattern for '{}'", identifier);
+
+                        return nullptr;
+                    }
+                }
+            }
+
+            try {
+                return std::make_unique<xlog::filter::filter_stage>(identifier, options);
+            } catch (const std::regex_error& e) {
+                debug::print("filter", "invalid pattern for '{}', error: {}", identifier, e.what());
+            }
+
+            return nullptr;
+        }
+    }
+}
@@ -0,0 +1,599 @@
+#ifndef _WIN32
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "yaml-cpp/yaml.h"
+#include "checkpoint.hpp"
+#include "config.hpp"
+#include "debug.hpp"
+#include "linesplitter.hpp"
+#include "multiline.hpp"
+#include "realtime.hpp"
+#include "xlog.hpp"
+#include "xlogsource.hpp"
+
+namespace xlog {
+    namespace glob {
+        bool is_pattern(const std::string& path) {
+            return path.find_first_of("*?[") != std::string::npos;
+        }
+
+    #ifndef _WIN32
+        using glob_clock = std::chrono::steady_clock;
+
+        static constexpr size_t g_read_chunk_size{64 * 1024};
+        static constexpr uint32_t g_watch_mask{IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_MODIFY | IN_CLOSE_WRITE | IN_ONLYDIR};
+
+        struct watched_directory {
+            std::string path{};
+            /* index of the pattern component that entries of this directory are matched against */
+            size_t depth{0};
+        };
+
+        struct tailed_file {
+            int handle{-1};
+            ino_t inode{0};
+            uint64_t position{0};
+            std::optional<uint64_t> checkpointed{};
+            bool dirty{false};
+            glob_clock::time_point last_activity{};
+            linesplitter splitter{};
+            std::optional<multiline> aggregator{};
+        };
+
+        class glob_source : public xlog::source {
+        private:
+            std::string identifier{};
+            std::string pattern{};
+            xlog::glob::options options{};
+
+            /* the pattern splits into a literal root directory and the components matched below it */
+            std::string root{};
+            std::vector<std::string> components{};
+
+            int notify_handle{-1};
+            std::unordered_map<int, xlog::glob::watched_directory> directories{};
+            std::unordered_map<std::string, xlog::glob::tailed_file> files{};
+            size_t open_count{0};
+            /* recomputed after every read instead of walking all files on each reactor iteration */
+            int64_t interval{-1};
+
+            std::vector<std::string> lines{};
+            std::vector<std::string> events{};
+
+            /* all files' positions are stored as one node under glob:<identifier>; what the last run stored is only
+               looked at while the files present at startup are discovered */
+            std::string checkpoint_key{};
+            std::unordered_map<std::string, YAML::Node> resumable{};
+            bool retired{false};
+
+            void close_file(xlog::glob::tailed_file& file) {
+                if (file.handle != -1) {
+                    ::close(file.handle);
+                    file.handle = -1;
+                    this->open_count--;
+                }
+            }
+
+            /* closes the descriptor of the least recently written file to stay under the cap */
+            void make_room() {
+                while (this->open_count >= this->options.maximum_open_files) {
+                    xlog::glob::tailed_file* oldest{nullptr};
+
+                    for (auto&& [path, file] : this->files) {
+                        if (file.handle != -1 && (!oldest || file.last_activity < oldest->last_activity)) {
+                            oldest = &file;
+                        }
+                    }
+
+                    if (!oldest) {
+                        return;
+                    }
+
+                    this->close_file(*oldest);
+                }
+            }
+
+            /* a file whose descriptor was closed and whose path now holds another inode is read from the start */
+            bool open_file(const std::string& path, xlog::glob::tailed_file& file) {
+                if (file.handle != -1) {
+                    return true;
+                }
+
+                this->make_room();
+
+                file.handle = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+                if (file.handle == -1) {
+                    if (errno != ENOENT) {
+                        debug::print("glob", "failed to open file '{}' for reading, error: {}", path, std::strerror(errno));
+                    }
+
+                    return false;
+                }
+
+                this->open_count++;
+
+                struct stat file_stat{};
+
+                if (fstat(file.handle, &file_stat) == -1) {
+                    debug::print("glob", "failed to stat file '{}', error: {}", path, std::strerror(errno));
+                    this->close_file(file);
+
+                    return false;
+                }
+
+                if (file.inode && file.inode != file_stat.st_ino) {
+                    file.position = 0;
+                }
+
+                file.inode = file_stat.st_ino;
+
+                return true;
+            }
+
+            void emit(const std::string& path, xlog::glob::tailed_file& file, std::vector<xlog::queue::log_entry_t>& batch, bool force) {
+                if (file.aggregator) {
+                    file.aggregator->feed(this->lines, this->events);
+                    file.aggregator->flush(this->events, force);
+                    this->lines.swap(this->events);
+                }
+
+                const bool verbose{config::current()->verbose};
+                const auto timestamp{realtime::coarse_ns()};
+
+                for (auto&& line : this->lines) {
+                    if (verbose) {
+                        debug::print("glob", "detected line from '{}': '{}'", path, line);
+                    }
+
+                    batch.push_back(xlog::queue::log_entry_t{.identifier = this->identifier, .timestamp = timestamp, .message = std::move(line), .fields = {{"path", path}}});
+                }
+
+                this->lines.clear();
+            }
+
+            void read_file(const std::string& path, xlog::glob::tailed_file& file, std::vector<xlog::queue::log_entry_t>& batch) {
+                file.dirty = false;
+
+                if (!this->open_file(path, file)) {
+                    return;
+                }
+
+                struct stat file_stat{};
+
+                if (fstat(file.handle, &file_stat) == 0 && static_cast<uint64_t>(file_stat.st_size) < file.position) {
+                    file.position = static_cast<uint64_t>(file_stat.st_size);
+                }
+
+                std::array<char, g_read_chunk_size> chunk{};
+
+                while (true) {
+                    auto read_length{::pread(file.handle, chunk.data(), chunk.size(), static_cast<off_t>(file.position))};
+
+                    if (read_length == -1) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+
+                        debug::print("glob", "failed to read file '{}', error: {}", path, std::strerror(errno));
+
+                        break;
+                    }
+
+                    file.splitter.feed(std::string_view(chunk.data(), static_cast<size_t>(read_length)), this->lines);
+                    file.position += static_cast<uint64_t>(read_length);
+
+                    if (static_cast<size_t>(read_length) < chunk.size()) {
+                        break;
+                    }
+                }
+
+                file.last_activity = glob_clock::now();
+                this->emit(path, file, batch, false);
+            }
+
+            /* ships whatever the file still holds, including an unterminated last line, and forgets it */
+            void retire(const std::string& path, std::vector<xlog::queue::log_entry_t>& batch) {
+                auto found{this->files.find(path)};
+
+                if (found == this->files.end()) {
+                    return;
+                }
+
+                auto& file{found->second};
+
+                if (file.handle != -1) {
+                    this->read_file(path, file, batch);
+                }
+
+                std::string tail{};
+
+                if (file.splitter.flush(tail)) {
+                    this->lines.push_back(std::move(tail));
+                }
+
+                this->emit(path, file, batch, true);
+                this->close_file(file);
+                this->files.erase(found);
+                this->retired = true;
+
+                debug::print("glob", "retired file '{}'", path);
+            }
+
+            /* files present at startup resume from their checkpoint or follow start_at; files that appear later
+               are read from their start */
+            void discover(const std::string& path, bool initial) {
+                auto [found, inserted]{this->files.try_emplace(path)};
+                auto& file{found->second};
+
+                file.dirty = true;
+
+                if (!inserted) {
+                    return;
+                }
+
+                if (this->options.file.multiline) {
+                    file.aggregator.emplace(*this->options.file.multiline);
+                }
+
+                struct stat file_stat{};
+
+                if (stat(path.c_str(), &file_stat) == 0) {
+                    file.inode = file_stat.st_ino;
+
+                    auto size{static_cast<uint64_t>(file_stat.st_size)};
+                    auto stored{initial ? this->resumable.find(path) : this->resumable.end()};
+                    auto resumed{stored != this->resumable.end() ? xlog::file::resume_position(stored->second, path, static_cast<uint64_t>(file.inode), size) : std::nullopt};
+
+                    if (resumed) {
+                        file.position = *resumed;
+                    } else if (initial && !this->options.file.start_at_beginning) {
+                        file.position = size;
+                        file.dirty = false;
+                    }
+                }
+
+                file.last_activity = glob_clock::now();
+
+                debug::print("glob", "tailing file '{}' from offset {}", path, file.position);
+            }
+
+            bool matches(size_t depth, const char* name) const {
+                return fnmatch(this->components[depth].c_str(), name, FNM_PERIOD) == 0;
+            }
+
+            /* watches the directory and walks the part of it that matches the pattern */
+            void scan_directory(const std::string& path, size_t depth, bool initial) {
+                auto watch{inotify_add_watch(this->notify_handle, path.c_str(), g_watch_mask)};
+
+                if (watch == -1) {
+                    debug::print("glob", "failed to watch directory '{}', error: {}", path, std::strerror(errno));
+
+                    return;
+                }
+
+                this->directories[watch] = xlog::glob::watched_directory{.path = path, .depth = depth};
+
+                std::error_code error{};
+                auto last{depth + 1 == this->components.size()};
+
+                for (auto&& entry : std::filesystem::directory_iterator(path, error)) {
+                    auto name{entry.path().filename().string()};
+
+                    if (!this->matches(depth, name.c_str())) {
+                        continue;
+                    }
+
+                    std::error_code type_error{};
+
+                    if (!last && entry.is_directory(type_error)) {
+                        this->scan_directory(entry.path().string(), depth + 1, initial);
+                    } else if (last && entry.is_regular_file(type_error)) {
+                        this->discover(entry.path().string(), initial);
+                    }
+                }
+
+                if (error) {
+                    debug::print("glob", "failed to list directory '{}', error: {}", path, error.message());
+                }
+            }
+
+            /* returns false when the event queue overflowed and the tree has to be rescanned */
+            bool consume_events(std::vector<xlog::queue::log_entry_t>& batch) {
+                bool complete{true};
+
+                while (true) {
+                    alignas(inotify_event) char buffer[16 * 1024]{};
+                    auto read_length{::read(this->notify_handle, buffer, sizeof(buffer))};
+
+                    if (read_length <= 0) {
+                        if (read_length == -1 && errno != EAGAIN) {
+                            debug::print("glob", "failed to read from watch handle, error: {}", std::strerror(errno));
+                        }
+
+                        return complete;
+                    }
+
+                    for (char* ptr{buffer}; ptr < buffer + read_length; ptr += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(ptr)->len) {
+                        const inotify_event* event{reinterpret_cast<inotify_event*>(ptr)};
+
+                        if (event->mask & IN_Q_OVERFLOW) {
+                            complete = false;
+                            continue;
+                        }
+
+                        auto directory{this->directories.find(event->wd)};
+
+                        if (directory == this->directories.end()) {
+                            continue;
+                        }
+
+                        if (event->mask & IN_IGNORED) {
+                            this->directories.erase(directory);
+                            continue;
+                        }
+
+                        if (!event->len || !this->matches(directory->second.depth, event->name)) {
+                            continue;
+                        }
+
+                        auto depth{directory->second.depth};
+                        auto path{directory->second.path + "/" + event->name};
+                        auto last{depth + 1 == this->components.size()};
+
+                        if (event->mask & IN_ISDIR) {
+                            if (!last && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                                this->scan_directory(path, depth + 1, false);
+                            }
+
+                            continue;
+                        }
+
+                        if (!last) {
+                            continue;
+                        }
+
+                        if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                            this->retire(path, batch);
+                        } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                            // a new file under a known path replaces the old one
+                            this->retire(path, batch);
+                            this->discover(path, false);
+                        } else {
+                            this->discover(path, false);
+                        }
+                    }
+                }
+            }
+
+            /* wakes for multiline timeouts and to close idle descriptors */
+            void update_interval() {
+                this->interval = this->open_count ? this->options.idle_timeout_s * 1000 : -1;
+
+                for (auto&& [path, file] : this->files) {
+                    // files found at startup with start_at beginning are read on the first wakeup
+                    if (file.dirty) {
+                        this->interval = 0;
+
+                        return;
+                    }
+
+                    if (file.aggregator && file.aggregator->pending()) {
+                        auto timeout{file.aggregator->flush_timeout_ms()};
+                        this->interval = this->interval < 0 ? timeout : std::min(this->interval, timeout);
+                    }
+                }
+            }
+
+            void close_idle(glob_clock::time_point now) {
+                auto idle{std::chrono::seconds(this->options.idle_timeout_s)};
+
+                for (auto&& [path, file] : this->files) {
+                    if (file.handle != -1 && now - file.last_activity >= idle) {
+                        debug::print("glob", "closing idle file '{}'", path);
+                        this->close_file(file);
+                    }
+                }
+            }
+        public:
+            glob_source(std::string identifier, std::string pattern, const xlog::glob::options& options)
+                : identifier(std::move(identifier)), pattern(std::move(pattern)), options(options) {}
+
+            ~glob_source() override {
+                for (auto&& [path, file] : this->files) {
+                    this->close_file(file);
+                }
+
+                if (this->notify_handle != -1) {
+                    ::close(this->notify_handle);
+                }
+            }
+
+            std::string name() const override {
+                return "glob:" + this->pattern;
+            }
+
+            bool open() override {
+                if (this->options.file.backfill) {
+                    debug::print("glob", "backfill isn't supported for patterns, reading '{}' in order instead", this->pattern);
+                }
+
+                if (this->options.file.multiline) {
+                    try {
+                        multiline validate{*this->options.file.multiline};
+                    } catch (const std::regex_error& e) {
+                        debug::print("glob", "invalid multiline pattern for '{}'; error: {}", this->pattern, e.what());
+
+                        return false;
+                    }
+                }
+
+                std::filesystem::path path(this->pattern);
+                std::filesystem::path root{};
+                bool wildcard{false};
+
+                for (auto&& component : path) {
+                    if (!wildcard && xlog::glob::is_pattern(component.string())) {
+                        wildcard = true;
+                    }
+
+                    if (wildcard) {
+                        this->components.push_back(component.string());
+                    } else {
+                        root /= component;
+                    }
+                }
+
+                if (this->components.empty()) {
+                    debug::print("glob", "'{}' holds no wildcard", this->pattern);
+
+                    return false;
+                }
+
+                this->root = root.empty() ? std::string{"."} : root.string();
+                this->notify_handle = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+                if (this->notify_handle == -1) {
+                    debug::print("glob", "failed to create watch handle, error: {}", std::strerror(errno));
+
+                    return false;
+                }
+
+                this->checkpoint_key = "glob:" + this->identifier;
+
+                if (auto state{checkpoint::load(this->checkpoint_key)}; state.IsMap()) {
+                    for (auto&& entry : state) {
+                        this->resumable.emplace(entry.first.as<std::string>(), entry.second);
+                    }
+                }
+
+                this->scan_directory(this->root, 0, true);
+                this->resumable.clear();
+
+                if (this->directories.empty()) {
+                    return false;
+                }
+
+                debug::print("glob", "watching {} directories, {} files match '{}'", this->directories.size(), this->files.size(), this->pattern);
+                this->update_interval();
+
+                return true;
+            }
+
+            xlog::source_handle_t poll_handle() const override {
+                return this->notify_handle;
+            }
+
+            int64_t poll_interval_ms() const override {
+                return this->interval;
+            }
+
+            bool read_batch(std::vector<xlog::queue::log_entry_t>& batch) override {
+                if (!this->consume_events(batch)) {
+                    debug::print("glob", "watch queue overflowed, rescanning '{}'", this->pattern);
+                    this->scan_directory(this->root, 0, false);
+                }
+
+                for (auto&& [path, file] : this->files) {
+                    if (file.dirty) {
+                        this->read_file(path, file, batch);
+                    } else if (file.aggregator && file.aggregator->pending()) {
+                        this->emit(path, file, batch, false);
+                    }
+                }
+
+                this->close_idle(glob_clock::now());
+                this->update_interval();
+
+                return true;
+            }
+
+            /* like the file source's, positions count what was read; a stop or detach drains the rest first */
+            void checkpoint() override {
+                auto changed{std::exchange(this->retired, false)};
+
+                for (auto&& [path, file] : this->files) {
+                    if (file.checkpointed != file.position) {
+                        file.checkpointed = file.position;
+                        changed = true;
+                    }
+                }
+
+                if (!changed) {
+                    return;
+                }
+
+                YAML::Node state{YAML::NodeType::Map};
+
+                // force_insert appends without the key lookup operator[] does on every insert
+                for (auto&& [path, file] : this->files) {
+                    state.force_insert(path, xlog::file::position_state(static_cast<uint64_t>(file.inode), file.position));
+                }
+
+                checkpoint::store(this->checkpoint_key, state);
+            }
+
+            void drain(std::vector<xlog::queue::log_entry_t>& batch) override {
+                for (auto&& [path, file] : this->files) {
+                    std::string tail{};
+
+                    if (file.splitter.flush(tail)) {
+                        this->lines.push_back(std::move(tail));
+                    }
+
+                    this->emit(path, file, batch, true);
+                }
+            }
+        };
+
+        bool start(std::string identifier, std::string pattern, const xlog::glob::options& options, const xlog::pipeline_t& pipeline) {
+            if (!xlog::reactor::attach(std::make_unique<xlog::glob::glob_source>(identifier, pattern, options), pipeline)) {
+                return false;
+            }
+
+            debug::print("glob", "started on pattern '{}'", pattern);
+
+            return true;
+        }
+
+        bool platform_support() {
+            return true;
+        }
+    #else
+        bool start(std::string identifier, std::string pattern, const xlog::glob::options& options, const xlog::pipeline_t& pipeline) {
+            (void)(identifier);
+            (void)(pattern);
+            (void)(options);
+            (void)(pipeline);
+
+            return false;
+        }
+
+        bool platform_support() {
+            return false;
+        }
+    #endif
+    }
+}
@@ -1,46 +1,736 @@
 #include <exception>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <utility>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include "xlog.hpp"
 #include "yaml-cpp/node/node.h"
 #include "yaml-cpp/node/parse.h"
 #include "yaml-cpp/yaml.h"
 #include "debug.hpp"
+#include "xlogsource.hpp"
 
 namespace xlog {
-    static const char* g_filename{"log.yml"};
+    struct state_t {
+        std::string filename{};
+        /* running entries by entry_key(), with the group their sources were attached under */
+        std::mutex running_lock{};
+        std::unordered_map<std::string, uint64_t> running{};
+        uint64_t next_group{1};
+    };
+
+    static xlog::state_t* g_state{nullptr};
+
+    /* absent keys keep the value they were given */
+    template<typename T>
+    static bool load_optional_key(const YAML::Node& config, const char* entry_name, const char* key_name, T& value) {
+        if (!config[key_name]) {
+            return true;
+        }
+
+        if (!config[key_name].IsScalar()) {
+            debug::print("log", "{} entry's '{}' is not key-value type", entry_name, key_name);
+
+            return false;
+        }
+
+        try {
+            value = config[key_name].as<T>();
+        } catch (const std::exception& e) {
+            debug::print("log", "failed to load key '{}', error: {}", key_name, e.what());
+
+            return false;
+        }
+
+        return true;
+    }
+
+    template<typename T>
+    static bool load_optional_list(const YAML::Node& config, const char* entry_name, const char* key_name, std::vector<T>& values) {
+        if (!config[key_name]) {
+            return true;
+        }
+
+        if (!config[key_name].IsSequence()) {
+            debug::print("log", "{} entry's '{}' is not a list", entry_name, key_name);
+
+            return false;
+        }
+
+        try {
+            values = config[key_name].as<std::vector<T>>();
+        } catch (const std::exception& e) {
+            debug::print("log", "failed to load key '{}', error: {}", key_name, e.what());
+
+            return false;
+        }
+
+        return true;
+    }
+
+    static bool load_multiline(const YAML::Node& config, const char* entry_name, std::optional<multiline_options>& result) {
+        if (!config["multiline"]) {
+            return true;
+        }
+
+        const auto& node{config["multiline"]};
+
+        if (!node.IsMap()) {
+            debug::print("log", "{} entry's 'multiline' is not a map", entry_name);
+
+            return false;
+        }
+
+        multiline_options options{};
+
+        if (!xlog::load_optional_key(node, entry_name, "start", options.start_pattern)
+            || !xlog::load_optional_key(node, entry_name, "continuation", options.continuation_pattern)
+            || !xlog::load_optional_key(node, entry_name, "max_lines", options.maximum_lines)
+            || !xlog::load_optional_key(node, entry_name, "max_bytes", options.maximum_bytes)
+            || !xlog::load_optional_key(node, entry_name, "flush_timeout_ms", options.flush_timeout_ms)) {
+            return false;
+        }
+
+        if (options.start_pattern.empty() == options.continuation_pattern.empty()) {
+            debug::print("log", "{} entry's 'multiline' needs exactly one of 'start' or 'continuation'", entry_name);
+
+            return false;
+        }
+
+        if (!options.maximum_lines || !options.maximum_bytes || options.flush_timeout_ms < 0) {
+            debug::print("log", "{} entry's 'multiline' limits must be positive", entry_name);
+
+            return false;
+        }
+
+        result = options;
+
+        return true;
+    }
+
+    /* a rule is either a plain substring or a map with one of 'literal' or 'regex' */
+    static bool load_filter_rules(const YAML::Node& config, const char* entry_name, const char* key_name, std::vector<xlog::filter::rule>& rules) {
+        if (!config[key_name]) {
+            return true;
+        }
+
+        if (!config[key_name].IsSequence()) {
+            debug::print("log", "{} entry's 'filter.{}' is not a list", entry_name, key_name);
+
+            return false;
+        }
+
+        for (auto&& node : config[key_name]) {
+            xlog::filter::rule rule{};
+
+            if (node.IsScalar()) {
+                rule.pattern = node.as<std::string>();
+            } else if (node.IsMap() && node["regex"]) {
+                rule.regex = true;
+
+                if (!xlog::load_optional_key(node, entry_name, "regex", rule.pattern)) {
+                    return false;
+                }
+            } else if (node.IsMap() && node["literal"]) {
+                if (!xlog::load_optional_key(node, entry_name, "literal", rule.pattern)) {
+                    return false;
+                }
+            } else {
+                debug::print("log", "{} entry's 'filter.{}' rules must be a string or a map with 'literal' or 'regex'", entry_name, key_name);
+
+                return false;
+            }
+
+            rules.push_back(std::move(rule));
+        }
+
+        return true;
+    }
+
+    /* 'severity: true' keeps the defaults; a map may set 'field', 'keywords' and 'rules', where a rule is a map
+       with one of 'prefix', 'literal' or 'regex' and a 'level' given as a number or a name */
+    static bool load_severity(const YAML::Node& node, const char* entry_name, xlog::severity::options& options) {
+        if (node.IsScalar()) {
+            bool enabled{false};
+
+            if (!YAML::convert<bool>::decode(node, enabled) || !enabled) {
+                debug::print("log", "{} entry's 'severity' is neither true nor a map", entry_name);
+
+                return false;
+            }
+
+            return true;
+        }
+
+        if (!node.IsMap()) {
+            debug::print("log", "{} entry's 'severity' is neither true nor a map", entry_name);
+
+            return false;
+        }
+
+        if (!xlog::load_optional_key(node, entry_name, "field", options.field)
+            || !xlog::load_optional_key(node, entry_name, "keywords", options.keywords)) {
+            return false;
+        }
+
+        if (!node["rules"]) {
+            return true;
+        }
+
+        if (!node["rules"].IsSequence()) {
+            debug::print("log", "{} entry's 'severity.rules' is not a list", entry_name);
+
+            return false;
+        }
+
+        static const std::pair<const char*, xlog::severity::match> kinds[]{
+            {"prefix", xlog::severity::match::prefix},
+            {"literal", xlog::severity::match::literal},
+            {"regex", xlog::severity::match::regex},
+        };
+
+        for (auto&& rule_node : node["rules"]) {
+            xlog::severity::rule rule{};
+            std::string level{};
+            bool found{false};
+
+            if (!rule_node.IsMap()) {
+                debug::print("log", "{} entry's 'severity.rules' must be maps", entry_name);
+
+                return false;
+            }
+
+            for (auto&& [key, kind] : kinds) {
+                if (rule_node[key]) {
+                    found = true;
+                    rule.kind = kind;
+
+                    if (!xlog::load_optional_key(rule_node, entry_name, key, rule.pattern)) {
+                        return false;
+                    }
+
+                    break;
+                }
+            }
+
+            if (!xlog::load_optional_key(rule_node, entry_name, "level", level)) {
+                return false;
+            }
+
+            auto parsed{xlog::severity::parse_level(level)};
+
+            if (!found || !parsed) {
+                debug::print("log", "{} entry's 'severity.rules' need one of 'prefix', 'literal' or 'regex' and a level", entry_name);
+
+                return false;
+            }
+
+            rule.level = *parsed;
+            options.rules.push_back(std::move(rule));
+        }
+
+        return true;
+    }
+
+    /* a map with 'interval_ms', 'drop', 'max_series', an optional 'pattern' shared by its metrics and an 'extract' list;
+       a metric is a map with 'name', 'type' (counter, gauge or histogram), 'labels', 'value' and its own 'pattern' */
+    static bool load_aggregate(const YAML::Node& node, const char* entry_name, xlog::aggregate::options& options) {
+        if (!node.IsMap()) {
+            debug::print("log", "{} entry's 'metrics' is not a map", entry_name);
+
+            return false;
+        }
+
+        std::string pattern{};
+
+        if (!xlog::load_optional_key(node, entry_name, "interval_ms", options.interval_ms)
+            || !xlog::load_optional_key(node, entry_name, "drop", options.drop)
+            || !xlog::load_optional_key(node, entry_name, "max_series", options.maximum_series)
+            || !xlog::load_optional_key(node, entry_name, "pattern", pattern)) {
+            return false;
+        }
+
+        if (!node["extract"] || !node["extract"].IsSequence()) {
+            debug::print("log", "{} entry's 'metrics.extract' is not a list", entry_name);
+
+            return false;
+        }
+
+        static const std::pair<const char*, xlog::aggregate::kind> kinds[]{
+            {"counter", xlog::aggregate::kind::counter},
+            {"gauge", xlog::aggregate::kind::gauge},
+            {"histogram", xlog::aggregate::kind::histogram},
+        };
+
+        for (auto&& metric_node : node["extract"]) {
+            xlog::aggregate::metric metric{.pattern = pattern};
+            std::string type{"counter"};
+            bool found{false};
+
+            if (!metric_node.IsMap()) {
+                debug::print("log", "{} entry's 'metrics.extract' must be maps", entry_name);
+
+                return false;
+            }
+
+            if (!xlog::load_optional_key(metric_node, entry_name, "name", metric.name)
+                || !xlog::load_optional_key(metric_node, entry_name, "type", type)
+                || !xlog::load_optional_key(metric_node, entry_name, "pattern", metric.pattern)
+                || !xlog::load_optional_key(metric_node, entry_name, "value", metric.value)) {
+                return false;
+            }
+
+            for (auto&& [name, kind] : kinds) {
+                if (type == name) {
+                    found = true;
+                    metric.type = kind;
+                }
+            }
+
+            if (!found) {
+                debug::print("log", "{} entry's metric '{}' has unknown type '{}'", entry_name, metric.name, type);
+
+                return false;
+            }
+
+            if (metric_node["labels"]) {
+                if (!metric_node["labels"].IsSequence()) {
+                    debug::print("log", "{} entry's metric '{}' labels are not a list", entry_name, metric.name);
+
+                    return false;
+                }
+
+                try {
+                    metric.labels = metric_node["labels"].as<std::vector<std::string>>();
+                } catch (const std::exception& e) {
+                    debug::print("log", "failed to load key 'labels', error: {}", e.what());
+
+                    return false;
+                }
+            }
+
+            options.metrics.push_back(std::move(metric));
+        }
+
+        return true;
+    }
+
+    /* processing keys shared by every entry type; the factory is validated by building it once */
+    static bool load_stages(const YAML::Node& config, const char* entry_name, xlog::stage_factory_t& result) {
+        std::string identifier{config["identifier"].as<std::string>()};
+        std::optional<xlog::filter::options> filter{};
+        std::optional<xlog::dedup::options> dedup{};
+        std::optional<xlog::parser::options> parser{};
+        std::optional<xlog::timestamp::options> timestamp{};
+        std::optional<xlog::severity::options> severity{};
+        std::optional<xlog::aggregate::options> aggregate{};
+
+        if (config["filter"]) {
+            const auto& node{config["filter"]};
+            xlog::filter::options options{};
+
+            if (!node.IsMap()) {
+                debug::print("log", "{} entry's 'filter' is not a map", entry_name);
+
+                return false;
+            }
+
+            if (!xlog::load_filter_rules(node, entry_name, "include", options.include)
+                || !xlog::load_filter_rules(node, entry_name, "exclude", options.exclude)) {
+                return false;
+            }
+
+            filter = options;
+        }
+
+        if (config["dedup"]) {
+            const auto& node{config["dedup"]};
+            xlog::dedup::options options{};
+
+            if (!node.IsMap()) {
+                debug::print("log", "{} entry's 'dedup' is not a map", entry_name);
+
+                return false;
+            }
+
+            if (!xlog::load_optional_key(node, entry_name, "window_ms", options.window_ms)
+                || !xlog::load_optional_key(node, entry_name, "max_entries", options.maximum_entries)
+                || !xlog::load_optional_key(node, entry_name, "ignore_numbers", options.ignore_numbers)) {
+                return false;
+            }
+
+            if (node["ignore"]) {
+                if (!node["ignore"].IsSequence()) {
+                    debug::print("log", "{} entry's 'dedup.ignore' is not a list", entry_name);
+
+                    return false;
+                }
+
+                try {
+                    options.ignore = node["ignore"].as<std::vector<std::string>>();
+                } catch (const std::exception& e) {
+                    debug::print("log", "failed to load key 'ignore', error: {}", e.what());
+
+                    return false;
+                }
+            }
+
+            dedup = options;
+        }
+
+        if (config["parser"]) {
+            const auto& node{config["parser"]};
+            xlog::parser::options options{};
+
+            if (node.IsScalar()) {
+                options.type = node.as<std::string>();
+            } else if (node.IsMap()) {
+                if (!xlog::load_optional_key(node, entry_name, "type", options.type)
+                    || !xlog::load_optional_key(node, entry_name, "pattern", options.pattern)) {
+                    return false;
+                }
+            } else {
+                debug::print("log", "{} entry's 'parser' is neither key-value nor a map", entry_name);
+
+                return false;
+            }
+
+            parser = options;
+        }
+
+        if (config["timestamp"]) {
+            const auto& node{config["timestamp"]};
+            xlog::timestamp::options options{};
+
+            if (node.IsScalar()) {
+                options.format = node.as<std::string>();
+            } else if (node.IsMap()) {
+                if (!xlog::load_optional_key(node, entry_name, "format", options.format)
+                    || !xlog::load_optional_key(node, entry_name, "field", options.field)) {
+                    return false;
+                }
+            } else {
+                debug::print("log", "{} entry's 'timestamp' is neither key-value nor a map", entry_name);
+
+                return false;
+            }
+
+            timestamp = options;
+        }
+
+        if (config["severity"]) {
+            xlog::severity::options options{};
+
+            if (!xlog::load_severity(config["severity"], entry_name, options)) {
+                return false;
+            }
+
+            severity = options;
+        }
+
+        if (config["metrics"]) {
+            xlog::aggregate::options options{};
+
+            if (!xlog::load_aggregate(config["metrics"], entry_name, options)) {
+                return false;
+            }
+
+            aggregate = options;
+        }
+
+        /* filtering and dedup run first so dropped and collapsed lines are never parsed;
+           timestamps and severities are read last so they can come from a parsed field, and metrics
+           are extracted after everything else so they can use all of it */
+        result = [identifier, filter, dedup, parser, timestamp, severity, aggregate]() -> xlog::stages_t {
+            xlog::stages_t stages{};
+
+            if (filter) {
+                if (auto stage{xlog::filter::create(identifier, *filter)}) {
+                    stages.push_back(std::move(stage));
+                }
+            }
+
+            if (dedup) {
+                if (auto stage{xlog::dedup::create(*dedup)}) {
+                    stages.push_back(std::move(stage));
+                }
+            }
+
+            if (parser) {
+                if (auto stage{xlog::parser::create(*parser)}) {
+                    stages.push_back(std::move(stage));
+                }
+            }
+
+            if (timestamp) {
+                if (auto stage{xlog::timestamp::create(identifier, *timestamp)}) {
+                    stages.push_back(std::move(stage));
+                }
+            }
+
+            if (severity) {
+                if (auto stage{xlog::severity::create(identifier, *severity)}) {
+                    stages.push_back(std::move(stage));
+                }
+            }
+
+            if (aggregate) {
+                if (auto stage{xlog::aggregate::create(identifier, *aggregate)}) {
+                    stages.push_back(std::move(stage));
+                }
+            }
+
+            return stages;
+        };
+
+        if (filter && !xlog::filter::create(identifier, *filter)) {
+            debug::print("log", "{} entry's 'filter' is invalid", entry_name);
+
+            return false;
+        }
+
+        if (dedup && !xlog::dedup::create(*dedup)) {
+            debug::print("log", "{} entry's 'dedup' is invalid", entry_name);
+
+            return false;
+        }
+
+        if (parser && !xlog::parser::create(*parser)) {
+            debug::print("log", "{} entry's 'parser' is invalid", entry_name);
+
+            return false;
+        }
+
+        if (timestamp && !xlog::timestamp::create(identifier, *timestamp)) {
+            debug::print("log", "{} entry's 'timestamp' is invalid", entry_name);
+
+            return false;
+        }
+
+        if (severity && !xlog::severity::create(identifier, *severity)) {
+            debug::print("log", "{} entry's 'severity' is invalid", entry_name);
+
+            return false;
+        }
+
+        if (aggregate && !xlog::aggregate::create(identifier, *aggregate)) {
+            debug::print("log", "{} entry's 'metrics' is invalid", entry_name);
+
+            return false;
+        }
+
+        return true;
+    }
+
+    /* unix_stream and fifo entries share their keys */
+    static bool check_stream(const YAML::Node& config, const char* entry_name) {
+        if (!xlog::stream::platform_support()) {
+            debug::print("log", "{} is not supported on this platform", entry_name);
+
+            return false;
+        }
+
+        if (!config["identifier"]) {
+            debug::print("log", "{} entry is missing key 'identifier'", entry_name);
+
+            return false;
+        }
+
+        if (!config["source"]) {
+            debug::print("log", "{} entry is missing key 'source'", entry_name);
+
+            return false;
+        }
+
+        if (!config["identifier"].IsScalar()) {
+            debug::print("log", "{} entry's 'identifier' is not key-value type", entry_name);
+
+            return false;
+        }
+
+        if (!config["source"].IsScalar()) {
+            debug::print("log", "{} entry's 'source' is not key-value type", entry_name);
+
+            return false;
+        }
+
+        return true;
+    }
+
+    static bool load_stream(const YAML::Node& config, const char* entry_name, std::string& identifier, std::string& source, xlog::stream::options& options) {
+        try {
+            identifier = config["identifier"].as<std::string>();
+        } catch (const std::exception& e) {
+            debug::print("log", "failed to load key 'identifier', error: {}", e.what());
+
+            return false;
+        }
+
+        try {
+            source = config["source"].as<std::string>();
+        } catch (const std::exception& e) {
+            debug::print("log", "failed to load key 'source', error: {}", e.what());
+
+            return false;
+        }
+
+        if (!xlog::load_optional_key(config, entry_name, "max_connections", options.maximum_connections)
+            || !xlog::load_optional_key(config, entry_name, "max_line_length", options.maximum_line_length)
+            || !xlog::load_optional_key(config, entry_name, "backpressure", options.backpressure)) {
+            return false;
+        }
+
+        if (!options.maximum_line_length) {
+            debug::print("log", "{} entry's 'max_line_length' must be positive", entry_name);
+
+            return false;
+        }
+
+        return true;
+    }
 
     struct LogEntry {
         const std::function<bool(const YAML::Node&)> check;
-        const std::function<bool(const YAML::Node&)> setup;
+        const std::function<bool(const YAML::Node&, const xlog::pipeline_t&)> setup;
     };
 
     static const std::unordered_map<std::string, LogEntry> g_lookup_table = {
         { "journald", {
             .check = [](const YAML::Node& config) -> bool {
-                if (!xlog::journald::platform_support()) {
-                    debug::print("log", "journal is not supported on this platform");
+                if (!xlog::journald::platform_support()) {
+                    debug::print("log", "journal is not supported on this platform");
+
+                    return false;
+                }
+
+                if (!config["identifier"]) {
+                    debug::print("log", "journal entry is missing key 'identifier'");
+
+                    return false;
+                }
+
+                if (!config["identifier"].IsScalar()) {
+                    debug::print("log", "journal entry's 'identifier' is not key-value type");
+
+                    return false;
+                }
+
+                return true;
+            },
+            .setup = [](const YAML::Node& config, const xlog::pipeline_t& pipeline) -> bool {
+                std::string identifier{};
+
+                try {
+                    identifier = config["identifier"].as<std::string>();
+                } catch (const std::exception& e) {
+                    debug::print("log", "failed to load key 'identifier', error: {}", e.what());
+
+                    return false;
+                }
+
+                return xlog::journald::start(identifier, pipeline);
+            },
+        }},
+        { "winevent", {
+            .check = [](const YAML::Node& config) -> bool {
+                if (!xlog::winevent::platform_support()) {
+                    debug::print("log", "winevent is not supported on this platform");
+
+                    return false;
+                }
+
+                if (!config["identifier"]) {
+                    debug::print("log", "winevent entry is missing key 'identifier'");
+
+                    return false;
+                }
+
+                if (!config["source"]) {
+                    debug::print("log", "winevent entry is missing key 'source'");
+
+                    return false;
+                }
+
+                if (!config["identifier"].IsScalar()) {
+                    debug::print("log", "winevent entry's 'identifier' is not key-value type");
+
+                    return false;
+                }
+
+                if (!config["source"].IsScalar()) {
+                    debug::print("log", "winevent entry's 'source' is not key-value type");
+
+                    return false;
+                }
+
+                return true;
+            },
+            .setup = [](const YAML::Node& config, const xlog::pipeline_t& pipeline) -> bool {
+                std::string identifier{};
+                std::string source{};
+
+                try {
+                    identifier = config["identifier"].as<std::string>();
+                } catch (const std::exception& e) {
+                    debug::print("log", "failed to load key 'identifier', error: {}", e.what());
+
+                    return false;
+                }
+
+                try {
+                    source = config["source"].as<std::string>();
+                } catch (const std::exception& e) {
+                    debug::print("log", "failed to load key 'source', error: {}", e.what());
+
+                    return false;
+                }
+
+                return xlog::winevent::start(identifier, source, pipeline);
+            },
+        }},
+        { "archive", {
+            .check = [](const YAML::Node& config) -> bool {
+                if (!xlog::archive::platform_support()) {
+                    debug::print("log", "archive is not supported on this build");
 
                     return false;
                 }
 
                 if (!config["identifier"]) {
-                    debug::print("log", "journal entry is missing key 'identifier'");
+                    debug::print("log", "archive entry is missing key 'identifier'");
+
+                    return false;
+                }
+
+                if (!config["source"]) {
+                    debug::print("log", "archive entry is missing key 'source'");
 
                     return false;
                 }
 
                 if (!config["identifier"].IsScalar()) {
-                    debug::print("log", "journal entry's 'identifier' is not key-value type");
+                    debug::print("log", "archive entry's 'identifier' is not key-value type");
+
+                    return false;
+                }
+
+                if (!config["source"].IsScalar() && !config["source"].IsSequence()) {
+                    debug::print("log", "archive entry's 'source' is neither key-value nor a list");
 
                     return false;
                 }
 
                 return true;
             },
-            .setup = [](const YAML::Node& config) -> bool {
+            .setup = [](const YAML::Node& config, const xlog::pipeline_t& pipeline) -> bool {
                 std::string identifier{};
+                std::vector<std::string> sources{};
+                size_t concurrency{1};
 
                 try {
                     identifier = config["identifier"].as<std::string>();
@@ -50,46 +740,111 @@ namespace xlog {
                     return false;
                 }
 
-                return xlog::journald::start(identifier);
+                try {
+                    if (config["source"].IsSequence()) {
+                        sources = config["source"].as<std::vector<std::string>>();
+                    } else {
+                        sources.push_back(config["source"].as<std::string>());
+                    }
+                } catch (const std::exception& e) {
+                    debug::print("log", "failed to load key 'source', error: {}", e.what());
+
+                    return false;
+                }
+
+                if (!xlog::load_optional_key(config, "archive", "concurrency", concurrency)) {
+                    return false;
+                }
+
+                return xlog::archive::start(identifier, sources, concurrency, pipeline);
             },
         }},
-        { "winevent", {
+        { "kmsg", {
             .check = [](const YAML::Node& config) -> bool {
-                if (!xlog::winevent::platform_support()) {
-                    debug::print("log", "winevent is not supported on this platform");
+                if (!xlog::kmsg::platform_support()) {
+                    debug::print("log", "kmsg is not supported on this platform");
 
                     return false;
                 }
 
                 if (!config["identifier"]) {
-                    debug::print("log", "winevent entry is missing key 'identifier'");
+                    debug::print("log", "kmsg entry is missing key 'identifier'");
 
                     return false;
                 }
 
-                if (!config["source"]) {
-                    debug::print("log", "winevent entry is missing key 'source'");
+                if (!config["identifier"].IsScalar()) {
+                    debug::print("log", "kmsg entry's 'identifier' is not key-value type");
+
+                    return false;
+                }
+
+                if (config["start_at"]) {
+                    std::string start_at{};
+
+                    if (!xlog::load_optional_key(config, "kmsg", "start_at", start_at)) {
+                        return false;
+                    }
+
+                    if (start_at != "beginning" && start_at != "end") {
+                        debug::print("log", "kmsg entry's 'start_at' must be 'beginning' or 'end'");
+
+                        return false;
+                    }
+                }
+
+                return true;
+            },
+            .setup = [](const YAML::Node& config, const xlog::pipeline_t& pipeline) -> bool {
+                std::string identifier{};
+                std::string start_at{"beginning"};
+
+                try {
+                    identifier = config["identifier"].as<std::string>();
+                } catch (const std::exception& e) {
+                    debug::print("log", "failed to load key 'identifier', error: {}", e.what());
+
+                    return false;
+                }
+
+                if (!xlog::load_optional_key(config, "kmsg", "start_at", start_at)) {
+                    return false;
+                }
+
+                return xlog::kmsg::start(identifier, xlog::kmsg::options{.start_at_beginning = start_at == "beginning"}, pipeline);
+            },
+        }},
+        { "syslog", {
+            .check = [](const YAML::Node& config) -> bool {
+                if (!xlog::syslog::platform_support()) {
+                    debug::print("log", "syslog is not supported on this platform");
+
+                    return false;
+                }
+
+                if (!config["identifier"]) {
+                    debug::print("log", "syslog entry is missing key 'identifier'");
 
                     return false;
                 }
 
                 if (!config["identifier"].IsScalar()) {
-                    debug::print("log", "winevent entry's 'identifier' is not key-value type");
+                    debug::print("log", "syslog entry's 'identifier' is not key-value type");
 
                     return false;
                 }
 
-                if (!config["source"].IsScalar()) {
-                    debug::print("log", "winevent entry's 'source' is not key-value type");
+                if (!config["unix"] && !config["udp"] && !config["tcp"]) {
+                    debug::print("log", "syslog entry needs at least one of 'unix', 'udp' or 'tcp'");
 
                     return false;
                 }
 
                 return true;
             },
-            .setup = [](const YAML::Node& config) -> bool {
+            .setup = [](const YAML::Node& config, const xlog::pipeline_t& pipeline) -> bool {
                 std::string identifier{};
-                std::string source{};
+                xlog::syslog::options options{};
 
                 try {
                     identifier = config["identifier"].as<std::string>();
@@ -99,15 +854,106 @@ namespace xlog {
                     return false;
                 }
 
+                if (!xlog::load_optional_key(config, "syslog", "unix", options.unix_path)
+                    || !xlog::load_optional_key(config, "syslog", "udp", options.udp)
+                    || !xlog::load_optional_key(config, "syslog", "tcp", options.tcp)
+                    || !xlog::load_optional_key(config, "syslog", "max_connections", options.maximum_connections)
+                    || !xlog::load_optional_key(config, "syslog", "max_message_size", options.maximum_message_size)) {
+                    return false;
+                }
+
+                if (!options.maximum_message_size) {
+                    debug::print("log", "syslog entry's 'max_message_size' must be positive");
+
+                    return false;
+                }
+
+                return xlog::syslog::start(identifier, options, pipeline);
+            },
+        }},
+        { "unix_stream", {
+            .check = [](const YAML::Node& config) -> bool {
+                return xlog::check_stream(config, "unix_stream");
+            },
+            .setup = [](const YAML::Node& config, const xlog::pipeline_t& pipeline) -> bool {
+                std::string identifier{};
+                std::string source{};
+                xlog::stream::options options{};
+
+                if (!xlog::load_stream(config, "unix_stream", identifier, source, options)) {
+                    return false;
+                }
+
+                return xlog::stream::start_unix_stream(identifier, source, options, pipeline);
+            },
+        }},
+        { "fifo", {
+            .check = [](const YAML::Node& config) -> bool {
+                return xlog::check_stream(config, "fifo");
+            },
+            .setup = [](const YAML::Node& config, const xlog::pipeline_t& pipeline) -> bool {
+                std::string identifier{};
+                std::string source{};
+                xlog::stream::options options{};
+
+                if (!xlog::load_stream(config, "fifo", identifier, source, options)) {
+                    return false;
+                }
+
+                return xlog::stream::start_fifo(identifier, source, options, pipeline);
+            },
+        }},
+        { "shm", {
+            .check = [](const YAML::Node& config) -> bool {
+                if (!xlog::shm::platform_support()) {
+                    debug::print("log", "shm is not supported on this platform");
+
+                    return false;
+                }
+
+                if (!config["identifier"]) {
+                    debug::print("log", "shm entry is missing key 'identifier'");
+
+                    return false;
+                }
+
+                if (!config["identifier"].IsScalar()) {
+                    debug::print("log", "shm entry's 'identifier' is not key-value type");
+
+                    return false;
+                }
+
+                return true;
+            },
+            .setup = [](const YAML::Node& config, const xlog::pipeline_t& pipeline) -> bool {
+                std::string identifier{};
+                xlog::shm::options options{};
+
                 try {
-                    source = config["source"].as<std::string>();
+                    identifier = config["identifier"].as<std::string>();
                 } catch (const std::exception& e) {
-                    debug::print("log", "failed to load key 'source', error: {}", e.what());
+                    debug::print("log", "failed to load key 'identifier', error: {}", e.what());
+
+                    return false;
+                }
+
+                // the channel defaults to the identifier
+                options.channel = identifier;
+
+                if (!xlog::load_optional_key(config, "shm", "channel", options.channel)
+                    || !xlog::load_optional_key(config, "shm", "poll_interval_ms", options.poll_interval_ms)
+                    || !xlog::load_optional_list(config, "shm", "allowed_uids", options.allowed_uids)
+                    || !xlog::load_optional_list(config, "shm", "allowed_gids", options.allowed_gids)) {
+                    return false;
+                }
+
+                if (options.poll_interval_ms <= 0) {
+                    debug::print("log", "shm entry's 'poll_interval_ms' must be positive");
 
                     return false;
                 }
 
-                return xlog::winevent::start(identifier, source);
+                return xlog::shm::start(identifier, options, pipeline);
             },
         }},
         { "file", {
@@ -136,9 +982,35 @@ namespace xlog {
                     return false;
                 }
 
+                if (config["start_at"]) {
+                    std::string start_at{};
+
+                    if (!xlog::load_optional_key(config, "file", "start_at", start_at)) {
+                        return false;
+                    }
+
+                    if (start_at != "beginning" && start_at != "end") {
+                        debug::print("log", "file entry's 'start_at' must be 'beginning' or 'end'");
+
+                        return false;
+                    }
+                }
+
+                std::optional<multiline_options> multiline{};
+
+                if (!xlog::load_multiline(config, "file", multiline)) {
+                    return false;
+                }
+
+                if (xlog::glob::is_pattern(config["source"].as<std::string>()) && !xlog::glob::platform_support()) {
+                    debug::print("log", "file entry's 'source' is a pattern, which isn't supported on this platform");
+
+                    return false;
+                }
+
                 return true;
             },
-            .setup = [](const YAML::Node& config) -> bool {
+            .setup = [](const YAML::Node& config, const xlog::pipeline_t& pipeline) -> bool {
                 std::string identifier{};
                 std::string source{};
 
@@ -158,38 +1030,87 @@ namespace xlog {
                     return false;
                 }
 
-                return xlog::file::start(identifier, source);
+                xlog::file::options options{};
+                std::string start_at{"end"};
+
+                if (!xlog::load_optional_key(config, "file", "start_at", start_at)
+                    || !xlog::load_optional_key(config, "file", "backfill", options.backfill)
+                    || !xlog::load_optional_key(config, "file", "backfill_rate_mb", options.backfill_rate_mb)) {
+                    return false;
+                }
+
+                if (!xlog::load_multiline(config, "file", options.multiline)) {
+                    return false;
+                }
+
+                options.start_at_beginning = start_at == "beginning" || options.backfill;
+
+                if (xlog::glob::is_pattern(source)) {
+                    xlog::glob::options glob_options{.file = options};
+
+                    if (!xlog::load_optional_key(config, "file", "max_open_files", glob_options.maximum_open_files)
+                        || !xlog::load_optional_key(config, "file", "idle_timeout_s", glob_options.idle_timeout_s)) {
+                        return false;
+                    }
+
+                    if (!glob_options.maximum_open_files || glob_options.idle_timeout_s <= 0) {
+                        debug::print("log", "file entry's 'max_open_files' and 'idle_timeout_s' must be positive");
+
+                        return false;
+                    }
+
+                    return xlog::glob::start(identifier, source, glob_options, pipeline);
+                }
+
+                return xlog::file::start(identifier, source, options, pipeline);
             },
         }}
     };
 
-    /* checks for invalid config */
-    static bool check_config(const YAML::Node& config) {
+    /* log.yml is either a map of type to entry, or a list of such maps; an entry may also be a list
+       of entries, so one type can be configured several times */
+    static bool for_each_entry(const YAML::Node& config, const std::function<bool(const std::string&, const YAML::Node&)>& procedure) {
+        if (config.IsSequence()) {
+            for (auto&& document : config) {
+                if (!document.IsMap()) {
+                    debug::print("log", "list items must be maps of logging type to entry");
+
+                    return false;
+                }
+
+                if (!xlog::for_each_entry(document, procedure)) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
         for (auto&& entry : config) {
             const auto key_name{entry.first.as<std::string>()};
+            const auto value{entry.second.as<YAML::Node>()};
 
-            auto lookup_entry{xlog::g_lookup_table.find(key_name)};
-
-            if (lookup_entry == xlog::g_lookup_table.end()) {
-                debug::print("log", "unknown logging type '{}'", key_name);
+            if (!value.IsSequence()) {
+                if (!procedure(key_name, value)) {
+                    return false;
+                }
 
-                return false;
+                continue;
             }
 
-            const auto check_fn = xlog::g_lookup_table.at(key_name).check;
-
-            if (!check_fn(entry.second.as<YAML::Node>())) {
-                return false;
+            for (auto&& item : value) {
+                if (!procedure(key_name, item)) {
+                    return false;
+                }
             }
         }
 
         return true;
     }
 
-    static bool run_config(const YAML::Node& config) {
-        for (auto&& entry : config) {
-            const auto key_name{entry.first.as<std::string>()};
-
+    /* checks for invalid config */
+    static bool check_config(const YAML::Node& config) {
+        return xlog::for_each_entry(config, [](const std::string& key_name, const YAML::Node& entry) -> bool {
             auto lookup_entry{xlog::g_lookup_table.find(key_name)};
 
             if (lookup_entry == xlog::g_lookup_table.end()) {
@@ -198,34 +1119,179 @@ namespace xlog {
                 return false;
             }
 
-            const auto setup_fn = xlog::g_lookup_table.at(key_name).setup;
+            if (!entry.IsMap()) {
+                debug::print("log", "{} entry is not a map", key_name);
 
-            if (!setup_fn(entry.second.as<YAML::Node>())) {
                 return false;
             }
+
+            const auto check_fn = lookup_entry->second.check;
+
+            if (!check_fn(entry)) {
+                return false;
+            }
+
+            xlog::stage_factory_t stages{};
+
+            return xlog::load_stages(entry, key_name.c_str(), stages);
+        });
+    }
+
+    /* an entry is identified by its type and its serialized content, so any edit counts as a new entry */
+    static std::string entry_key(const std::string& key_name, const YAML::Node& entry) {
+        YAML::Emitter emitter{};
+        emitter << entry;
+
+        return key_name + "\n" + emitter.c_str();
+    }
+
+    static bool start_entry(const std::string& key_name, const YAML::Node& entry) {
+        auto lookup_entry{xlog::g_lookup_table.find(key_name)};
+
+        if (lookup_entry == xlog::g_lookup_table.end()) {
+            debug::print("log", "unknown logging type '{}'", key_name);
+
+            return false;
+        }
+
+        auto key{xlog::entry_key(key_name, entry)};
+
+        if (xlog::g_state->running.contains(key)) {
+            debug::print("log", "identical {} entry listed twice; starting it once", key_name);
+
+            return true;
+        }
+
+        const auto setup_fn = lookup_entry->second.setup;
+        xlog::pipeline_t pipeline{.group = xlog::g_state->next_group++};
+
+        if (!xlog::load_stages(entry, key_name.c_str(), pipeline.stages)) {
+            return false;
+        }
+
+        if (!setup_fn(entry, pipeline)) {
+            // sources the entry did attach before failing are stopped with it
+            xlog::reactor::detach(pipeline.group);
+
+            return false;
         }
 
+        xlog::g_state->running[key] = pipeline.group;
+
         return true;
     }
 
-    bool initialize() {
-        YAML::Node config{};
+    static bool run_config(const YAML::Node& config) {
+        return xlog::for_each_entry(config, xlog::start_entry);
+    }
 
+    static bool load_file(const std::string& filename, YAML::Node& config) {
         try {
-            config = YAML::LoadFile(xlog::g_filename);
+            config = YAML::LoadFile(filename);
         } catch (const std::exception& e) {
-            debug::print("log", "failed to load config file '{}', error: {}", xlog::g_filename, e.what());
+            debug::print("log", "failed to load config file '{}', error: {}", filename, e.what());
             return false;
         }
 
-        if (!xlog::check_config(config)) {
-            return false;
+        return true;
+    }
+
+    std::shared_ptr<xlog::state_t> initialize(std::string filename) {
+        YAML::Node config{};
+
+        if (!xlog::load_file(filename, config) || !xlog::check_config(config)) {
+            return nullptr;
         }
 
+        auto state{std::make_shared<xlog::state_t>()};
+        state->filename = std::move(filename);
+
+        const std::lock_guard<std::mutex> _lock(state->running_lock);
+        xlog::g_state = state.get();
+
+        // the sources a failing entry left attached stop with the reactor
         if (!xlog::run_config(config)) {
+            xlog::g_state = nullptr;
+
+            return nullptr;
+        }
+
+        return state;
+    }
+
+    void clear() {
+        if (!xlog::g_state) {
+            return;
+        }
+
+        {
+            const std::lock_guard<std::mutex> _lock(xlog::g_state->running_lock);
+            xlog::g_state->running.clear();
+        }
+
+        xlog::g_state = nullptr;
+    }
+
+    bool reload() {
+        if (!xlog::g_state) {
+            return false;
+        }
+
+        const std::lock_guard<std::mutex> _lock(xlog::g_state->running_lock);
+        auto& running_entries{xlog::g_state->running};
+        YAML::Node config{};
+
+        if (!xlog::load_file(xlog::g_state->filename, config) || !xlog::check_config(config)) {
+            debug::print("log", "keeping the running entries");
+
             return false;
         }
 
+        std::vector<std::pair<std::string, YAML::Node>> wanted{};
+        std::unordered_set<std::string> wanted_keys{};
+
+        xlog::for_each_entry(config, [&](const std::string& key_name, const YAML::Node& entry) -> bool {
+            wanted.emplace_back(key_name, entry);
+            wanted_keys.insert(xlog::entry_key(key_name, entry));
+
+            return true;
+        });
+
+        size_t stopped{0};
+        size_t started{0};
+
+        for (auto running{running_entries.begin()}; running != running_entries.end();) {
+            if (wanted_keys.contains(running->first)) {
+                running++;
+                continue;
+            }
+
+            xlog::reactor::detach(running->second);
+            running = running_entries.erase(running);
+            stopped++;
+        }
+
+        // a failing entry doesn't hold back the others
+        for (auto&& [key_name, entry] : wanted) {
+            if (running_entries.contains(xlog::entry_key(key_name, entry))) {
+                continue;
+            }
+
+            if (xlog::start_entry(key_name, entry)) {
+                started++;
+            } else {
+                debug::print("log", "failed to start a {} entry", key_name);
+            }
+        }
+
+        debug::print("log", "reloaded; {} entries stopped, {} started, {} running", stopped, started, running_entries.size());
+
         return true;
     }
+
+    const std::string& filename() {
+        static const std::string none{};
+
+        return xlog::g_state ? xlog::g_state->filename : none;
+    }
 }
@@ -6,7 +6,9 @@
 #include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <limits>
+#include <memory>
 
 #ifndef _WIN32
 #include <systemd/sd-journal.h>
@@ -15,113 +17,226 @@
 #include <tuple>
 #include <utility>
 #include <vector>
-#include <future>
 #include "nlohmann/json_fwd.hpp"
 #include "nlohmann/json.hpp"
+#include "checkpoint.hpp"
 #include "config.hpp"
 #include "debug.hpp"
+#include "realtime.hpp"
 #include "xlog.hpp"
+#include "xlogsource.hpp"
 
 namespace xlog {
     namespace journald {
     #ifndef _WIN32
-        static sd_journal * g_journal_handle{nullptr};
-        static std::optional<std::future<void>> g_worker_routine{};
-
-        static bool journal_entry_procedure(sd_journal* journal, std::pair<int64_t, std::string>& result) {
+        /* every KEY=value pair becomes a field and MESSAGE the message, so the columnar batches see the keys and the
+           values repeating across entries; the entry is stamped with the journal's own realtime, the monotonic time
+           and boot id go into fields so entries of one boot stay ordered even when the wall clock was stepped,
+           the severity so urgent ones take the fast path */
+        static bool journal_entry_procedure(sd_journal* journal, int64_t fallback_timestamp, xlog::queue::log_entry_t& result) {
             size_t data_nb{0};
             const void * data_c{nullptr};
-            nlohmann::json entry_json{};
-            auto timestamp = static_cast<int64_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+            auto fields = nlohmann::json::object();
+            uint64_t realtime_usec{0};
+            uint64_t monotonic_usec{0};
+            sd_id128_t boot_id{};
 
             SD_JOURNAL_FOREACH_DATA(journal, data_c, data_nb) {
-                std::string data(const_cast<char*>(reinterpret_cast<const char*>(data_c)), data_nb);
+                std::string_view data(reinterpret_cast<const char*>(data_c), data_nb);
                 auto split_idx{data.find_first_of('=')};
 
-                if (split_idx == std::string::npos) {
+                if (split_idx == std::string_view::npos) {
                     debug::print("journald", "failed to split key value entry, error: missing '=' on '{}'", data);
                     continue;
                 }
 
-                std::string key(data.begin(), data.begin() + split_idx);
-                std::string value(data.begin() + split_idx + 1, data.end());
-                entry_json[key] = value;
+                auto key{data.substr(0, split_idx)};
+                auto value{data.substr(split_idx + 1)};
+
+                if (key == "MESSAGE") {
+                    result.message = value;
+                } else {
+                    fields[std::string(key)] = value;
+                }
+            }
+
+            if (sd_journal_get_realtime_usec(journal, &realtime_usec) >= 0) {
+                result.timestamp = static_cast<int64_t>(realtime_usec) * 1000;
+            } else {
+                result.timestamp = fallback_timestamp;
+            }
+
+            if (sd_journal_get_monotonic_usec(journal, &monotonic_usec, &boot_id) >= 0) {
+                char boot_id_string[SD_ID128_STRING_MAX]{};
+                sd_id128_to_string(boot_id, boot_id_string);
+
+                fields["monotonic_us"] = monotonic_usec;
+                fields["boot_id"] = boot_id_string;
+            }
+
+            // PRIORITY is the syslog severity, as syslog and kmsg entries carry it
+            if (auto priority{fields.find("PRIORITY")}; priority != fields.end() && priority->is_string()) {
+                if (auto level{xlog::severity::parse_level(priority->get_ref<const std::string&>())}) {
+                    fields["severity"] = *level;
+                }
             }
 
-            result = std::make_pair(timestamp, entry_json.dump());
+            result.fields = std::move(fields);
 
             return true;
         }
 
-        static void worker(std::string identifier) {
-            while (true) {
-                char* initial_cursor{nullptr};
-                sd_journal_seek_tail(xlog::journald::g_journal_handle);
+        class journald_source : public xlog::source {
+        private:
+            std::string identifier{};
+            sd_journal * journal_handle{nullptr};
+            int journal_fd{-1};
+            std::string checkpoint_key{};
+            /* cursor of the last entry read, and of the last one checkpointed */
+            std::string cursor{};
+            std::string checkpointed{};
+
+            /* seeks next to the entry shipped last; stepping onto it tells whether it's still there, otherwise the
+               entry the seek landed on wasn't shipped yet and is read first */
+            bool resume(const std::string& cursor) {
+                auto result{sd_journal_seek_cursor(this->journal_handle, cursor.c_str())};
+
+                if (result < 0) {
+                    debug::print("log-journal", "failed to seek to the checkpointed cursor, error: {}", std::strerror(-result));
+
+                    return false;
+                }
+
+                if (sd_journal_next(this->journal_handle) > 0 && sd_journal_test_cursor(this->journal_handle, cursor.c_str()) <= 0) {
+                    sd_journal_previous(this->journal_handle);
+                }
+
+                this->cursor = cursor;
+                this->checkpointed = cursor;
+
+                debug::print("log-journal", "resuming after cursor '{}'", cursor);
+
+                return true;
+            }
+        public:
+            journald_source(std::string identifier) : identifier(std::move(identifier)) {}
+
+            ~journald_source() override {
+                if (this->journal_handle) {
+                    sd_journal_close(this->journal_handle);
+                }
+            }
+
+            std::string name() const override {
+                return "journald:" + this->identifier;
+            }
+
+            bool open() override {
+                auto result{sd_journal_open(&this->journal_handle, SD_JOURNAL_LOCAL_ONLY)};
+
+                if (result < 0) {
+                    debug::print("log-journal", "failed to open the journal, error: {}", std::strerror(-result));
+                    this->journal_handle = nullptr;
 
-                if (sd_journal_previous(xlog::journald::g_journal_handle)) {
-                    sd_journal_get_cursor(xlog::journald::g_journal_handle, &initial_cursor);
+                    return false;
                 }
 
-                int wait_result{sd_journal_wait(xlog::journald::g_journal_handle, std::numeric_limits<int64_t>::max())};
+                this->checkpoint_key = "journald:" + this->identifier;
 
-                if (wait_result == SD_JOURNAL_APPEND) {
-                    std::vector<xlog::queue::log_entry_t> entries{};
+                auto state{checkpoint::load(this->checkpoint_key)};
+                bool resumed{false};
 
-                    SD_JOURNAL_FOREACH_BACKWARDS(xlog::journald::g_journal_handle) {
-                        char* current_cursor{nullptr};
-                        sd_journal_get_cursor(xlog::journald::g_journal_handle, &current_cursor);
+                try {
+                    resumed = state.IsMap() && this->resume(state["cursor"].as<std::string>());
+                } catch (const std::exception& e) {
+                    debug::print("log-journal", "ignoring unreadable checkpoint, error: {}", e.what());
+                }
 
-                        if (std::string(initial_cursor) == std::string(current_cursor)) {
-                            break;
-                        }
+                // without a checkpoint, position on the newest entry so that only appended entries are read
+                if (!resumed) {
+                    sd_journal_seek_tail(this->journal_handle);
+                    sd_journal_previous(this->journal_handle);
+                }
 
-                        std::pair<int64_t, std::string> result{};
+                this->journal_fd = sd_journal_get_fd(this->journal_handle);
 
-                        if (!xlog::journald::journal_entry_procedure(xlog::journald::g_journal_handle, result)) {
-                            continue;
-                        }
+                if (this->journal_fd < 0) {
+                    debug::print("log-journal", "failed to get the journal handle, error: {}", std::strerror(-this->journal_fd));
 
-                        entries.push_back(std::make_tuple(identifier, result.first, result.second));
-                    }
+                    return false;
+                }
+
+                return true;
+            }
+
+            xlog::source_handle_t poll_handle() const override {
+                return this->journal_fd;
+            }
+
+            bool read_batch(std::vector<xlog::queue::log_entry_t>& batch) override {
+                auto process_result{sd_journal_process(this->journal_handle)};
+
+                if (process_result < 0) {
+                    debug::print("journald", "failed to process journal events, error: {}", std::strerror(-process_result));
 
-                    for (auto entry{entries.rbegin()}; entry != entries.rend(); entry++) {
-                        auto value{*entry};
+                    return false;
+                }
+
+                const bool verbose{config::current()->verbose};
+                const auto timestamp{realtime::coarse_ns()};
+                bool read{false};
 
-                        if (config::field_verbose) {
-                            debug::print("journald", "journal message recevived, details: '{}'", std::get<2>(value));
-                        }
+                while (sd_journal_next(this->journal_handle) > 0) {
+                    xlog::queue::log_entry_t result{.identifier = this->identifier};
+                    read = true;
+
+                    if (!xlog::journald::journal_entry_procedure(this->journal_handle, timestamp, result)) {
+                        continue;
+                    }
 
-                        xlog::queue::insert(value);
+                    if (verbose) {
+                        debug::print("journald", "journal message recevived, details: '{}'", result.message);
                     }
+
+                    batch.push_back(std::move(result));
+                }
+
+                // the journal stays on the last entry once sd_journal_next() runs out
+                if (char* last{nullptr}; read && sd_journal_get_cursor(this->journal_handle, &last) >= 0) {
+                    this->cursor = last;
+                    std::free(last);
                 }
+
+                return true;
             }
-        }
+
+            void checkpoint() override {
+                if (this->cursor.empty() || this->cursor == this->checkpointed) {
+                    return;
+                }
+
+                YAML::Node state{};
+                state["cursor"] = this->cursor;
+
+                checkpoint::store(this->checkpoint_key, state);
+                this->checkpointed = this->cursor;
+            }
+        };
     #endif
 
     #ifdef _WIN32
-        bool start(std::string identifier) {
+        bool start(std::string identifier, const xlog::pipeline_t& pipeline) {
             (void)(identifier);
+            (void)(pipeline);
 
             return false;
         }
     #else
-        bool start(std::string identifier) {
-            if (g_worker_routine.has_value()) {
-                debug::print("log-journal", "already running");
-
+        bool start(std::string identifier, const xlog::pipeline_t& pipeline) {
+            if (!xlog::reactor::attach(std::make_unique<xlog::journald::journald_source>(identifier), pipeline)) {
                 return false;
             }
 
-            auto result{sd_journal_open(&xlog::journald::g_journal_handle, SD_JOURNAL_LOCAL_ONLY)};
-
-            if (result < 0) {
-                debug::print("log-journal", "failed to open the journal, error: {}", std::strerror(result));
-
-                return false;
-            }
-
-            xlog::journald::g_worker_routine = std::make_optional(std::async(xlog::journald::worker, identifier));
-
             debug::print("log-journal", "started");
 
             return true;
@@ -0,0 +1,356 @@
+#ifndef _WIN32
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "yaml-cpp/yaml.h"
+#include "checkpoint.hpp"
+#include "config.hpp"
+#include "debug.hpp"
+#include "metrics.hpp"
+#include "xlog.hpp"
+#include "xlogsource.hpp"
+
+namespace xlog {
+    namespace kmsg {
+        bool parse_record(std::string_view text, xlog::kmsg::record& result) {
+            auto header_end{text.find(';')};
+
+            if (header_end == std::string_view::npos) {
+                return false;
+            }
+
+            auto header{text.substr(0, header_end)};
+            std::array<std::string_view, 4> parts{};
+            size_t count{0};
+
+            while (count < parts.size()) {
+                auto comma{header.find(',')};
+                parts[count++] = header.substr(0, comma);
+
+                if (comma == std::string_view::npos) {
+                    break;
+                }
+
+                header.remove_prefix(comma + 1);
+            }
+
+            if (count < 4) {
+                return false;
+            }
+
+            auto number = [](std::string_view digits, uint64_t& value) -> bool {
+                value = 0;
+
+                if (digits.empty()) {
+                    return false;
+                }
+
+                for (auto c : digits) {
+                    if (c < '0' || c > '9') {
+                        return false;
+                    }
+
+                    value = value * 10 + static_cast<uint64_t>(c - '0');
+                }
+
+                return true;
+            };
+
+            uint64_t priority{0};
+
+            if (!number(parts[0], priority) || !number(parts[1], result.sequence) || !number(parts[2], result.monotonic_us)) {
+                return false;
+            }
+
+            result.priority = static_cast<int>(priority);
+            result.flag = parts[3].empty() ? '-' : parts[3][0];
+
+            auto body{text.substr(header_end + 1)};
+            auto newline{body.find('\n')};
+
+            result.message = body.substr(0, newline);
+            result.dictionary = newline == std::string_view::npos ? std::string_view{} : body.substr(newline + 1);
+
+            return true;
+        }
+
+    #ifndef _WIN32
+        static const char* g_device{"/dev/kmsg"};
+        static const char* g_boot_id_filename{"/proc/sys/kernel/random/boot_id"};
+
+        /* every read() returns one record; the kernel caps them well below this */
+        static constexpr size_t g_record_size{16 * 1024};
+        /* records per wakeup, so a full ring doesn't hold the reactor thread */
+        static constexpr size_t g_batch_records{1024};
+
+        static int64_t clock_ns(clockid_t clock) {
+            timespec now{};
+            clock_gettime(clock, &now);
+
+            return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+        }
+
+        /* sequence numbers restart with every boot, so checkpoints are only valid for the boot that wrote them */
+        static std::string read_boot_id() {
+            std::ifstream input(g_boot_id_filename);
+            std::string boot_id{};
+
+            std::getline(input, boot_id);
+
+            return boot_id;
+        }
+
+        class kmsg_source : public xlog::source {
+        private:
+            std::string identifier{};
+            xlog::kmsg::options options{};
+
+            int handle{-1};
+            std::string boot_id{};
+            std::string checkpoint_key{};
+            /* CLOCK_REALTIME minus CLOCK_MONOTONIC at open; record times are monotonic, which
+               stops while suspended, so entries after a resume are stamped a little early */
+            int64_t boot_realtime_ns{0};
+
+            /* last sequence number read, and the last one written to the checkpoint */
+            uint64_t last_sequence{0};
+            bool has_sequence{false};
+            uint64_t checkpointed{0};
+            /* records up to this one were shipped by an earlier run of this boot */
+            uint64_t skip_until{0};
+            bool skipping{false};
+
+            std::vector<char> buffer{};
+
+            std::atomic<uint64_t>* records_read{nullptr};
+            std::atomic<uint64_t>* lost{nullptr};
+            std::atomic<uint64_t>* overruns{nullptr};
+
+            void restore() {
+                auto state{checkpoint::load(this->checkpoint_key)};
+
+                if (!state.IsMap()) {
+                    if (!this->options.start_at_beginning) {
+                        lseek(this->handle, 0, SEEK_END);
+                    }
+
+                    return;
+                }
+
+                try {
+                    if (state["boot_id"].as<std::string>() == this->boot_id) {
+                        this->skip_until = state["sequence"].as<uint64_t>();
+                        this->skipping = true;
+                        this->checkpointed = this->skip_until;
+                        // records that wrapped out while we were down count as lost too
+                        this->last_sequence = this->skip_until;
+                        this->has_sequence = true;
+
+                        debug::print("kmsg", "resuming after sequence {}", this->skip_until);
+                    }
+                } catch (const std::exception& e) {
+                    debug::print("kmsg", "ignoring unreadable checkpoint, error: {}", e.what());
+                }
+            }
+
+            /* a jump in the sequence means the ring wrapped before we read the records in between */
+            void track_sequence(uint64_t sequence) {
+                if (this->has_sequence && sequence > this->last_sequence + 1) {
+                    auto missing{sequence - this->last_sequence - 1};
+                    (*this->lost) += missing;
+
+                    debug::print("kmsg", "{} kernel records were overwritten before they could be read", missing);
+                }
+
+                this->last_sequence = sequence;
+                this->has_sequence = true;
+            }
+
+            void emit(const xlog::kmsg::record& record, std::vector<xlog::queue::log_entry_t>& batch) {
+                nlohmann::json fields = {
+                    {"facility", record.priority >> 3},
+                    {"severity", record.priority & 7},
+                    {"sequence", record.sequence},
+                    {"monotonic_us", record.monotonic_us},
+                };
+
+                if (record.flag == '+' || record.flag == 'c') {
+                    fields["continuation"] = true;
+                }
+
+                auto dictionary{record.dictionary};
+
+                while (!dictionary.empty()) {
+                    auto newline{dictionary.find('\n')};
+                    auto line{dictionary.substr(0, newline)};
+
+                    dictionary = newline == std::string_view::npos ? std::string_view{} : dictionary.substr(newline + 1);
+
+                    if (line.starts_with(' ')) {
+                        line.remove_prefix(1);
+                    }
+
+                    auto equals{line.find('=')};
+
+                    if (equals != std::string_view::npos && equals > 0) {
+                        fields[std::string(line.substr(0, equals))] = std::string(line.substr(equals + 1));
+                    }
+                }
+
+                auto timestamp{this->boot_realtime_ns + static_cast<int64_t>(record.monotonic_us) * 1000};
+
+                batch.push_back(xlog::queue::log_entry_t{
+                    .identifier = this->identifier,
+                    .timestamp = timestamp,
+                    .message = std::string(record.message),
+                    .fields = std::move(fields),
+                });
+            }
+        public:
+            kmsg_source(std::string identifier, const xlog::kmsg::options& options)
+                : identifier(std::move(identifier)), options(options) {
+                this->records_read = &metrics::counter(std::format("kmsg.{}.read", this->identifier));
+                this->lost = &metrics::counter(std::format("kmsg.{}.lost", this->identifier));
+                this->overruns = &metrics::counter(std::format("kmsg.{}.overruns", this->identifier));
+            }
+
+            ~kmsg_source() override {
+                if (this->handle != -1) {
+                    ::close(this->handle);
+                }
+            }
+
+            std::string name() const override {
+                return "kmsg:" + this->identifier;
+            }
+
+            bool open() override {
+                this->handle = ::open(g_device, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+                if (this->handle == -1) {
+                    debug::print("kmsg", "failed to open '{}', error: {}", g_device, std::strerror(errno));
+
+                    return false;
+                }
+
+                this->boot_id = xlog::kmsg::read_boot_id();
+                this->checkpoint_key = "kmsg:" + this->identifier;
+                this->boot_realtime_ns = clock_ns(CLOCK_REALTIME) - clock_ns(CLOCK_MONOTONIC);
+                this->buffer.resize(g_record_size);
+                this->restore();
+
+                return true;
+            }
+
+            xlog::source_handle_t poll_handle() const override {
+                return this->handle;
+            }
+
+            bool read_batch(std::vector<xlog::queue::log_entry_t>& batch) override {
+                const bool verbose{config::current()->verbose};
+
+                for (size_t i = 0; i < g_batch_records; i++) {
+                    auto read_length{::read(this->handle, this->buffer.data(), this->buffer.size())};
+
+                    if (read_length == -1) {
+                        if (errno == EPIPE) {
+                            // the next read continues at the oldest record still in the ring
+                            (*this->overruns)++;
+                            continue;
+                        }
+
+                        if (errno != EAGAIN && errno != EINTR) {
+                            debug::print("kmsg", "failed to read '{}', error: {}", g_device, std::strerror(errno));
+
+                            return false;
+                        }
+
+                        break;
+                    }
+
+                    xlog::kmsg::record record{};
+
+                    if (!xlog::kmsg::parse_record(std::string_view(this->buffer.data(), static_cast<size_t>(read_length)), record)) {
+                        continue;
+                    }
+
+                    (*this->records_read)++;
+
+                    if (this->skipping) {
+                        if (record.sequence <= this->skip_until) {
+                            continue;
+                        }
+
+                        this->skipping = false;
+                    }
+
+                    this->track_sequence(record.sequence);
+
+                    if (verbose) {
+                        debug::print("kmsg", "kernel message received, details: '{}'", record.message);
+                    }
+
+                    this->emit(record, batch);
+                }
+
+                return true;
+            }
+
+            void checkpoint() override {
+                if (!this->has_sequence || this->last_sequence == this->checkpointed) {
+                    return;
+                }
+
+                YAML::Node state{};
+                state["boot_id"] = this->boot_id;
+                state["sequence"] = this->last_sequence;
+
+                checkpoint::store(this->checkpoint_key, state);
+                this->checkpointed = this->last_sequence;
+            }
+        };
+
+        bool start(std::string identifier, const xlog::kmsg::options& options, const xlog::pipeline_t& pipeline) {
+            if (!xlog::reactor::attach(std::make_unique<xlog::kmsg::kmsg_source>(identifier, options), pipeline)) {
+                return false;
+            }
+
+            debug::print("kmsg", "started '{}'", identifier);
+
+            return true;
+        }
+
+        bool platform_support() {
+            return true;
+        }
+    #else
+        bool start(std::string identifier, const xlog::kmsg::options& options, const xlog::pipeline_t& pipeline) {
+            (void)(identifier);
+            (void)(options);
+            (void)(pipeline);
+
+            return false;
+        }
+
+        bool platform_support() {
+            return false;
+        }
+    #endif
+    }
+}
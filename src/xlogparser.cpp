@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "debug.hpp"
+#include "namedregex.hpp"
+#include "workpool.hpp"
+#include "xlog.hpp"
+#include "xlogsource.hpp"
+
+namespace xlog {
+    namespace parser {
+        /* batches at least this large are parsed in parallel chunks */
+        static constexpr size_t g_parallel_threshold{2048};
+        static constexpr size_t g_maximum_chunks{8};
+
+        static bool parse_json(const std::string& message, nlohmann::json& fields) {
+            auto parsed = nlohmann::json::parse(message, nullptr, false);
+
+            if (parsed.is_discarded() || !parsed.is_object()) {
+                return false;
+            }
+
+            fields = std::move(parsed);
+
+            return true;
+        }
+
+        /* key=value key="quoted \" value" flag; a bare key is stored as true */
+        static bool parse_logfmt(const std::string& message, nlohmann::json& fields) {
+            auto result = nlohmann::json::object();
+            size_t i{0};
+
+            while (i < message.length()) {
+                while (i < message.length() && message[i] == ' ') {
+                    i++;
+                }
+
+                auto key_start{i};
+
+                while (i < message.length() && message[i] != '=' && message[i] != ' ' && message[i] != '"') {
+                    i++;
+                }
+
+                if (i == key_start) {
+                    if (i < message.length()) {
+                        return false;
+                    }
+
+                    break;
+                }
+
+                auto key{message.substr(key_start, i - key_start)};
+
+                if (i >= message.length() || message[i] != '=') {
+                    if (i < message.length() && message[i] == '"') {
+                        return false;
+                    }
+
+                    result[key] = true;
+                    continue;
+                }
+
+                i++;
+
+                std::string value{};
+
+                if (i < message.length() && message[i] == '"') {
+                    bool closed{false};
+
+                    for (i++; i < message.length(); i++) {
+                        if (message[i] == '\\' && i + 1 < message.length()) {
+                            value.push_back(message[++i]);
+                        } else if (message[i] == '"') {
+                            closed = true;
+                            i++;
+                            break;
+                        } else {
+                            value.push_back(message[i]);
+                        }
+                    }
+
+                    if (!closed) {
+                        return false;
+                    }
+                } else {
+                    auto value_start{i};
+
+                    while (i < message.length() && message[i] != ' ') {
+                        i++;
+                    }
+
+                    value = message.substr(value_start, i - value_start);
+                }
+
+                result[key] = std::move(value);
+            }
+
+            if (result.empty()) {
+                return false;
+            }
+
+            fields = std::move(result);
+
+            return true;
+        }
+
+        class parser_stage : public xlog::stage {
+        private:
+            xlog::parser::options options{};
+            std::optional<namedregex> pattern{};
+            std::atomic<uint64_t> failures{0};
+            /* reported at 1, 2, 4, ... failures to keep a noisy source from flooding the output */
+            uint64_t next_report{1};
+
+            bool parse(const std::string& message, nlohmann::json& fields) const {
+                if (this->pattern) {
+                    return this->pattern->match(message, fields);
+                }
+
+                if (this->options.type == "json") {
+                    return xlog::parser::parse_json(message, fields);
+                }
+
+                return xlog::parser::parse_logfmt(message, fields);
+            }
+
+            /* entries that don't parse are shipped unchanged; fields set by earlier stages win over parsed ones */
+            void parse_range(std::vector<xlog::queue::log_entry_t>& batch, size_t begin, size_t end) {
+                uint64_t failed{0};
+
+                for (auto i{begin}; i < end; i++) {
+                    nlohmann::json fields{};
+
+                    if (!this->parse(batch[i].message, fields)) {
+                        failed++;
+                        continue;
+                    }
+
+                    if (batch[i].fields.is_object()) {
+                        fields.update(batch[i].fields);
+                    }
+
+                    batch[i].fields = std::move(fields);
+                }
+
+                this->failures += failed;
+            }
+        public:
+            parser_stage(const xlog::parser::options& options) : options(options) {
+                if (options.type == "regex") {
+                    this->pattern.emplace(options.pattern);
+                }
+            }
+
+            void process(std::vector<xlog::queue::log_entry_t>& batch) override {
+                if (batch.size() < xlog::parser::g_parallel_threshold) {
+                    this->parse_range(batch, 0, batch.size());
+                } else {
+                    auto chunk_count{std::clamp<size_t>(std::thread::hardware_concurrency(), 1, xlog::parser::g_maximum_chunks)};
+                    auto chunk_length{(batch.size() + chunk_count - 1) / chunk_count};
+                    std::vector<std::function<void()>> chunks{};
+
+                    for (size_t begin{0}; begin < batch.size(); begin += chunk_length) {
+                        auto end{std::min(begin + chunk_length, batch.size())};
+
+                        chunks.emplace_back([this, &batch, begin, end]() { this->parse_range(batch, begin, end); });
+                    }
+
+                    workpool::run(chunks);
+                }
+
+                auto failures{this->failures.load()};
+
+                if (failures >= this->next_report) {
+                    debug::print("parser", "{} parser failed on {} entries so far", this->options.type, failures);
+
+                    while (this->next_report <= failures) {
+                        this->next_report *= 2;
+                    }
+                }
+            }
+        };
+
+        std::unique_ptr<xlog::stage> create(const xlog::parser::options& options) {
+            if (options.type != "json" && options.type != "logfmt" && options.type != "regex") {
+                debug::print("parser", "unknown parser type '{}'", options.type);
+
+                return nullptr;
+            }
+
+            if (options.type == "regex" && options.pattern.empty()) {
+                debug::print("parser", "regex parser is missing a pattern");
+
+                return nullptr;
+            }
+
+            try {
+                return std::make_unique<xlog::parser::parser_stage>(options);
+            } catch (const std::regex_error& e) {
+                debug::print("parser", "invalid pattern '{}', error: {}", options.pattern, e.what());
+            }
+
+            return nullptr;
+        }
+    }
+}
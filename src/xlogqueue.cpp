@@ -1,59 +1,350 @@
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
-#include <optional>
 #include <queue>
-#include <future>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "nlohmann/json.hpp"
 #include "config.hpp"
 #include "debug.hpp"
+#include "metrics.hpp"
 #include "xlog.hpp"
 #include "inet.hpp"
 
 namespace xlog {
     namespace queue {
-        static std::queue<xlog::queue::log_entry_t> g_queue{};
-        static std::mutex g_queue_lock{};
-        static std::optional<std::future<void>> g_worker_handle{};
+        /* entries at or above priority_severity wait in their own lane, which the worker publishes as soon
+           as it fills instead of every dispatch_sleep_ms */
+        struct lane_t {
+            std::queue<xlog::queue::log_entry_t> entries{};
+            /* when the oldest entry waiting was inserted */
+            std::chrono::steady_clock::time_point since{};
+        };
+
+        struct state_t {
+            xlog::queue::lane_t queue{};
+            xlog::queue::lane_t priority{};
+            std::mutex lock{};
+            std::condition_variable_any urgent{};
+            /* last, so it's joined before the lanes go */
+            std::jthread worker{};
+        };
+
+        static xlog::queue::state_t* g_state{nullptr};
+
+        static std::atomic<uint64_t>& g_dropped{metrics::counter("queue.dropped")};
+        static std::atomic<uint64_t>& g_published{metrics::counter("queue.published")};
+        static std::atomic<uint64_t>& g_prioritized{metrics::counter("queue.prioritized")};
+
+        /* expects the lock held; the oldest ordinary entry goes first, urgent ones only when nothing else is left */
+        static void make_room(size_t maximum) {
+            while (xlog::queue::g_state->queue.entries.size() + xlog::queue::g_state->priority.entries.size() >= maximum) {
+                auto& lane{xlog::queue::g_state->queue.entries.empty() ? xlog::queue::g_state->priority : xlog::queue::g_state->queue};
+
+                if (lane.entries.empty()) {
+                    return;
+                }
+
+                debug::print("queue", "the limit of {} log entries has been reached, popping oldest log", maximum);
+                lane.entries.pop();
+                xlog::queue::g_dropped++;
+            }
+        }
+
+        /* expects the lock held; true when the entry went into the priority lane */
+        static bool push(xlog::queue::log_entry_t entry, int64_t priority_severity) {
+            auto urgent{xlog::severity::urgent(entry.fields, priority_severity)};
+            auto& lane{urgent ? xlog::queue::g_state->priority : xlog::queue::g_state->queue};
+
+            if (lane.entries.empty()) {
+                lane.since = std::chrono::steady_clock::now();
+            }
+
+            lane.entries.push(std::move(entry));
+
+            return urgent;
+        }
 
         void insert(const xlog::queue::log_entry_t& data) {
-            xlog::queue::g_queue_lock.lock();
+            const auto settings{config::current()};
+            bool urgent{false};
+
+            {
+                const std::lock_guard<std::mutex> _lock(xlog::queue::g_state->lock);
 
-            if (g_queue.size() >= config::field_maximum_log_entries) {
-                debug::print("queue", "the limit of {} log entries has been reached, popping oldest log", config::field_maximum_log_entries);
-                xlog::queue::g_queue.pop();
+                xlog::queue::make_room(settings->maximum_log_entries);
+                urgent = xlog::queue::push(data, settings->priority_severity);
             }
 
-            xlog::queue::g_queue.push(data);
-            xlog::queue::g_queue_lock.unlock();
+            if (urgent) {
+                xlog::queue::g_prioritized++;
+                xlog::queue::g_state->urgent.notify_one();
+            }
         }
 
-        static void worker() {
-            while (true) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(config::field_dispatch_sleep_ms));
-                std::lock_guard<std::mutex> scope_lock(xlog::queue::g_queue_lock);
+        void insert(std::vector<xlog::queue::log_entry_t>& entries) {
+            const auto settings{config::current()};
+            size_t urgent{0};
+
+            {
+                const std::lock_guard<std::mutex> _lock(xlog::queue::g_state->lock);
 
-                while (!xlog::queue::g_queue.empty()) {
-                    xlog::queue::log_entry_t entry{xlog::queue::g_queue.front()};
+                for (auto&& entry : entries) {
+                    xlog::queue::make_room(settings->maximum_log_entries);
 
-                    if (config::field_verbose) {
-                        debug::print("queue", "dispatching: identififer: '{}', timestamp: '{}', message: '{}'", std::get<0>(entry), std::get<1>(entry), std::get<2>(entry));
+                    if (xlog::queue::push(std::move(entry), settings->priority_severity)) {
+                        urgent++;
                     }
+                }
+            }
+
+            entries.clear();
+
+            if (urgent) {
+                xlog::queue::g_prioritized += urgent;
+                xlog::queue::g_state->urgent.notify_one();
+            }
+        }
+
+        size_t size() {
+            if (!xlog::queue::g_state) {
+                return 0;
+            }
+
+            const std::lock_guard<std::mutex> _lock(xlog::queue::g_state->lock);
+
+            return xlog::queue::g_state->queue.entries.size() + xlog::queue::g_state->priority.entries.size();
+        }
+
+        std::string serialize(const xlog::queue::log_entry_t& entry) {
+            nlohmann::json data = {
+                {"identifier", entry.identifier},
+                {"timestamp", entry.timestamp},
+                {"timestamp_unit", "ns"},
+                {"message", entry.message},
+            };
+
+            if (!entry.fields.is_null()) {
+                data["fields"] = entry.fields;
+            }
+
+            /* runs on the dispatcher thread, so a tailed line with invalid UTF-8 must not throw */
+            return data.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+        }
+
+        void append_json_string(std::string& output, std::string_view text) {
+            static constexpr char hex[]{"0123456789abcdef"};
+            output.push_back('"');
+
+            for (size_t i = 0; i < text.length();) {
+                // printable ASCII that needs no escaping goes in as one run
+                auto run{i};
+
+                while (run < text.length() && static_cast<unsigned char>(text[run]) >= 0x20 && static_cast<unsigned char>(text[run]) < 0x80
+                    && text[run] != '"' && text[run] != '\\') {
+                    run++;
+                }
+
+                if (run > i) {
+                    output.append(text.substr(i, run - i));
+                    i = run;
+                    continue;
+                }
+
+                auto c{static_cast<unsigned char>(text[i])};
+
+                if (c < 0x80) {
+                    switch (c) {
+                        case '"': output.append("\\\""); break;
+                        case '\\': output.append("\\\\"); break;
+                        case '\n': output.append("\\n"); break;
+                        case '\r': output.append("\\r"); break;
+                        case '\t': output.append("\\t"); break;
+                        default:
+                            if (c < 0x20) {
+                                output.append("\\u00");
+                                output.push_back(hex[c >> 4]);
+                                output.push_back(hex[c & 15]);
+                            } else {
+                                output.push_back(static_cast<char>(c));
+                            }
+                    }
+
+                    i++;
+                    continue;
+                }
+
+                // the length of the sequence, and the allowed range of its second byte
+                size_t length{0};
+                unsigned char low{0x80};
+                unsigned char high{0xbf};
+
+                if (c >= 0xc2 && c <= 0xdf) {
+                    length = 2;
+                } else if (c >= 0xe0 && c <= 0xef) {
+                    length = 3;
+                    low = c == 0xe0 ? 0xa0 : 0x80;
+                    high = c == 0xed ? 0x9f : 0xbf;
+                } else if (c >= 0xf0 && c <= 0xf4) {
+                    length = 4;
+                    low = c == 0xf0 ? 0x90 : 0x80;
+                    high = c == 0xf4 ? 0x8f : 0xbf;
+                }
+
+                size_t valid{length ? 1u : 0u};
 
-                    if (!inet::send_log(std::get<0>(entry), std::get<1>(entry), std::get<2>(entry))) {
-                        debug::print("queue", "not connected: can't send");
+                while (valid && valid < length && i + valid < text.length()) {
+                    auto next{static_cast<unsigned char>(text[i + valid])};
+
+                    if (next < (valid == 1 ? low : 0x80) || next > (valid == 1 ? high : 0xbf)) {
+                        break;
                     }
 
-                    xlog::queue::g_queue.pop();
+                    valid++;
                 }
 
-                (void)(scope_lock);
+                if (length && valid == length) {
+                    output.append(text.substr(i, length));
+                    i += length;
+                } else {
+                    output.append("\xef\xbf\xbd");
+                    i += valid ? valid : 1;
+                }
             }
+
+            output.push_back('"');
         }
 
-        bool start() {
-            xlog::queue::g_worker_handle = std::make_optional(std::async(xlog::queue::worker));
+        /* serializes a lane once and hands it to the sinks; the lock is only held for the swap */
+        static size_t publish(xlog::queue::lane_t& lane, bool urgent) {
+            std::queue<xlog::queue::log_entry_t> entries{};
+            std::chrono::steady_clock::time_point since{};
+
+            {
+                const std::lock_guard<std::mutex> _lock(xlog::queue::g_state->lock);
+                entries.swap(lane.entries);
+                since = lane.since;
+            }
+
+            if (entries.empty()) {
+                return 0;
+            }
+
+            auto records{std::make_shared<xlog::sinks::records_t>()};
+            records->reserve(entries.size());
+
+            // the columnar encoder builds its columns from the entries rather than from the records
+            const bool keep_entries{config::current()->columnar_batches};
+
+            if (keep_entries) {
+                records->entries.reserve(entries.size());
+            }
+
+            while (!entries.empty()) {
+                records->push_back(xlog::queue::serialize(entries.front()));
+
+                if (keep_entries) {
+                    records->entries.push_back(std::move(entries.front()));
+                }
+
+                entries.pop();
+            }
+
+            xlog::sinks::publish(records, urgent, since);
+            xlog::queue::g_published += records->size();
+
+            return records->size();
+        }
+
+        /* everything queued, urgent entries first */
+        static size_t publish() {
+            return xlog::queue::publish(xlog::queue::g_state->priority, true) + xlog::queue::publish(xlog::queue::g_state->queue, false);
+        }
+
+        void publish(std::span<const xlog::queue::log_view_t> entries) {
+            // keeps entries of sources and of the caller in the order they arrived
+            xlog::queue::publish();
+
+            if (entries.empty()) {
+                return;
+            }
+
+            auto records{std::make_shared<xlog::sinks::records_t>()};
+            records->reserve(entries.size());
+
+            for (auto&& entry : entries) {
+                // the same object serialize() writes, in the same key order
+                std::string record{};
+                record.reserve(entry.identifier.length() + entry.message.length() + 80);
+                record.append("{\"identifier\":");
+                xlog::queue::append_json_string(record, entry.identifier);
+                record.append(",\"message\":");
+                xlog::queue::append_json_string(record, entry.message);
+                record.append(",\"timestamp\":");
+                record.append(std::to_string(entry.timestamp));
+                record.append(",\"timestamp_unit\":\"ns\"}");
+
+                records->push_back(std::move(record));
+            }
+
+            xlog::sinks::publish(records, false, std::chrono::steady_clock::now());
+            xlog::queue::g_published += records->size();
+        }
+
+        /* the ordinary lane lingers dispatch_sleep_ms to batch up; the priority lane goes as soon as it fills */
+        static void worker(std::stop_token stop_token) {
+            auto next_dispatch{std::chrono::steady_clock::now() + std::chrono::milliseconds(config::current()->dispatch_sleep_ms)};
+
+            while (!stop_token.stop_requested()) {
+                {
+                    std::unique_lock<std::mutex> scope_lock(xlog::queue::g_state->lock);
+
+                    xlog::queue::g_state->urgent.wait_until(scope_lock, stop_token, next_dispatch, []() {
+                        return !xlog::queue::g_state->priority.entries.empty();
+                    });
+                }
+
+                xlog::queue::publish(xlog::queue::g_state->priority, true);
+
+                if (std::chrono::steady_clock::now() >= next_dispatch) {
+                    xlog::queue::publish(xlog::queue::g_state->queue, false);
+                    next_dispatch = std::chrono::steady_clock::now() + std::chrono::milliseconds(config::current()->dispatch_sleep_ms);
+                }
+            }
+        }
+
+        std::shared_ptr<xlog::queue::state_t> start() {
+            auto state{std::make_shared<xlog::queue::state_t>()};
+
+            xlog::queue::g_state = state.get();
+            state->worker = std::jthread(xlog::queue::worker);
             debug::print("log-journal", "queue started");
 
-            return true;
+            return state;
+        }
+
+        size_t drain(std::chrono::milliseconds deadline) {
+            if (xlog::queue::g_state) {
+                if (xlog::queue::g_state->worker.joinable()) {
+                    xlog::queue::g_state->worker.request_stop();
+                    xlog::queue::g_state->worker.join();
+                }
+
+                xlog::queue::publish();
+                xlog::queue::g_state = nullptr;
+            }
+
+            return xlog::sinks::drain(std::chrono::steady_clock::now() + deadline);
+        }
+
+        uint64_t dropped() {
+            return xlog::queue::g_dropped.load();
         }
     }
 }
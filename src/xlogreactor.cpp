@@ -0,0 +1,565 @@
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "config.hpp"
+#include "debug.hpp"
+#include "xlog.hpp"
+#include "xlogsource.hpp"
+
+namespace xlog {
+    namespace reactor {
+        using reactor_clock = std::chrono::steady_clock;
+
+        /* identifier 0 is reserved for the wake handle */
+        static constexpr uint64_t g_wake_id{0};
+
+        struct attached_source {
+            std::unique_ptr<xlog::source> source{};
+            xlog::stages_t stages{};
+            uint64_t group{0};
+            reactor_clock::time_point next_poll{};
+        };
+
+        struct reactor_thread {
+            size_t index{0};
+            std::mutex pending_lock{};
+            std::vector<xlog::reactor::attached_source> pending{};
+            /* groups to stop, each with the promise detach() waits on */
+            std::vector<std::pair<uint64_t, std::promise<void>>> detaching{};
+            std::atomic<size_t> load{0};
+            xlog::source_handle_t wake_handle{xlog::source_handle_nullptr};
+        #ifndef _WIN32
+            int epoll_handle{-1};
+        #endif
+            std::jthread thread{};
+
+            ~reactor_thread() {
+                if (this->thread.joinable()) {
+                    this->thread.request_stop();
+                    this->thread.join();
+                }
+
+            #ifdef _WIN32
+                if (this->wake_handle != xlog::source_handle_nullptr) {
+                    CloseHandle(this->wake_handle);
+                }
+            #else
+                if (this->wake_handle != xlog::source_handle_nullptr) {
+                    ::close(this->wake_handle);
+                }
+
+                if (this->epoll_handle != -1) {
+                    ::close(this->epoll_handle);
+                }
+            #endif
+            }
+        };
+
+        struct state_t {
+            std::vector<std::unique_ptr<xlog::reactor::reactor_thread>> threads{};
+        };
+
+        static xlog::reactor::state_t* g_state{nullptr};
+
+        static void wake(xlog::reactor::reactor_thread& self) {
+        #ifdef _WIN32
+            SetEvent(self.wake_handle);
+        #else
+            uint64_t value{1};
+
+            if (::write(self.wake_handle, &value, sizeof(value)) == -1 && errno != EAGAIN) {
+                debug::print("reactor", "failed to wake thread {}, error: {}", self.index, std::strerror(errno));
+            }
+        #endif
+        }
+
+        static void pin_thread(size_t index) {
+            size_t cpu_count{std::max<size_t>(1, std::thread::hardware_concurrency())};
+
+        #ifdef _WIN32
+            cpu_count = std::min<size_t>(cpu_count, sizeof(DWORD_PTR) * 8);
+
+            if (!SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR{1} << (index % cpu_count))) {
+                debug::print("reactor", "failed to pin thread {}, error: 0x{:08X}", index, GetLastError());
+            }
+        #else
+            cpu_set_t cpu_set{};
+            CPU_ZERO(&cpu_set);
+            CPU_SET(index % cpu_count, &cpu_set);
+
+            auto result{pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set)};
+
+            if (result != 0) {
+                debug::print("reactor", "failed to pin thread {}, error: {}", index, std::strerror(result));
+            }
+        #endif
+        }
+
+        static bool register_handle(xlog::reactor::reactor_thread& self, uint64_t id, xlog::source_handle_t handle) {
+        #ifdef _WIN32
+            (void)(self);
+            (void)(id);
+            (void)(handle);
+        #else
+            if (handle == xlog::source_handle_nullptr) {
+                return true;
+            }
+
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.u64 = id;
+
+            if (epoll_ctl(self.epoll_handle, EPOLL_CTL_ADD, handle, &event) == -1) {
+                debug::print("reactor", "failed to register handle {}, error: {}", handle, std::strerror(errno));
+
+                return false;
+            }
+        #endif
+
+            return true;
+        }
+
+        static void unregister_handle(xlog::reactor::reactor_thread& self, xlog::source_handle_t handle) {
+        #ifdef _WIN32
+            (void)(self);
+            (void)(handle);
+        #else
+            if (handle != xlog::source_handle_nullptr) {
+                epoll_ctl(self.epoll_handle, EPOLL_CTL_DEL, handle, nullptr);
+            }
+        #endif
+        }
+
+        /* blocks until a handle is ready or the timeout elapses; fills the identifiers of ready sources */
+        static void wait_ready(xlog::reactor::reactor_thread& self, const std::unordered_map<uint64_t, xlog::reactor::attached_source>& sources, int64_t timeout_ms, std::vector<uint64_t>& ready) {
+            ready.clear();
+
+        #ifdef _WIN32
+            std::vector<HANDLE> handles{self.wake_handle};
+            std::vector<uint64_t> ids{xlog::reactor::g_wake_id};
+
+            for (auto&& [id, entry] : sources) {
+                auto handle{entry.source->poll_handle()};
+
+                if (handle != xlog::source_handle_nullptr) {
+                    handles.push_back(handle);
+                    ids.push_back(id);
+                }
+            }
+
+            DWORD timeout{timeout_ms < 0 ? INFINITE : static_cast<DWORD>(timeout_ms)};
+            DWORD wait_status{WaitForMultipleObjects(static_cast<DWORD>(handles.size()), handles.data(), FALSE, timeout)};
+
+            if (wait_status >= WAIT_OBJECT_0 && wait_status < WAIT_OBJECT_0 + handles.size()) {
+                auto id{ids[wait_status - WAIT_OBJECT_0]};
+
+                if (id != xlog::reactor::g_wake_id) {
+                    ready.push_back(id);
+                }
+            } else if (wait_status == WAIT_FAILED) {
+                debug::print("reactor", "failed to wait on thread {}, error: 0x{:08X}", self.index, GetLastError());
+            }
+        #else
+            (void)(sources);
+
+            std::array<epoll_event, 64> events{};
+            int timeout{static_cast<int>(std::min<int64_t>(timeout_ms, std::numeric_limits<int>::max()))};
+            int count{epoll_wait(self.epoll_handle, events.data(), static_cast<int>(events.size()), timeout)};
+
+            if (count == -1) {
+                if (errno != EINTR) {
+                    debug::print("reactor", "failed to wait on thread {}, error: {}", self.index, std::strerror(errno));
+                }
+
+                return;
+            }
+
+            for (int i{0}; i < count; i++) {
+                if (events[i].data.u64 == xlog::reactor::g_wake_id) {
+                    uint64_t value{0};
+
+                    if (::read(self.wake_handle, &value, sizeof(value)) == -1 && errno != EAGAIN) {
+                        debug::print("reactor", "failed to reset wake handle, error: {}", std::strerror(errno));
+                    }
+
+                    continue;
+                }
+
+                ready.push_back(events[i].data.u64);
+            }
+        #endif
+        }
+
+        /* shortest interval of the source and its stages; -1 when none of them is time-driven */
+        static int64_t poll_interval_ms(const xlog::reactor::attached_source& entry) {
+            auto interval{entry.source->poll_interval_ms()};
+
+            for (auto&& stage : entry.stages) {
+                auto stage_interval{stage->poll_interval_ms()};
+
+                if (stage_interval >= 0 && (interval < 0 || stage_interval < interval)) {
+                    interval = stage_interval;
+                }
+            }
+
+            return interval;
+        }
+
+        static void process_stages(xlog::reactor::attached_source& entry, std::vector<xlog::queue::log_entry_t>& batch) {
+            for (auto&& stage : entry.stages) {
+                try {
+                    stage->process(batch);
+                } catch (const std::exception& e) {
+                    debug::print("reactor", "stage of source '{}' failed, error: {}", entry.source->name(), e.what());
+                }
+            }
+        }
+
+        /* like process_stages, but every stage also hands out what it holds back, so later stages still see it */
+        static void drain_stages(xlog::reactor::attached_source& entry, std::vector<xlog::queue::log_entry_t>& batch) {
+            for (auto&& stage : entry.stages) {
+                try {
+                    stage->process(batch);
+                    stage->drain(batch);
+                } catch (const std::exception& e) {
+                    debug::print("reactor", "stage of source '{}' failed to drain, error: {}", entry.source->name(), e.what());
+                }
+            }
+        }
+
+        /* sources stop at a consistent point: what they buffered is queued before their last checkpoint */
+        static void finish(xlog::reactor::attached_source& entry, std::vector<xlog::queue::log_entry_t>& batch) {
+            batch.clear();
+
+            try {
+                entry.source->drain(batch);
+            } catch (const std::exception& e) {
+                debug::print("reactor", "source '{}' failed to drain, error: {}", entry.source->name(), e.what());
+            }
+
+            xlog::reactor::drain_stages(entry, batch);
+
+            if (!batch.empty()) {
+                xlog::queue::insert(batch);
+            }
+
+            entry.source->checkpoint();
+        }
+
+        /* returns false when the source asked to be detached */
+        static bool service(xlog::reactor::attached_source& entry, std::vector<xlog::queue::log_entry_t>& batch) {
+            bool keep{false};
+            batch.clear();
+
+            try {
+                keep = entry.source->read_batch(batch);
+            } catch (const std::exception& e) {
+                debug::print("reactor", "source '{}' failed, error: {}", entry.source->name(), e.what());
+            }
+
+            xlog::reactor::process_stages(entry, batch);
+
+            if (!batch.empty()) {
+                xlog::queue::insert(batch);
+            }
+
+            entry.source->checkpoint();
+
+            auto interval{xlog::reactor::poll_interval_ms(entry)};
+
+            if (interval >= 0) {
+                entry.next_poll = reactor_clock::now() + std::chrono::milliseconds(interval);
+            }
+
+            return keep;
+        }
+
+        static void worker(std::stop_token stop_token, xlog::reactor::reactor_thread& self) {
+            if (config::current()->reactor_pin_threads) {
+                xlog::reactor::pin_thread(self.index);
+            }
+
+            std::stop_callback wake_on_stop(stop_token, [&self]() {
+                xlog::reactor::wake(self);
+            });
+
+            std::unordered_map<uint64_t, xlog::reactor::attached_source> sources{};
+            std::vector<xlog::queue::log_entry_t> batch{};
+            std::vector<uint64_t> ready{};
+            uint64_t next_id{xlog::reactor::g_wake_id + 1};
+
+            auto detach = [&](uint64_t id) {
+                auto found{sources.find(id)};
+
+                if (found == sources.end()) {
+                    return;
+                }
+
+                debug::print("reactor", "detaching source '{}' from thread {}", found->second.source->name(), self.index);
+                xlog::reactor::finish(found->second, batch);
+                xlog::reactor::unregister_handle(self, found->second.source->poll_handle());
+                sources.erase(found);
+                self.load--;
+            };
+
+            while (!stop_token.stop_requested()) {
+                {
+                    std::vector<xlog::reactor::attached_source> pending{};
+                    std::vector<std::pair<uint64_t, std::promise<void>>> detaching{};
+
+                    {
+                        const std::lock_guard<std::mutex> _lock(self.pending_lock);
+                        pending.swap(self.pending);
+                        detaching.swap(self.detaching);
+                    }
+
+                    for (auto&& entry : pending) {
+                        auto id{next_id++};
+
+                        if (!xlog::reactor::register_handle(self, id, entry.source->poll_handle())) {
+                            self.load--;
+                            continue;
+                        }
+
+                        entry.next_poll = reactor_clock::now();
+                        sources.emplace(id, std::move(entry));
+                    }
+
+                    // after adoption, so a source attached and detached in quick succession is still stopped
+                    for (auto&& [group, done] : detaching) {
+                        std::vector<uint64_t> ids{};
+
+                        for (auto&& [id, entry] : sources) {
+                            if (entry.group == group) {
+                                ids.push_back(id);
+                            }
+                        }
+
+                        for (auto id : ids) {
+                            detach(id);
+                        }
+
+                        done.set_value();
+                    }
+                }
+
+                int64_t timeout_ms{-1};
+                auto now{reactor_clock::now()};
+
+                for (auto&& [id, entry] : sources) {
+                    if (xlog::reactor::poll_interval_ms(entry) < 0) {
+                        continue;
+                    }
+
+                    auto remaining{std::chrono::duration_cast<std::chrono::milliseconds>(entry.next_poll - now).count()};
+                    remaining = std::max<int64_t>(remaining, 0);
+
+                    if (timeout_ms < 0 || remaining < timeout_ms) {
+                        timeout_ms = remaining;
+                    }
+                }
+
+                xlog::reactor::wait_ready(self, sources, timeout_ms, ready);
+
+                for (auto id : ready) {
+                    auto found{sources.find(id)};
+
+                    if (found != sources.end()) {
+                        found->second.source->prepare();
+                    }
+                }
+
+                for (auto id : ready) {
+                    auto found{sources.find(id)};
+
+                    if (found != sources.end() && !xlog::reactor::service(found->second, batch)) {
+                        detach(id);
+                    }
+                }
+
+                now = reactor_clock::now();
+                ready.clear();
+
+                for (auto&& [id, entry] : sources) {
+                    if (xlog::reactor::poll_interval_ms(entry) >= 0 && entry.next_poll <= now) {
+                        ready.push_back(id);
+                    }
+                }
+
+                for (auto id : ready) {
+                    if (!xlog::reactor::service(sources.at(id), batch)) {
+                        detach(id);
+                    }
+                }
+            }
+
+            for (auto&& [id, entry] : sources) {
+                xlog::reactor::finish(entry, batch);
+            }
+        }
+
+        bool attach(std::unique_ptr<xlog::source> source, const xlog::pipeline_t& pipeline) {
+            if (!xlog::reactor::g_state || xlog::reactor::g_state->threads.empty()) {
+                debug::print("reactor", "not running; can't attach source '{}'", source->name());
+
+                return false;
+            }
+
+            const auto source_name{source->name()};
+
+            if (!source->open()) {
+                debug::print("reactor", "failed to open source '{}'", source_name);
+
+                return false;
+            }
+
+            auto& target{**std::min_element(xlog::reactor::g_state->threads.begin(), xlog::reactor::g_state->threads.end(), [](const auto& left, const auto& right) {
+                return left->load < right->load;
+            })};
+
+        #ifdef _WIN32
+            if (target.load + 1 >= MAXIMUM_WAIT_OBJECTS) {
+                debug::print("reactor", "all threads are at the wait limit; can't attach source '{}'", source_name);
+
+                return false;
+            }
+        #endif
+
+            {
+                const std::lock_guard<std::mutex> _lock(target.pending_lock);
+                target.pending.push_back(xlog::reactor::attached_source{
+                    .source = std::move(source),
+                    .stages = pipeline.stages ? pipeline.stages() : xlog::stages_t{},
+                    .group = pipeline.group,
+                });
+            }
+
+            target.load++;
+            xlog::reactor::wake(target);
+
+            debug::print("reactor", "attached source '{}' to thread {}", source_name, target.index);
+
+            return true;
+        }
+
+        void detach(uint64_t group) {
+            std::vector<std::future<void>> detached{};
+
+            if (!xlog::reactor::g_state) {
+                return;
+            }
+
+            for (auto&& thread : xlog::reactor::g_state->threads) {
+                std::promise<void> done{};
+                detached.push_back(done.get_future());
+
+                {
+                    const std::lock_guard<std::mutex> _lock(thread->pending_lock);
+                    thread->detaching.emplace_back(group, std::move(done));
+                }
+
+                xlog::reactor::wake(*thread);
+            }
+
+            // a thread that stopped first breaks its promise, which ends the wait as well
+            for (auto&& future : detached) {
+                future.wait();
+            }
+        }
+
+        void stop() {
+            if (!xlog::reactor::g_state) {
+                return;
+            }
+
+            // destroying a thread requests its stop and joins it
+            xlog::reactor::g_state->threads.clear();
+            xlog::reactor::g_state = nullptr;
+            debug::print("reactor", "stopped");
+        }
+
+        std::shared_ptr<xlog::reactor::state_t> start() {
+            if (xlog::reactor::g_state) {
+                debug::print("reactor", "already running");
+
+                return nullptr;
+            }
+
+            // threads started before a failure are joined as the state goes
+            auto state{std::make_shared<xlog::reactor::state_t>()};
+
+            size_t thread_count{config::current()->reactor_threads};
+
+            if (!thread_count) {
+                thread_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+            }
+
+            for (size_t index{0}; index < thread_count; index++) {
+                auto self{std::make_unique<xlog::reactor::reactor_thread>()};
+                self->index = index;
+
+            #ifdef _WIN32
+                self->wake_handle = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+                if (self->wake_handle == NULL) {
+                    self->wake_handle = xlog::source_handle_nullptr;
+                    debug::print("reactor", "failed to create wake event, error: 0x{:08X}", GetLastError());
+
+                    return nullptr;
+                }
+            #else
+                self->epoll_handle = epoll_create1(EPOLL_CLOEXEC);
+
+                if (self->epoll_handle == -1) {
+                    debug::print("reactor", "failed to create epoll handle, error: {}", std::strerror(errno));
+
+                    return nullptr;
+                }
+
+                self->wake_handle = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+                if (self->wake_handle == -1) {
+                    debug::print("reactor", "failed to create wake handle, error: {}", std::strerror(errno));
+
+                    return nullptr;
+                }
+
+                if (!xlog::reactor::register_handle(*self, xlog::reactor::g_wake_id, self->wake_handle)) {
+                    return nullptr;
+                }
+            #endif
+
+                self->thread = std::jthread(xlog::reactor::worker, std::ref(*self));
+                state->threads.push_back(std::move(self));
+            }
+
+            xlog::reactor::g_state = state.get();
+            debug::print("reactor", "started with {} thread(s)", thread_count);
+
+            return state;
+        }
+    }
+}
@@ -0,0 +1,219 @@
+#include <atomic>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "debug.hpp"
+#include "metrics.hpp"
+#include "xlog.hpp"
+#include "xlogsource.hpp"
+
+namespace xlog {
+    namespace severity {
+        /* level words are only looked for this far into a message, so one deep in the text doesn't count */
+        static constexpr size_t g_scan_length{64};
+
+        struct level_name {
+            std::string_view name{};
+            int level{0};
+        };
+
+        static constexpr level_name g_names[]{
+            {"emerg", 0}, {"emergency", 0}, {"panic", 0},
+            {"alert", 1},
+            {"crit", 2}, {"critical", 2}, {"fatal", 2},
+            {"err", 3}, {"error", 3},
+            {"warn", 4}, {"warning", 4},
+            {"notice", 5},
+            {"info", 6}, {"informational", 6},
+            {"debug", 7}, {"trace", 7},
+        };
+
+        std::optional<int> parse_level(std::string_view text) {
+            if (text.length() == 1 && text[0] >= '0' && text[0] <= '7') {
+                return text[0] - '0';
+            }
+
+            for (auto&& entry : xlog::severity::g_names) {
+                if (entry.name.length() != text.length()) {
+                    continue;
+                }
+
+                bool equal{true};
+
+                for (size_t i = 0; i < text.length() && equal; i++) {
+                    equal = std::tolower(static_cast<unsigned char>(text[i])) == entry.name[i];
+                }
+
+                if (equal) {
+                    return entry.level;
+                }
+            }
+
+            return std::nullopt;
+        }
+
+        /* the first word near the start that names a level, as in '[ERROR]', 'level=warn' or 'E0412 FATAL:' */
+        static std::optional<int> scan_words(std::string_view text) {
+            auto truncated{text.length() > xlog::severity::g_scan_length};
+            text = text.substr(0, xlog::severity::g_scan_length);
+
+            for (size_t i = 0; i < text.length();) {
+                if (!std::isalpha(static_cast<unsigned char>(text[i]))) {
+                    i++;
+                    continue;
+                }
+
+                auto start{i};
+
+                while (i < text.length() && std::isalpha(static_cast<unsigned char>(text[i]))) {
+                    i++;
+                }
+
+                // a word cut by the scan window may continue past it
+                if (i == text.length() && truncated) {
+                    break;
+                }
+
+                if (auto level{xlog::severity::parse_level(text.substr(start, i - start))}) {
+                    return level;
+                }
+            }
+
+            return std::nullopt;
+        }
+
+        struct compiled_rule {
+            std::string pattern{};
+            xlog::severity::match kind{};
+            std::optional<std::regex> regex{};
+            int level{0};
+        };
+
+        class severity_stage : public xlog::stage {
+        private:
+            std::vector<xlog::severity::compiled_rule> rules{};
+            std::string field{};
+            bool keywords{true};
+            std::atomic<uint64_t>* unclassified{nullptr};
+
+            bool matches(const xlog::severity::compiled_rule& rule, const std::string& message) const {
+                switch (rule.kind) {
+                    case xlog::severity::match::prefix: return message.starts_with(rule.pattern);
+                    case xlog::severity::match::literal: return message.find(rule.pattern) != std::string::npos;
+                    case xlog::severity::match::regex: return std::regex_search(message, *rule.regex);
+                }
+
+                return false;
+            }
+
+            std::optional<int> classify(const xlog::queue::log_entry_t& entry) const {
+                if (!this->field.empty() && entry.fields.is_object()) {
+                    auto value{entry.fields.find(this->field)};
+
+                    if (value != entry.fields.end() && value->is_string()) {
+                        if (auto level{xlog::severity::parse_level(value->get_ref<const std::string&>())}) {
+                            return level;
+                        }
+                    } else if (value != entry.fields.end() && value->is_number_integer()) {
+                        auto level{value->get<int64_t>()};
+
+                        if (level >= 0 && level <= 7) {
+                            return static_cast<int>(level);
+                        }
+                    }
+                }
+
+                for (auto&& rule : this->rules) {
+                    if (this->matches(rule, entry.message)) {
+                        return rule.level;
+                    }
+                }
+
+                if (this->keywords) {
+                    return xlog::severity::scan_words(entry.message);
+                }
+
+                return std::nullopt;
+            }
+        public:
+            /* throws std::regex_error on an invalid pattern */
+            severity_stage(const std::string& identifier, const xlog::severity::options& options)
+                : field(options.field), keywords(options.keywords) {
+                for (auto&& rule : options.rules) {
+                    xlog::severity::compiled_rule compiled{
+                        .pattern = rule.pattern,
+                        .kind = rule.kind,
+                        .level = rule.level,
+                    };
+
+                    if (rule.kind == xlog::severity::match::regex) {
+                        compiled.regex.emplace(rule.pattern, std::regex::ECMAScript | std::regex::optimize);
+                    }
+
+                    this->rules.push_back(std::move(compiled));
+                }
+
+                this->unclassified = &metrics::counter(std::format("severity.{}.unclassified", identifier));
+            }
+
+            /* entries their source already classified, like syslog, kmsg and journald ones, are left alone */
+            void process(std::vector<xlog::queue::log_entry_t>& batch) override {
+                for (auto&& entry : batch) {
+                    if (entry.fields.is_object() && entry.fields.contains("severity")) {
+                        continue;
+                    }
+
+                    auto level{this->classify(entry)};
+
+                    if (!level) {
+                        (*this->unclassified)++;
+                        continue;
+                    }
+
+                    if (entry.fields.is_null()) {
+                        entry.fields = nlohmann::json::object();
+                    }
+
+                    if (entry.fields.is_object()) {
+                        entry.fields["severity"] = *level;
+                    }
+                }
+            }
+        };
+
+        std::unique_ptr<xlog::stage> create(const std::string& identifier, const xlog::severity::options& options) {
+            for (auto&& rule : options.rules) {
+                if (rule.pattern.empty() || rule.level < 0 || rule.level > 7) {
+                    debug::print("severity", "rules for '{}' need a pattern and a level between 0 and 7", identifier);
+
+                    return nullptr;
+                }
+            }
+
+            try {
+                return std::make_unique<xlog::severity::severity_stage>(identifier, options);
+            } catch (const std::regex_error& e) {
+                debug::print("severity", "invalid pattern for '{}', error: {}", identifier, e.what());
+            }
+
+            return nullptr;
+        }
+
+        bool urgent(const nlohmann::json& fields, int64_t threshold) {
+            if (threshold < 0 || !fields.is_object()) {
+                return false;
+            }
+
+            auto value{fields.find("severity")};
+
+            return value != fields.end() && value->is_number_integer() && value->get<int64_t>() <= threshold;
+        }
+    }
+}
@@ -0,0 +1,403 @@
+#ifndef _WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "route8-log/shm.hpp"
+#include "config.hpp"
+#include "debug.hpp"
+#include "metrics.hpp"
+#include "xlog.hpp"
+#include "xlogsource.hpp"
+
+namespace xlog {
+    namespace shm {
+    #ifndef _WIN32
+        /* where POSIX shared memory objects show up as files */
+        static const char* g_directory{"/dev/shm"};
+        /* new rings are looked for, and producers checked for liveness, this often */
+        static constexpr int64_t g_scan_interval_ms{1000};
+        /* records taken from one ring per wakeup, so a busy producer can't starve the others */
+        static constexpr size_t g_batch_records{4096};
+
+        struct ring {
+            /* kept open so the size can be checked against the mapping before every read */
+            int handle{-1};
+            void* mapping{nullptr};
+            size_t mapping_size{0};
+            xlog::shm::ring_header* header{nullptr};
+            const char* data{nullptr};
+            uint64_t capacity{0};
+            int64_t pid{0};
+            /* read up to here; published to the producer as its tail on checkpoint() */
+            uint64_t position{0};
+            uint64_t overflows_seen{0};
+        };
+
+        class shm_source : public xlog::source {
+        private:
+            std::string identifier{};
+            xlog::shm::options options{};
+            /* file names in g_directory belonging to this channel start with this */
+            std::string prefix{};
+
+            std::unordered_map<std::string, xlog::shm::ring> rings{};
+            /* rings whose owner or mode was refused; a producer's ring keeps its name, so they aren't checked again */
+            std::unordered_set<std::string> refused{};
+            std::chrono::steady_clock::time_point next_scan{};
+
+            std::atomic<uint64_t>* records_read{nullptr};
+            std::atomic<uint64_t>* overflows{nullptr};
+            std::atomic<uint64_t>* dead_producers{nullptr};
+            std::atomic<uint64_t>* corrupt{nullptr};
+
+            /* records of a ring others can write could be forged, so the owner and mode are checked before mapping */
+            bool permitted(const std::string& filename, const struct stat& ring_stat) const {
+                const auto& uids{this->options.allowed_uids};
+                const auto& gids{this->options.allowed_gids};
+                const bool uid_allowed{uids.empty() && gids.empty() ? ring_stat.st_uid == ::geteuid()
+                    : std::find(uids.begin(), uids.end(), ring_stat.st_uid) != uids.end()};
+                const bool gid_allowed{std::find(gids.begin(), gids.end(), ring_stat.st_gid) != gids.end()};
+
+                if (!S_ISREG(ring_stat.st_mode) || (ring_stat.st_mode & S_IWOTH) || ((ring_stat.st_mode & S_IWGRP) && !gid_allowed)) {
+                    debug::print("shm", "ignoring '{}'; its mode {:o} lets other users write to it", filename, ring_stat.st_mode & 07777);
+
+                    return false;
+                }
+
+                if (!uid_allowed && !gid_allowed) {
+                    debug::print("shm", "ignoring '{}'; its owner {}:{} isn't allowed", filename, ring_stat.st_uid, ring_stat.st_gid);
+
+                    return false;
+                }
+
+                return true;
+            }
+
+            bool map_ring(const std::string& filename, xlog::shm::ring& result) {
+                auto handle{::shm_open(("/" + filename).c_str(), O_RDWR | O_CLOEXEC | O_NOFOLLOW, 0)};
+
+                if (handle == -1) {
+                    return false;
+                }
+
+                struct stat ring_stat{};
+
+                if (fstat(handle, &ring_stat) == -1 || static_cast<size_t>(ring_stat.st_size) <= xlog::shm::data_offset) {
+                    ::close(handle);
+
+                    return false;
+                }
+
+                if (!this->permitted(filename, ring_stat)) {
+                    this->refused.insert(filename);
+                    ::close(handle);
+
+                    return false;
+                }
+
+                result.mapping_size = static_cast<size_t>(ring_stat.st_size);
+                result.mapping = ::mmap(nullptr, result.mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+
+                if (result.mapping == MAP_FAILED) {
+                    result.mapping = nullptr;
+                    ::close(handle);
+
+                    return false;
+                }
+
+                result.handle = handle;
+                result.header = static_cast<xlog::shm::ring_header*>(result.mapping);
+
+                // a producer still setting up the ring hasn't written the magic yet
+                if (result.header->magic.load(std::memory_order_acquire) != xlog::shm::ring_magic) {
+                    this->unmap(result);
+
+                    return false;
+                }
+
+                result.capacity = result.header->capacity;
+
+                if (result.header->version != xlog::shm::ring_version || result.capacity == 0 || (result.capacity & (result.capacity - 1)) != 0
+                    || xlog::shm::data_offset + result.capacity > result.mapping_size) {
+                    debug::print("shm", "ignoring '{}'; not a ring this version can read", filename);
+                    this->unmap(result);
+
+                    return false;
+                }
+
+                result.data = static_cast<const char*>(result.mapping) + xlog::shm::data_offset;
+                result.pid = result.header->pid;
+                result.position = result.header->tail.load(std::memory_order_acquire);
+                result.overflows_seen = 0;
+
+                return true;
+            }
+
+            void scan() {
+                std::error_code ec{};
+
+                for (const auto& item : std::filesystem::directory_iterator(g_directory, ec)) {
+                    auto filename{item.path().filename().string()};
+
+                    if (!filename.starts_with(this->prefix) || this->rings.contains(filename) || this->refused.contains(filename)) {
+                        continue;
+                    }
+
+                    xlog::shm::ring ring{};
+
+                    if (this->map_ring(filename, ring)) {
+                        debug::print("shm", "reading ring '{}' of process {}", filename, ring.pid);
+                        this->rings[filename] = ring;
+                    }
+                }
+            }
+
+            void unmap(xlog::shm::ring& ring) {
+                ::munmap(ring.mapping, ring.mapping_size);
+                ::close(ring.handle);
+                ring.mapping = nullptr;
+                ring.handle = -1;
+            }
+
+            /* a ring cut shorter than its mapping would fault on the pages past its new end */
+            bool intact(const xlog::shm::ring& ring) {
+                struct stat ring_stat{};
+
+                return fstat(ring.handle, &ring_stat) == 0 && static_cast<size_t>(ring_stat.st_size) >= ring.mapping_size;
+            }
+
+            /* false once the ring can't be trusted anymore */
+            bool read_ring(xlog::shm::ring& ring, size_t limit, std::vector<xlog::queue::log_entry_t>& batch) {
+                if (!this->intact(ring)) {
+                    return false;
+                }
+
+                const auto head{ring.header->head.load(std::memory_order_acquire)};
+                const auto mask{ring.capacity - 1};
+                const nlohmann::json fields = {{"pid", ring.pid}};
+
+                if (head - ring.position > ring.capacity) {
+                    return false;
+                }
+
+                for (size_t count = 0; ring.position != head && count < limit;) {
+                    const auto offset{ring.position & mask};
+                    xlog::shm::record_header record{};
+
+                    std::memcpy(&record, ring.data + offset, std::min<uint64_t>(sizeof(record), ring.capacity - offset));
+
+                    if (record.kind == xlog::shm::record_kind_padding) {
+                        ring.position += ring.capacity - offset;
+                        continue;
+                    }
+
+                    const auto size{xlog::shm::record_size(record.length)};
+
+                    if (record.kind != xlog::shm::record_kind_entry || size > head - ring.position || offset + size > ring.capacity) {
+                        return false;
+                    }
+
+                    batch.push_back(xlog::queue::log_entry_t{
+                        .identifier = this->identifier,
+                        .timestamp = record.timestamp,
+                        .message = std::string(ring.data + offset + sizeof(record), record.length),
+                        .fields = fields,
+                    });
+
+                    ring.position += size;
+                    count++;
+                    (*this->records_read)++;
+                }
+
+                const auto overflows{ring.header->overflows.load(std::memory_order_relaxed)};
+
+                if (overflows != ring.overflows_seen) {
+                    debug::print("shm", "process {} found its ring full {} times", ring.pid, overflows - ring.overflows_seen);
+
+                    (*this->overflows) += overflows - ring.overflows_seen;
+                    ring.overflows_seen = overflows;
+                }
+
+                return true;
+            }
+
+            /* a ring is finished once drained and its producer closed it or died without doing so */
+            bool finished(const xlog::shm::ring& ring) {
+                if (ring.position != ring.header->head.load(std::memory_order_acquire)) {
+                    return false;
+                }
+
+                if (ring.header->closed.load(std::memory_order_acquire)) {
+                    return true;
+                }
+
+                if (::kill(static_cast<pid_t>(ring.pid), 0) == -1 && errno == ESRCH) {
+                    debug::print("shm", "process {} exited without closing its ring", ring.pid);
+                    (*this->dead_producers)++;
+
+                    return true;
+                }
+
+                return false;
+            }
+
+            void release(const std::string& filename, xlog::shm::ring& ring, bool remove) {
+                if (this->intact(ring)) {
+                    ring.header->tail.store(ring.position, std::memory_order_release);
+                }
+
+                this->unmap(ring);
+
+                if (remove) {
+                    ::shm_unlink(("/" + filename).c_str());
+                }
+            }
+        public:
+            shm_source(std::string identifier, const xlog::shm::options& options)
+                : identifier(std::move(identifier)), options(options) {
+                this->records_read = &metrics::counter(std::format("shm.{}.read", this->identifier));
+                this->overflows = &metrics::counter(std::format("shm.{}.overflows", this->identifier));
+                this->dead_producers = &metrics::counter(std::format("shm.{}.dead_producers", this->identifier));
+                this->corrupt = &metrics::counter(std::format("shm.{}.corrupt", this->identifier));
+            }
+
+            ~shm_source() override {
+                // rings stay for the next run to continue where this one stopped
+                for (auto&& [filename, ring] : this->rings) {
+                    this->release(filename, ring, false);
+                }
+            }
+
+            std::string name() const override {
+                return "shm:" + this->options.channel;
+            }
+
+            bool open() override {
+                if (this->options.channel.empty() || this->options.channel.find('/') != std::string::npos) {
+                    debug::print("shm", "'{}' is not a valid channel name", this->options.channel);
+
+                    return false;
+                }
+
+                this->prefix = std::string(xlog::shm::name_prefix) + this->options.channel + ".";
+                this->scan();
+                this->next_scan = std::chrono::steady_clock::now() + std::chrono::milliseconds(g_scan_interval_ms);
+
+                return true;
+            }
+
+            xlog::source_handle_t poll_handle() const override {
+                return xlog::source_handle_nullptr;
+            }
+
+            int64_t poll_interval_ms() const override {
+                return this->options.poll_interval_ms;
+            }
+
+            bool read_batch(std::vector<xlog::queue::log_entry_t>& batch) override {
+                const auto now{std::chrono::steady_clock::now()};
+                const bool housekeeping{now >= this->next_scan};
+
+                for (auto it{this->rings.begin()}; it != this->rings.end();) {
+                    auto& [filename, ring] = *it;
+
+                    if (!this->read_ring(ring, g_batch_records, batch)) {
+                        debug::print("shm", "ring '{}' is corrupt; removing it", filename);
+                        (*this->corrupt)++;
+
+                        this->release(filename, ring, true);
+                        it = this->rings.erase(it);
+                        continue;
+                    }
+
+                    if (housekeeping && this->finished(ring)) {
+                        debug::print("shm", "ring '{}' is drained and its process is gone; removing it", filename);
+
+                        this->release(filename, ring, true);
+                        it = this->rings.erase(it);
+                        continue;
+                    }
+
+                    it++;
+                }
+
+                if (housekeeping) {
+                    this->scan();
+                    this->next_scan = now + std::chrono::milliseconds(g_scan_interval_ms);
+                }
+
+                if (config::current()->verbose) {
+                    for (auto&& entry : batch) {
+                        debug::print("shm", "detected record on '{}': '{}'", this->options.channel, entry.message);
+                    }
+                }
+
+                return true;
+            }
+
+            /* space is handed back to producers only once their records are queued */
+            void checkpoint() override {
+                for (auto&& [filename, ring] : this->rings) {
+                    if (this->intact(ring)) {
+                        ring.header->tail.store(ring.position, std::memory_order_release);
+                    }
+                }
+            }
+
+            void drain(std::vector<xlog::queue::log_entry_t>& batch) override {
+                for (auto&& [filename, ring] : this->rings) {
+                    this->read_ring(ring, ring.capacity, batch);
+                }
+            }
+        };
+
+        bool start(std::string identifier, const xlog::shm::options& options, const xlog::pipeline_t& pipeline) {
+            if (!xlog::reactor::attach(std::make_unique<xlog::shm::shm_source>(identifier, options), pipeline)) {
+                return false;
+            }
+
+            debug::print("shm", "started on channel '{}'", options.channel);
+
+            return true;
+        }
+
+        bool platform_support() {
+            return true;
+        }
+    #else
+        bool start(std::string identifier, const xlog::shm::options& options, const xlog::pipeline_t& pipeline) {
+            (void)(identifier);
+            (void)(options);
+            (void)(pipeline);
+
+            return false;
+        }
+
+        bool platform_support() {
+            return false;
+        }
+    #endif
+    }
+}
@@ -0,0 +1,463 @@
+#include <algorithm>
+#include <charconv>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <ios>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <system_error>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "config.hpp"
+#include "crc32c.hpp"
+#include "debug.hpp"
+#include "metrics.hpp"
+#include "xlog.hpp"
+#include "xlogsink.hpp"
+
+namespace xlog {
+    namespace sinks {
+        using records_ptr = std::shared_ptr<const xlog::sinks::records_t>;
+
+        static std::atomic<uint64_t>& g_spool_mismatches{metrics::counter("spool.crc_mismatches")};
+
+        /* spool lines are '<record>\t<crc32c as 8 hex digits>'; serialized records never hold a raw tab */
+        static void write_spool_line(std::ofstream& spool, const std::string& record) {
+            spool << record << '\t' << std::format("{:08x}", crc32c::compute(record)) << '\n';
+        }
+
+        /* false when the line has no checksum or it doesn't match */
+        static bool read_spool_line(std::string& line) {
+            auto separator{line.rfind('\t')};
+
+            if (separator == std::string::npos) {
+                return false;
+            }
+
+            uint32_t expected{0};
+            auto digits{std::string_view(line).substr(separator + 1)};
+            auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.length(), expected, 16);
+
+            if (ec != std::errc{} || end != digits.data() + digits.length() || digits.length() != 8) {
+                return false;
+            }
+
+            line.resize(separator);
+
+            return crc32c::compute(line) == expected;
+        }
+
+        /* a shared batch in a sink's backlog, written up to offset */
+        struct batch_t {
+            records_ptr records{};
+            size_t offset{0};
+            bool urgent{false};
+            /* when its oldest entry was queued */
+            std::chrono::steady_clock::time_point ingested{};
+        };
+
+        /* ingest-to-written latency of one lane's batches, measured from their oldest entry */
+        struct latency_t {
+            std::atomic<uint64_t>* batches{nullptr};
+            /* the sum; divided by batches it's the mean */
+            std::atomic<uint64_t>* total_us{nullptr};
+            std::atomic<uint64_t>* maximum_us{nullptr};
+
+            latency_t(const std::string& prefix) {
+                this->batches = &metrics::counter(prefix + ".batches");
+                this->total_us = &metrics::counter(prefix + ".latency_us");
+                this->maximum_us = &metrics::counter(prefix + ".latency_max_us");
+            }
+
+            void record(std::chrono::steady_clock::time_point ingested) {
+                auto elapsed{std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - ingested)};
+                auto value{static_cast<uint64_t>(std::max<int64_t>(elapsed.count(), 0))};
+                auto maximum{this->maximum_us->load()};
+
+                (*this->batches)++;
+                (*this->total_us) += value;
+
+                while (value > maximum && !this->maximum_us->compare_exchange_weak(maximum, value)) {
+                }
+            }
+        };
+
+        /* one sink with its thread and backlog; urgent batches queue ahead of ordinary ones,
+           but never ahead of the front batch while it's being written */
+        class runner {
+        private:
+            std::unique_ptr<xlog::sink> sink{};
+            std::string spool_directory{};
+            std::mutex lock{};
+            std::condition_variable_any changed{};
+            std::deque<xlog::sinks::batch_t> backlog{};
+            size_t pending{0};
+            bool in_flight{false};
+            std::atomic<uint64_t>* written{nullptr};
+            std::atomic<uint64_t>* dropped{nullptr};
+            xlog::sinks::latency_t priority_latency;
+            xlog::sinks::latency_t normal_latency;
+            std::jthread thread{};
+
+            std::string spool_filename() const {
+                return (std::filesystem::path(this->spool_directory) / std::format("spool.{}.jsonl", this->sink->name())).string();
+            }
+
+            void procedure(std::stop_token stop_token) {
+                auto interval{this->sink->poll_interval_ms()};
+                auto next_poll{std::chrono::steady_clock::now() + std::chrono::milliseconds(interval)};
+
+                while (!stop_token.stop_requested()) {
+                    records_ptr records{};
+                    size_t from{0};
+
+                    {
+                        std::unique_lock<std::mutex> scope_lock(this->lock);
+
+                        auto ready = [this]() { return !this->backlog.empty(); };
+
+                        if (interval < 0) {
+                            this->changed.wait(scope_lock, stop_token, ready);
+                        } else {
+                            this->changed.wait_until(scope_lock, stop_token, next_poll, ready);
+                        }
+
+                        if (!this->backlog.empty()) {
+                            records = this->backlog.front().records;
+                            from = this->backlog.front().offset;
+                            this->in_flight = true;
+                        }
+                    }
+
+                    if (interval >= 0 && std::chrono::steady_clock::now() >= next_poll) {
+                        this->sink->poll();
+                        next_poll = std::chrono::steady_clock::now() + std::chrono::milliseconds(interval);
+                    }
+
+                    if (!records) {
+                        continue;
+                    }
+
+                    auto count{this->sink->write(*records, from)};
+
+                    {
+                        const std::lock_guard<std::mutex> _lock(this->lock);
+                        auto& batch{this->backlog.front()};
+
+                        this->in_flight = false;
+                        batch.offset += count;
+                        this->pending -= count;
+
+                        if (batch.offset >= records->size()) {
+                            (batch.urgent ? this->priority_latency : this->normal_latency).record(batch.ingested);
+                            this->backlog.pop_front();
+                        }
+                    }
+
+                    (*this->written) += count;
+                    this->changed.notify_all();
+
+                    if (from + count < records->size()) {
+                        std::unique_lock<std::mutex> wait_lock(this->lock);
+                        const auto settings{config::current()};
+
+                        this->changed.wait_for(wait_lock, stop_token, std::chrono::milliseconds(settings->dispatch_sleep_ms), []() { return false; });
+                    }
+                }
+            }
+        public:
+            runner(std::unique_ptr<xlog::sink> sink, std::string spool_directory)
+                : sink(std::move(sink)),
+                  spool_directory(std::move(spool_directory)),
+                  priority_latency(std::format("sink.{}.priority", this->sink->name())),
+                  normal_latency(std::format("sink.{}.normal", this->sink->name())) {
+                this->written = &metrics::counter(std::format("sink.{}.written", this->sink->name()));
+                this->dropped = &metrics::counter(std::format("sink.{}.dropped", this->sink->name()));
+            }
+
+            const xlog::sink& get() const {
+                return *this->sink;
+            }
+
+            void start() {
+                this->thread = std::jthread([this](std::stop_token stop_token) { this->procedure(stop_token); });
+            }
+
+            /* past maximum_log_entries drops the oldest ordinary batches, then the oldest urgent ones,
+               but never the one being written nor the one just pushed */
+            void push(const records_ptr& records, bool urgent, std::chrono::steady_clock::time_point ingested) {
+                const auto maximum{config::current()->maximum_log_entries};
+
+                {
+                    const std::lock_guard<std::mutex> _lock(this->lock);
+                    auto position{this->backlog.end()};
+
+                    if (urgent) {
+                        position = this->in_flight ? this->backlog.begin() + 1 : this->backlog.begin();
+
+                        while (position != this->backlog.end() && position->urgent) {
+                            position++;
+                        }
+                    }
+
+                    this->backlog.insert(position, xlog::sinks::batch_t{.records = records, .urgent = urgent, .ingested = ingested});
+                    this->pending += records->size();
+
+                    while (this->pending > maximum) {
+                        auto first{this->in_flight ? this->backlog.begin() + 1 : this->backlog.begin()};
+                        auto victim{std::find_if(first, this->backlog.end(), [&records](const xlog::sinks::batch_t& batch) {
+                            return !batch.urgent && batch.records != records;
+                        })};
+
+                        if (victim == this->backlog.end()) {
+                            victim = std::find_if(first, this->backlog.end(), [&records](const xlog::sinks::batch_t& batch) {
+                                return batch.records != records;
+                            });
+                        }
+
+                        if (victim == this->backlog.end()) {
+                            break;
+                        }
+
+                        auto count{victim->records->size() - victim->offset};
+
+                        debug::print("sink", "'{}' is {} records behind; dropping its oldest {}", this->sink->name(), this->pending, count);
+
+                        this->pending -= count;
+                        (*this->dropped) += count;
+                        this->backlog.erase(victim);
+                    }
+                }
+
+                this->changed.notify_all();
+            }
+
+            /* false when records are still pending at until */
+            bool wait(std::chrono::steady_clock::time_point until) {
+                std::unique_lock<std::mutex> scope_lock(this->lock);
+
+                return this->changed.wait_until(scope_lock, until, [this]() { return this->pending == 0; });
+            }
+
+            size_t size() {
+                const std::lock_guard<std::mutex> _lock(this->lock);
+
+                return this->pending;
+            }
+
+            void stop() {
+                if (this->thread.joinable()) {
+                    this->thread.request_stop();
+                    this->thread.join();
+                }
+
+                this->sink->close();
+            }
+
+            /* a spool left by the previous run goes ahead of anything new */
+            void load_spool() {
+                auto filename{this->spool_filename()};
+                std::ifstream spool(filename, std::ios_base::in | std::ios_base::binary);
+
+                if (!spool.is_open()) {
+                    return;
+                }
+
+                auto records{std::make_shared<xlog::sinks::records_t>()};
+                std::string line{};
+
+                size_t mismatches{0};
+
+                while (std::getline(spool, line)) {
+                    if (line.empty()) {
+                        continue;
+                    }
+
+                    if (!xlog::sinks::read_spool_line(line)) {
+                        mismatches++;
+                        continue;
+                    }
+
+                    records->push_back(std::move(line));
+                }
+
+                if (mismatches) {
+                    debug::print("sink", "skipped {} corrupt records in '{}'", mismatches, filename);
+                    xlog::sinks::g_spool_mismatches += mismatches;
+                }
+
+                spool.close();
+                std::remove(filename.c_str());
+
+                debug::print("sink", "loaded {} spooled records for '{}'", records->size(), this->sink->name());
+
+                if (!records->empty()) {
+                    this->push(records, false, std::chrono::steady_clock::now());
+                }
+            }
+
+            /* expects the thread stopped */
+            size_t persist() {
+                const std::lock_guard<std::mutex> _lock(this->lock);
+
+                if (this->pending == 0) {
+                    return 0;
+                }
+
+                auto filename{this->spool_filename()};
+                std::ofstream spool(filename, std::ios_base::out | std::ios_base::app | std::ios_base::binary);
+
+                if (!spool.is_open()) {
+                    debug::print("sink", "failed to open spool '{}'; {} records are lost", filename, this->pending);
+
+                    return 0;
+                }
+
+                size_t spooled{0};
+
+                for (auto&& batch : this->backlog) {
+                    for (auto i{batch.offset}; i < batch.records->size(); i++) {
+                        xlog::sinks::write_spool_line(spool, (*batch.records)[i]);
+                        spooled++;
+                    }
+                }
+
+                spool.flush();
+
+                if (!spool) {
+                    debug::print("sink", "failed to write spool '{}'", filename);
+
+                    return 0;
+                }
+
+                this->backlog.clear();
+                this->pending = 0;
+
+                return spooled;
+            }
+
+            uint64_t dropped_count() const {
+                return this->dropped->load();
+            }
+        };
+
+        struct state_t {
+            std::string spool_directory{};
+            std::vector<std::unique_ptr<xlog::sinks::runner>> runners{};
+        };
+
+        static xlog::sinks::state_t* g_state{nullptr};
+
+        /* none when no state is started, as before start() or in a rollback */
+        static std::vector<std::unique_ptr<xlog::sinks::runner>>& runners() {
+            static std::vector<std::unique_ptr<xlog::sinks::runner>> none{};
+
+            return xlog::sinks::g_state ? xlog::sinks::g_state->runners : none;
+        }
+
+        static bool add(std::unique_ptr<xlog::sink> sink) {
+            if (!sink || !sink->open()) {
+                return false;
+            }
+
+            auto runner{std::make_unique<xlog::sinks::runner>(std::move(sink), xlog::sinks::g_state->spool_directory)};
+            runner->load_spool();
+            runner->start();
+
+            debug::print("sink", "'{}' started", runner->get().name());
+            xlog::sinks::g_state->runners.push_back(std::move(runner));
+
+            return true;
+        }
+
+        std::shared_ptr<xlog::sinks::state_t> create(std::string spool_directory) {
+            auto state{std::make_shared<xlog::sinks::state_t>()};
+            state->spool_directory = std::move(spool_directory);
+
+            return state;
+        }
+
+        bool start(xlog::sinks::state_t& state) {
+            xlog::sinks::g_state = &state;
+
+            if (!xlog::sinks::add(xlog::sinks::remote::create())) {
+                return false;
+            }
+
+            if (!config::current()->archive_directory.empty()) {
+                if (!xlog::sinks::add(xlog::sinks::archive::create())) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        void publish(const records_ptr& records, bool urgent, std::chrono::steady_clock::time_point ingested) {
+            for (auto&& runner : xlog::sinks::runners()) {
+                runner->push(records, urgent, ingested);
+            }
+        }
+
+        size_t drain(std::chrono::steady_clock::time_point until) {
+            size_t pending{0};
+
+            for (auto&& runner : xlog::sinks::runners()) {
+                runner->wait(until);
+                pending += runner->size();
+            }
+
+            return pending;
+        }
+
+        size_t backlog() {
+            size_t result{0};
+
+            for (auto&& runner : xlog::sinks::runners()) {
+                result = std::max(result, runner->size());
+            }
+
+            return result;
+        }
+
+        size_t persist(size_t& held) {
+            size_t spooled{0};
+            held = 0;
+
+            for (auto&& runner : xlog::sinks::runners()) {
+                runner->stop();
+                held += runner->size();
+                spooled += runner->persist();
+            }
+
+            return spooled;
+        }
+
+        uint64_t dropped() {
+            uint64_t result{0};
+
+            for (auto&& runner : xlog::sinks::runners()) {
+                result += runner->dropped_count();
+            }
+
+            return result;
+        }
+
+        void stop() {
+            if (xlog::sinks::g_state) {
+                xlog::sinks::g_state->runners.clear();
+                xlog::sinks::g_state = nullptr;
+            }
+        }
+    }
+}
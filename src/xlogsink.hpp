@@ -0,0 +1,45 @@
+#ifndef __XLOGSINK_HPP
+#define __XLOGSINK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "xlog.hpp"
+
+namespace xlog {
+    /* a destination for shipped entries; every sink runs on its own thread with its own backlog,
+       so a slow destination only holds up itself. open() is called once on start, write() whenever
+       the backlog holds records, poll() at least every poll_interval_ms() and close() on shutdown */
+    class sink {
+    public:
+        virtual ~sink() = default;
+
+        virtual std::string name() const = 0;
+        virtual bool open() = 0;
+
+        /* writes records from offset on; returns how many were written, fewer when the destination
+           is unavailable. the rest is offered again after dispatch_sleep_ms */
+        virtual size_t write(const xlog::sinks::records_t& records, size_t offset) = 0;
+
+        /* -1 when the sink has no time-driven work */
+        virtual int64_t poll_interval_ms() const { return -1; }
+
+        virtual void poll() {}
+        virtual void close() {}
+    };
+
+    namespace sinks {
+        namespace remote {
+            /* the TLS collector connection kept up by inet::connect() */
+            std::unique_ptr<xlog::sink> create();
+        }
+
+        namespace archive {
+            /* size and time rotated files under archive_directory, gzip compressed when archive_compress is set */
+            std::unique_ptr<xlog::sink> create();
+        }
+    }
+}
+
+#endif
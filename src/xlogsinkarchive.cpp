@@ -0,0 +1,332 @@
+#ifdef ROUTE8_LOG_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <ios>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include "config.hpp"
+#include "crc32c.hpp"
+#include "debug.hpp"
+#include "realtime.hpp"
+#include "xlog.hpp"
+#include "xlogsink.hpp"
+
+namespace xlog {
+    namespace sinks {
+        namespace archive {
+            /* rotated files are named <prefix><UTC time><extension> */
+            static constexpr const char* g_prefix{"route8-log-"};
+            /* written data is flushed to the file and the age checked this often */
+            static constexpr int64_t g_poll_interval_ms{1000};
+            static constexpr int g_compression_level{6};
+            /* rotated files get a sidecar with the CRC32C of their uncompressed content, as 8 hex digits */
+            static constexpr const char* g_checksum_extension{".crc32c"};
+
+            class archive_sink : public xlog::sink {
+            private:
+                std::filesystem::path directory{};
+                uint64_t maximum_bytes{0};
+                int64_t maximum_age_s{0};
+                bool compress{false};
+                size_t keep{0};
+            #ifdef ROUTE8_LOG_HAVE_ZLIB
+                gzFile gz_file{nullptr};
+            #endif
+                std::ofstream plain_file{};
+                uint64_t file_bytes{0};
+                bool unflushed{false};
+                std::chrono::steady_clock::time_point opened{};
+                std::string buffer{};
+                /* of the current file's content; unknown once it was reopened after a failed write */
+                std::optional<uint32_t> checksum{};
+
+                std::string extension() const {
+                    return this->compress ? ".jsonl.gz" : ".jsonl";
+                }
+
+                std::filesystem::path current_path() const {
+                    return this->directory / ("current" + this->extension());
+                }
+
+                bool open_current() {
+                    auto path{this->current_path()};
+                    std::error_code ec{};
+                    const bool fresh{!std::filesystem::exists(path, ec) || std::filesystem::file_size(path, ec) == 0};
+
+                #ifdef ROUTE8_LOG_HAVE_ZLIB
+                    if (this->compress) {
+                        // appending to a leftover adds a gzip member, which readers concatenate
+                        this->gz_file = gzopen(path.string().c_str(), std::format("ab{}", g_compression_level).c_str());
+
+                        if (!this->gz_file) {
+                            debug::print("archive-sink", "failed to open '{}'", path.string());
+
+                            return false;
+                        }
+
+                        gzbuffer(this->gz_file, 128 * 1024);
+                    } else
+                #endif
+                    {
+                        this->plain_file.open(path, std::ios_base::out | std::ios_base::app | std::ios_base::binary);
+
+                        if (!this->plain_file.is_open()) {
+                            debug::print("archive-sink", "failed to open '{}'", path.string());
+
+                            return false;
+                        }
+                    }
+
+                    this->file_bytes = 0;
+                    this->checksum = fresh ? std::make_optional<uint32_t>(0) : std::nullopt;
+                    this->unflushed = false;
+                    this->opened = std::chrono::steady_clock::now();
+
+                    return true;
+                }
+
+                void close_current() {
+                #ifdef ROUTE8_LOG_HAVE_ZLIB
+                    if (this->gz_file) {
+                        gzclose(this->gz_file);
+                        this->gz_file = nullptr;
+                    }
+                #endif
+
+                    if (this->plain_file.is_open()) {
+                        this->plain_file.close();
+                    }
+                }
+
+                bool is_open() const {
+                #ifdef ROUTE8_LOG_HAVE_ZLIB
+                    if (this->gz_file) {
+                        return true;
+                    }
+                #endif
+
+                    return this->plain_file.is_open();
+                }
+
+                bool write_current(const std::string& data) {
+                #ifdef ROUTE8_LOG_HAVE_ZLIB
+                    if (this->gz_file) {
+                        return gzwrite(this->gz_file, data.data(), static_cast<unsigned>(data.length())) == static_cast<int>(data.length());
+                    }
+                #endif
+
+                    this->plain_file.write(data.data(), static_cast<std::streamsize>(data.length()));
+
+                    return static_cast<bool>(this->plain_file);
+                }
+
+                void flush_current() {
+                #ifdef ROUTE8_LOG_HAVE_ZLIB
+                    if (this->gz_file) {
+                        // a sync flush keeps the file readable up to here at a small cost in ratio
+                        gzflush(this->gz_file, Z_SYNC_FLUSH);
+                    }
+                #endif
+
+                    if (this->plain_file.is_open()) {
+                        this->plain_file.flush();
+                    }
+
+                    this->unflushed = false;
+                }
+
+                /* moves a finished file to its final name, then removes the oldest past archive_keep */
+                void retire(const std::filesystem::path& path, const std::string& extension, std::optional<uint32_t> checksum) {
+                    std::error_code ec{};
+                    auto now{std::chrono::sys_time<std::chrono::nanoseconds>(std::chrono::nanoseconds(realtime::coarse_ns()))};
+                    auto stem{std::format("{}{:%Y%m%dT%H%M%SZ}", g_prefix, std::chrono::floor<std::chrono::seconds>(now))};
+                    auto target{this->directory / (stem + extension)};
+
+                    for (size_t i = 1; std::filesystem::exists(target, ec); i++) {
+                        target = this->directory / std::format("{}-{}{}", stem, i, extension);
+                    }
+
+                    std::filesystem::rename(path, target, ec);
+
+                    if (ec) {
+                        debug::print("archive-sink", "failed to rotate '{}', error: {}", path.string(), ec.message());
+
+                        return;
+                    }
+
+                    debug::print("archive-sink", "rotated into '{}'", target.string());
+
+                    if (checksum) {
+                        std::ofstream sidecar(target.string() + g_checksum_extension, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+                        sidecar << std::format("{:08x}\n", *checksum);
+
+                        if (!sidecar.flush()) {
+                            debug::print("archive-sink", "failed to write the checksum of '{}'", target.string());
+                        }
+                    }
+
+                    this->prune();
+                }
+
+                void prune() {
+                    if (this->keep == 0) {
+                        return;
+                    }
+
+                    std::error_code ec{};
+                    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> rotated{};
+
+                    for (const auto& item : std::filesystem::directory_iterator(this->directory, ec)) {
+                        auto filename{item.path().filename().string()};
+
+                        if (item.is_regular_file(ec) && filename.starts_with(g_prefix) && !filename.ends_with(g_checksum_extension)) {
+                            rotated.emplace_back(item.last_write_time(ec), item.path());
+                        }
+                    }
+
+                    if (rotated.size() <= this->keep) {
+                        return;
+                    }
+
+                    std::sort(rotated.begin(), rotated.end());
+
+                    for (size_t i = 0; i + this->keep < rotated.size(); i++) {
+                        std::filesystem::remove(rotated[i].second, ec);
+                        std::filesystem::remove(rotated[i].second.string() + g_checksum_extension, ec);
+                    }
+                }
+
+                bool rotate(bool reopen) {
+                    this->close_current();
+                    this->retire(this->current_path(), this->extension(), this->checksum);
+
+                    return !reopen || this->open_current();
+                }
+            public:
+                archive_sink(const config::snapshot_t& settings)
+                    : directory(settings.archive_directory), maximum_bytes(settings.archive_maximum_bytes),
+                      maximum_age_s(settings.archive_maximum_age_s), compress(settings.archive_compress), keep(settings.archive_keep) {
+                #ifndef ROUTE8_LOG_HAVE_ZLIB
+                    if (this->compress) {
+                        debug::print("archive-sink", "built without zlib; archiving uncompressed");
+                        this->compress = false;
+                    }
+                #endif
+                }
+
+                ~archive_sink() override {
+                    this->close_current();
+                }
+
+                std::string name() const override {
+                    return "archive";
+                }
+
+                bool open() override {
+                    std::error_code ec{};
+                    std::filesystem::create_directories(this->directory, ec);
+
+                    if (ec) {
+                        debug::print("archive-sink", "failed to create '{}', error: {}", this->directory.string(), ec.message());
+
+                        return false;
+                    }
+
+                    // a file left by the previous run is finished first, whatever it was compressed with
+                    for (auto&& extension : {".jsonl", ".jsonl.gz"}) {
+                        auto leftover{this->directory / (std::string("current") + extension)};
+
+                        if (!std::filesystem::exists(leftover, ec)) {
+                            continue;
+                        }
+
+                        if (std::filesystem::file_size(leftover, ec) == 0) {
+                            std::filesystem::remove(leftover, ec);
+                        } else {
+                            this->retire(leftover, extension, std::nullopt);
+                        }
+                    }
+
+                    return this->open_current();
+                }
+
+                size_t write(const xlog::sinks::records_t& records, size_t offset) override {
+                    if (!this->is_open() && !this->open_current()) {
+                        return 0;
+                    }
+
+                    this->buffer.clear();
+
+                    for (auto i{offset}; i < records.size(); i++) {
+                        this->buffer.append(records[i]);
+                        this->buffer.push_back('\n');
+                    }
+
+                    if (!this->write_current(this->buffer)) {
+                        debug::print("archive-sink", "failed to write '{}'", this->current_path().string());
+
+                        // reopened on the next write
+                        this->close_current();
+
+                        return 0;
+                    }
+
+                    this->file_bytes += this->buffer.length();
+                    this->unflushed = true;
+
+                    if (this->checksum) {
+                        this->checksum = crc32c::compute(this->buffer, *this->checksum);
+                    }
+
+                    if (this->file_bytes >= this->maximum_bytes) {
+                        this->rotate(true);
+                    }
+
+                    return records.size() - offset;
+                }
+
+                int64_t poll_interval_ms() const override {
+                    return g_poll_interval_ms;
+                }
+
+                void poll() override {
+                    if (this->unflushed) {
+                        this->flush_current();
+                    }
+
+                    if (this->maximum_age_s > 0 && this->file_bytes > 0
+                        && std::chrono::steady_clock::now() - this->opened >= std::chrono::seconds(this->maximum_age_s)) {
+                        this->rotate(true);
+                    }
+                }
+
+                void close() override {
+                    if (this->file_bytes > 0) {
+                        this->rotate(false);
+                    } else {
+                        std::error_code ec{};
+
+                        this->close_current();
+                        std::filesystem::remove(this->current_path(), ec);
+                    }
+                }
+            };
+
+            std::unique_ptr<xlog::sink> create() {
+                return std::make_unique<xlog::sinks::archive::archive_sink>(*config::current());
+            }
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#include <cstddef>
+#include <memory>
+#include <string>
+#include "config.hpp"
+#include "debug.hpp"
+#include "inet.hpp"
+#include "xlog.hpp"
+#include "xlogsink.hpp"
+
+namespace xlog {
+    namespace sinks {
+        namespace remote {
+            class remote_sink : public xlog::sink {
+            public:
+                std::string name() const override {
+                    return "remote";
+                }
+
+                bool open() override {
+                    return true;
+                }
+
+                size_t write(const xlog::sinks::records_t& records, size_t offset) override {
+                    if (config::current()->verbose) {
+                        for (auto i{offset}; i < records.size(); i++) {
+                            debug::print("sink", "dispatching: '{}'", records[i]);
+                        }
+                    }
+
+                    return inet::send_logs(records, offset);
+                }
+            };
+
+            std::unique_ptr<xlog::sink> create() {
+                return std::make_unique<xlog::sinks::remote::remote_sink>();
+            }
+        }
+    }
+}
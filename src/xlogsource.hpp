@@ -0,0 +1,69 @@
+#ifndef __XLOGSOURCE_HPP
+#define __XLOGSOURCE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "xlog.hpp"
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+namespace xlog {
+#ifdef _WIN32
+    using source_handle_t = HANDLE;
+    // constexpr = expression did not evaluate to a constant
+    const source_handle_t source_handle_nullptr{INVALID_HANDLE_VALUE};
+#else
+    using source_handle_t = int;
+    constexpr source_handle_t source_handle_nullptr{-1};
+#endif
+
+    /* a log source driven by the reactor pool; open() is called once on attach,
+       read_batch() whenever poll_handle() is ready or poll_interval_ms() has elapsed,
+       checkpoint() after the batch has been handed to the queue, and drain() when the process stops.
+       prepare() is called on every ready source of a reactor thread before any of them is read,
+       so sources can batch their I/O submissions */
+    class source {
+    public:
+        virtual ~source() = default;
+
+        virtual std::string name() const = 0;
+        virtual bool open() = 0;
+
+        /* handle the reactor waits on; source_handle_nullptr for sources that are only polled on interval */
+        virtual source_handle_t poll_handle() const = 0;
+
+        /* -1 when the source only needs to be read on readiness */
+        virtual int64_t poll_interval_ms() const { return -1; }
+
+        virtual void prepare() {}
+
+        /* returning false detaches and destroys the source */
+        virtual bool read_batch(std::vector<xlog::queue::log_entry_t>& batch) = 0;
+
+        virtual void checkpoint() {}
+
+        /* called once on shutdown, before the last checkpoint(); hands out buffered partial events */
+        virtual void drain(std::vector<xlog::queue::log_entry_t>& batch) { (void)(batch); }
+    };
+
+    /* processing applied to each batch of a source between read_batch() and the queue;
+       runs on the source's reactor thread */
+    class stage {
+    public:
+        virtual ~stage() = default;
+
+        /* may rewrite, drop or add entries */
+        virtual void process(std::vector<xlog::queue::log_entry_t>& batch) = 0;
+
+        /* called once on shutdown, after the last process(); hands out what the stage holds back */
+        virtual void drain(std::vector<xlog::queue::log_entry_t>& batch) { (void)(batch); }
+
+        /* -1 when the stage has no time-driven work */
+        virtual int64_t poll_interval_ms() const { return -1; }
+    };
+}
+
+#endif
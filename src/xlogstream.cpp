@@ -0,0 +1,436 @@
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "config.hpp"
+#include "debug.hpp"
+#include "linesplitter.hpp"
+#include "metrics.hpp"
+#include "realtime.hpp"
+#include "xlog.hpp"
+#include "xlogsource.hpp"
+
+namespace xlog {
+    namespace stream {
+    #ifndef _WIN32
+        /* bytes taken from one writer per wakeup, so a chatty writer can't starve the others */
+        static constexpr size_t g_read_budget{64 * 1024};
+        static constexpr int g_listen_backlog{128};
+        /* while throttled, the pipeline is checked this often instead of on readiness */
+        static constexpr int64_t g_throttle_poll_ms{100};
+
+        enum class stream_kind {
+            unix_stream,
+            fifo,
+        };
+
+        struct connection {
+            linesplitter splitter{};
+            /* the writer's credentials; unknown for FIFOs */
+            int64_t pid{-1};
+            int64_t uid{-1};
+        };
+
+        /* writers are read with plain read() into one reused buffer and framed right away: every byte
+           has to reach user space to become a line, so splice() into pipes would only add a hop.
+           backpressure comes from not reading: while the pipeline is backed up every descriptor is
+           disarmed, the kernel buffers fill and writers block instead of entries being dropped */
+        class stream_source : public xlog::source {
+        private:
+            std::string identifier{};
+            std::string path{};
+            xlog::stream::stream_kind kind{};
+            xlog::stream::options options{};
+
+            int epoll_handle{-1};
+            int listen_handle{-1};
+            /* a FIFO we also hold open for writing never reads EOF when its last writer leaves */
+            int fifo_keepalive{-1};
+            std::unordered_map<int, xlog::stream::connection> connections{};
+
+            bool throttled{false};
+            int64_t interval{-1};
+
+            std::vector<char> buffer{};
+            std::vector<std::string> lines{};
+
+            std::atomic<uint64_t>* throttles{nullptr};
+            std::atomic<uint64_t>* refused{nullptr};
+
+            bool watch(int handle) {
+                epoll_event event{};
+                event.events = EPOLLIN;
+                event.data.fd = handle;
+
+                if (epoll_ctl(this->epoll_handle, EPOLL_CTL_ADD, handle, &event) == -1) {
+                    debug::print("stream", "failed to watch '{}', error: {}", this->path, std::strerror(errno));
+
+                    return false;
+                }
+
+                return true;
+            }
+
+            void set_armed(bool armed) {
+                epoll_event event{};
+                event.events = armed ? static_cast<uint32_t>(EPOLLIN) : 0;
+
+                auto modify = [this, &event](int handle) {
+                    event.data.fd = handle;
+                    epoll_ctl(this->epoll_handle, EPOLL_CTL_MOD, handle, &event);
+                };
+
+                if (this->listen_handle != -1) {
+                    modify(this->listen_handle);
+                }
+
+                for (auto&& [handle, connection] : this->connections) {
+                    modify(handle);
+                }
+            }
+
+            /* the queue plus the most backed-up sink against the limit at which they start dropping */
+            bool under_pressure() const {
+                const auto maximum{config::current()->maximum_log_entries};
+
+                return xlog::queue::size() + xlog::sinks::backlog() >= maximum / 4 * 3;
+            }
+
+            bool open_unix_stream() {
+                sockaddr_un address{};
+                address.sun_family = AF_UNIX;
+
+                if (this->path.length() >= sizeof(address.sun_path)) {
+                    debug::print("stream", "socket path '{}' is too long", this->path);
+
+                    return false;
+                }
+
+                std::memcpy(address.sun_path, this->path.c_str(), this->path.length() + 1);
+
+                struct stat path_stat{};
+
+                if (lstat(this->path.c_str(), &path_stat) == 0 && S_ISSOCK(path_stat.st_mode)) {
+                    ::unlink(this->path.c_str());
+                }
+
+                this->listen_handle = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+                if (this->listen_handle == -1) {
+                    debug::print("stream", "failed to create a socket for '{}', error: {}", this->path, std::strerror(errno));
+
+                    return false;
+                }
+
+                if (::bind(this->listen_handle, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1
+                    || ::listen(this->listen_handle, g_listen_backlog) == -1) {
+                    debug::print("stream", "failed to listen on '{}', error: {}", this->path, std::strerror(errno));
+
+                    return false;
+                }
+
+                ::chmod(this->path.c_str(), 0666);
+
+                return this->watch(this->listen_handle);
+            }
+
+            bool open_fifo() {
+                struct stat path_stat{};
+
+                if (stat(this->path.c_str(), &path_stat) == -1) {
+                    if (mkfifo(this->path.c_str(), 0622) == -1) {
+                        debug::print("stream", "failed to create FIFO '{}', error: {}", this->path, std::strerror(errno));
+
+                        return false;
+                    }
+
+                    ::chmod(this->path.c_str(), 0622);
+                } else if (!S_ISFIFO(path_stat.st_mode)) {
+                    debug::print("stream", "'{}' exists and isn't a FIFO", this->path);
+
+                    return false;
+                }
+
+                auto handle{::open(this->path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC)};
+
+                if (handle == -1) {
+                    debug::print("stream", "failed to open FIFO '{}', error: {}", this->path, std::strerror(errno));
+
+                    return false;
+                }
+
+                this->connections[handle] = xlog::stream::connection{.splitter = linesplitter(this->options.maximum_line_length)};
+                this->fifo_keepalive = ::open(this->path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+
+                if (this->fifo_keepalive == -1) {
+                    debug::print("stream", "failed to hold FIFO '{}' open, error: {}", this->path, std::strerror(errno));
+
+                    return false;
+                }
+
+                return this->watch(handle);
+            }
+
+            void accept_connections() {
+                while (true) {
+                    auto handle{::accept4(this->listen_handle, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)};
+
+                    if (handle == -1) {
+                        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                            debug::print("stream", "failed to accept on '{}', error: {}", this->path, std::strerror(errno));
+                        }
+
+                        return;
+                    }
+
+                    if (this->connections.size() >= this->options.maximum_connections || !this->watch(handle)) {
+                        (*this->refused)++;
+                        ::close(handle);
+                        continue;
+                    }
+
+                    xlog::stream::connection connection{.splitter = linesplitter(this->options.maximum_line_length)};
+                    ucred credentials{};
+                    socklen_t credentials_length{sizeof(credentials)};
+
+                    if (getsockopt(handle, SOL_SOCKET, SO_PEERCRED, &credentials, &credentials_length) == 0) {
+                        connection.pid = credentials.pid;
+                        connection.uid = credentials.uid;
+                    }
+
+                    this->connections[handle] = std::move(connection);
+                }
+            }
+
+            void emit(const xlog::stream::connection& connection, int64_t timestamp, std::vector<xlog::queue::log_entry_t>& batch) {
+                for (auto&& line : this->lines) {
+                    xlog::queue::log_entry_t entry{.identifier = this->identifier, .timestamp = timestamp, .message = std::move(line)};
+
+                    if (connection.pid != -1) {
+                        entry.fields = {{"pid", connection.pid}, {"uid", connection.uid}};
+                    }
+
+                    batch.push_back(std::move(entry));
+                }
+
+                this->lines.clear();
+            }
+
+            void close_connection(int handle) {
+                epoll_ctl(this->epoll_handle, EPOLL_CTL_DEL, handle, nullptr);
+                ::close(handle);
+                this->connections.erase(handle);
+            }
+
+            void receive(int handle, int64_t timestamp, std::vector<xlog::queue::log_entry_t>& batch) {
+                auto& connection{this->connections[handle]};
+                size_t taken{0};
+                bool closed{false};
+
+                while (taken < g_read_budget) {
+                    auto read_length{::read(handle, this->buffer.data(), this->buffer.size())};
+
+                    if (read_length == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                        break;
+                    }
+
+                    if (read_length <= 0) {
+                        closed = true;
+                        break;
+                    }
+
+                    connection.splitter.feed(std::string_view(this->buffer.data(), static_cast<size_t>(read_length)), this->lines);
+                    taken += static_cast<size_t>(read_length);
+                }
+
+                if (closed) {
+                    std::string tail{};
+
+                    if (connection.splitter.flush(tail)) {
+                        this->lines.push_back(std::move(tail));
+                    }
+                }
+
+                this->emit(connection, timestamp, batch);
+
+                if (closed) {
+                    this->close_connection(handle);
+                }
+            }
+        public:
+            stream_source(std::string identifier, std::string path, xlog::stream::stream_kind kind, const xlog::stream::options& options)
+                : identifier(std::move(identifier)), path(std::move(path)), kind(kind), options(options) {
+                this->throttles = &metrics::counter(std::format("stream.{}.throttled", this->identifier));
+                this->refused = &metrics::counter(std::format("stream.{}.refused", this->identifier));
+            }
+
+            ~stream_source() override {
+                for (auto&& [handle, connection] : this->connections) {
+                    ::close(handle);
+                }
+
+                if (this->listen_handle != -1) {
+                    ::close(this->listen_handle);
+                    ::unlink(this->path.c_str());
+                }
+
+                if (this->fifo_keepalive != -1) {
+                    ::close(this->fifo_keepalive);
+                }
+
+                if (this->epoll_handle != -1) {
+                    ::close(this->epoll_handle);
+                }
+            }
+
+            std::string name() const override {
+                return (this->kind == xlog::stream::stream_kind::fifo ? "fifo:" : "unix_stream:") + this->path;
+            }
+
+            bool open() override {
+                this->epoll_handle = epoll_create1(EPOLL_CLOEXEC);
+
+                if (this->epoll_handle == -1) {
+                    debug::print("stream", "failed to create the poll handle, error: {}", std::strerror(errno));
+
+                    return false;
+                }
+
+                this->buffer.resize(g_read_budget);
+
+                return this->kind == xlog::stream::stream_kind::fifo ? this->open_fifo() : this->open_unix_stream();
+            }
+
+            xlog::source_handle_t poll_handle() const override {
+                return this->epoll_handle;
+            }
+
+            int64_t poll_interval_ms() const override {
+                return this->interval;
+            }
+
+            bool read_batch(std::vector<xlog::queue::log_entry_t>& batch) override {
+                if (this->options.backpressure && this->under_pressure()) {
+                    if (!this->throttled) {
+                        debug::print("stream", "pipeline backed up; pausing reads from '{}'", this->path);
+
+                        this->set_armed(false);
+                        this->throttled = true;
+                        this->interval = g_throttle_poll_ms;
+                        (*this->throttles)++;
+                    }
+
+                    return true;
+                }
+
+                if (this->throttled) {
+                    debug::print("stream", "resuming reads from '{}'", this->path);
+
+                    this->set_armed(true);
+                    this->throttled = false;
+                    this->interval = -1;
+                }
+
+                std::array<epoll_event, 64> events{};
+                auto ready{epoll_wait(this->epoll_handle, events.data(), static_cast<int>(events.size()), 0)};
+                const auto timestamp{realtime::coarse_ns()};
+
+                for (int i = 0; i < ready; i++) {
+                    auto handle{events[i].data.fd};
+
+                    if (handle == this->listen_handle) {
+                        this->accept_connections();
+                    } else if (this->connections.contains(handle)) {
+                        this->receive(handle, timestamp, batch);
+                    }
+                }
+
+                if (config::current()->verbose) {
+                    for (auto&& entry : batch) {
+                        debug::print("stream", "detected line from '{}': '{}'", this->path, entry.message);
+                    }
+                }
+
+                return true;
+            }
+
+            void drain(std::vector<xlog::queue::log_entry_t>& batch) override {
+                const auto timestamp{realtime::coarse_ns()};
+
+                for (auto&& [handle, connection] : this->connections) {
+                    std::string tail{};
+
+                    if (connection.splitter.flush(tail)) {
+                        this->lines.push_back(std::move(tail));
+                    }
+
+                    this->emit(connection, timestamp, batch);
+                }
+            }
+        };
+
+        static bool start(std::string identifier, std::string path, xlog::stream::stream_kind kind, const xlog::stream::options& options, const xlog::pipeline_t& pipeline) {
+            if (!xlog::reactor::attach(std::make_unique<xlog::stream::stream_source>(identifier, path, kind, options), pipeline)) {
+                return false;
+            }
+
+            debug::print("stream", "started on '{}'", path);
+
+            return true;
+        }
+
+        bool start_unix_stream(std::string identifier, std::string path, const xlog::stream::options& options, const xlog::pipeline_t& pipeline) {
+            return xlog::stream::start(std::move(identifier), std::move(path), xlog::stream::stream_kind::unix_stream, options, pipeline);
+        }
+
+        bool start_fifo(std::string identifier, std::string path, const xlog::stream::options& options, const xlog::pipeline_t& pipeline) {
+            return xlog::stream::start(std::move(identifier), std::move(path), xlog::stream::stream_kind::fifo, options, pipeline);
+        }
+
+        bool platform_support() {
+            return true;
+        }
+    #else
+        bool start_unix_stream(std::string identifier, std::string path, const xlog::stream::options& options, const xlog::pipeline_t& pipeline) {
+            (void)(identifier);
+            (void)(path);
+            (void)(options);
+            (void)(pipeline);
+
+            return false;
+        }
+
+        bool start_fifo(std::string identifier, std::string path, const xlog::stream::options& options, const xlog::pipeline_t& pipeline) {
+            (void)(identifier);
+            (void)(path);
+            (void)(options);
+            (void)(pipeline);
+
+            return false;
+        }
+
+        bool platform_support() {
+            return false;
+        }
+    #endif
+    }
+}
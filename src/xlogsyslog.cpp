@@ -0,0 +1,727 @@
+#ifndef _WIN32
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "config.hpp"
+#include "debug.hpp"
+#include "metrics.hpp"
+#include "realtime.hpp"
+#include "timeformat.hpp"
+#include "xlog.hpp"
+#include "xlogsource.hpp"
+
+namespace xlog {
+    namespace syslog {
+        /* RFC 5424 times carry their zone, so they replace the receive time; RFC 3164 ones are local
+           to the sender without a zone and year, so those entries keep the receive time */
+        static const timeformat g_precise_time{"%Y-%m-%dT%H:%M:%S.%f%z"};
+        static const timeformat g_plain_time{"%Y-%m-%dT%H:%M:%S%z"};
+        static const timeformat g_bsd_time{"%b %e %H:%M:%S"};
+
+        static std::string_view next_token(std::string_view& rest) {
+            auto space{rest.find(' ')};
+            auto token{rest.substr(0, space)};
+
+            rest = space == std::string_view::npos ? std::string_view{} : rest.substr(space + 1);
+
+            return token;
+        }
+
+        static void set_unless_nil(nlohmann::json& fields, const char* key, std::string_view value) {
+            if (!value.empty() && value != "-") {
+                fields[key] = std::string(value);
+            }
+        }
+
+        /* [id key="value"]... with '\]' and '\"' escaped inside values; returns the length taken */
+        static size_t structured_data_length(std::string_view rest) {
+            size_t i{0};
+
+            while (i < rest.length() && rest[i] == '[') {
+                bool quoted{false};
+
+                for (i++; i < rest.length(); i++) {
+                    if (quoted && rest[i] == '\\') {
+                        i++;
+                    } else if (rest[i] == '"') {
+                        quoted = !quoted;
+                    } else if (!quoted && rest[i] == ']') {
+                        break;
+                    }
+                }
+
+                if (i >= rest.length()) {
+                    return rest.length();
+                }
+
+                i++;
+            }
+
+            return i;
+        }
+
+        static void parse_rfc5424(std::string_view rest, nlohmann::json& fields, std::string& message, int64_t& timestamp) {
+            auto time{next_token(rest)};
+            int64_t parsed{0};
+            size_t consumed{0};
+
+            if ((g_precise_time.parse(time, 0, parsed, consumed) || g_plain_time.parse(time, 0, parsed, consumed)) && consumed == time.length()) {
+                timestamp = parsed;
+            }
+
+            set_unless_nil(fields, "hostname", next_token(rest));
+            set_unless_nil(fields, "app_name", next_token(rest));
+            set_unless_nil(fields, "procid", next_token(rest));
+            set_unless_nil(fields, "msgid", next_token(rest));
+
+            if (rest.starts_with('[')) {
+                auto length{structured_data_length(rest)};
+
+                fields["structured_data"] = std::string(rest.substr(0, length));
+                rest.remove_prefix(length);
+            } else if (rest.starts_with('-')) {
+                rest.remove_prefix(1);
+            }
+
+            if (rest.starts_with(' ')) {
+                rest.remove_prefix(1);
+            }
+
+            if (rest.starts_with("\xEF\xBB\xBF")) {
+                rest.remove_prefix(3);
+            }
+
+            message = rest;
+        }
+
+        /* local senders such as glibc's syslog() leave the hostname out, so a first word that
+           looks like a tag is taken as one */
+        static void parse_rfc3164(std::string_view rest, nlohmann::json& fields, std::string& message) {
+            int64_t parsed{0};
+            size_t consumed{0};
+
+            if (g_bsd_time.parse(rest, 1970, parsed, consumed)) {
+                rest.remove_prefix(consumed);
+
+                if (rest.starts_with(' ')) {
+                    rest.remove_prefix(1);
+                }
+
+                auto space{rest.find(' ')};
+                auto word{rest.substr(0, space)};
+
+                if (space != std::string_view::npos && !word.ends_with(':') && word.find('[') == std::string_view::npos) {
+                    fields["hostname"] = std::string(word);
+                    rest.remove_prefix(space + 1);
+                }
+            }
+
+            size_t end{0};
+
+            while (end < rest.length() && end < 48 && rest[end] != '[' && rest[end] != ':' && rest[end] != ' ') {
+                end++;
+            }
+
+            if (end > 0 && end < rest.length() && (rest[end] == '[' || rest[end] == ':')) {
+                fields["app_name"] = std::string(rest.substr(0, end));
+
+                if (rest[end] == '[') {
+                    auto close{rest.find(']', end)};
+
+                    if (close != std::string_view::npos) {
+                        fields["procid"] = std::string(rest.substr(end + 1, close - end - 1));
+                        end = close + 1;
+                    }
+                }
+
+                if (end < rest.length() && rest[end] == ':') {
+                    end++;
+                }
+
+                while (end < rest.length() && rest[end] == ' ') {
+                    end++;
+                }
+
+                rest.remove_prefix(end);
+            }
+
+            message = rest;
+        }
+
+        void parse(std::string_view frame, nlohmann::json& fields, std::string& message, int64_t& timestamp) {
+            while (!frame.empty() && (frame.back() == '\n' || frame.back() == '\r' || frame.back() == '\0')) {
+                frame.remove_suffix(1);
+            }
+
+            size_t close{frame.starts_with('<') ? frame.find('>') : std::string_view::npos};
+            int priority{0};
+
+            if (close == std::string_view::npos || close < 2 || close > 4) {
+                message = frame;
+
+                return;
+            }
+
+            for (size_t i = 1; i < close; i++) {
+                if (frame[i] < '0' || frame[i] > '9') {
+                    message = frame;
+
+                    return;
+                }
+
+                priority = priority * 10 + (frame[i] - '0');
+            }
+
+            if (priority > 191) {
+                message = frame;
+
+                return;
+            }
+
+            fields["facility"] = priority / 8;
+            fields["severity"] = priority % 8;
+
+            auto rest{frame.substr(close + 1)};
+
+            if (rest.starts_with("1 ")) {
+                xlog::syslog::parse_rfc5424(rest.substr(2), fields, message, timestamp);
+            } else {
+                xlog::syslog::parse_rfc3164(rest, fields, message);
+            }
+        }
+
+    #ifndef _WIN32
+        /* datagrams taken per recvmmsg() call, and calls per listener per wakeup so one busy
+           listener can't starve the rest of the reactor thread */
+        static constexpr size_t g_datagram_batch{64};
+        static constexpr size_t g_datagram_rounds{16};
+        static constexpr size_t g_stream_read_size{64 * 1024};
+        static constexpr int g_listen_backlog{128};
+        static constexpr int g_receive_buffer_size{4 * 1024 * 1024};
+
+        /* host:port, [v6]:port or :port for every address */
+        static bool split_address(const std::string& address, std::string& host, std::string& port) {
+            auto colon{address.rfind(':')};
+
+            if (colon == std::string::npos || colon + 1 == address.length()) {
+                return false;
+            }
+
+            host = address.substr(0, colon);
+            port = address.substr(colon + 1);
+
+            if (host.starts_with('[') && host.ends_with(']')) {
+                host = host.substr(1, host.length() - 2);
+            }
+
+            return true;
+        }
+
+        static std::string peer_address(const sockaddr_storage& address) {
+            char text[INET6_ADDRSTRLEN]{};
+
+            if (address.ss_family == AF_INET) {
+                inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in&>(address).sin_addr, text, sizeof(text));
+            } else if (address.ss_family == AF_INET6) {
+                inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6&>(address).sin6_addr, text, sizeof(text));
+            }
+
+            return text;
+        }
+
+        enum class listener_kind {
+            datagram,
+            stream,
+        };
+
+        struct connection {
+            std::string buffer{};
+            std::string peer{};
+            /* rest of an octet-counted frame longer than maximum_message_size */
+            size_t discard{0};
+        };
+
+        class syslog_source : public xlog::source {
+        private:
+            std::string identifier{};
+            xlog::syslog::options options{};
+
+            int epoll_handle{-1};
+            std::unordered_map<int, xlog::syslog::listener_kind> listeners{};
+            std::unordered_map<int, xlog::syslog::connection> connections{};
+            std::string unix_path{};
+
+            /* receive buffers are allocated once in open() and reused by every recvmmsg() */
+            std::vector<char> datagram_storage{};
+            std::array<mmsghdr, g_datagram_batch> headers{};
+            std::array<iovec, g_datagram_batch> vectors{};
+            std::array<sockaddr_storage, g_datagram_batch> names{};
+            std::vector<char> stream_storage{};
+
+            std::atomic<uint64_t>* received{nullptr};
+            std::atomic<uint64_t>* truncated{nullptr};
+            std::atomic<uint64_t>* refused{nullptr};
+
+            bool watch(int handle) {
+                epoll_event event{};
+                event.events = EPOLLIN;
+                event.data.fd = handle;
+
+                if (epoll_ctl(this->epoll_handle, EPOLL_CTL_ADD, handle, &event) == -1) {
+                    debug::print("syslog", "failed to watch a socket, error: {}", std::strerror(errno));
+
+                    return false;
+                }
+
+                return true;
+            }
+
+            bool add_listener(int handle, xlog::syslog::listener_kind kind, const std::string& description) {
+                if (!this->watch(handle)) {
+                    ::close(handle);
+
+                    return false;
+                }
+
+                this->listeners[handle] = kind;
+                debug::print("syslog", "listening on {}", description);
+
+                return true;
+            }
+
+            bool listen_unix(const std::string& path) {
+                sockaddr_un address{};
+                address.sun_family = AF_UNIX;
+
+                if (path.length() >= sizeof(address.sun_path)) {
+                    debug::print("syslog", "socket path '{}' is too long", path);
+
+                    return false;
+                }
+
+                std::memcpy(address.sun_path, path.c_str(), path.length() + 1);
+
+                // a socket left by a previous run would make bind() fail
+                struct stat path_stat{};
+
+                if (lstat(path.c_str(), &path_stat) == 0 && S_ISSOCK(path_stat.st_mode)) {
+                    ::unlink(path.c_str());
+                }
+
+                auto handle{::socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+
+                if (handle == -1) {
+                    debug::print("syslog", "failed to create a socket for '{}', error: {}", path, std::strerror(errno));
+
+                    return false;
+                }
+
+                setsockopt(handle, SOL_SOCKET, SO_RCVBUF, &g_receive_buffer_size, sizeof(g_receive_buffer_size));
+
+                if (::bind(handle, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1) {
+                    debug::print("syslog", "failed to bind '{}', error: {}", path, std::strerror(errno));
+                    ::close(handle);
+
+                    return false;
+                }
+
+                // every local process may log
+                ::chmod(path.c_str(), 0666);
+                this->unix_path = path;
+
+                return this->add_listener(handle, xlog::syslog::listener_kind::datagram, std::format("unix datagram '{}'", path));
+            }
+
+            bool listen_inet(const std::string& address, bool stream) {
+                std::string host{};
+                std::string port{};
+
+                if (!xlog::syslog::split_address(address, host, port)) {
+                    debug::print("syslog", "'{}' is not a host:port address", address);
+
+                    return false;
+                }
+
+                addrinfo hints{};
+                hints.ai_family = AF_UNSPEC;
+                hints.ai_socktype = stream ? SOCK_STREAM : SOCK_DGRAM;
+                hints.ai_flags = AI_PASSIVE;
+
+                addrinfo* resolved{nullptr};
+                auto result{getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &resolved)};
+
+                if (result != 0) {
+                    debug::print("syslog", "failed to resolve '{}', error: {}", address, gai_strerror(result));
+
+                    return false;
+                }
+
+                std::unique_ptr<addrinfo, decltype(&freeaddrinfo)> resolved_safe(resolved, freeaddrinfo);
+
+                for (auto candidate{resolved}; candidate; candidate = candidate->ai_next) {
+                    auto handle{::socket(candidate->ai_family, candidate->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, candidate->ai_protocol)};
+
+                    if (handle == -1) {
+                        continue;
+                    }
+
+                    int enable{1};
+                    setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+                    if (!stream) {
+                        setsockopt(handle, SOL_SOCKET, SO_RCVBUF, &g_receive_buffer_size, sizeof(g_receive_buffer_size));
+                    }
+
+                    if (::bind(handle, candidate->ai_addr, candidate->ai_addrlen) == -1 || (stream && ::listen(handle, g_listen_backlog) == -1)) {
+                        debug::print("syslog", "failed to bind '{}', error: {}", address, std::strerror(errno));
+                        ::close(handle);
+                        continue;
+                    }
+
+                    auto kind{stream ? xlog::syslog::listener_kind::stream : xlog::syslog::listener_kind::datagram};
+
+                    return this->add_listener(handle, kind, std::format("{} '{}'", stream ? "tcp" : "udp", address));
+                }
+
+                return false;
+            }
+
+            void emit(std::string_view frame, const std::string& peer, int64_t timestamp, std::vector<xlog::queue::log_entry_t>& batch) {
+                xlog::queue::log_entry_t entry{.identifier = this->identifier, .timestamp = timestamp, .fields = nlohmann::json::object()};
+
+                xlog::syslog::parse(frame, entry.fields, entry.message, entry.timestamp);
+
+                if (!peer.empty()) {
+                    entry.fields["peer"] = peer;
+                }
+
+                batch.push_back(std::move(entry));
+            }
+
+            void receive_datagrams(int handle, int64_t timestamp, std::vector<xlog::queue::log_entry_t>& batch) {
+                const auto size{this->options.maximum_message_size};
+                size_t count{0};
+
+                for (size_t round = 0; round < g_datagram_rounds; round++) {
+                    for (size_t i = 0; i < g_datagram_batch; i++) {
+                        this->vectors[i] = iovec{.iov_base = this->datagram_storage.data() + i * size, .iov_len = size};
+                        this->headers[i] = mmsghdr{};
+                        this->headers[i].msg_hdr.msg_name = &this->names[i];
+                        this->headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+                        this->headers[i].msg_hdr.msg_iov = &this->vectors[i];
+                        this->headers[i].msg_hdr.msg_iovlen = 1;
+                    }
+
+                    auto received{recvmmsg(handle, this->headers.data(), g_datagram_batch, MSG_DONTWAIT, nullptr)};
+
+                    if (received <= 0) {
+                        if (received == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                            debug::print("syslog", "failed to receive, error: {}", std::strerror(errno));
+                        }
+
+                        break;
+                    }
+
+                    for (int i = 0; i < received; i++) {
+                        const auto& header{this->headers[i]};
+
+                        if (header.msg_hdr.msg_flags & MSG_TRUNC) {
+                            (*this->truncated)++;
+                        }
+
+                        std::string_view frame(this->datagram_storage.data() + i * size, header.msg_len);
+                        this->emit(frame, xlog::syslog::peer_address(this->names[i]), timestamp, batch);
+                    }
+
+                    count += static_cast<size_t>(received);
+
+                    if (static_cast<size_t>(received) < g_datagram_batch) {
+                        break;
+                    }
+                }
+
+                (*this->received) += count;
+            }
+
+            void accept_connections(int handle) {
+                while (true) {
+                    sockaddr_storage address{};
+                    socklen_t address_length{sizeof(address)};
+                    auto connection{::accept4(handle, reinterpret_cast<sockaddr*>(&address), &address_length, SOCK_NONBLOCK | SOCK_CLOEXEC)};
+
+                    if (connection == -1) {
+                        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                            debug::print("syslog", "failed to accept, error: {}", std::strerror(errno));
+                        }
+
+                        return;
+                    }
+
+                    if (this->connections.size() >= this->options.maximum_connections) {
+                        (*this->refused)++;
+                        ::close(connection);
+                        continue;
+                    }
+
+                    if (!this->watch(connection)) {
+                        ::close(connection);
+                        continue;
+                    }
+
+                    this->connections[connection] = xlog::syslog::connection{.peer = xlog::syslog::peer_address(address)};
+                }
+            }
+
+            /* RFC 6587: a frame starting with a digit is octet-counted, anything else ends at a newline */
+            void frame_stream(xlog::syslog::connection& connection, bool closing, int64_t timestamp, std::vector<xlog::queue::log_entry_t>& batch) {
+                const auto maximum{this->options.maximum_message_size};
+                std::string_view rest{connection.buffer};
+
+                while (!rest.empty()) {
+                    if (connection.discard) {
+                        auto skipped{std::min(connection.discard, rest.length())};
+                        connection.discard -= skipped;
+                        rest.remove_prefix(skipped);
+                        continue;
+                    }
+
+                    if (rest[0] >= '0' && rest[0] <= '9') {
+                        auto space{rest.find(' ')};
+
+                        if (space == std::string_view::npos || space > 9) {
+                            if (space == std::string_view::npos && rest.length() <= 9 && !closing) {
+                                break;
+                            }
+                        } else {
+                            size_t length{0};
+                            bool digits{true};
+
+                            for (size_t i = 0; i < space; i++) {
+                                digits = digits && rest[i] >= '0' && rest[i] <= '9';
+                                length = length * 10 + static_cast<size_t>(rest[i] - '0');
+                            }
+
+                            if (digits) {
+                                if (length > maximum && rest.length() >= space + 1 + maximum) {
+                                    (*this->truncated)++;
+                                    this->emit(rest.substr(space + 1, maximum), connection.peer, timestamp, batch);
+                                    connection.discard = length - maximum;
+                                    rest.remove_prefix(space + 1 + maximum);
+                                    continue;
+                                }
+
+                                if (rest.length() < space + 1 + length) {
+                                    if (closing) {
+                                        this->emit(rest.substr(space + 1), connection.peer, timestamp, batch);
+                                        rest = {};
+                                    }
+
+                                    break;
+                                }
+
+                                this->emit(rest.substr(space + 1, length), connection.peer, timestamp, batch);
+                                rest.remove_prefix(space + 1 + length);
+                                continue;
+                            }
+                        }
+                    }
+
+                    auto newline{rest.find('\n')};
+
+                    if (newline == std::string_view::npos) {
+                        if (rest.length() > maximum) {
+                            (*this->truncated)++;
+                            this->emit(rest.substr(0, maximum), connection.peer, timestamp, batch);
+                            rest.remove_prefix(maximum);
+                            continue;
+                        }
+
+                        if (closing) {
+                            this->emit(rest, connection.peer, timestamp, batch);
+                            rest = {};
+                        }
+
+                        break;
+                    }
+
+                    if (newline > 0) {
+                        this->emit(rest.substr(0, newline), connection.peer, timestamp, batch);
+                    }
+
+                    rest.remove_prefix(newline + 1);
+                }
+
+                connection.buffer.erase(0, connection.buffer.length() - rest.length());
+            }
+
+            void close_connection(int handle) {
+                epoll_ctl(this->epoll_handle, EPOLL_CTL_DEL, handle, nullptr);
+                ::close(handle);
+                this->connections.erase(handle);
+            }
+
+            void receive_stream(int handle, int64_t timestamp, std::vector<xlog::queue::log_entry_t>& batch) {
+                auto& connection{this->connections[handle]};
+                auto read_length{::read(handle, this->stream_storage.data(), this->stream_storage.size())};
+
+                if (read_length == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                    return;
+                }
+
+                if (read_length <= 0) {
+                    this->frame_stream(connection, true, timestamp, batch);
+                    this->close_connection(handle);
+
+                    return;
+                }
+
+                connection.buffer.append(this->stream_storage.data(), static_cast<size_t>(read_length));
+
+                auto before{batch.size()};
+                this->frame_stream(connection, false, timestamp, batch);
+                (*this->received) += batch.size() - before;
+            }
+        public:
+            syslog_source(std::string identifier, const xlog::syslog::options& options)
+                : identifier(std::move(identifier)), options(options) {
+                this->received = &metrics::counter(std::format("syslog.{}.received", this->identifier));
+                this->truncated = &metrics::counter(std::format("syslog.{}.truncated", this->identifier));
+                this->refused = &metrics::counter(std::format("syslog.{}.refused", this->identifier));
+            }
+
+            ~syslog_source() override {
+                for (auto&& [handle, connection] : this->connections) {
+                    ::close(handle);
+                }
+
+                for (auto&& [handle, kind] : this->listeners) {
+                    ::close(handle);
+                }
+
+                if (!this->unix_path.empty()) {
+                    ::unlink(this->unix_path.c_str());
+                }
+
+                if (this->epoll_handle != -1) {
+                    ::close(this->epoll_handle);
+                }
+            }
+
+            std::string name() const override {
+                return "syslog:" + this->identifier;
+            }
+
+            bool open() override {
+                this->epoll_handle = epoll_create1(EPOLL_CLOEXEC);
+
+                if (this->epoll_handle == -1) {
+                    debug::print("syslog", "failed to create the poll handle, error: {}", std::strerror(errno));
+
+                    return false;
+                }
+
+                if ((!this->options.unix_path.empty() && !this->listen_unix(this->options.unix_path))
+                    || (!this->options.udp.empty() && !this->listen_inet(this->options.udp, false))
+                    || (!this->options.tcp.empty() && !this->listen_inet(this->options.tcp, true))) {
+                    return false;
+                }
+
+                this->datagram_storage.resize(g_datagram_batch * this->options.maximum_message_size);
+                this->stream_storage.resize(g_stream_read_size);
+
+                return true;
+            }
+
+            /* the reactor waits on the inner epoll handle, which is readable while any socket is */
+            xlog::source_handle_t poll_handle() const override {
+                return this->epoll_handle;
+            }
+
+            bool read_batch(std::vector<xlog::queue::log_entry_t>& batch) override {
+                std::array<epoll_event, 64> events{};
+                auto ready{epoll_wait(this->epoll_handle, events.data(), static_cast<int>(events.size()), 0)};
+                const auto timestamp{realtime::coarse_ns()};
+
+                for (int i = 0; i < ready; i++) {
+                    auto handle{events[i].data.fd};
+                    auto listener{this->listeners.find(handle)};
+
+                    if (listener == this->listeners.end()) {
+                        if (this->connections.contains(handle)) {
+                            this->receive_stream(handle, timestamp, batch);
+                        }
+                    } else if (listener->second == xlog::syslog::listener_kind::stream) {
+                        this->accept_connections(handle);
+                    } else {
+                        this->receive_datagrams(handle, timestamp, batch);
+                    }
+                }
+
+                if (config::current()->verbose) {
+                    for (auto&& entry : batch) {
+                        debug::print("syslog", "message received, details: '{}'", entry.message);
+                    }
+                }
+
+                return true;
+            }
+
+            void drain(std::vector<xlog::queue::log_entry_t>& batch) override {
+                const auto timestamp{realtime::coarse_ns()};
+
+                for (auto&& [handle, connection] : this->connections) {
+                    this->frame_stream(connection, true, timestamp, batch);
+                }
+            }
+        };
+
+        bool start(std::string identifier, const xlog::syslog::options& options, const xlog::pipeline_t& pipeline) {
+            if (!xlog::reactor::attach(std::make_unique<xlog::syslog::syslog_source>(identifier, options), pipeline)) {
+                return false;
+            }
+
+            debug::print("syslog", "started '{}'", identifier);
+
+            return true;
+        }
+
+        bool platform_support() {
+            return true;
+        }
+    #else
+        bool start(std::string identifier, const xlog::syslog::options& options, const xlog::pipeline_t& pipeline) {
+            (void)(identifier);
+            (void)(options);
+            (void)(pipeline);
+
+            return false;
+        }
+
+        bool platform_support() {
+            return false;
+        }
+    #endif
+    }
+}
@@ -0,0 +1,97 @@
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "debug.hpp"
+#include "metrics.hpp"
+#include "timeformat.hpp"
+#include "xlog.hpp"
+#include "xlogsource.hpp"
+
+namespace xlog {
+    namespace timestamp {
+        /* a year-less time more than this far ahead of the read time is taken to be from last year */
+        static constexpr int64_t g_rollover_slack_ns{int64_t{86400} * 1000000000};
+
+        static int utc_year(int64_t timestamp) {
+            std::chrono::sys_time<std::chrono::nanoseconds> time{std::chrono::nanoseconds{timestamp}};
+            std::chrono::year_month_day date{std::chrono::floor<std::chrono::days>(time)};
+
+            return static_cast<int>(date.year());
+        }
+
+        class timestamp_stage : public xlog::stage {
+        private:
+            timeformat format;
+            std::string field{};
+            std::atomic<uint64_t>* unparsed{nullptr};
+
+            /* entries keep the time their source stamped when theirs doesn't parse */
+            bool parse(std::string_view text, int64_t& timestamp) const {
+                size_t consumed{0};
+                int64_t parsed{0};
+                auto year{utc_year(timestamp)};
+
+                if (!this->format.parse(text, year, parsed, consumed)) {
+                    return false;
+                }
+
+                if (!this->format.year_given() && parsed > timestamp + g_rollover_slack_ns) {
+                    this->format.parse(text, year - 1, parsed, consumed);
+                }
+
+                timestamp = parsed;
+
+                return true;
+            }
+        public:
+            /* throws std::invalid_argument on an invalid format */
+            timestamp_stage(const std::string& identifier, const xlog::timestamp::options& options)
+                : format(options.format), field(options.field) {
+                this->unparsed = &metrics::counter(std::format("timestamp.{}.unparsed", identifier));
+            }
+
+            void process(std::vector<xlog::queue::log_entry_t>& batch) override {
+                for (auto&& entry : batch) {
+                    bool parsed{false};
+
+                    if (this->field.empty()) {
+                        parsed = this->parse(entry.message, entry.timestamp);
+                    } else if (entry.fields.is_object()) {
+                        auto value{entry.fields.find(this->field)};
+
+                        if (value != entry.fields.end() && value->is_string()) {
+                            parsed = this->parse(value->get_ref<const std::string&>(), entry.timestamp);
+                        }
+                    }
+
+                    if (!parsed) {
+                        (*this->unparsed)++;
+                    }
+                }
+            }
+        };
+
+        std::unique_ptr<xlog::stage> create(const std::string& identifier, const xlog::timestamp::options& options) {
+            if (options.format.empty()) {
+                debug::print("timestamp", "empty format for '{}'", identifier);
+
+                return nullptr;
+            }
+
+            try {
+                return std::make_unique<xlog::timestamp::timestamp_stage>(identifier, options);
+            } catch (const std::invalid_argument& e) {
+                debug::print("timestamp", "invalid format for '{}', error: {}", identifier, e.what());
+            }
+
+            return nullptr;
+        }
+    }
+}
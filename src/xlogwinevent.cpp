@@ -9,23 +9,21 @@
 #endif
 
 #include <chrono>
-#include <future>
-#include <thread>
 #include <optional>
+#include <sstream>
 #include <string>
-#include <future>
 #include <array>
 #include <memory>
+#include <vector>
 #include "debug.hpp"
 #include "config.hpp"
 #include "xlog.hpp"
+#include "xlogsource.hpp"
 #include "nlohmann/json.hpp"
 
 namespace xlog {
     namespace winevent {
     #ifdef _WIN32
-        static std::vector<std::future<void>> g_worker_routines{};
-
         static DWORD read_record(HANDLE log_event_handle, char*& result, DWORD record_numb, DWORD flags) {
             DWORD status = ERROR_SUCCESS;
             DWORD bytes_read{0};
@@ -118,118 +116,137 @@ namespace xlog {
             }
         }
 
-        static void worker_inside(HANDLE event_log_handle, HANDLE wait_event, std::string& identifier, std::string& log_source_name) {
-            xlog::winevent::seek_tail(event_log_handle);
+        class winevent_source : public xlog::source {
+        private:
+            std::string identifier{};
+            std::string log_source_name{};
+            HANDLE event_log_handle{NULL};
+            HANDLE wait_event{NULL};
+        public:
+            winevent_source(std::string identifier, std::string log_source_name)
+                : identifier(std::move(identifier)), log_source_name(std::move(log_source_name)) {}
+
+            ~winevent_source() override {
+                if (this->event_log_handle != NULL) {
+                    CloseEventLog(this->event_log_handle);
+                }
 
-            while (true) {
-                DWORD wait_status{WaitForSingleObject(wait_event, INFINITE)};
+                if (this->wait_event != NULL) {
+                    CloseHandle(this->wait_event);
+                }
+            }
 
-                if (wait_status == WAIT_OBJECT_0) {
-                    DWORD read_status{ERROR_SUCCESS};
-                    std::vector<xlog::queue::log_entry_t> entries{};
+            std::string name() const override {
+                return "winevent:" + this->log_source_name;
+            }
 
-                    do {
-                        char* record_buffer{nullptr};
-                        read_status = read_record(event_log_handle, record_buffer, 0, EVENTLOG_SEQUENTIAL_READ | EVENTLOG_FORWARDS_READ);
+            bool open() override {
+                this->event_log_handle = OpenEventLogA(NULL, this->log_source_name.c_str());
 
-                        if (read_status != ERROR_SUCCESS && read_status != ERROR_HANDLE_EOF) {
-                            debug::print("winevent", "failed to read, error: 0x{:08X}", read_status);
-                            return;
-                        }
+                if (this->event_log_handle == NULL) {
+                    debug::print("winevent", "failed to open '{}' log, error: 0x{:08X}", this->log_source_name, GetLastError());
+                    return false;
+                }
+
+                this->wait_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+                if (this->wait_event == NULL) {
+                    debug::print("winevent", "failed to create wait event for '{}' log, error: 0x{:08X}", this->log_source_name, GetLastError());
+                    return false;
+                }
 
-                        if (record_buffer) {
-                            std::unique_ptr<char[]> record_buffer_safe(record_buffer);
-                            EVENTLOGRECORD* record = reinterpret_cast<EVENTLOGRECORD*>(record_buffer_safe.get());
-                            if (record->EventID) {
-                                try {
-                                    std::stringstream description{};
-                                    const char* description_c{reinterpret_cast<const char*>(reinterpret_cast<size_t>(record) + record->StringOffset)};
+                if (!NotifyChangeEventLog(this->event_log_handle, this->wait_event)) {
+                    debug::print("winevent", "failed to set waiting event for '{}' log, error: 0x{:08X}", this->log_source_name, GetLastError());
+                    return false;
+                }
 
-                                    for (DWORD i = 0; i < record->NumStrings; i++) {
-                                        description << description_c;
+                xlog::winevent::seek_tail(this->event_log_handle);
 
-                                        if (i + 1 < record->NumStrings) {
-                                            description << std::endl;
-                                        }
+                return true;
+            }
 
-                                        description_c += strlen(description_c) + 1;
-                                    }
+            xlog::source_handle_t poll_handle() const override {
+                return this->wait_event;
+            }
 
-                                    nlohmann::json data{
-                                        {"event_source", log_source_name},
-                                        {"event_type", record_event_type_translate(record->EventType)},
-                                        {"event_category", record->EventCategory},
-                                        {"time_generated", record->TimeGenerated},
-                                        {"time_written", record->TimeWritten},
-                                        {"source_name", std::string(reinterpret_cast<const char*>(reinterpret_cast<size_t>(record) + sizeof(EVENTLOGRECORD)))},
-                                        {"description", description.str()},
-                                    };
-
-                                    auto timestamp{static_cast<int64_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count())};
-                                    entries.push_back(std::make_tuple(identifier, timestamp, data.dump()));
-                                } catch (const std::exception& e) {
-                                    debug::print("winevent", "corrupted record, error: {}", e.what());
-                                }
-                            }
-                        }
-                    } while (read_status != ERROR_HANDLE_EOF);
+            bool read_batch(std::vector<xlog::queue::log_entry_t>& batch) override {
+                ResetEvent(this->wait_event);
 
-                    for (auto entry{entries.rbegin()}; entry != entries.rend(); entry++) {
-                        auto value{*entry};
+                DWORD read_status{ERROR_SUCCESS};
 
-                        if (config::field_verbose) {
-                            debug::print("winevent", "event received, details: '{}'", std::get<2>(value));
-                        }
+                do {
+                    char* record_buffer{nullptr};
+                    read_status = read_record(this->event_log_handle, record_buffer, 0, EVENTLOG_SEQUENTIAL_READ | EVENTLOG_FORWARDS_READ);
 
-                        xlog::queue::insert(value);
+                    if (read_status != ERROR_SUCCESS && read_status != ERROR_HANDLE_EOF) {
+                        debug::print("winevent", "failed to read, error: 0x{:08X}", read_status);
+                        return false;
                     }
-                }
-            }
 
-            (void)(identifier);
-            (void)(log_source_name);
-        }
+                    if (record_buffer) {
+                        std::unique_ptr<char[]> record_buffer_safe(record_buffer);
+                        EVENTLOGRECORD* record = reinterpret_cast<EVENTLOGRECORD*>(record_buffer_safe.get());
+                        if (record->EventID) {
+                            try {
+                                std::stringstream description{};
+                                const char* description_c{reinterpret_cast<const char*>(reinterpret_cast<size_t>(record) + record->StringOffset)};
 
-        static void worker(std::string identifier, std::string log_source_name) {
-            HANDLE event_log_handle{OpenEventLogA(NULL, log_source_name.c_str())};
+                                for (DWORD i = 0; i < record->NumStrings; i++) {
+                                    description << description_c;
 
-            if (event_log_handle == NULL) {
-                debug::print("winevent", "failed to open '{}' log, error: 0x{:08X}", log_source_name, GetLastError());
-                return;
-            }
+                                    if (i + 1 < record->NumStrings) {
+                                        description << std::endl;
+                                    }
 
-            HANDLE wait_event{CreateEvent(NULL, TRUE, FALSE, NULL)};
+                                    description_c += strlen(description_c) + 1;
+                                }
 
-            if (wait_event == NULL) {
-                debug::print("winevent", "failed to create wait event for '{}' log, error: 0x{:08X}", log_source_name, GetLastError());
-                CloseEventLog(event_log_handle);
-                return;
-            }
+                                nlohmann::json data{
+                                    {"event_source", this->log_source_name},
+                                    {"event_type", record_event_type_translate(record->EventType)},
+                                    {"event_category", record->EventCategory},
+                                    {"time_generated", record->TimeGenerated},
+                                    {"time_written", record->TimeWritten},
+                                    {"source_name", std::string(reinterpret_cast<const char*>(reinterpret_cast<size_t>(record) + sizeof(EVENTLOGRECORD)))},
+                                    {"description", description.str()},
+                                };
+
+                                // TimeGenerated is seconds since the Unix epoch
+                                auto timestamp{static_cast<int64_t>(record->TimeGenerated) * 1000000000};
+                                xlog::queue::log_entry_t entry{.identifier = this->identifier, .timestamp = timestamp, .message = data.dump()};
+
+                                if (config::current()->verbose) {
+                                    debug::print("winevent", "event received, details: '{}'", entry.message);
+                                }
 
-            if (!NotifyChangeEventLog(event_log_handle, wait_event)) {
-                debug::print("winevent", "failed to set waiting event for '{}' log, error: 0x{:08X}", log_source_name, GetLastError());
-                CloseHandle(wait_event);
-                CloseEventLog(event_log_handle);
-                return;
-            }
+                                batch.push_back(std::move(entry));
+                            } catch (const std::exception& e) {
+                                debug::print("winevent", "corrupted record, error: {}", e.what());
+                            }
+                        }
+                    }
+                } while (read_status != ERROR_HANDLE_EOF);
 
-            xlog::winevent::worker_inside(event_log_handle, wait_event, identifier, log_source_name);
-            CloseEventLog(event_log_handle);
-            CloseHandle(wait_event);
-        }
+                return true;
+            }
+        };
     #endif
 
     #ifdef _WIN32
-        bool start(std::string identifier, std::string source_name) {
-            xlog::winevent::g_worker_routines.push_back(std::async(xlog::winevent::worker, identifier, source_name));
+        bool start(std::string identifier, std::string source_name, const xlog::pipeline_t& pipeline) {
+            if (!xlog::reactor::attach(std::make_unique<xlog::winevent::winevent_source>(identifier, source_name), pipeline)) {
+                return false;
+            }
+
             debug::print("winevent", "started on source '{}'", source_name);
 
             return true;
         }
     #else
-        bool start(std::string identifier, std::string source_name) {
+        bool start(std::string identifier, std::string source_name, const xlog::pipeline_t& pipeline) {
             (void)(identifier);
             (void)(source_name);
+            (void)(pipeline);
 
             return false;
         }
@@ -0,0 +1,69 @@
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ahocorasick.hpp"
+#include "check.hpp"
+
+/* matches against a naive find() of every pattern, including overlapping ones and those only reached through failure links */
+
+static std::vector<bool> naive(const std::vector<std::string>& patterns, std::string_view text) {
+    std::vector<bool> matched(patterns.size());
+
+    for (size_t i{0}; i < patterns.size(); i++) {
+        matched[i] = text.find(patterns[i]) != std::string_view::npos;
+    }
+
+    return matched;
+}
+
+int main() {
+    const std::vector<std::string> patterns{"he", "she", "his", "hers", "error", "err", "timeout", "\xff\x01", std::string("a\0b", 3)};
+    ahocorasick matcher{};
+
+    for (size_t i{0}; i < patterns.size(); i++) {
+        CHECK(matcher.add(patterns[i]) == i);
+    }
+
+    matcher.build();
+    CHECK(matcher.size() == patterns.size());
+
+    std::vector<bool> matched{};
+
+    matcher.search("ushers", matched);
+    CHECK(matched.size() == patterns.size());
+    CHECK(matched[0] && matched[1] && !matched[2] && matched[3]);
+    CHECK(matched == naive(patterns, "ushers"));
+
+    const std::vector<std::string_view> texts{"", "h", "this", "connection timeout after 3 retries", "errors: 2",
+        "ERROR", "shishers", "\xff\xff\x01", std::string_view("a\0b", 3)};
+
+    for (auto text : texts) {
+        matcher.search(text, matched);
+        CHECK(matched == naive(patterns, text));
+    }
+
+    // matched is cleared from the previous search
+    matcher.search("hers", matched);
+    matcher.search("nothing", matched);
+    CHECK(matched == std::vector<bool>(patterns.size()));
+
+    bool threw{false};
+
+    try {
+        matcher.add("late");
+    } catch (const std::logic_error&) {
+        threw = true;
+    }
+
+    CHECK(threw);
+
+    // an empty matcher finds nothing
+    ahocorasick empty{};
+    empty.build();
+    empty.search("anything", matched);
+    CHECK(matched.empty());
+
+    return check::result();
+}
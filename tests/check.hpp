@@ -0,0 +1,28 @@
+#ifndef __CHECK_HPP
+#define __CHECK_HPP
+
+#include <format>
+#include <iostream>
+#include <source_location>
+#include <string_view>
+
+/* the tests' only assertion; a failed check is reported and the test carries on, so one run lists
+   every failure. main returns check::result() */
+namespace check {
+    inline int g_failures{0};
+
+    inline void expect(bool passed, std::string_view expression, std::source_location location = std::source_location::current()) {
+        if (!passed) {
+            std::cout << std::format("{}:{}: check failed: {}\n", location.file_name(), location.line(), expression);
+            check::g_failures++;
+        }
+    }
+
+    inline int result() {
+        return check::g_failures ? 1 : 0;
+    }
+}
+
+#define CHECK(condition) check::expect((condition), #condition)
+
+#endif
@@ -0,0 +1,133 @@
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "columnar.hpp"
+#include "xlog.hpp"
+#include "check.hpp"
+
+/* batches decode back to the records they were encoded from, whether encoded from the queued entries or
+   from the records alone as for spooled ones */
+
+static nlohmann::json value(const nlohmann::json& column, size_t i) {
+    if (!column.contains("dictionary")) {
+        return column["values"][i];
+    }
+
+    auto code{column["values"][i].get<int64_t>()};
+
+    return code < 0 ? nlohmann::json{} : column["dictionary"][static_cast<size_t>(code)];
+}
+
+/* the records a collector reads out of a batch */
+static std::vector<nlohmann::json> decode(const std::string& batch) {
+    auto columns = nlohmann::json::parse(batch);
+    auto count{columns["count"].get<size_t>()};
+    auto timestamp{columns["timestamp"]["base"].get<int64_t>()};
+    std::vector<nlohmann::json> records{};
+
+    for (size_t i{0}; i < count; i++) {
+        timestamp += columns["timestamp"]["deltas"][i].get<int64_t>();
+
+        auto record = nlohmann::json::object();
+        record["identifier"] = value(columns["identifier"], i);
+        record["timestamp"] = timestamp;
+        record["timestamp_unit"] = columns["timestamp_unit"];
+        record["message"] = value(columns["message"], i);
+
+        if (columns.contains("fields")) {
+            for (auto&& [key, column] : columns["fields"].items()) {
+                if (auto field = value(column, i); !field.is_null()) {
+                    record["fields"][key] = field;
+                }
+            }
+        }
+
+        records.push_back(std::move(record));
+    }
+
+    return records;
+}
+
+/* the record as it should come back; empty fields come back without fields */
+static nlohmann::json expected(const std::string& record) {
+    auto parsed = nlohmann::json::parse(record);
+
+    if (parsed.contains("fields") && parsed["fields"].empty()) {
+        parsed.erase("fields");
+    }
+
+    return parsed;
+}
+
+static void round_trip(const xlog::sinks::records_t& records, size_t first, size_t last) {
+    std::string batch{};
+
+    CHECK(columnar::encode(records, first, last, batch));
+
+    auto decoded = decode(batch);
+    CHECK(decoded.size() == last - first);
+
+    for (size_t i{0}; i < decoded.size() && first + i < last; i++) {
+        CHECK(decoded[i] == expected(records[first + i]));
+    }
+}
+
+int main() {
+    std::vector<xlog::queue::log_entry_t> entries{
+        {.identifier = "journal", .timestamp = 1792390331000000000, .message = "plain",
+            .fields = {{"_HOSTNAME", "web-1"}, {"_PID", "811"}, {"PRIORITY", "6"}, {"severity", 6}}},
+        {.identifier = "journal", .timestamp = 1792390331000001500, .message = "quotes \" backslash \\ tab \t newline \n",
+            .fields = {{"_HOSTNAME", "web-1"}, {"_PID", "812"}, {"monotonic_us", 18446744073709551615ull}}},
+        // timestamps go backwards when the wall clock is stepped
+        {.identifier = "app", .timestamp = 1792390330000000000, .message = "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x93\x9c and invalid \xff\xfe bytes",
+            .fields = {{"_HOSTNAME", "web-1"}, {"ratio", 0.25}, {"ok", true}, {"offset", -12}, {"nested", {{"a", {1, 2}}}}}},
+        {.identifier = "app", .timestamp = 1792390330000000020, .message = "no fields"},
+        {.identifier = "app", .timestamp = 1792390330000000040, .message = "empty fields", .fields = nlohmann::json::object()},
+        {.identifier = "journal", .timestamp = 1792390330000000060, .message = "",
+            .fields = {{"_HOSTNAME", "web-2"}, {"_PID", 811}, {"\x01key \"quoted\"", "control \x01 character"}}},
+    };
+
+    xlog::sinks::records_t records{};
+
+    for (auto&& entry : entries) {
+        records.push_back(xlog::queue::serialize(entry));
+    }
+
+    // the same records without their entries, as loaded from a spool
+    xlog::sinks::records_t spooled{records};
+    records.entries = entries;
+
+    for (auto source : {&records, &spooled}) {
+        round_trip(*source, 0, source->size());
+        round_trip(*source, 1, 4);
+        round_trip(*source, 5, 6);
+    }
+
+    // both paths write the same batch
+    std::string from_entries{};
+    std::string from_records{};
+
+    CHECK(columnar::encode(records, 0, records.size(), from_entries));
+    CHECK(columnar::encode(spooled, 0, spooled.size(), from_records));
+    CHECK(from_entries == from_records);
+
+    // repeated strings are dictionary-encoded
+    auto batch = nlohmann::json::parse(from_entries);
+    CHECK(batch["identifier"]["dictionary"] == nlohmann::json({"journal", "app"}));
+    CHECK(batch["fields"]["_HOSTNAME"]["values"] == nlohmann::json({0, 0, 0, -1, -1, 1}));
+
+    // a spooled record that isn't one the queue serialized fails the batch
+    for (std::string invalid : {"not json", "[]", R"({"identifier":"a","timestamp":"1","timestamp_unit":"ns","message":"m"})",
+        R"({"identifier":"a","timestamp":1,"timestamp_unit":"us","message":"m"})", R"({"identifier":"a","timestamp":1,"timestamp_unit":"ns"})"}) {
+        xlog::sinks::records_t broken{spooled};
+        std::string output{};
+
+        broken.push_back(invalid);
+        CHECK(!columnar::encode(broken, 0, broken.size(), output));
+        CHECK(columnar::encode(broken, 0, broken.size() - 1, output));
+    }
+
+    return check::result();
+}
@@ -0,0 +1,68 @@
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include "crc32c.hpp"
+#include "check.hpp"
+
+/* the RFC 3720 test vectors, and every length and alignment the hardware path takes apart, against a bitwise CRC */
+
+static uint32_t bitwise(std::string_view data) {
+    uint32_t crc{0xffffffff};
+
+    for (auto c : data) {
+        crc ^= static_cast<uint8_t>(c);
+
+        for (int bit{0}; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ 0x82f63b78 : crc >> 1;
+        }
+    }
+
+    return ~crc;
+}
+
+int main() {
+    std::cout << std::format("implementation: {}\n", crc32c::implementation());
+
+    std::string ascending{};
+    std::string descending{};
+
+    for (int i{0}; i < 32; i++) {
+        ascending.push_back(static_cast<char>(i));
+        descending.push_back(static_cast<char>(31 - i));
+    }
+
+    CHECK(crc32c::compute(std::string_view("123456789")) == 0xe3069283);
+    CHECK(crc32c::compute(std::string(32, '\0')) == 0x8a9136aa);
+    CHECK(crc32c::compute(std::string(32, '\xff')) == 0x62a8ab43);
+    CHECK(crc32c::compute(ascending) == 0x46dd794e);
+    CHECK(crc32c::compute(descending) == 0x113fdb5c);
+    CHECK(crc32c::compute(std::string_view{}) == 0);
+
+    std::string text{};
+
+    for (size_t i{0}; i < 4096; i++) {
+        text.push_back(static_cast<char>(i * 131 + 7));
+    }
+
+    for (size_t offset{0}; offset < 8; offset++) {
+        for (size_t length{0}; length < 1100; length += length < 64 ? 1 : 37) {
+            auto data{std::string_view(text).substr(offset, length)};
+
+            CHECK(crc32c::compute(data) == bitwise(data));
+            CHECK(crc32c::compute(data.data(), data.size()) == bitwise(data));
+        }
+    }
+
+    // a previous result continues the CRC over more data
+    for (size_t split : {0, 1, 7, 100, 4095, 4096}) {
+        auto first{std::string_view(text).substr(0, split)};
+        auto rest{std::string_view(text).substr(split)};
+
+        CHECK(crc32c::compute(rest, crc32c::compute(first)) == crc32c::compute(text));
+    }
+
+    return check::result();
+}
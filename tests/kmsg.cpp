@@ -0,0 +1,37 @@
+#include <string_view>
+#include "xlog.hpp"
+#include "check.hpp"
+
+/* records as /dev/kmsg hands them out, with and without dictionaries and extra header fields */
+
+int main() {
+    xlog::kmsg::record record{};
+
+    CHECK(xlog::kmsg::parse_record("6,1234,5678901,-;usb 1-1: new high-speed USB device\n SUBSYSTEM=usb\n DEVICE=c189:1\n", record));
+    CHECK(record.priority == 6);
+    CHECK(record.sequence == 1234);
+    CHECK(record.monotonic_us == 5678901);
+    CHECK(record.flag == '-');
+    CHECK(record.message == "usb 1-1: new high-speed USB device");
+    CHECK(record.dictionary == " SUBSYSTEM=usb\n DEVICE=c189:1\n");
+
+    // the priority carries the facility, fields past the flag are newer kernels' additions
+    CHECK(xlog::kmsg::parse_record("30,18446744073709551615,0,c,caller=T1;continued", record));
+    CHECK(record.priority == 30);
+    CHECK(record.sequence == 18446744073709551615ull);
+    CHECK(record.monotonic_us == 0);
+    CHECK(record.flag == 'c');
+    CHECK(record.message == "continued");
+    CHECK(record.dictionary.empty());
+
+    CHECK(xlog::kmsg::parse_record("4,1,2,;semicolons; in; the message\n", record));
+    CHECK(record.flag == '-');
+    CHECK(record.message == "semicolons; in; the message");
+
+    for (std::string_view invalid : {"", "no header", "6,1,2;three fields", "6,a,2,-;letters", ",1,2,-;empty priority",
+        "6,1,,-;empty time", "-6,1,2,-;sign"}) {
+        CHECK(!xlog::kmsg::parse_record(invalid, record));
+    }
+
+    return check::result();
+}
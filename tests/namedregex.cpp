@@ -0,0 +1,61 @@
+#include <regex>
+#include <string>
+#include "nlohmann/json.hpp"
+#include "namedregex.hpp"
+#include "check.hpp"
+
+/* named groups in both spellings, numbered among unnamed, non-capturing and lookahead groups, escapes and classes */
+
+int main() {
+    nlohmann::json fields{};
+
+    namedregex access{R"(^(?<address>\S+) \S+ \S+ \[(?<time>[^\]]+)\] "(?P<method>\S+) (?<path>\S+) [^"]*" (?<status>\d{3}))"};
+    CHECK(access.match(R"(10.0.0.1 - - [19/Oct/2026:08:12:11 +0000] "GET /api HTTP/1.1" 200 512)", fields));
+    CHECK(fields == nlohmann::json({{"address", "10.0.0.1"}, {"time", "19/Oct/2026:08:12:11 +0000"}, {"method", "GET"},
+        {"path", "/api"}, {"status", "200"}}));
+    CHECK(!access.match("not an access log line", fields));
+
+    namedregex mixed{R"((a)(?:b)(?=c)(?<third>c)(d)(?<fifth>e))"};
+    CHECK(mixed.groups().size() == 2);
+    CHECK(mixed.groups()[0].first == 2 && mixed.groups()[0].second == "third");
+    CHECK(mixed.groups()[1].first == 4 && mixed.groups()[1].second == "fifth");
+    CHECK(mixed.match("xxabcde", fields));
+    CHECK(fields == nlohmann::json({{"third", "c"}, {"fifth", "e"}}));
+
+    // escaped parentheses and parentheses inside classes aren't groups
+    namedregex escaped{R"(\((?<inner>\d+)\) [(](?<class>[)\]]))"};
+    CHECK(escaped.groups().size() == 2 && escaped.groups()[0].first == 1 && escaped.groups()[1].first == 2);
+    CHECK(escaped.match("(42) ()", fields));
+    CHECK(fields == nlohmann::json({{"inner", "42"}, {"class", ")"}}));
+
+    // as in ECMAScript, a leading ']' ends the class: '[^]' matches anything and '[]' nothing
+    namedregex leading{R"([^](?<after>y)(?<last>z))"};
+    CHECK(leading.groups().size() == 2 && leading.groups()[0].first == 1 && leading.groups()[1].first == 2);
+    CHECK(leading.match("xyz", fields));
+    CHECK(fields == nlohmann::json({{"after", "y"}, {"last", "z"}}));
+
+    namedregex empty_class{R"([]|(?<only>b))"};
+    CHECK(empty_class.match("b", fields));
+    CHECK(fields == nlohmann::json({{"only", "b"}}));
+
+    // a group that took no part in the match is left out
+    namedregex optional{R"((?<sign>-)?(?<digits>\d+))"};
+    CHECK(optional.match("42", fields));
+    CHECK(fields == nlohmann::json({{"digits", "42"}}));
+    CHECK(optional.match("-42", fields));
+    CHECK(fields == nlohmann::json({{"sign", "-"}, {"digits", "42"}}));
+
+    for (const char* invalid : {"(?<>x)", "(?<name", "(?<name>x"}) {
+        bool threw{false};
+
+        try {
+            namedregex pattern{invalid};
+        } catch (const std::regex_error&) {
+            threw = true;
+        }
+
+        CHECK(threw);
+    }
+
+    return check::result();
+}
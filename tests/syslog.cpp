@@ -0,0 +1,82 @@
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "nlohmann/json.hpp"
+#include "xlog.hpp"
+#include "check.hpp"
+
+/* RFC 5424 and RFC 3164 frames as sent by rsyslog, glibc's syslog() and network devices, and frames without a valid <PRI> */
+
+static constexpr int64_t g_received{42};
+
+struct parsed_t {
+    nlohmann::json fields{};
+    std::string message{};
+    int64_t timestamp{g_received};
+};
+
+static parsed_t parse(std::string_view frame) {
+    parsed_t result{};
+    xlog::syslog::parse(frame, result.fields, result.message, result.timestamp);
+
+    return result;
+}
+
+int main() {
+    auto full{parse("<34>1 2026-10-19T06:12:11.5Z web-1 app 811 ID47 [exampleSDID@32473 iut=\"3\" eventSource=\"App\"] started\n")};
+    CHECK(full.fields == nlohmann::json({{"facility", 4}, {"severity", 2}, {"hostname", "web-1"}, {"app_name", "app"}, {"procid", "811"},
+        {"msgid", "ID47"}, {"structured_data", "[exampleSDID@32473 iut=\"3\" eventSource=\"App\"]"}}));
+    CHECK(full.message == "started");
+    CHECK(full.timestamp == 1792390331500000000);
+
+    // nil values are left out, and a time without fraction or zone still replaces the receive time when it has a zone
+    auto nil{parse("<165>1 2026-10-19T08:12:11+02:00 - - - - - message")};
+    CHECK(nil.fields == nlohmann::json({{"facility", 20}, {"severity", 5}}));
+    CHECK(nil.message == "message");
+    CHECK(nil.timestamp == 1792390331000000000);
+
+    auto no_time{parse("<13>1 - host app - - - \xEF\xBB\xBFwith a BOM\r\n")};
+    CHECK(no_time.fields == nlohmann::json({{"facility", 1}, {"severity", 5}, {"hostname", "host"}, {"app_name", "app"}}));
+    CHECK(no_time.message == "with a BOM");
+    CHECK(no_time.timestamp == g_received);
+
+    // escaped ']' and '"' inside values don't end the structured data
+    auto escaped{parse(R"(<14>1 - - - - - [a k="x\]y"][b k="\"q\""] text)")};
+    CHECK(escaped.fields["structured_data"] == R"([a k="x\]y"][b k="\"q\""])");
+    CHECK(escaped.message == "text");
+
+    auto empty_message{parse("<14>1 - - - - - -")};
+    CHECK(empty_message.message.empty());
+
+    auto bsd{parse("<13>Oct  9 08:12:11 web-1 sshd[744]: Accepted publickey for deploy")};
+    CHECK(bsd.fields == nlohmann::json({{"facility", 1}, {"severity", 5}, {"hostname", "web-1"}, {"app_name", "sshd"}, {"procid", "744"}}));
+    CHECK(bsd.message == "Accepted publickey for deploy");
+    CHECK(bsd.timestamp == g_received);
+
+    // glibc's syslog() leaves the hostname out
+    auto local{parse("<78>Oct 19 08:12:11 CRON[612]: (root) CMD (true)")};
+    CHECK(local.fields == nlohmann::json({{"facility", 9}, {"severity", 6}, {"app_name", "CRON"}, {"procid", "612"}}));
+    CHECK(local.message == "(root) CMD (true)");
+
+    auto tag_only{parse("<14>Oct 19 08:12:11 myapp: hello")};
+    CHECK(tag_only.fields == nlohmann::json({{"facility", 1}, {"severity", 6}, {"app_name", "myapp"}}));
+    CHECK(tag_only.message == "hello");
+
+    auto no_header{parse("<14>tag: text")};
+    CHECK(no_header.fields == nlohmann::json({{"facility", 1}, {"severity", 6}, {"app_name", "tag"}}));
+    CHECK(no_header.message == "text");
+
+    auto plain{parse("<0>just a message")};
+    CHECK(plain.fields == nlohmann::json({{"facility", 0}, {"severity", 0}}));
+    CHECK(plain.message == "just a message");
+
+    for (std::string_view invalid : {"no priority", "<192>too high", "<1a>digits", "<>empty", "<1234>long", "<13"}) {
+        auto kept{parse(invalid)};
+
+        CHECK(kept.fields.is_null());
+        CHECK(kept.message == invalid);
+        CHECK(kept.timestamp == g_received);
+    }
+
+    return check::result();
+}
@@ -0,0 +1,92 @@
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include "timeformat.hpp"
+#include "check.hpp"
+
+static constexpr int64_t g_second{1000000000};
+
+/* parses text whole, or up to consumed_expected when given */
+static std::optional<int64_t> parse(const timeformat& format, std::string_view text, int fallback_year = 1970, size_t consumed_expected = 0) {
+    int64_t timestamp{0};
+    size_t consumed{0};
+
+    if (!format.parse(text, fallback_year, timestamp, consumed)) {
+        return std::nullopt;
+    }
+
+    CHECK(consumed == (consumed_expected ? consumed_expected : text.length()));
+
+    return timestamp;
+}
+
+int main() {
+    const timeformat rfc3339{"%Y-%m-%dT%H:%M:%S.%f%z"};
+
+    CHECK(parse(rfc3339, "2026-10-19T06:12:11.5Z") == 1792390331 * g_second + 500000000);
+    CHECK(parse(rfc3339, "2026-10-19T08:12:11.500000+02:00") == 1792390331 * g_second + 500000000);
+    CHECK(parse(rfc3339, "2026-10-19T04:12:11.5-0200") == 1792390331 * g_second + 500000000);
+    CHECK(parse(rfc3339, "2026-10-19T08:12:11.5+02") == 1792390331 * g_second + 500000000);
+    // digits past nanoseconds are read but dropped
+    CHECK(parse(rfc3339, "2026-10-19T06:12:11.1234567891Z") == 1792390331 * g_second + 123456789);
+    CHECK(parse(rfc3339, "2024-02-29T23:59:59.0Z") == 1709251199 * g_second);
+    CHECK(parse(rfc3339, "1970-01-01T00:00:00.0Z") == 0);
+
+    // what follows the timestamp is left to the caller
+    CHECK(parse(rfc3339, "2026-10-19T06:12:11.5Z GET /", 1970, 22) == 1792390331 * g_second + 500000000);
+
+    const timeformat bsd{"%b %e %H:%M:%S"};
+
+    CHECK(!bsd.year_given());
+    CHECK(rfc3339.year_given());
+    CHECK(parse(bsd, "Oct  9 08:12:11", 2026) == 1791533531 * g_second);
+    CHECK(parse(bsd, "oct 9 08:12:11", 2026) == 1791533531 * g_second);
+    CHECK(parse(bsd, "Oct  9 08:12:11 host sshd[1]: hello", 2026, 15) == 1791533531 * g_second);
+
+    const timeformat clf{"%d/%b/%Y:%T %z"};
+
+    CHECK(parse(clf, "19/Oct/2026:08:12:11 +0000") == 1792397531 * g_second);
+    CHECK(parse(clf, "19/Oct/2026:10:12:11 +0200") == 1792397531 * g_second);
+
+    const timeformat epoch{"%s.%f"};
+
+    CHECK(parse(epoch, "1792397531.25") == 1792397531 * g_second + 250000000);
+
+    const timeformat percent{"%H%%%M"};
+
+    CHECK(parse(percent, "08%12") == (8 * 3600 + 12 * 60) * g_second);
+
+    // out of range fields, literals that don't match and text that ends early
+    CHECK(parse(rfc3339, "2026-13-19T06:12:11.5Z") == std::nullopt);
+    CHECK(parse(rfc3339, "2026-10-32T06:12:11.5Z") == std::nullopt);
+    CHECK(parse(rfc3339, "2026-10-19T24:12:11.5Z") == std::nullopt);
+    CHECK(parse(rfc3339, "2026/10/19T06:12:11.5Z") == std::nullopt);
+    CHECK(parse(rfc3339, "2026-10-19T06:12:11.5") == std::nullopt);
+    CHECK(parse(rfc3339, "2026-10-19") == std::nullopt);
+    CHECK(parse(bsd, "Okt  9 08:12:11", 2026) == std::nullopt);
+    CHECK(parse(bsd, "Oct") == std::nullopt);
+
+    bool threw{false};
+
+    try {
+        timeformat unsupported{"%Y-%j"};
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+
+    CHECK(threw);
+
+    threw = false;
+
+    try {
+        timeformat lone{"%H:%"};
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+
+    CHECK(threw);
+
+    return check::result();
+}